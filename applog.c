@@ -1,4 +1,4 @@
-#define _POSIX_SOURCE
+#define _POSIX_C_SOURCE 200112L /* flockfile, localtime_r */
 
 #include "applog.h"
 #include <time.h>
@@ -6,58 +6,220 @@
 #include <stdio.h>
 #include <string.h>
 
-static struct tm *windows_localtime_r(const time_t *pt, struct tm *ptm)
+/* longest message output, longer ones are truncated */
+#define APPLOG_LINE_SIZE 1024
+
+/* number of distinct messages tracked for repeat limiting, further ones are
+   not limited */
+#define APPLOG_REPEAT_SLOTS 64
+
+#define APPLOG_DEFAULT_REPEAT_LIMIT 100
+
+enum ApplogLevel applog_threshold = APPLOG_NOTICE;
+
+static unsigned repeat_limit = APPLOG_DEFAULT_REPEAT_LIMIT;
+static int timestamps = 0;
+
+/* Messages are identified by their format string, which is a string literal
+   at each call site, so comparing pointers is enough. */
+static struct ApplogRepeat {
+	const char *format;
+	const char *function_name;
+	unsigned long count;
+} repeats[APPLOG_REPEAT_SLOTS];
+
+/* localtime is only called when the second changes */
+static time_t time_cached = (time_t)-1;
+static char time_string[32];
+
+static const char *level_names[] = {
+	"debug",
+	"info",
+	"notice",
+	"warning",
+	"error",
+	"fatal",
+	"bug",
+	"none"
+};
+
+static void lock_file(FILE *file)
 {
-	struct tm *tm = localtime(pt);
-	memcpy(ptm, tm, sizeof(*ptm));
-	return ptm;
+#if defined(OS_WINDOWS_NT)
+	(void)file;
+#else
+	flockfile(file);
+#endif
+}
+
+static void unlock_file(FILE *file)
+{
+#if defined(OS_WINDOWS_NT)
+	(void)file;
+#else
+	funlockfile(file);
+#endif
 }
 
 static struct tm *portable_localtime_r(const time_t *pt, struct tm *ptm)
 {
-#if OS_FAMILY == Windows
-	return windows_localtime_r(pt, ptm);
+#if defined(OS_WINDOWS_NT)
+	struct tm *tm = localtime(pt);
+	memcpy(ptm, tm, sizeof(*ptm));
+	return ptm;
 #else
 	return localtime_r(pt, ptm);
 #endif
 }
 
-void applog(enum ApplogLevel level, const char *function_name, const char *format, ...)
+/* Count one more output of a message, must be called with the file locked.
+   Returns 0 if the message should be suppressed. */
+static int count_repeat(const char *function_name, const char *format)
 {
-	va_list args;
-	FILE *file = stderr;
-	enum OutputFormat { NONE, STRING, TIME_FUNC_STRING } output_format = STRING;
+	unsigned i;
 
-	if (level < APPLOG_NOTICE) {
-		/* users are not interested in debugging output. */
-		/* TODO: make this dynamically configurable at run-time via an option */
-		return;
+	if (!repeat_limit) {
+		return 1;
+	}
+	for (i = 0; i < APPLOG_REPEAT_SLOTS; i++) {
+		struct ApplogRepeat *r = &repeats[i];
+		if (r->format == format) {
+			return ++r->count <= repeat_limit;
+		}
+		if (!r->format) {
+			r->format = format;
+			r->function_name = function_name;
+			r->count = 1;
+			return 1;
+		}
 	}
+	return 1;
+}
 
-	va_start(args, format);
+/* Format and write one message, must be called with the file locked. */
+static void write_line(FILE *file, const char *function_name,
+	const char *format, va_list args
+)
+{
+	char line[APPLOG_LINE_SIZE];
+	size_t length = 0;
+	int written;
 
-	switch (output_format) {
-		case TIME_FUNC_STRING : {
-			char time_string[32] = { 0 };
-			time_t time_now;
+	if (timestamps) {
+		time_t time_now = time(NULL);
+
+		if (time_now != time_cached) {
 			struct tm tm_localtime;
 
-			time_now = time(NULL);
 			portable_localtime_r(&time_now, &tm_localtime);
 			strftime(time_string, sizeof(time_string)-1, "%Y-%m-%dT%H:%M:%S", &tm_localtime);
-			fprintf(file, "%s|%s|", time_string, function_name);
-			vfprintf(file, format, args);
-			fprintf(file, "\n");
-			break;
+			time_cached = time_now;
 		}
-		case STRING : {
-			vfprintf(file, format, args);
-			fprintf(file, "\n");
-			break;
+		written = snprintf(line, sizeof(line), "%s|%s|", time_string, function_name);
+		if (written > 0) {
+			length = (size_t)written < sizeof(line) ? (size_t)written : sizeof(line) - 1;
 		}
-		default :
-			break;
 	}
 
+	written = vsnprintf(line + length, sizeof(line) - length, format, args);
+	if (written > 0) {
+		length += (size_t)written;
+		if (length > sizeof(line) - 2) {
+			length = sizeof(line) - 2;
+		}
+	}
+	line[length++] = '\n';
+
+	/* one write per message, so that messages from several threads are not
+	   interleaved */
+	fwrite(line, 1, length, file);
+}
+
+void applog_write(enum ApplogLevel level, const char *function_name, const char *format, ...)
+{
+	va_list args;
+	FILE *file = stderr;
+
+	if (level < applog_threshold) {
+		return;
+	}
+
+	lock_file(file);
+	if (count_repeat(function_name, format)) {
+		va_start(args, format);
+		write_line(file, function_name, format, args);
+		va_end(args);
+	}
+	unlock_file(file);
+}
+
+/* applog_write() without the repeat limit, for reporting on the limit */
+static void write_unlimited(enum ApplogLevel level, const char *function_name, const char *format, ...)
+{
+	va_list args;
+	FILE *file = stderr;
+
+	if (level < applog_threshold) {
+		return;
+	}
+
+	lock_file(file);
+	va_start(args, format);
+	write_line(file, function_name, format, args);
 	va_end(args);
+	unlock_file(file);
+}
+
+void applog_set_level(enum ApplogLevel level)
+{
+	applog_threshold = level;
+}
+
+int applog_parse_level(const char *name, enum ApplogLevel *level)
+{
+	unsigned i;
+
+	for (i = 0; i < sizeof(level_names) / sizeof(level_names[0]); i++) {
+		if (!strcmp(name, level_names[i])) {
+			*level = (enum ApplogLevel)i;
+			return 1;
+		}
+	}
+	return 0;
+}
+
+void applog_set_repeat_limit(unsigned limit)
+{
+	repeat_limit = limit;
+}
+
+void applog_set_timestamps(int enabled)
+{
+	timestamps = enabled;
+}
+
+void applog_flush(void)
+{
+	const unsigned limit = repeat_limit;
+	unsigned i;
+
+	for (i = 0; limit && i < APPLOG_REPEAT_SLOTS; i++) {
+		unsigned long count;
+		const char *function_name;
+		const char *format;
+
+		lock_file(stderr);
+		count = repeats[i].count;
+		function_name = repeats[i].function_name;
+		format = repeats[i].format;
+		repeats[i].count = repeats[i].format ? limit : 0;
+		unlock_file(stderr);
+
+		if (count > limit) {
+			write_unlimited(APPLOG_NOTICE, __func__,
+				"%lu repeats of \"%s\" from %s were suppressed.",
+				count - limit, format, function_name
+			);
+		}
+	}
 }
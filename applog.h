@@ -8,12 +8,53 @@ enum ApplogLevel {
 	APPLOG_WARNING,
 	APPLOG_ERROR,
 	APPLOG_FATAL,
-	APPLOG_BUG
+	APPLOG_BUG,
+	APPLOG_NONE /* only used as a threshold, to disable all messages */
 };
 
-void applog(enum ApplogLevel level,
+/* Messages below this level are discarded.  Use applog_set_level() to
+   change it. */
+extern enum ApplogLevel applog_threshold;
+
+void applog_write(enum ApplogLevel level,
 	const char *function_name, const char *format,
 	...
 );
 
+/* Check the level before calling applog_write(), so that the arguments of
+   disabled messages are not even evaluated.  Compilers without variadic
+   macros call applog_write() directly, which checks the level itself. */
+#if defined(__GNUC__) || (defined(__STDC_VERSION__) && __STDC_VERSION__ >= 199901L)
+#define applog(level, ...) \
+	do { \
+		if ((level) >= applog_threshold) { \
+			applog_write((level), __VA_ARGS__); \
+		} \
+	} while (0)
+#else
+#define applog applog_write
+#endif
+
+/** @brief Set the minimum level of messages to output. */
+void applog_set_level(enum ApplogLevel level);
+
+/** @brief Convert a level name (debug, info, notice, warning, error, fatal,
+ *         bug or none) to its level.
+ *
+ *  @return 1 if the name was valid, 0 otherwise.
+ */
+int applog_parse_level(const char *name, enum ApplogLevel *level);
+
+/** @brief Set the number of times each message (identified by its format
+ *         string) is output before further repeats are suppressed.
+ *         0 means no limit.
+ */
+void applog_set_repeat_limit(unsigned limit);
+
+/** @brief Prefix each message with the time and function name. */
+void applog_set_timestamps(int enabled);
+
+/** @brief Output the number of suppressed repeats of each message. */
+void applog_flush(void);
+
 #endif
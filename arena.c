@@ -0,0 +1,87 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "applog.h"
+#include "numa.h"
+
+struct BitcoinArena {
+	unsigned char *block; /* as returned by malloc */
+	unsigned char *base;  /* block, aligned */
+	size_t size;
+	size_t used;
+};
+
+struct BitcoinArena *BitcoinArena_create(size_t size)
+{
+	struct BitcoinArena *arena = calloc(1, sizeof(*arena));
+
+	if (!arena) {
+		applog(APPLOG_ERROR, __func__, "Failed to allocate arena.");
+		return NULL;
+	}
+
+	/* calloc rather than malloc and memset, so that large blocks come
+	   straight from zeroed pages and are only touched when used */
+	arena->block = calloc(1, size + BITCOIN_ARENA_ALIGNMENT);
+	if (!arena->block) {
+		applog(APPLOG_ERROR, __func__,
+			"Failed to allocate arena of %lu bytes.", (unsigned long)size
+		);
+		free(arena);
+		return NULL;
+	}
+	arena->base = arena->block + (BITCOIN_ARENA_ALIGNMENT
+		- (size_t)arena->block % BITCOIN_ARENA_ALIGNMENT) % BITCOIN_ARENA_ALIGNMENT;
+	arena->size = size;
+
+	return arena;
+}
+
+void BitcoinArena_destroy(struct BitcoinArena *arena)
+{
+	if (!arena) {
+		return;
+	}
+	BitcoinArena_Reset(arena);
+	free(arena->block);
+	free(arena);
+}
+
+void *BitcoinArena_Alloc(struct BitcoinArena *arena, size_t size)
+{
+	const size_t padded = (size + BITCOIN_ARENA_ALIGNMENT - 1)
+		& ~(size_t)(BITCOIN_ARENA_ALIGNMENT - 1);
+	void *p;
+
+	if (padded < size || padded > arena->size - arena->used) {
+		applog(APPLOG_ERROR, __func__,
+			"Arena full: %lu of %lu bytes used, %lu more needed.",
+			(unsigned long)arena->used,
+			(unsigned long)arena->size,
+			(unsigned long)size
+		);
+		return NULL;
+	}
+
+	/* memory is zero from creation or the last reset */
+	p = arena->base + arena->used;
+	arena->used += padded;
+	return p;
+}
+
+void BitcoinArena_Reset(struct BitcoinArena *arena)
+{
+	memset(arena->base, 0, arena->used);
+	arena->used = 0;
+}
+
+int BitcoinArena_Bind(struct BitcoinArena *arena, unsigned node)
+{
+	return BitcoinNUMA_Bind(arena->base, arena->size, node);
+}
+
+size_t BitcoinArena_GetUsed(const struct BitcoinArena *arena)
+{
+	return arena->used;
+}
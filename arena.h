@@ -0,0 +1,55 @@
+#ifndef BITCOIN_INCLUDE_ARENA_H
+#define BITCOIN_INCLUDE_ARENA_H
+
+/** @file arena.h
+ *  @brief Bump allocator for working memory which lives as long as its
+ *         owner, eg: the record arrays of a context.
+ *
+ *  An arena is one block of memory, allocated up front, from which
+ *  allocations are carved in order.  Allocations are aligned for SIMD
+ *  loads and never freed one at a time: the whole arena is reset or
+ *  destroyed at once, and it is wiped first, since it may hold keys.
+ */
+
+#include <stddef.h> /* size_t */
+
+/* alignment of every allocation, one cache line */
+#define BITCOIN_ARENA_ALIGNMENT 64
+
+struct BitcoinArena;
+
+/** @brief Allocate a new arena.
+ *
+ *  @param[in] size Bytes available for allocations.  Pages which are
+ *                  never used are normally never touched.
+ *
+ *  @return Pointer to arena, or NULL if failure.
+ */
+struct BitcoinArena *BitcoinArena_create(size_t size);
+
+/** @brief Wipe and free an arena, and everything allocated from it. */
+void BitcoinArena_destroy(struct BitcoinArena *arena);
+
+/** @brief Allocate zeroed memory from an arena.
+ *
+ *  @return Pointer aligned to BITCOIN_ARENA_ALIGNMENT, or NULL if the
+ *          arena does not have size bytes left.
+ */
+void *BitcoinArena_Alloc(struct BitcoinArena *arena, size_t size);
+
+/** @brief Wipe everything allocated from an arena, and make all of it
+ *         available again.
+ */
+void BitcoinArena_Reset(struct BitcoinArena *arena);
+
+/** @brief Place an arena's memory on a NUMA node (see numa.h), for the
+ *         thread using it running there.
+ *
+ *  @return Non-zero if success.
+ */
+int BitcoinArena_Bind(struct BitcoinArena *arena, unsigned node);
+
+/** @brief Get the number of bytes allocated, including alignment padding. */
+size_t BitcoinArena_GetUsed(const struct BitcoinArena *arena);
+
+#endif
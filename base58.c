@@ -5,21 +5,12 @@
 #include "utility.h"
 #include "applog.h"
 #include "combination.h"
+#include "cpu.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-#if defined(OS_WINDOWS)
-#include <malloc.h>
-#endif
-
-#if defined(OS_LINUX)
-#include <alloca.h>
-#endif
-
-#include <openssl/bn.h>
-
 /* base58 is 0-9,A-Z,a-z (62 chars), but with the 0,I,O, and l chars removed,
 leaving 58 chars */
 static const char base58_digits[] =
@@ -27,63 +18,250 @@ static const char base58_digits[] =
 	"ABCDEFGHJKLMNPQRSTUVWXYZ"
 	"abcdefghijkmnopqrstuvwxyz";
 
+/*
+base58_values maps ASCII chars 0x00 to 0x7f to base58 digit values 0 to 57,
+or -1 if the character is invalid, and base58_powers holds 58^0 to 58^5.
+Both are generated from the digits above by gentables at build time.
+*/
+#include "base58_table.h"
+
+/* Numbers are converted as arrays of 32-bit limbs, least significant
+first.  Base58 numbers use limbs of 5 digits (base 58^5, which is less than
+2^30), so that each step of a conversion is one 64-bit multiply or divide by
+a constant.  Limbs for a conversion are allocated by the caller, from the
+stack for the usual sizes. */
+#define BITCOIN_BASE58_LIMB_DIGITS 5
+#define BITCOIN_BASE58_LIMB_BASE 656356768u /* 58^5 */
+#define BITCOIN_BASE58_STACK_LIMBS 64
+
+/* limbs needed for a number of source bytes, or Base58 digits */
+#define BITCOIN_BASE58_ENCODE_LIMBS(bytes) ((bytes) * 138 / 500 + 2)
+#define BITCOIN_BASE58_DECODE_LIMBS(digits) ((digits) * 586 / 3200 + 2)
+
+/* Base58 kernels convert the number without its leading zeros, and return
+the number of digits or bytes written, or (size_t)-1 if the output does not
+fit. */
+typedef size_t (*BitcoinBase58EncodeKernel)(char *output, size_t output_size,
+	const uint8_t *source, size_t source_size, uint32_t *limbs
+);
+typedef size_t (*BitcoinBase58DecodeKernel)(uint8_t *output, size_t output_size,
+	const char *input, size_t input_size, uint32_t *limbs
+);
+
+static __inline__ __attribute__((always_inline)) size_t Bitcoin_EncodeBase58Number(
+	char *output, size_t output_size,
+	const uint8_t *source, size_t source_size, uint32_t *limbs
+)
+{
+	size_t used = 0, offset = 0, digits, i;
+	uint32_t top;
+
+	/* take the source 32 bits at a time, with any odd bytes first */
+	while (offset < source_size) {
+		const size_t chunk = offset ? 4 : (source_size - 1) % 4 + 1;
+		uint64_t carry = 0;
+
+		for (i = 0; i < chunk; i++) {
+			carry = (carry << 8) | source[offset + i];
+		}
+		offset += chunk;
+
+		for (i = 0; i < used; i++) {
+			const uint64_t t = ((uint64_t)limbs[i] << (chunk * 8)) | carry;
+			limbs[i] = (uint32_t)(t % BITCOIN_BASE58_LIMB_BASE);
+			carry = t / BITCOIN_BASE58_LIMB_BASE;
+		}
+		while (carry) {
+			limbs[used++] = (uint32_t)(carry % BITCOIN_BASE58_LIMB_BASE);
+			carry /= BITCOIN_BASE58_LIMB_BASE;
+		}
+	}
+
+	if (!used) {
+		return 0;
+	}
+
+	digits = (used - 1) * BITCOIN_BASE58_LIMB_DIGITS;
+	for (top = limbs[used - 1]; top; top /= 58) {
+		digits++;
+	}
+	if (digits > output_size) {
+		return (size_t)-1;
+	}
+
+	/* write digits from the least significant end */
+	offset = digits;
+	for (i = 0; i < used; i++) {
+		uint32_t limb = limbs[i];
+		unsigned j;
+		for (j = 0; j < BITCOIN_BASE58_LIMB_DIGITS && offset; j++) {
+			output[--offset] = base58_digits[limb % 58];
+			limb /= 58;
+		}
+	}
+
+	return digits;
+}
+
+static __inline__ __attribute__((always_inline)) size_t Bitcoin_DecodeBase58Number(
+	uint8_t *output, size_t output_size,
+	const char *input, size_t input_size, uint32_t *limbs
+)
+{
+	size_t used = 0, offset = 0, bytes, i;
+	uint32_t top;
+
+	/* take the input 5 digits at a time, with any odd digits first */
+	while (offset < input_size) {
+		const size_t chunk = offset ? BITCOIN_BASE58_LIMB_DIGITS
+			: (input_size - 1) % BITCOIN_BASE58_LIMB_DIGITS + 1;
+		uint64_t carry = 0;
+
+		for (i = 0; i < chunk; i++) {
+			carry = carry * 58 + base58_values[(unsigned char)input[offset + i]];
+		}
+		offset += chunk;
+
+		for (i = 0; i < used; i++) {
+			const uint64_t t = (uint64_t)limbs[i] * base58_powers[chunk] + carry;
+			limbs[i] = (uint32_t)t;
+			carry = t >> 32;
+		}
+		if (carry) {
+			limbs[used++] = (uint32_t)carry;
+		}
+	}
+
+	if (!used) {
+		return 0;
+	}
+
+	bytes = (used - 1) * 4;
+	for (top = limbs[used - 1]; top; top >>= 8) {
+		bytes++;
+	}
+	if (bytes > output_size) {
+		return (size_t)-1;
+	}
+
+	offset = bytes;
+	for (i = 0; i < used; i++) {
+		uint32_t limb = limbs[i];
+		unsigned j;
+		for (j = 0; j < 4 && offset; j++) {
+			output[--offset] = (uint8_t)limb;
+			limb >>= 8;
+		}
+	}
+
+	return bytes;
+}
+
+/* The kernels are the same code compiled for each instruction set, where
+BMI2 lets the compiler use flag-free multiplies and shifts for the
+divisions by constants. */
+#define BITCOIN_BASE58_KERNELS(suffix, attributes) \
+attributes static size_t Bitcoin_EncodeBase58Kernel##suffix( \
+	char *output, size_t output_size, \
+	const uint8_t *source, size_t source_size, uint32_t *limbs \
+) \
+{ \
+	return Bitcoin_EncodeBase58Number(output, output_size, \
+		source, source_size, limbs \
+	); \
+} \
+attributes static size_t Bitcoin_DecodeBase58Kernel##suffix( \
+	uint8_t *output, size_t output_size, \
+	const char *input, size_t input_size, uint32_t *limbs \
+) \
+{ \
+	return Bitcoin_DecodeBase58Number(output, output_size, \
+		input, input_size, limbs \
+	); \
+}
+
+BITCOIN_BASE58_KERNELS(Generic, )
+
+#ifdef BITCOIN_HAVE_X86_SIMD
+BITCOIN_BASE58_KERNELS(BMI2, __attribute__((target("bmi2,avx2"))))
+#endif
+
+static BitcoinBase58EncodeKernel base58_encode_kernel = NULL;
+static BitcoinBase58DecodeKernel base58_decode_kernel = NULL;
+static const char *base58_kernel_name = NULL;
+
+/* called once, through BitcoinCPU_SelectKernels() */
+void Bitcoin_SelectBase58Kernels(void)
+{
+	BitcoinBase58EncodeKernel encode = Bitcoin_EncodeBase58KernelGeneric;
+	BitcoinBase58DecodeKernel decode = Bitcoin_DecodeBase58KernelGeneric;
+	const char *name = "generic";
+
+#ifdef BITCOIN_HAVE_X86_SIMD
+	if (BitcoinCPU_Has(BITCOIN_CPU_BMI2 | BITCOIN_CPU_AVX2)) {
+		name = "bmi2";
+		encode = Bitcoin_EncodeBase58KernelBMI2;
+		decode = Bitcoin_DecodeBase58KernelBMI2;
+	}
+#endif
+	base58_kernel_name = name;
+	base58_decode_kernel = decode;
+	base58_encode_kernel = encode;
+}
+
+const char *Bitcoin_GetBase58KernelName(void)
+{
+	BitcoinCPU_SelectKernels();
+	return base58_kernel_name;
+}
+
 BitcoinResult Bitcoin_EncodeBase58(
 	char *output, size_t output_buffer_size, size_t *encoded_output_size,
 	const void *source, size_t source_size
 )
 {
-	static const unsigned base = 58;
 	const unsigned char *source_bytes = (const unsigned char *)source;
-	BIGNUM *x, *base_bn, *div_bn, *rem_bn;
-	BN_CTX *bn_ctx = BN_CTX_new();
-	char *d = output;
-	size_t output_count = 0;
-	int output_overflow = 0;
-
-	/* initialise bignums */
-	x = BN_new();
-	base_bn = BN_new();
-	div_bn = BN_new();
-	rem_bn = BN_new();
-	BN_bin2bn(source, source_size, x);
-	BN_set_word(base_bn, base);
-
-	/* while source is not zero, keep dividing source by base, using the
-		remainder to map to a digit. (standard base conversion)
-	*/
-	while (!BN_is_zero(x) && !output_overflow) {
-		BN_div(div_bn, rem_bn, x, base_bn, bn_ctx);
-		BN_copy(x, div_bn);
-		if (output_count < output_buffer_size) {
-			*d++ = base58_digits[BN_get_word(rem_bn)];
-			output_count++;
-		} else {
-			output_overflow = 1;
-		}
+	uint32_t stack_limbs[BITCOIN_BASE58_STACK_LIMBS];
+	uint32_t *limbs = stack_limbs;
+	size_t leading_zeros = 0;
+	size_t digits;
+
+	if (!base58_encode_kernel) {
+		BitcoinCPU_SelectKernels();
 	}
 
-	/* for the number of leading zeros in the source, add that many
-		digit[0] characters to the end of the encoded string
-	*/
-	while (
-		(source_bytes != source_bytes+source_size)
-		&& *source_bytes == 0
-	) {
-		*d++ = base58_digits[*source_bytes++];
+	/* each leading zero byte is encoded as a digit[0] character */
+	while (leading_zeros < source_size && !source_bytes[leading_zeros]) {
+		leading_zeros++;
+	}
+	if (leading_zeros > output_buffer_size) {
+		return BITCOIN_ERROR_OUTPUT_BUFFER_TOO_SMALL;
 	}
+	memset(output, base58_digits[0], leading_zeros);
 
-	/* reverse everything, so that it is most significant to least significant */
-	Bitcoin_ReverseBytes(output, d - output);
+	if (BITCOIN_BASE58_ENCODE_LIMBS(source_size) > BITCOIN_BASE58_STACK_LIMBS) {
+		limbs = malloc(BITCOIN_BASE58_ENCODE_LIMBS(source_size) * sizeof(*limbs));
+		if (!limbs) {
+			applog(APPLOG_ERROR, __func__, "Failed to allocate limbs.");
+			return BITCOIN_ERROR;
+		}
+	}
 
-	*encoded_output_size = d - output;
+	digits = base58_encode_kernel(output + leading_zeros,
+		output_buffer_size - leading_zeros,
+		source_bytes + leading_zeros, source_size - leading_zeros, limbs
+	);
+
+	if (limbs != stack_limbs) {
+		free(limbs);
+	}
 
-	BN_CTX_free(bn_ctx);
-	BN_free(x);
-	BN_free(base_bn);
-	BN_free(div_bn);
-	BN_free(rem_bn);
+	if (digits == (size_t)-1) {
+		return BITCOIN_ERROR_OUTPUT_BUFFER_TOO_SMALL;
+	}
+	*encoded_output_size = leading_zeros + digits;
 
-	return output_overflow ? BITCOIN_ERROR_OUTPUT_BUFFER_TOO_SMALL : BITCOIN_SUCCESS;
+	return BITCOIN_SUCCESS;
 }
 
 BitcoinResult Bitcoin_EncodeBase58Check(
@@ -113,99 +291,70 @@ BitcoinResult Bitcoin_DecodeBase58(
 	const void *input, size_t input_size
 )
 {
-	/*
-	map ASCII chars 0x00 to 0x7f to base58 digit values 0 to 57,
-	or -1 if the character is invalid
-	*/
-	static int digits[] = {
-		 -1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1
-		,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1
-		,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1
-		,-1, 0, 1, 2, 3, 4, 5, 6, 7, 8,-1,-1,-1,-1,-1,-1
-		,-1, 9,10,11,12,13,14,15,16,-1,17,18,19,20,21,-1
-		,22,23,24,25,26,27,28,29,30,31,32,-1,-1,-1,-1,-1
-		,-1,33,34,35,36,37,38,39,40,41,42,43,-1,44,45,46
-		,47,48,49,50,51,52,53,54,55,56,57,-1,-1,-1,-1,-1
-	};
-	const char *input_bytes_start = (const char *)input;
-	const char *input_bytes_end = input_bytes_start + input_size;
-	const char *pzc = input_bytes_start;
-	const char *pc = input_bytes_end - 1;
-	unsigned leading_zeros = 0;
-	unsigned bn_bytes_req = 0;
-	unsigned bn_bytes_wrote = 0;
-	int retval = 0;
-
-	BIGNUM *base, *m1, *m2, *result, *sub;
-	BN_CTX *bn_ctx;
-
-	bn_ctx = BN_CTX_new();
-	base = BN_new();
-	m1 = BN_new();
-	m2 = BN_new();
-	result = BN_new();
-	sub = BN_new();
-
-	BN_zero(result);
-	BN_one(m2);
-	BN_set_word(base, 58);
-
-	/* count leading zero bytes (encoded as '1') */
-	while (pzc != input_bytes_end && *pzc == '1') {
-		leading_zeros++;
-		pzc++;
+	const char *input_chars = (const char *)input;
+	uint32_t stack_limbs[BITCOIN_BASE58_STACK_LIMBS];
+	uint32_t *limbs = stack_limbs;
+	size_t leading_zeros = 0;
+	size_t bytes, i;
+
+	if (!base58_decode_kernel) {
+		BitcoinCPU_SelectKernels();
 	}
 
-	pc = input_bytes_end - 1;
-
-	while (pc >= pzc) {
-		int v = digits[(unsigned)*pc];
-		if (v == -1) {
+	for (i = 0; i < input_size; i++) {
+		const unsigned char c = (unsigned char)input_chars[i];
+		if (c >= sizeof(base58_values) || base58_values[c] < 0) {
 			char char_string[32];
-			if (*pc >= ' ' && *pc <= '~') {
-				snprintf(char_string, sizeof(char_string), "'%c' = ", (char)*pc);
+			if (c >= ' ' && c <= '~') {
+				snprintf(char_string, sizeof(char_string), "'%c' = ", (char)c);
 			} else {
 				char_string[0] = '\0';
 			}
 			applog(APPLOG_ERROR, __func__,
-				"Invalid character (%sASCII %u)", char_string, (unsigned)*pc);
-			retval = BITCOIN_ERROR_INVALID_FORMAT;
-			goto done;
+				"Invalid character (%sASCII %u)", char_string, (unsigned)c);
+			return BITCOIN_ERROR_INVALID_FORMAT;
 		}
-		BN_set_word(m1, v);
-		BN_mul(sub, m1, m2, bn_ctx);
-		BN_add(result, result, sub);
-		pc--;
-		BN_mul(m2, m2, base, bn_ctx);
 	}
 
-	bn_bytes_req = BN_num_bytes(result);
+	/* count leading zero bytes (encoded as '1') */
+	while (leading_zeros < input_size && input_chars[leading_zeros] == base58_digits[0]) {
+		leading_zeros++;
+	}
 
-	if (bn_bytes_req > output_buffer_size) {
-		applog(APPLOG_ERROR, __func__,
-			"bn_bytes_req too large (%u)", bn_bytes_req);
-		/* output buffer too small, failure */
-		retval = BITCOIN_ERROR_OUTPUT_BUFFER_TOO_SMALL;
-		goto done;
+	if (BITCOIN_BASE58_DECODE_LIMBS(input_size) > BITCOIN_BASE58_STACK_LIMBS) {
+		limbs = malloc(BITCOIN_BASE58_DECODE_LIMBS(input_size) * sizeof(*limbs));
+		if (!limbs) {
+			applog(APPLOG_ERROR, __func__, "Failed to allocate limbs.");
+			return BITCOIN_ERROR;
+		}
 	}
 
-	bn_bytes_wrote = BN_bn2bin(result, output+leading_zeros);
-	retval = BITCOIN_SUCCESS;
+	bytes = (size_t)-1;
+	if (leading_zeros <= output_buffer_size) {
+		bytes = base58_decode_kernel(output + leading_zeros,
+			output_buffer_size - leading_zeros,
+			input_chars + leading_zeros, input_size - leading_zeros, limbs
+		);
+	}
 
-	/* clean up resources */
-done:
-	BN_CTX_free(bn_ctx);
-	BN_free(base);
-	BN_free(m1);
-	BN_free(m2);
-	BN_free(result);
-	BN_free(sub);
+	if (limbs != stack_limbs) {
+		free(limbs);
+	}
 
-	if (retval == BITCOIN_SUCCESS) {
-		*decoded_output_size = bn_bytes_wrote + leading_zeros;
+	if (bytes == (size_t)-1) {
+		applog(APPLOG_ERROR, __func__,
+			"Decoded input too large for output buffer (%u bytes)",
+			(unsigned)output_buffer_size
+		);
+		return BITCOIN_ERROR_OUTPUT_BUFFER_TOO_SMALL;
 	}
 
-	return retval;
+	/* the output buffer may hold a previous result, so the leading zero
+	   bytes must be written explicitly */
+	memset(output, 0, leading_zeros);
+	*decoded_output_size = leading_zeros + bytes;
+
+	return BITCOIN_SUCCESS;
 }
 
 BitcoinResult Bitcoin_DecodeBase58Check(
@@ -225,6 +374,11 @@ BitcoinResult Bitcoin_DecodeBase58Check(
 		return result;
 	}
 
+	if (temp_decoded_output_size < BITCOIN_BASE58CHECK_CHECKSUM_SIZE) {
+		/* too short to even contain a checksum */
+		return BITCOIN_ERROR_CHECKSUM_FAILURE;
+	}
+
 	Bitcoin_DoubleSHA256(&hash, output,
 		temp_decoded_output_size - BITCOIN_BASE58CHECK_CHECKSUM_SIZE
 	);
@@ -158,4 +158,12 @@ BitcoinResult Bitcoin_FixBase58Check(
 	unsigned remove_chars
 );
 
+/** @brief Select the Base58 kernels for this CPU.  Only to be called by
+ *         BitcoinCPU_SelectKernels(), which does it once.
+ */
+void Bitcoin_SelectBase58Kernels(void);
+
+/** @brief Get the name of the Base58 kernels selected for this CPU. */
+const char *Bitcoin_GetBase58KernelName(void);
+
 #endif
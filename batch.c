@@ -0,0 +1,182 @@
+#include <string.h>
+
+#include "batch.h"
+#include "base58.h"
+#include "secp256k1.h"
+
+/* public keys are derived this many at a time on the way to addresses */
+#define BITCOIN_BATCH_CHUNK 64
+
+/* Record the result of one record, and count it if it succeeded. */
+static size_t BitcoinBatch_record(BitcoinResult *results, size_t i,
+	BitcoinResult result
+)
+{
+	if (results) {
+		results[i] = result;
+	}
+	return result == BITCOIN_SUCCESS;
+}
+
+/* Encode one record as NUL-terminated Base58Check text. */
+static BitcoinResult BitcoinBatch_encodeText(char *output, size_t output_size,
+	const void *source, size_t source_size
+)
+{
+	size_t encoded_size = 0;
+	BitcoinResult result;
+
+	if (!output_size) {
+		return BITCOIN_ERROR_OUTPUT_BUFFER_TOO_SMALL;
+	}
+	result = Bitcoin_EncodeBase58Check(output, output_size - 1, &encoded_size,
+		source, source_size
+	);
+	output[result == BITCOIN_SUCCESS ? encoded_size : 0] = '\0';
+	return result;
+}
+
+size_t BitcoinBatch_MakePublicKeys(struct BitcoinContext *context,
+	struct BitcoinPublicKey *public_keys,
+	const struct BitcoinPrivateKey *private_keys,
+	size_t count, BitcoinResult *results
+)
+{
+	return BitcoinSecp256k1_MakePublicKeysOnNode(BitcoinContext_GetNode(context),
+		public_keys, private_keys, count, results
+	);
+}
+
+size_t BitcoinBatch_MakeAddresses(struct BitcoinContext *context,
+	struct BitcoinAddress *addresses,
+	const struct BitcoinPrivateKey *private_keys,
+	size_t count, BitcoinResult *results
+)
+{
+	struct BitcoinPublicKey public_keys[BITCOIN_BATCH_CHUNK];
+	BitcoinResult chunk_results[BITCOIN_BATCH_CHUNK];
+	size_t start, i, valid = 0;
+
+	for (start = 0; start < count; start += BITCOIN_BATCH_CHUNK) {
+		const size_t n = count - start < BITCOIN_BATCH_CHUNK
+			? count - start : BITCOIN_BATCH_CHUNK;
+
+		BitcoinSecp256k1_MakePublicKeysOnNode(BitcoinContext_GetNode(context),
+			public_keys, &private_keys[start], n, chunk_results
+		);
+		for (i = 0; i < n; i++) {
+			BitcoinResult result = chunk_results[i];
+
+			if (result == BITCOIN_SUCCESS) {
+				result = Bitcoin_MakeAddressFromPublicKey(&addresses[start + i],
+					&public_keys[i]
+				);
+			}
+			valid += BitcoinBatch_record(results, start + i, result);
+		}
+	}
+	return valid;
+}
+
+size_t BitcoinBatch_EncodeAddresses(struct BitcoinContext *context,
+	char *output, size_t output_stride,
+	const struct BitcoinAddress *addresses,
+	size_t count, BitcoinResult *results
+)
+{
+	size_t i, valid = 0;
+
+	for (i = 0; i < count; i++) {
+		valid += BitcoinBatch_record(results, i,
+			BitcoinBatch_encodeText(output + i * output_stride, output_stride,
+				addresses[i].data, sizeof(addresses[i].data)
+			)
+		);
+	}
+	return valid;
+}
+
+size_t BitcoinBatch_DecodeAddresses(struct BitcoinContext *context,
+	struct BitcoinAddress *addresses,
+	const char *const *texts,
+	const struct BitcoinNetworkType *network_type,
+	size_t count, BitcoinResult *results
+)
+{
+	size_t i, valid = 0;
+
+	for (i = 0; i < count; i++) {
+		/* room for the checksum, and for one byte too many so that
+		   overlong addresses are caught by the size check */
+		uint8_t raw[BITCOIN_ADDRESS_SIZE + BITCOIN_BASE58CHECK_CHECKSUM_SIZE + 1];
+		size_t raw_size = 0;
+		BitcoinResult result;
+
+		result = Bitcoin_DecodeBase58Check(raw, sizeof(raw), &raw_size,
+			texts[i], strlen(texts[i])
+		);
+		if (result == BITCOIN_SUCCESS) {
+			if (raw_size != BITCOIN_ADDRESS_SIZE) {
+				result = BITCOIN_ERROR_INVALID_FORMAT;
+			} else if (network_type
+				&& raw[0] != BitcoinNetworkType_GetPublicKeyPrefix(network_type)
+			) {
+				result = BITCOIN_ERROR_INVALID_FORMAT;
+			} else if (addresses) {
+				memcpy(addresses[i].data, raw, BITCOIN_ADDRESS_SIZE);
+			}
+		}
+		valid += BitcoinBatch_record(results, i, result);
+	}
+	return valid;
+}
+
+size_t BitcoinBatch_EncodePrivateKeysWIF(struct BitcoinContext *context,
+	char *output, size_t output_stride,
+	const struct BitcoinPrivateKey *private_keys,
+	size_t count, BitcoinResult *results
+)
+{
+	size_t i, valid = 0;
+
+	for (i = 0; i < count; i++) {
+		const struct BitcoinPrivateKey *private_key = &private_keys[i];
+		uint8_t raw[BITCOIN_PRIVATE_KEY_WIF_COMPRESSED_SIZE];
+		const size_t raw_size = BitcoinPrivateKey_GetWIFSize(private_key);
+		BitcoinResult result = BITCOIN_ERROR_PRIVATE_KEY_INVALID_FORMAT;
+
+		if (raw_size && private_key->network_type) {
+			raw[0] = BitcoinNetworkType_GetPrivateKeyPrefix(private_key->network_type);
+			memcpy(raw + BITCOIN_PRIVATE_KEY_WIF_VERSION_SIZE,
+				private_key->data, BITCOIN_PRIVATE_KEY_SIZE
+			);
+			if (private_key->public_key_compression == BITCOIN_PUBLIC_KEY_COMPRESSED) {
+				raw[raw_size - 1] = BITCOIN_PRIVATE_KEY_WIF_COMPRESSION_FLAG_COMPRESSED;
+			}
+			result = BitcoinBatch_encodeText(output + i * output_stride,
+				output_stride, raw, raw_size
+			);
+			memset(raw, 0, sizeof(raw));
+		}
+		valid += BitcoinBatch_record(results, i, result);
+	}
+	return valid;
+}
+
+size_t BitcoinBatch_DecodePrivateKeysWIF(struct BitcoinContext *context,
+	struct BitcoinPrivateKey *private_keys,
+	const char *const *texts,
+	size_t count, BitcoinResult *results
+)
+{
+	size_t i, valid = 0;
+
+	for (i = 0; i < count; i++) {
+		valid += BitcoinBatch_record(results, i,
+			Bitcoin_LoadPrivateKeyFromBase58(&private_keys[i],
+				texts[i], strlen(texts[i])
+			)
+		);
+	}
+	return valid;
+}
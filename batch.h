@@ -0,0 +1,116 @@
+#ifndef BITCOIN_INCLUDE_BATCH_H
+#define BITCOIN_INCLUDE_BATCH_H
+
+/** @file batch.h
+ *  @brief Conversions over arrays of records, for embedding in other
+ *         programs.
+ *
+ *  All arrays are owned by the caller, nothing is allocated per record.
+ *  Each function converts 'count' records and returns the number which
+ *  were converted successfully.  If 'results' is not NULL, it must point to
+ *  an array of 'count' results, which is set to the result of each record,
+ *  so that one bad record does not stop the rest of the batch.  Outputs
+ *  for failed records are left undefined.
+ *
+ *  Text records are read from an array of 'count' pointers to strings,
+ *  with NUL terminators.  Text output is written as NUL-terminated strings
+ *  'output_stride' chars apart, so that a 2D char array can be used.
+ *
+ *  Messages about invalid input are logged through applog; callers which
+ *  expect invalid input can silence them with applog_set_level().
+ *
+ *  Hex records can be converted with Bitcoin_DecodeHexRecords() and
+ *  Bitcoin_EncodeHexRecords() from utility.h.
+ */
+
+#include <stddef.h> /* size_t */
+
+#include "context.h"
+#include "keys.h"
+#include "prefix.h"
+#include "result.h"
+#include "utility.h"
+
+/* output buffer sizes (including terminator) sufficient for any record */
+#define BITCOIN_BATCH_ADDRESS_TEXT_SIZE 40
+#define BITCOIN_BATCH_PRIVATE_KEY_WIF_TEXT_SIZE 56
+
+/** @brief Derive public keys from private keys.
+ *
+ *  @param[out] public_keys Array of public keys to write.
+ *  @param[in] private_keys Array of private keys, which must have their
+ *                          public_key_compression and network_type set.
+ */
+size_t BitcoinBatch_MakePublicKeys(struct BitcoinContext *context,
+	struct BitcoinPublicKey *public_keys,
+	const struct BitcoinPrivateKey *private_keys,
+	size_t count, BitcoinResult *results
+);
+
+/** @brief Derive addresses from private keys.
+ *
+ *  @param[out] addresses Array of addresses to write.
+ *  @param[in] private_keys Array of private keys, which must have their
+ *                          public_key_compression and network_type set.
+ */
+size_t BitcoinBatch_MakeAddresses(struct BitcoinContext *context,
+	struct BitcoinAddress *addresses,
+	const struct BitcoinPrivateKey *private_keys,
+	size_t count, BitcoinResult *results
+);
+
+/** @brief Encode addresses as Base58Check text.
+ *
+ *  @param[out] output Buffer of count * output_stride chars.
+ *  @param[in] output_stride Distance between output strings, at least
+ *                           BITCOIN_BATCH_ADDRESS_TEXT_SIZE is enough.
+ */
+size_t BitcoinBatch_EncodeAddresses(struct BitcoinContext *context,
+	char *output, size_t output_stride,
+	const struct BitcoinAddress *addresses,
+	size_t count, BitcoinResult *results
+);
+
+/** @brief Decode and validate Base58Check addresses.
+ *
+ *  An address is valid if its checksum matches, it has the right length
+ *  and its prefix is the public key prefix of network_type.
+ *
+ *  @param[out] addresses Array of decoded addresses to write, may be NULL
+ *                        if only validating.
+ *  @param[in] texts Array of NUL-terminated address strings.
+ *  @param[in] network_type Network the addresses must belong to, or NULL to
+ *                          accept any prefix.
+ */
+size_t BitcoinBatch_DecodeAddresses(struct BitcoinContext *context,
+	struct BitcoinAddress *addresses,
+	const char *const *texts,
+	const struct BitcoinNetworkType *network_type,
+	size_t count, BitcoinResult *results
+);
+
+/** @brief Encode private keys as Base58Check text in Wallet Import Format.
+ *
+ *  @param[out] output Buffer of count * output_stride chars.
+ *  @param[in] output_stride Distance between output strings, at least
+ *                           BITCOIN_BATCH_PRIVATE_KEY_WIF_TEXT_SIZE is enough.
+ */
+size_t BitcoinBatch_EncodePrivateKeysWIF(struct BitcoinContext *context,
+	char *output, size_t output_stride,
+	const struct BitcoinPrivateKey *private_keys,
+	size_t count, BitcoinResult *results
+);
+
+/** @brief Decode private keys from Base58Check text in Wallet Import Format.
+ *         The compression and network of each key are set from its text.
+ *
+ *  @param[out] private_keys Array of private keys to write.
+ *  @param[in] texts Array of NUL-terminated WIF strings.
+ */
+size_t BitcoinBatch_DecodePrivateKeysWIF(struct BitcoinContext *context,
+	struct BitcoinPrivateKey *private_keys,
+	const char *const *texts,
+	size_t count, BitcoinResult *results
+);
+
+#endif
@@ -0,0 +1,148 @@
+/* Test of the batch API (batch.h), linked against libbitcointool.a the way
+an embedding program would be.
+
+Each conversion is run over a fixed set of records, good and bad, with a
+results array, and one line is written per record:
+
+	<conversion> <record>: <result>[ <output>]
+
+followed by a line with the count the function returned.  tests.sh compares
+the whole output with what it expects.
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "applog.h"
+#include "batch.h"
+
+#define BATCHTEST_MAX_RECORDS 8
+
+/* a 100 char Base58 string, which decodes to far more than any record */
+#define BATCHTEST_LONG_TEXT \
+	"1BgGZ9tcN4rm9KBzDn7KprQz87SZ26SAMH1BgGZ9tcN4rm9KBzDn7KprQz87SZ26SAMH" \
+	"1BgGZ9tcN4rm9KBzDn7KprQz87SZ26SAMH"
+
+static void BatchTest_printResults(const char *conversion, size_t valid,
+	const BitcoinResult *results, size_t count,
+	const char *output, size_t output_stride
+)
+{
+	size_t i;
+
+	for (i = 0; i < count; i++) {
+		printf("%s %u: %s", conversion, (unsigned)i,
+			Bitcoin_ResultString(results[i])
+		);
+		if (output && results[i] == BITCOIN_SUCCESS) {
+			printf(" %s", output + i * output_stride);
+		}
+		printf("\n");
+	}
+	printf("%s valid: %u\n", conversion, (unsigned)valid);
+}
+
+static void BatchTest_addresses(struct BitcoinContext *context)
+{
+	const char *const texts[] = {
+		"1BgGZ9tcN4rm9KBzDn7KprQz87SZ26SAMH", /* good */
+		"1BgGZ9tcN4rm9KBzDn7KprQz87SZ26SAMx", /* bad checksum */
+		"mrCDrCybB6J1vRfbwM5hemdJz73FwDBC8r", /* testnet */
+		BATCHTEST_LONG_TEXT,
+		"" /* empty */
+	};
+	const size_t count = sizeof(texts) / sizeof(texts[0]);
+	struct BitcoinAddress addresses[BATCHTEST_MAX_RECORDS];
+	BitcoinResult results[BATCHTEST_MAX_RECORDS];
+	char output[BATCHTEST_MAX_RECORDS][BITCOIN_BATCH_ADDRESS_TEXT_SIZE];
+	size_t valid;
+
+	valid = BitcoinBatch_DecodeAddresses(context, addresses, texts,
+		Bitcoin_GetNetworkTypeByName("bitcoin"), count, results
+	);
+	BatchTest_printResults("decode-address", valid, results, count, NULL, 0);
+
+	/* without a network, any prefix is accepted */
+	valid = BitcoinBatch_DecodeAddresses(context, addresses, texts, NULL,
+		count, results
+	);
+	BatchTest_printResults("decode-address-any", valid, results, count,
+		NULL, 0
+	);
+
+	/* encode back the two which decoded */
+	addresses[1] = addresses[2];
+	valid = BitcoinBatch_EncodeAddresses(context, output[0], sizeof(output[0]),
+		addresses, 2, results
+	);
+	BatchTest_printResults("encode-address", valid, results, 2, output[0],
+		sizeof(output[0])
+	);
+
+	/* a stride too small for any address */
+	valid = BitcoinBatch_EncodeAddresses(context, output[0], 20, addresses, 1,
+		results
+	);
+	BatchTest_printResults("encode-address-short", valid, results, 1, NULL, 0);
+}
+
+static void BatchTest_privateKeysWIF(struct BitcoinContext *context)
+{
+	const char *const texts[] = {
+		"KwdMAjGmerYanjeui5SHS7JkmpZvVipYvB2LJGU1ZxJwYvP98617", /* compressed */
+		"5HueCGU8rMjxEXxiPuD5BDku4MkFqeZyd4dZ1jvhTVqvbTLvyTJ", /* uncompressed */
+		"cMzLdeGd5vEqxB8B6VFQoRopQ3sLAAvEzDAoQgvX54xwofSWj1fx", /* testnet */
+		"KwdMAjGmerYanjeui5SHS7JkmpZvVipYvB2LJGU1ZxJwYvP98618", /* checksum */
+		"1BgGZ9tcN4rm9KBzDn7KprQz87SZ26SAMH", /* an address */
+		BATCHTEST_LONG_TEXT
+	};
+	const size_t count = sizeof(texts) / sizeof(texts[0]);
+	struct BitcoinPrivateKey private_keys[BATCHTEST_MAX_RECORDS];
+	BitcoinResult results[BATCHTEST_MAX_RECORDS];
+	char output[BATCHTEST_MAX_RECORDS][BITCOIN_BATCH_PRIVATE_KEY_WIF_TEXT_SIZE];
+	size_t valid, i;
+
+	memset(private_keys, 0, sizeof(private_keys));
+	valid = BitcoinBatch_DecodePrivateKeysWIF(context, private_keys, texts,
+		count, results
+	);
+	BatchTest_printResults("decode-wif", valid, results, count, NULL, 0);
+	for (i = 0; i < count; i++) {
+		if (results[i] == BITCOIN_SUCCESS) {
+			printf("decode-wif %u: %s %s\n", (unsigned)i,
+				private_keys[i].network_type->name,
+				private_keys[i].public_key_compression
+					== BITCOIN_PUBLIC_KEY_COMPRESSED
+					? "compressed" : "uncompressed"
+			);
+		}
+	}
+
+	/* the first three decoded, and the fourth has no network to encode */
+	private_keys[3].network_type = NULL;
+	valid = BitcoinBatch_EncodePrivateKeysWIF(context, output[0],
+		sizeof(output[0]), private_keys, 4, results
+	);
+	BatchTest_printResults("encode-wif", valid, results, 4, output[0],
+		sizeof(output[0])
+	);
+
+	memset(private_keys, 0, sizeof(private_keys));
+}
+
+int main(void)
+{
+	struct BitcoinContext *context;
+
+	/* the bad records would log errors, which aren't under test */
+	applog_set_level(APPLOG_NONE);
+
+	context = BitcoinContext_create();
+	if (!context) {
+		return 1;
+	}
+	BatchTest_addresses(context);
+	BatchTest_privateKeysWIF(context);
+	BitcoinContext_destroy(context);
+	return 0;
+}
@@ -0,0 +1,928 @@
+/* Microbenchmarks for each conversion stage.
+
+Each benchmark runs a stage over a fixed set of inputs generated from a seeded
+PRNG, so that results are comparable between builds and releases.  Output is
+one tab-separated line per benchmark, with a '#' header line, so that it can
+be collected by scripts:
+
+	# benchmark	iterations	total_ns	ns_per_op	ops_per_sec
+	sha256	4194304	501234567	119.50	8368200.12
+
+The same program also generates the corpora for the end-to-end benchmarks in
+bench.sh (--generate), and measures a complete bitcoin-tool run (--exec),
+reporting records per second, CPU time and peak RSS of the child process.
+--verify checks the secp256k1 kernel selected for this CPU, and the generic
+one, against OpenSSL.
+
+The index and hash set lookup benchmarks build an index (in TMPDIR) and a
+hash set of --index-hashes random hashes the first time one runs, larger
+than the CPU caches by default, and look up hashes of which half are in
+them.
+
+--huge-pages sets how the secp256k1 tables, the index and the hash set use
+huge pages (see hugepage.h), so running the same benchmarks with off and
+with transparent or explicit shows what they save in TLB misses.  The
+backing each got is reported on '#' lines.
+*/
+
+#define _POSIX_C_SOURCE 200112L /* clock_gettime, getrusage */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#include "hash.h"
+#include "keys.h"
+#include "base58.h"
+#include "utility.h"
+#include "prefix.h"
+#include "applog.h"
+#include "context.h"
+#include "batch.h"
+#include "secp256k1.h"
+#include "index.h"
+#include "hashset.h"
+
+#define BENCH_INPUT_COUNT 256
+#define BENCH_DEFAULT_SEED 0x626974636f696e21ULL
+#define BENCH_DEFAULT_MIN_TIME 0.5
+
+/* hashes in the index of the lookup benchmarks (80 MiB of them), and
+   hashes to look up in it (a power of two) */
+#define BENCH_DEFAULT_INDEX_HASHES (4UL * 1024 * 1024)
+#define BENCH_INDEX_PROBES (1024 * 1024)
+
+struct BenchInput {
+	uint8_t private_key[BITCOIN_PRIVATE_KEY_SIZE];
+	uint8_t public_key[BITCOIN_PUBLIC_KEY_COMPRESSED_SIZE];
+	uint8_t address[BITCOIN_ADDRESS_SIZE];
+	char private_key_hex[BITCOIN_PRIVATE_KEY_SIZE * 2];
+	char address_base58[64];
+	size_t address_base58_size;
+	char address_base58check[64];
+	size_t address_base58check_size;
+};
+
+struct BenchState {
+	struct BenchInput inputs[BENCH_INPUT_COUNT];
+	struct BitcoinPrivateKey private_keys[BENCH_INPUT_COUNT];
+
+	struct BitcoinContext *context;
+
+	/* built by the first index benchmark run */
+	unsigned long index_hashes;
+	struct BitcoinIndex *index;
+	struct BitcoinHashSet *hash_set;
+	struct BitcoinRIPEMD160 *index_probes;
+
+	/* results are accumulated here so the compiler cannot discard work */
+	volatile unsigned sink;
+};
+
+struct Bench {
+	const char *name;
+	void (*run)(struct BenchState *state, unsigned long iterations);
+};
+
+static uint64_t bench_random_state;
+
+/* xorshift64* - we only need repeatable inputs, not good randomness */
+static uint64_t Bench_random(void)
+{
+	bench_random_state ^= bench_random_state >> 12;
+	bench_random_state ^= bench_random_state << 25;
+	bench_random_state ^= bench_random_state >> 27;
+	return bench_random_state * 0x2545f4914f6cdd1dULL;
+}
+
+static void Bench_randomBytes(uint8_t *output, size_t size)
+{
+	while (size--) {
+		*output++ = (uint8_t)(Bench_random() >> 56);
+	}
+}
+
+static double Bench_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void Bench_sha256(struct BenchState *s, unsigned long iterations)
+{
+	struct BitcoinSHA256 hash;
+	unsigned long i;
+	for (i = 0; i < iterations; i++) {
+		const struct BenchInput *in = &s->inputs[i % BENCH_INPUT_COUNT];
+		Bitcoin_SHA256(&hash, in->public_key, sizeof(in->public_key));
+		s->sink += hash.data[0];
+	}
+}
+
+static void Bench_doubleSHA256(struct BenchState *s, unsigned long iterations)
+{
+	struct BitcoinSHA256 hash;
+	unsigned long i;
+	for (i = 0; i < iterations; i++) {
+		const struct BenchInput *in = &s->inputs[i % BENCH_INPUT_COUNT];
+		Bitcoin_DoubleSHA256(&hash, in->address, sizeof(in->address));
+		s->sink += hash.data[0];
+	}
+}
+
+static void Bench_ripemd160(struct BenchState *s, unsigned long iterations)
+{
+	struct BitcoinRIPEMD160 hash;
+	unsigned long i;
+	for (i = 0; i < iterations; i++) {
+		const struct BenchInput *in = &s->inputs[i % BENCH_INPUT_COUNT];
+		Bitcoin_RIPEMD160(&hash, in->private_key, sizeof(in->private_key));
+		s->sink += hash.data[0];
+	}
+}
+
+static void Bench_encodeBase58(struct BenchState *s, unsigned long iterations)
+{
+	char output[64];
+	size_t output_size;
+	unsigned long i;
+	for (i = 0; i < iterations; i++) {
+		const struct BenchInput *in = &s->inputs[i % BENCH_INPUT_COUNT];
+		Bitcoin_EncodeBase58(output, sizeof(output), &output_size,
+			in->address, sizeof(in->address)
+		);
+		s->sink += output_size;
+	}
+}
+
+static void Bench_encodeBase58Check(struct BenchState *s, unsigned long iterations)
+{
+	char output[64];
+	size_t output_size;
+	unsigned long i;
+	for (i = 0; i < iterations; i++) {
+		const struct BenchInput *in = &s->inputs[i % BENCH_INPUT_COUNT];
+		Bitcoin_EncodeBase58Check(output, sizeof(output), &output_size,
+			in->address, sizeof(in->address)
+		);
+		s->sink += output_size;
+	}
+}
+
+static void Bench_decodeBase58(struct BenchState *s, unsigned long iterations)
+{
+	uint8_t output[64];
+	size_t output_size;
+	unsigned long i;
+	for (i = 0; i < iterations; i++) {
+		const struct BenchInput *in = &s->inputs[i % BENCH_INPUT_COUNT];
+		Bitcoin_DecodeBase58(output, sizeof(output), &output_size,
+			in->address_base58, in->address_base58_size
+		);
+		s->sink += output_size;
+	}
+}
+
+static void Bench_decodeBase58Check(struct BenchState *s, unsigned long iterations)
+{
+	uint8_t output[64];
+	size_t output_size;
+	unsigned long i;
+	for (i = 0; i < iterations; i++) {
+		const struct BenchInput *in = &s->inputs[i % BENCH_INPUT_COUNT];
+		Bitcoin_DecodeBase58Check(output, sizeof(output), &output_size,
+			in->address_base58check, in->address_base58check_size
+		);
+		s->sink += output_size;
+	}
+}
+
+static void Bench_decodeHex(struct BenchState *s, unsigned long iterations)
+{
+	uint8_t output[BITCOIN_PRIVATE_KEY_SIZE];
+	size_t output_size;
+	unsigned long i;
+	for (i = 0; i < iterations; i++) {
+		const struct BenchInput *in = &s->inputs[i % BENCH_INPUT_COUNT];
+		Bitcoin_DecodeHex(output, sizeof(output), &output_size,
+			in->private_key_hex, sizeof(in->private_key_hex)
+		);
+		s->sink += output[0];
+	}
+}
+
+static void Bench_encodeHex(struct BenchState *s, unsigned long iterations)
+{
+	char output[BITCOIN_PRIVATE_KEY_SIZE * 2];
+	size_t output_size;
+	unsigned long i;
+	for (i = 0; i < iterations; i++) {
+		const struct BenchInput *in = &s->inputs[i % BENCH_INPUT_COUNT];
+		Bitcoin_EncodeHex(output, sizeof(output), &output_size,
+			in->private_key, sizeof(in->private_key), 1
+		);
+		s->sink += output[0];
+	}
+}
+
+static void Bench_makePublicKey(struct BenchState *s, unsigned long iterations)
+{
+	struct BitcoinPublicKey public_key;
+	unsigned long i;
+	for (i = 0; i < iterations; i++) {
+		Bitcoin_MakePublicKeyFromPrivateKey(&public_key,
+			&s->private_keys[i % BENCH_INPUT_COUNT]
+		);
+		s->sink += public_key.data[1];
+	}
+}
+
+static void Bench_contextMakePublicKey(struct BenchState *s, unsigned long iterations)
+{
+	struct BitcoinPublicKey public_key;
+	unsigned long i;
+	for (i = 0; i < iterations; i++) {
+		BitcoinContext_MakePublicKey(s->context, &public_key,
+			&s->private_keys[i % BENCH_INPUT_COUNT]
+		);
+		s->sink += public_key.data[1];
+	}
+}
+
+static void Bench_secp256k1Generic(struct BenchState *s, unsigned long iterations)
+{
+	struct BitcoinPublicKey public_key;
+	unsigned long i;
+	for (i = 0; i < iterations; i++) {
+		BitcoinSecp256k1_MakePublicKeysGeneric(&public_key,
+			&s->private_keys[i % BENCH_INPUT_COUNT], 1, NULL
+		);
+		s->sink += public_key.data[1];
+	}
+}
+
+/* public keys through the selected kernel, BENCH_INPUT_COUNT at a time
+   (iterations are rounded up to a whole batch) */
+static void Bench_secp256k1Batch(struct BenchState *s, unsigned long iterations)
+{
+	static struct BitcoinPublicKey public_keys[BENCH_INPUT_COUNT];
+	unsigned long i;
+	for (i = 0; i < iterations; i += BENCH_INPUT_COUNT) {
+		const size_t count = iterations - i < BENCH_INPUT_COUNT ?
+			iterations - i : BENCH_INPUT_COUNT;
+		BitcoinSecp256k1_MakePublicKeys(public_keys, s->private_keys, count, NULL);
+		s->sink += public_keys[0].data[1];
+	}
+}
+
+/* private keys to text addresses through the batch API, in batches of
+   BENCH_INPUT_COUNT (iterations are rounded up to a whole batch) */
+static void Bench_batchAddress(struct BenchState *s, unsigned long iterations)
+{
+	static struct BitcoinAddress addresses[BENCH_INPUT_COUNT];
+	static char text[BENCH_INPUT_COUNT][BITCOIN_BATCH_ADDRESS_TEXT_SIZE];
+	unsigned long i;
+	for (i = 0; i < iterations; i += BENCH_INPUT_COUNT) {
+		const size_t count = iterations - i < BENCH_INPUT_COUNT ?
+			iterations - i : BENCH_INPUT_COUNT;
+		BitcoinBatch_MakeAddresses(s->context, addresses, s->private_keys, count, NULL);
+		BitcoinBatch_EncodeAddresses(s->context, text[0], sizeof(text[0]),
+			addresses, count, NULL
+		);
+		s->sink += text[0][1];
+	}
+}
+
+/* Build the index, the hash set and the hashes to look up, unless done
+   already */
+static void Bench_openIndex(struct BenchState *s)
+{
+	struct BitcoinIndexBuilder *builder = NULL;
+	struct BitcoinRIPEMD160 *hashes;
+	const char *directory = getenv("TMPDIR");
+	char filename[256], lock[256 + 8];
+	enum BitcoinHugePageBacking backing;
+	uint64_t huge_bytes;
+	unsigned long i;
+	int success;
+
+	if (s->index) {
+		return;
+	}
+	if (!directory || !*directory || strlen(directory) > 200) {
+		directory = "/tmp";
+	}
+	sprintf(filename, "%s/bitcoin-tool-bench-%ld.idx", directory, (long)getpid());
+	sprintf(lock, "%s.lock", filename);
+
+	hashes = malloc(s->index_hashes * sizeof(*hashes));
+	s->index_probes = malloc(BENCH_INDEX_PROBES * sizeof(*s->index_probes));
+	success = hashes && s->index_probes;
+	if (success) {
+		for (i = 0; i < s->index_hashes; i++) {
+			Bench_randomBytes(hashes[i].data, sizeof(hashes[i].data));
+		}
+		for (i = 0; i < BENCH_INDEX_PROBES; i++) {
+			if (i & 1) {
+				Bench_randomBytes(s->index_probes[i].data,
+					sizeof(s->index_probes[i].data)
+				);
+			} else {
+				s->index_probes[i] = hashes[Bench_random() % s->index_hashes];
+			}
+		}
+
+		/* sorted in memory, not spilled */
+		builder = BitcoinIndexBuilder_create(1,
+			2 * s->index_hashes * sizeof(*hashes) + 1
+		);
+		success = builder
+			&& BitcoinIndexBuilder_AddHashes(builder, hashes, s->index_hashes)
+				== s->index_hashes
+			&& BitcoinIndexBuilder_Finish(builder, filename, NULL)
+				== BITCOIN_SUCCESS;
+		BitcoinIndexBuilder_destroy(builder);
+	}
+	if (success) {
+		s->hash_set = BitcoinHashSet_create(s->index_hashes);
+		success = s->hash_set != NULL;
+		for (i = 0; success && i < s->index_hashes; i++) {
+			success = BitcoinHashSet_Add(s->hash_set, &hashes[i]) >= 0;
+		}
+	}
+	free(hashes);
+
+	if (success) {
+		s->index = BitcoinIndex_open(filename);
+		success = s->index != NULL;
+	}
+	remove(filename);
+	remove(lock);
+
+	if (!success) {
+		applog(APPLOG_ERROR, __func__,
+			"Failed to build the benchmark index and hash set."
+		);
+		exit(EXIT_FAILURE);
+	}
+
+	backing = BitcoinHashSet_GetBacking(s->hash_set, &huge_bytes);
+	printf("# index huge pages: %s, hash set huge pages: %s (%.1f of %.1f MiB)\n",
+		BitcoinHugePage_GetBackingName(BitcoinIndex_GetBacking(s->index, NULL)),
+		BitcoinHugePage_GetBackingName(backing), huge_bytes / 1048576.0,
+		BitcoinHashSet_GetMemorySize(s->hash_set) / 1048576.0
+	);
+}
+
+/* hashes looked up in an index one at a time */
+static void Bench_indexLookup(struct BenchState *s, unsigned long iterations)
+{
+	unsigned long i;
+	Bench_openIndex(s);
+	for (i = 0; i < iterations; i++) {
+		s->sink += BitcoinIndex_Contains(s->index,
+			&s->index_probes[i & (BENCH_INDEX_PROBES - 1)]
+		);
+	}
+}
+
+/* hashes looked up in an index in batches of BITCOIN_INDEX_BATCH_SIZE
+   (iterations are rounded up to a whole batch) */
+static void Bench_indexLookupBatch(struct BenchState *s, unsigned long iterations)
+{
+	static unsigned char found[BITCOIN_INDEX_BATCH_SIZE];
+	unsigned long i;
+	Bench_openIndex(s);
+	for (i = 0; i < iterations; i += BITCOIN_INDEX_BATCH_SIZE) {
+		const size_t count = iterations - i < BITCOIN_INDEX_BATCH_SIZE ?
+			iterations - i : BITCOIN_INDEX_BATCH_SIZE;
+		BitcoinIndex_ContainsBatch(s->index,
+			&s->index_probes[i & (BENCH_INDEX_PROBES - 1)], count, found
+		);
+		s->sink += found[0];
+	}
+}
+
+/* hashes looked up in a hash set one at a time */
+static void Bench_hashSetLookup(struct BenchState *s, unsigned long iterations)
+{
+	unsigned long i;
+	Bench_openIndex(s);
+	for (i = 0; i < iterations; i++) {
+		s->sink += BitcoinHashSet_Contains(s->hash_set,
+			&s->index_probes[i & (BENCH_INDEX_PROBES - 1)]
+		);
+	}
+}
+
+/* hashes looked up in a hash set in batches of BITCOIN_INDEX_BATCH_SIZE
+   (iterations are rounded up to a whole batch) */
+static void Bench_hashSetLookupBatch(struct BenchState *s, unsigned long iterations)
+{
+	static unsigned char found[BITCOIN_INDEX_BATCH_SIZE];
+	unsigned long i;
+	Bench_openIndex(s);
+	for (i = 0; i < iterations; i += BITCOIN_INDEX_BATCH_SIZE) {
+		const size_t count = iterations - i < BITCOIN_INDEX_BATCH_SIZE ?
+			iterations - i : BITCOIN_INDEX_BATCH_SIZE;
+		BitcoinHashSet_ContainsBatch(s->hash_set,
+			&s->index_probes[i & (BENCH_INDEX_PROBES - 1)], count, found
+		);
+		s->sink += found[0];
+	}
+}
+
+static const struct Bench benches[] = {
+	{ "sha256",             Bench_sha256 },
+	{ "double-sha256",      Bench_doubleSHA256 },
+	{ "ripemd160",          Bench_ripemd160 },
+	{ "base58-encode",      Bench_encodeBase58 },
+	{ "base58check-encode", Bench_encodeBase58Check },
+	{ "base58-decode",      Bench_decodeBase58 },
+	{ "base58check-decode", Bench_decodeBase58Check },
+	{ "hex-decode",         Bench_decodeHex },
+	{ "hex-encode",         Bench_encodeHex },
+	{ "make-public-key",    Bench_makePublicKey },
+	{ "context-make-public-key", Bench_contextMakePublicKey },
+	{ "secp256k1-generic",  Bench_secp256k1Generic },
+	{ "secp256k1-batch",    Bench_secp256k1Batch },
+	{ "batch-address",      Bench_batchAddress },
+	{ "index-lookup",       Bench_indexLookup },
+	{ "index-lookup-batch", Bench_indexLookupBatch },
+	{ "hash-set-lookup",    Bench_hashSetLookup },
+	{ "hash-set-lookup-batch", Bench_hashSetLookupBatch }
+};
+
+static void BenchState_init(struct BenchState *s, uint64_t seed)
+{
+	const struct BitcoinNetworkType *network = Bitcoin_GetNetworkTypeByName("bitcoin");
+	size_t i, size;
+
+	bench_random_state = seed ? seed : BENCH_DEFAULT_SEED;
+
+	for (i = 0; i < BENCH_INPUT_COUNT; i++) {
+		struct BenchInput *in = &s->inputs[i];
+		struct BitcoinPrivateKey *private_key = &s->private_keys[i];
+		struct BitcoinPublicKey public_key;
+		struct BitcoinSHA256 sha256;
+		struct BitcoinRIPEMD160 ripemd160;
+
+		Bench_randomBytes(in->private_key, sizeof(in->private_key));
+		Bitcoin_EncodeHex(in->private_key_hex, sizeof(in->private_key_hex),
+			&size, in->private_key, sizeof(in->private_key), 1
+		);
+
+		memcpy(private_key->data, in->private_key, sizeof(private_key->data));
+		private_key->public_key_compression = BITCOIN_PUBLIC_KEY_COMPRESSED;
+		private_key->network_type = network;
+
+		Bitcoin_MakePublicKeyFromPrivateKey(&public_key, private_key);
+		memcpy(in->public_key, public_key.data, sizeof(in->public_key));
+
+		Bitcoin_SHA256(&sha256, in->public_key, sizeof(in->public_key));
+		Bitcoin_RIPEMD160(&ripemd160, sha256.data, sizeof(sha256.data));
+		in->address[0] = BitcoinNetworkType_GetPublicKeyPrefix(network);
+		memcpy(in->address + 1, ripemd160.data, sizeof(ripemd160.data));
+
+		Bitcoin_EncodeBase58(in->address_base58, sizeof(in->address_base58),
+			&in->address_base58_size, in->address, sizeof(in->address)
+		);
+		Bitcoin_EncodeBase58Check(in->address_base58check,
+			sizeof(in->address_base58check), &in->address_base58check_size,
+			in->address, sizeof(in->address)
+		);
+	}
+}
+
+/* Write 'lines' lines of a deterministic corpus to stdout.  The corpora
+are generated without any EC operations so that multi-million line files
+can be produced quickly. */
+static int Bench_generate(const char *corpus, unsigned long lines, unsigned long seed)
+{
+	const struct BitcoinNetworkType *network = Bitcoin_GetNetworkTypeByName("bitcoin");
+	enum { PRIVATE_KEY_HEX, PRIVATE_KEY_WIF, ADDRESS } type;
+	unsigned long line;
+
+	if (!strcmp(corpus, "private-key-hex")) {
+		type = PRIVATE_KEY_HEX;
+	} else if (!strcmp(corpus, "private-key-wif")) {
+		type = PRIVATE_KEY_WIF;
+	} else if (!strcmp(corpus, "address")) {
+		type = ADDRESS;
+	} else {
+		applog(APPLOG_ERROR, __func__,
+			"Unknown corpus \"%s\", must be one of:"
+			" private-key-hex, private-key-wif, address", corpus
+		);
+		return 0;
+	}
+
+	bench_random_state = seed ? seed : BENCH_DEFAULT_SEED;
+
+	for (line = 0; line < lines; line++) {
+		uint8_t raw[BITCOIN_PRIVATE_KEY_WIF_COMPRESSED_SIZE];
+		char text[128];
+		size_t raw_size = 0, text_size = 0;
+
+		switch (type) {
+			case PRIVATE_KEY_HEX :
+				Bench_randomBytes(raw, BITCOIN_PRIVATE_KEY_SIZE);
+				Bitcoin_EncodeHex(text, sizeof(text), &text_size,
+					raw, BITCOIN_PRIVATE_KEY_SIZE, 1
+				);
+				break;
+			case PRIVATE_KEY_WIF :
+				raw[0] = BitcoinNetworkType_GetPrivateKeyPrefix(network);
+				Bench_randomBytes(raw + BITCOIN_PRIVATE_KEY_WIF_VERSION_SIZE,
+					BITCOIN_PRIVATE_KEY_SIZE
+				);
+				raw_size = BITCOIN_PRIVATE_KEY_WIF_UNCOMPRESSED_SIZE;
+				/* alternate compressed and uncompressed keys */
+				if (line & 1) {
+					raw[raw_size++] = BITCOIN_PRIVATE_KEY_WIF_COMPRESSION_FLAG_COMPRESSED;
+				}
+				Bitcoin_EncodeBase58Check(text, sizeof(text), &text_size,
+					raw, raw_size
+				);
+				break;
+			case ADDRESS :
+				raw[0] = BitcoinNetworkType_GetPublicKeyPrefix(network);
+				Bench_randomBytes(raw + BITCOIN_ADDRESS_VERSION_SIZE,
+					BITCOIN_RIPEMD160_SIZE
+				);
+				Bitcoin_EncodeBase58Check(text, sizeof(text), &text_size,
+					raw, BITCOIN_ADDRESS_SIZE
+				);
+				break;
+		}
+
+		text[text_size++] = '\n';
+		if (fwrite(text, 1, text_size, stdout) != text_size) {
+			applog(APPLOG_ERROR, __func__, "Error writing corpus (%s)",
+				strerror(errno)
+			);
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/* Run a command with stdin and stdout connected to /dev/null, and report its
+wall clock time, records per second, CPU time and peak RSS. */
+static int Bench_exec(const char *name, unsigned long records,
+	unsigned long runs, char *argv[]
+)
+{
+	struct rusage usage;
+	double start, elapsed;
+	unsigned long run;
+
+	start = Bench_now();
+
+	for (run = 0; run < runs; run++) {
+		pid_t pid;
+		int status = 0;
+
+		pid = fork();
+		if (pid < 0) {
+			applog(APPLOG_ERROR, __func__, "fork failed (%s)", strerror(errno));
+			return 0;
+		}
+		if (pid == 0) {
+			int null_fd = open("/dev/null", O_RDWR);
+			if (null_fd >= 0) {
+				dup2(null_fd, STDIN_FILENO);
+				dup2(null_fd, STDOUT_FILENO);
+				close(null_fd);
+			}
+			execvp(argv[0], argv);
+			applog(APPLOG_ERROR, __func__, "Failed to run [%s] (%s)",
+				argv[0], strerror(errno)
+			);
+			_exit(127);
+		}
+
+		while (waitpid(pid, &status, 0) < 0) {
+			if (errno != EINTR) {
+				applog(APPLOG_ERROR, __func__, "waitpid failed (%s)", strerror(errno));
+				return 0;
+			}
+		}
+
+		if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+			applog(APPLOG_ERROR, __func__, "[%s] failed with status %d",
+				argv[0], WIFEXITED(status) ? WEXITSTATUS(status) : -1
+			);
+			return 0;
+		}
+	}
+	elapsed = Bench_now() - start;
+	records *= runs;
+
+	/* we only ever run these children, so the children totals are theirs,
+	   and max_rss is the peak of any one run */
+	getrusage(RUSAGE_CHILDREN, &usage);
+
+	printf("# pipeline\trecords\twall_ns\trecords_per_sec\tuser_sec\tsys_sec\tmax_rss_kb\n");
+	printf("%s\t%lu\t%.0f\t%.2f\t%.3f\t%.3f\t%ld\n",
+		name,
+		records,
+		elapsed,
+		records / (elapsed / 1e9),
+		usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6,
+		usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6,
+		(long)usage.ru_maxrss
+	);
+
+	return 1;
+}
+
+/* Derive public keys for 'count' random private keys, plus the edge cases
+around zero and the curve order, with the selected secp256k1 kernel, the
+generic kernel and OpenSSL, and check that all three agree.  Keys are
+derived in batches of odd sizes so that partly filled vectors are covered. */
+static int Bench_verify(unsigned long count, unsigned long seed)
+{
+	static const uint8_t edge_keys[][BITCOIN_PRIVATE_KEY_SIZE] = {
+		/* 1, 2 */
+		{ 0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,1 },
+		{ 0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,2 },
+		/* n - 1, n + 1 */
+		{ 0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff, 0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xfe,
+		  0xba,0xae,0xdc,0xe6,0xaf,0x48,0xa0,0x3b, 0xbf,0xd2,0x5e,0x8c,0xd0,0x36,0x41,0x40 },
+		{ 0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff, 0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xfe,
+		  0xba,0xae,0xdc,0xe6,0xaf,0x48,0xa0,0x3b, 0xbf,0xd2,0x5e,0x8c,0xd0,0x36,0x41,0x42 },
+		/* 2^256 - 1 */
+		{ 0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff, 0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff,
+		  0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff, 0xff,0xff,0xff,0xff,0xff,0xff,0xff,0xff },
+		/* every nibble the same, and alternating nibbles */
+		{ 0x11,0x11,0x11,0x11,0x11,0x11,0x11,0x11, 0x11,0x11,0x11,0x11,0x11,0x11,0x11,0x11,
+		  0x11,0x11,0x11,0x11,0x11,0x11,0x11,0x11, 0x11,0x11,0x11,0x11,0x11,0x11,0x11,0x11 },
+		{ 0xf0,0xf0,0xf0,0xf0,0xf0,0xf0,0xf0,0xf0, 0xf0,0xf0,0xf0,0xf0,0xf0,0xf0,0xf0,0xf0,
+		  0xf0,0xf0,0xf0,0xf0,0xf0,0xf0,0xf0,0xf0, 0xf0,0xf0,0xf0,0xf0,0xf0,0xf0,0xf0,0xf0 }
+	};
+	const size_t edge_count = sizeof(edge_keys) / sizeof(edge_keys[0]);
+	const size_t total = (size_t)count + edge_count;
+	struct BitcoinPrivateKey *private_keys = calloc(total, sizeof(*private_keys));
+	struct BitcoinPublicKey *selected = calloc(total, sizeof(*selected));
+	struct BitcoinPublicKey *generic = calloc(total, sizeof(*generic));
+	BitcoinResult *results = calloc(total, sizeof(*results));
+	size_t i, start, batch, failures = 0;
+
+	if (!private_keys || !selected || !generic || !results) {
+		applog(APPLOG_ERROR, __func__, "Failed to allocate %lu keys.", count);
+		free(private_keys); free(selected); free(generic); free(results);
+		return 0;
+	}
+
+	bench_random_state = seed ? seed : BENCH_DEFAULT_SEED;
+	for (i = 0; i < total; i++) {
+		if (i < edge_count) {
+			memcpy(private_keys[i].data, edge_keys[i], BITCOIN_PRIVATE_KEY_SIZE);
+		} else {
+			Bench_randomBytes(private_keys[i].data, BITCOIN_PRIVATE_KEY_SIZE);
+		}
+		private_keys[i].public_key_compression = (i / edge_count) % 2
+			? BITCOIN_PUBLIC_KEY_UNCOMPRESSED : BITCOIN_PUBLIC_KEY_COMPRESSED;
+		private_keys[i].network_type = Bitcoin_GetNetworkTypeByName("bitcoin");
+	}
+
+	for (start = 0, batch = 1; start < total; start += batch, batch = batch % 13 + 1) {
+		if (batch > total - start) {
+			batch = total - start;
+		}
+		BitcoinSecp256k1_MakePublicKeys(&selected[start], &private_keys[start],
+			batch, &results[start]
+		);
+	}
+	BitcoinSecp256k1_MakePublicKeysGeneric(generic, private_keys, total, NULL);
+
+	for (i = 0; i < total; i++) {
+		struct BitcoinPublicKey expected;
+		const size_t size = BitcoinPublicKey_GetSize(&selected[i]);
+
+		if (results[i] != BITCOIN_SUCCESS
+			|| Bitcoin_MakePublicKeyFromPrivateKey(&expected, &private_keys[i])
+				!= BITCOIN_SUCCESS
+			|| size != BitcoinPublicKey_GetSize(&expected)
+			|| memcmp(selected[i].data, expected.data, size)
+			|| memcmp(generic[i].data, expected.data, size)
+		) {
+			applog(APPLOG_ERROR, __func__, "Public key %lu does not match.",
+				(unsigned long)i
+			);
+			failures++;
+		}
+	}
+
+	/* zero and n have no public key */
+	memset(private_keys[0].data, 0, BITCOIN_PRIVATE_KEY_SIZE);
+	memcpy(private_keys[1].data, edge_keys[2], BITCOIN_PRIVATE_KEY_SIZE);
+	private_keys[1].data[BITCOIN_PRIVATE_KEY_SIZE - 1]++;
+	{
+		const enum ApplogLevel threshold = applog_threshold;
+		applog_set_level(APPLOG_FATAL);
+		if (BitcoinSecp256k1_MakePublicKeys(selected, private_keys, 2, NULL)) {
+			failures++;
+		}
+		applog_set_level(threshold);
+	}
+
+	printf("secp256k1 %s: %lu keys, %lu mismatches\n",
+		BitcoinSecp256k1_GetKernelName(),
+		(unsigned long)total, (unsigned long)failures
+	);
+
+	free(private_keys); free(selected); free(generic); free(results);
+	return failures == 0;
+}
+
+static void Bench_help(void)
+{
+	FILE *file = stderr;
+	size_t i;
+
+	fprintf(file,
+		"Usage: bitcoin-tool-bench [option]... [benchmark]...\n"
+		"Measure the speed of each bitcoin-tool conversion stage.\n"
+		"\n"
+		"  --min-time <seconds> : Minimum time to run each benchmark (default=%.1f)\n"
+		"  --seed <number>      : Seed for generating inputs\n"
+		"  --index-hashes <number> : Hashes in the index and hash set of the\n"
+		"      lookup benchmarks (default=%lu)\n"
+		"  --huge-pages <mode>  : Huge pages for the secp256k1 tables, index and\n"
+		"      hash set, one of: transparent (default), explicit, off\n"
+		"  --list               : List benchmark names\n"
+		"\n"
+		"  --generate <corpus> <lines> : Write a deterministic corpus to stdout,\n"
+		"      one of: private-key-hex, private-key-wif, address\n"
+		"  --exec <name> <records> <command> [argument]... : Run a command and\n"
+		"      report records/second, CPU time and peak RSS\n"
+		"  --runs <number>      : Run the --exec command this many times in turn,\n"
+		"      each processing <records> records (default=1)\n"
+		"  --verify <keys>      : Check the secp256k1 kernels against OpenSSL\n"
+		"      for this many random keys\n"
+		"\n"
+		"Benchmarks (all are run if none are specified) :\n",
+		BENCH_DEFAULT_MIN_TIME, BENCH_DEFAULT_INDEX_HASHES
+	);
+	for (i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+		fprintf(file, "      %s\n", benches[i].name);
+	}
+}
+
+static int Bench_selected(const char *name, int argc, char *argv[], int first_name)
+{
+	int i;
+	if (first_name >= argc) {
+		return 1;
+	}
+	for (i = first_name; i < argc; i++) {
+		if (!strcmp(argv[i], name)) {
+			return 1;
+		}
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct BenchState *state = NULL;
+	double min_time_ns = BENCH_DEFAULT_MIN_TIME * 1e9;
+	unsigned long seed = (unsigned long)BENCH_DEFAULT_SEED;
+	unsigned long runs = 1;
+	unsigned long index_hashes = BENCH_DEFAULT_INDEX_HASHES;
+	enum BitcoinHugePageMode huge_pages = BITCOIN_HUGE_PAGES_TRANSPARENT;
+	enum BitcoinHugePageBacking backing;
+	uint64_t huge_bytes;
+	int first_name = argc;
+	int i;
+	size_t b;
+
+	for (i = 1; i < argc; i++) {
+		const char *a = argv[i];
+		if (!strcmp(a, "--min-time") && i + 1 < argc) {
+			min_time_ns = atof(argv[++i]) * 1e9;
+		} else if (!strcmp(a, "--seed") && i + 1 < argc) {
+			seed = strtoul(argv[++i], NULL, 0);
+		} else if (!strcmp(a, "--generate") && i + 2 < argc) {
+			return Bench_generate(argv[i + 1], strtoul(argv[i + 2], NULL, 0), seed)
+				? EXIT_SUCCESS : EXIT_FAILURE;
+		} else if (!strcmp(a, "--index-hashes") && i + 1 < argc) {
+			index_hashes = strtoul(argv[++i], NULL, 0);
+			if (!index_hashes) {
+				applog(APPLOG_ERROR, __func__, "--index-hashes should be positive");
+				return EXIT_FAILURE;
+			}
+		} else if (!strcmp(a, "--huge-pages") && i + 1 < argc) {
+			if (!BitcoinHugePage_ParseMode(argv[++i], &huge_pages)) {
+				applog(APPLOG_ERROR, __func__,
+					"--huge-pages should be one of: off, transparent, explicit"
+				);
+				return EXIT_FAILURE;
+			}
+		} else if (!strcmp(a, "--runs") && i + 1 < argc) {
+			runs = strtoul(argv[++i], NULL, 0);
+		} else if (!strcmp(a, "--exec") && i + 3 < argc) {
+			return Bench_exec(argv[i + 1], strtoul(argv[i + 2], NULL, 0), runs, argv + i + 3)
+				? EXIT_SUCCESS : EXIT_FAILURE;
+		} else if (!strcmp(a, "--verify") && i + 1 < argc) {
+			return Bench_verify(strtoul(argv[i + 1], NULL, 0), seed)
+				? EXIT_SUCCESS : EXIT_FAILURE;
+		} else if (!strcmp(a, "--list")) {
+			for (b = 0; b < sizeof(benches) / sizeof(benches[0]); b++) {
+				printf("%s\n", benches[b].name);
+			}
+			return EXIT_SUCCESS;
+		} else if (!strcmp(a, "--help")) {
+			Bench_help();
+			return EXIT_SUCCESS;
+		} else if (a[0] == '-') {
+			applog(APPLOG_ERROR, __func__, "unknown option \"%s\"", a);
+			Bench_help();
+			return EXIT_FAILURE;
+		} else {
+			first_name = i;
+			break;
+		}
+	}
+
+	for (i = first_name; i < argc; i++) {
+		int found = 0;
+		for (b = 0; b < sizeof(benches) / sizeof(benches[0]); b++) {
+			found |= !strcmp(argv[i], benches[b].name);
+		}
+		if (!found) {
+			applog(APPLOG_ERROR, __func__, "Unknown benchmark \"%s\"", argv[i]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	state = calloc(1, sizeof(*state));
+	state->context = BitcoinContext_create();
+	if (!state->context) {
+		free(state);
+		return EXIT_FAILURE;
+	}
+	BenchState_init(state, seed);
+	state->index_hashes = index_hashes;
+
+	BitcoinHugePage_SetMode(huge_pages);
+	backing = BitcoinSecp256k1_PlaceTables(&huge_bytes);
+
+	printf("# benchmark\titerations\ttotal_ns\tns_per_op\tops_per_sec\n");
+	printf("# secp256k1 tables huge pages: %s (%llu KiB)\n",
+		BitcoinHugePage_GetBackingName(backing),
+		(unsigned long long)(huge_bytes >> 10)
+	);
+
+	for (b = 0; b < sizeof(benches) / sizeof(benches[0]); b++) {
+		const struct Bench *bench = &benches[b];
+		unsigned long iterations = 1;
+		double elapsed = 0;
+
+		if (!Bench_selected(bench->name, argc, argv, first_name)) {
+			continue;
+		}
+
+		/* warm up caches, then double the iteration count until the run
+		   takes long enough to measure reliably */
+		bench->run(state, BENCH_INPUT_COUNT);
+		for (;;) {
+			double start = Bench_now();
+			bench->run(state, iterations);
+			elapsed = Bench_now() - start;
+			if (elapsed >= min_time_ns) {
+				break;
+			}
+			iterations *= 2;
+		}
+
+		printf("%s\t%lu\t%.0f\t%.2f\t%.2f\n",
+			bench->name,
+			iterations,
+			elapsed,
+			elapsed / iterations,
+			iterations / (elapsed / 1e9)
+		);
+		fflush(stdout);
+	}
+
+	BitcoinIndex_close(state->index);
+	BitcoinHashSet_destroy(state->hash_set);
+	free(state->index_probes);
+	BitcoinContext_destroy(state->context);
+	free(state);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,226 @@
+#!/usr/bin/env bash
+
+# End-to-end batch throughput benchmarks.
+#
+# Generates deterministic corpora (once, they are kept in $BENCH_DATA), then
+# runs bitcoin-tool in batch mode over each of them and reports records per
+# second, CPU time and peak RSS for each pipeline, as tab-separated lines.
+#
+# Usage: ./bench.sh [pipeline]...
+#        ./bench.sh --flavors [pipeline]...
+#        ./bench.sh --io-engines [pipeline]...
+#
+# With --flavors, each pipeline is run with ./bitcoin-tool and with each
+# build flavor in $BENCH_FLAVOR_DIR/<flavor>/bitcoin-tool (see the native,
+# lto and pgo make targets), reporting records per second and the gain
+# over ./bitcoin-tool.
+#
+# With --io-engines, each batch pipeline is run with each --io-engine,
+# reporting records per second, wall and CPU seconds, and the gain over
+# stdio.  Wall time falling while CPU time stays the same is the input and
+# output overlapping with the conversion.
+#
+# Environment:
+#   BENCH_LINES : number of lines in each corpus (default 2000000)
+#   BENCH_DATA  : directory to keep generated corpora in (default bench-data)
+#   BENCH_SEED  : seed for generating corpora
+#   BENCH_LATENCY_REQUESTS : requests sent by the serve-latency pipeline
+#                            (default 10000)
+#   BENCH_STARTUP_RUNS : invocations run by the startup pipeline (default 1000)
+#   BENCH_FLAVOR_DIR : directory containing build flavors (default build)
+#   BENCH_IO_ENGINES : engines compared by --io-engines
+#                      (default "stdio thread uring")
+#   BENCH_TOOL_ARGS : extra options passed to every batch run
+#
+# The startup pipeline runs bitcoin-tool once per record, converting a
+# single --input, to measure exec-to-exit time.
+#
+# The serve-latency pipeline is not run by default.  It starts
+# bitcoin-tool --serve and reports round trip times of single requests,
+# with its own header.
+
+BITCOIN_TOOL="${BITCOIN_TOOL:-./bitcoin-tool}"
+BITCOIN_TOOL_BENCH="${BITCOIN_TOOL_BENCH:-./bitcoin-tool-bench}"
+BITCOIN_TOOL_CLIENT="${BITCOIN_TOOL_CLIENT:-./bitcoin-tool-client}"
+BENCH_LATENCY_REQUESTS="${BENCH_LATENCY_REQUESTS:-10000}"
+BENCH_STARTUP_RUNS="${BENCH_STARTUP_RUNS:-1000}"
+BENCH_FLAVOR_DIR="${BENCH_FLAVOR_DIR:-build}"
+BENCH_IO_ENGINES="${BENCH_IO_ENGINES:-stdio thread uring}"
+BENCH_TOOL_ARGS="${BENCH_TOOL_ARGS:-}"
+BENCH_LINES="${BENCH_LINES:-2000000}"
+BENCH_DATA="${BENCH_DATA:-bench-data}"
+BENCH_SEED="${BENCH_SEED:-0}"
+
+BATCH_PIPELINES="wif-to-address hex-to-address address-validate output-all"
+PIPELINES="${BATCH_PIPELINES} startup"
+
+corpus () {
+	local FILE="${BENCH_DATA}/$1-${BENCH_LINES}-${BENCH_SEED}.txt"
+	if [ ! -s "${FILE}" ];then
+		mkdir -p "${BENCH_DATA}" || return 1
+		echo "# generating ${FILE}" >&2
+		"${BITCOIN_TOOL_BENCH}" --seed "${BENCH_SEED}" \
+			--generate "$1" "${BENCH_LINES}" > "${FILE}.tmp" || return 1
+		mv "${FILE}.tmp" "${FILE}" || return 1
+	fi
+	echo "${FILE}"
+}
+
+run () {
+	local NAME="$1"
+	shift
+	"${BITCOIN_TOOL_BENCH}" --exec "${NAME}" "${BENCH_LINES}" \
+		"${BITCOIN_TOOL}" --batch "$@" ${BENCH_TOOL_ARGS} | grep -v '^#'
+}
+
+serve_latency () {
+	local SOCKET="${TMPDIR:-/tmp}/bitcoin-tool-bench-$$.sock"
+	local SERVER I
+	"${BITCOIN_TOOL}" \
+		--serve "${SOCKET}" \
+		--log-level warning \
+		--input-type private-key \
+		--input-format hex \
+		--network bitcoin \
+		--public-key-compression compressed \
+		--output-type address \
+		--output-format base58check &
+	SERVER=$!
+	for I in $(seq 50);do [ -S "${SOCKET}" ] && break; sleep 0.1; done
+	echo 0000000000000000000000000000000000000000000000000000000000000001 \
+		| "${BITCOIN_TOOL_CLIENT}" --socket "${SOCKET}" \
+			--latency "${BENCH_LATENCY_REQUESTS}" \
+		| sed -e 's/^# requests/# serve-latency requests/' -e 's/^[0-9]/serve-latency\t&/'
+	kill "${SERVER}"
+	wait "${SERVER}"
+}
+
+pipeline () {
+	local INPUT
+	case "$1" in
+	wif-to-address)
+		INPUT=$(corpus private-key-wif) || return 1
+		run "$1" \
+			--input-file "${INPUT}" \
+			--input-type private-key-wif \
+			--input-format base58check \
+			--output-type address \
+			--output-format base58check
+		;;
+	hex-to-address)
+		INPUT=$(corpus private-key-hex) || return 1
+		run "$1" \
+			--input-file "${INPUT}" \
+			--input-type private-key \
+			--input-format hex \
+			--network bitcoin \
+			--public-key-compression compressed \
+			--output-type address \
+			--output-format base58check
+		;;
+	address-validate)
+		INPUT=$(corpus address) || return 1
+		run "$1" \
+			--input-file "${INPUT}" \
+			--input-type address \
+			--input-format base58check \
+			--output-type public-key-rmd \
+			--output-format hex
+		;;
+	output-all)
+		INPUT=$(corpus private-key-hex) || return 1
+		run "$1" \
+			--input-file "${INPUT}" \
+			--input-type private-key \
+			--input-format hex \
+			--network bitcoin \
+			--public-key-compression compressed \
+			--output-type all
+		;;
+	startup)
+		"${BITCOIN_TOOL_BENCH}" --runs "${BENCH_STARTUP_RUNS}" --exec "$1" 1 \
+			"${BITCOIN_TOOL}" \
+			--input 0000000000000000000000000000000000000000000000000000000000000001 \
+			--input-type private-key \
+			--input-format hex \
+			--network bitcoin \
+			--public-key-compression compressed \
+			--output-type address \
+			--output-format base58check | grep -v '^#'
+		;;
+	serve-latency)
+		serve_latency
+		;;
+	*)
+		echo "unknown pipeline $1, must be one of: ${PIPELINES} serve-latency" >&2
+		return 1
+		;;
+	esac
+}
+
+flavors () {
+	local DEFAULT_TOOL="${BITCOIN_TOOL}"
+	local PIPELINE FLAVOR TOOL RATE BASE
+	echo -e "# flavor\tpipeline\trecords_per_sec\tgain"
+	for PIPELINE in ${PIPELINES};do
+		BASE=""
+		for TOOL in "${DEFAULT_TOOL}" "${BENCH_FLAVOR_DIR}"/*/bitcoin-tool;do
+			[ -x "${TOOL}" ] || continue
+			if [ "${TOOL}" = "${DEFAULT_TOOL}" ];then
+				FLAVOR=default
+			else
+				FLAVOR=$(basename "$(dirname "${TOOL}")")
+			fi
+			BITCOIN_TOOL="${TOOL}"
+			RATE=$(pipeline "${PIPELINE}" | cut -f4) || return 1
+			[ -n "${BASE}" ] || BASE="${RATE}"
+			echo -e "${FLAVOR}\t${PIPELINE}\t${RATE}\t$(awk -v r="${RATE}" -v b="${BASE}" 'BEGIN { printf "%.3f", r / b }')"
+		done
+	done
+}
+
+io_engines () {
+	local PIPELINE ENGINE LINE RATE BASE
+	echo -e "# io_engine\tpipeline\trecords_per_sec\twall_sec\tcpu_sec\tgain"
+	for PIPELINE in ${PIPELINES};do
+		BASE=""
+		for ENGINE in ${BENCH_IO_ENGINES};do
+			LINE=$(BENCH_TOOL_ARGS="${BENCH_TOOL_ARGS} --io-engine ${ENGINE}" \
+				pipeline "${PIPELINE}") || return 1
+			RATE=$(echo "${LINE}" | cut -f4)
+			[ -n "${BASE}" ] || BASE="${RATE}"
+			echo "${LINE}" | awk -v e="${ENGINE}" -v b="${BASE}" -F '\t' '{
+				printf "%s\t%s\t%s\t%.3f\t%.3f\t%.3f\n",
+					e, $1, $4, $3 / 1e9, $5 + $6, $4 / b
+			}'
+		done
+	done
+}
+
+MODE=pipelines
+if [ "$1" = "--flavors" ];then
+	MODE=flavors
+	shift
+elif [ "$1" = "--io-engines" ];then
+	MODE=io_engines
+	PIPELINES="${BATCH_PIPELINES}"
+	shift
+fi
+
+if [ $# -gt 0 ];then
+	PIPELINES="$*"
+fi
+
+if [ "${MODE}" = "flavors" ];then
+	flavors
+	exit $?
+fi
+if [ "${MODE}" = "io_engines" ];then
+	io_engines
+	exit $?
+fi
+
+echo -e "# pipeline\trecords\twall_ns\trecords_per_sec\tuser_sec\tsys_sec\tmax_rss_kb"
+for PIPELINE in ${PIPELINES};do
+	pipeline "${PIPELINE}" || exit 1
+done
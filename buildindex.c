@@ -0,0 +1,368 @@
+/*
+Index build mode: read a list of Base58Check addresses, one per line, and
+write the sorted, deduplicated index of their hashes (see index.h).  Update
+mode reads the same with each line starting '+' (or with neither, for the
+same list) to add the address or '-' to remove it, and writes a delta.
+Once merging the deltas into the index is due, that is left to a process
+forked to do it in the background, so an update takes time in proportion
+to its size rather than the index's.  A match set is loaded from the same
+list, sorted the same way to count and deduplicate it, then scanned into a
+hash set (see hashset.h).
+
+Lines are read by this thread, a chunk at a time, through the batch I/O
+engine (so compressed lists are read too), and each chunk is decoded and
+added to the builder by options.threads threads.  The builder spills
+sorted runs to temporary files once options.index_memory is used, so lists
+far larger than memory can be indexed.
+*/
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "applog.h"
+#include "index.h"
+#include "hashset.h"
+#include "records.h"
+#include "result.h"
+#include "tool.h"
+
+/* lines read and decoded at a time */
+#define BITCOIN_TOOL_INDEX_LINES 65536
+
+/* a background compaction logs to <file>.compact.log */
+#define BITCOIN_TOOL_COMPACT_LOG_SUFFIX ".compact.log"
+
+static struct BitcoinIndexBuilder *BitcoinTool_createIndexBuilder(
+	BitcoinTool *self, unsigned share
+)
+{
+	const BitcoinToolOptions *o = &self->options;
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	return BitcoinIndexBuilder_create(
+		o->threads ? o->threads : cpus > 0 ? (unsigned)cpus : 1,
+		((size_t)(o->index_memory ? o->index_memory
+			: BITCOINTOOL_OPTION_DEFAULT_INDEX_MEMORY) << 20) / share
+	);
+}
+
+/* Read the addresses in a file into builders: all of them into added, or
+   if removed isn't NULL, those on lines starting '-' into removed and the
+   others, with any '+' skipped, into added */
+static int BitcoinTool_readIndexInput(BitcoinTool *self, const char *filename,
+	enum BitcoinCompression compression, struct BitcoinIndexBuilder *added,
+	struct BitcoinIndexBuilder *removed, unsigned long long *read
+)
+{
+	const BitcoinToolOptions *o = &self->options;
+	char (*lines)[BITCOIN_RECORD_TEXT_SIZE] = NULL;
+	const char **texts = NULL;
+	size_t *positions = NULL;
+	BitcoinResult *results = NULL;
+	unsigned long long line = 0;
+	FILE *input = NULL;
+	int success = 1;
+	size_t count, i;
+
+	lines = malloc(BITCOIN_TOOL_INDEX_LINES * sizeof(*lines));
+	texts = malloc(BITCOIN_TOOL_INDEX_LINES * sizeof(*texts));
+	positions = malloc(BITCOIN_TOOL_INDEX_LINES * sizeof(*positions));
+	results = malloc(BITCOIN_TOOL_INDEX_LINES * sizeof(*results));
+	if (!lines || !texts || !positions || !results) {
+		applog(APPLOG_ERROR, __func__, "Failed to allocate input buffers.");
+		success = 0;
+	}
+
+	if (success) {
+		input = BitcoinIO_OpenInput(filename, 0,
+			BitcoinIO_SelectEngine(o->io_engine), compression
+		);
+		if (!input) {
+			applog(APPLOG_ERROR, __func__, "Failed to open file [%s] (%s)",
+				filename, strerror(errno)
+			);
+			success = 0;
+		}
+	}
+
+	*read = 0;
+	while (success && !feof(input)) {
+		int removing;
+
+		for (count = 0; count < BITCOIN_TOOL_INDEX_LINES; count++) {
+			size_t size;
+
+			if (!fgets(lines[count], sizeof(lines[count]) - 1, input)) {
+				if (ferror(input)) {
+					applog(APPLOG_ERROR, __func__, "Failed to read file [%s] (%s)",
+						filename, strerror(errno)
+					);
+					success = 0;
+				}
+				break;
+			}
+			size = strlen(lines[count]);
+			if (size > 0 && lines[count][size - 1] == '\n') {
+				lines[count][size - 1] = '\0';
+			}
+		}
+		if (!success || !count) {
+			break;
+		}
+
+		/* the chunk's additions, then its removals */
+		for (removing = 0; success && removing <= (removed != NULL); removing++) {
+			struct BitcoinIndexBuilder *builder = removing ? removed : added;
+			size_t selected = 0;
+
+			for (i = 0; i < count; i++) {
+				const char *text = lines[i];
+
+				if (removed) {
+					if ((*text == '-') != removing) {
+						continue;
+					}
+					if (*text == '-' || *text == '+') {
+						text++;
+					}
+				}
+				texts[selected] = text;
+				positions[selected++] = i;
+			}
+
+			i = BitcoinIndexBuilder_AddAddresses(builder, texts,
+				o->network_type, selected, results
+			);
+			if (i == (size_t)-1) {
+				success = 0;
+				break;
+			}
+			*read += i;
+
+			for (i = 0; i < selected; i++) {
+				if (results[i] == BITCOIN_SUCCESS) {
+					continue;
+				}
+				applog(APPLOG_ERROR, __func__, "Invalid address on line %llu [%s] (%s)",
+					line + positions[i] + 1, lines[positions[i]],
+					Bitcoin_ResultString(results[i])
+				);
+				if (!o->ignore_input_errors) {
+					success = 0;
+					break;
+				}
+			}
+		}
+		line += count;
+	}
+
+	if (input) {
+		fclose(input);
+	}
+	free(results);
+	free(positions);
+	free(texts);
+	free(lines);
+
+	return success;
+}
+
+int BitcoinTool_buildIndex(BitcoinTool *self)
+{
+	struct BitcoinIndexBuilder *builder;
+	unsigned long long added = 0;
+	uint64_t unique = 0;
+	int success;
+
+	builder = BitcoinTool_createIndexBuilder(self, 1);
+	if (!builder) {
+		return 0;
+	}
+
+	success = BitcoinTool_readIndexInput(self, self->options.input_file,
+		self->options.input_compression, builder, NULL, &added
+	);
+	if (success) {
+		success = BitcoinIndexBuilder_Finish(builder, self->options.build_index,
+			&unique
+		) == BITCOIN_SUCCESS;
+	}
+	if (success) {
+		applog(APPLOG_NOTICE, __func__,
+			"Indexed %llu addresses, %llu distinct hashes, into [%s]",
+			added, (unsigned long long)unique, self->options.build_index
+		);
+	}
+
+	BitcoinIndexBuilder_destroy(builder);
+
+	return success;
+}
+
+/* Fork a process to merge the deltas of an index into it, detached from
+   this one, which goes on without waiting for it.  The process takes the
+   index's lock, so it waits for this update to finish first, and logs to
+   <file>.compact.log. */
+static void BitcoinTool_compactInBackground(const char *filename)
+{
+	char *log_name;
+	pid_t pid;
+	int null, log;
+
+	/* nothing buffered is written twice */
+	fflush(NULL);
+	pid = fork();
+	if (pid < 0) {
+		applog(APPLOG_WARNING, __func__,
+			"Failed to start compacting [%s] (%s), run --compact-index",
+			filename, strerror(errno)
+		);
+		return;
+	}
+	if (pid > 0) {
+		applog(APPLOG_NOTICE, __func__,
+			"Compacting [%s] in the background, process %ld", filename,
+			(long)pid
+		);
+		return;
+	}
+
+	/* none of the caller's descriptors are kept open, so a caller reading
+	   this process's output or errors doesn't wait for the compaction */
+	setsid();
+	null = open("/dev/null", O_RDWR);
+	log_name = malloc(strlen(filename) + sizeof(BITCOIN_TOOL_COMPACT_LOG_SUFFIX));
+	log = -1;
+	if (log_name) {
+		sprintf(log_name, "%s%s", filename, BITCOIN_TOOL_COMPACT_LOG_SUFFIX);
+		log = open(log_name, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+		free(log_name);
+	}
+	if (null >= 0) {
+		dup2(null, STDIN_FILENO);
+		dup2(null, STDOUT_FILENO);
+	}
+	if (log >= 0 || null >= 0) {
+		dup2(log >= 0 ? log : null, STDERR_FILENO);
+	}
+	if (null > STDERR_FILENO) {
+		close(null);
+	}
+	if (log > STDERR_FILENO) {
+		close(log);
+	}
+	_exit(BitcoinIndex_Compact(filename) == BITCOIN_SUCCESS ? 0 : 1);
+}
+
+int BitcoinTool_updateIndex(BitcoinTool *self)
+{
+	struct BitcoinIndexBuilder *added, *removed = NULL;
+	unsigned long long read = 0;
+	uint64_t added_count = 0, removed_count = 0;
+	int success, compaction_due = 0;
+
+	/* the memory is shared between the two */
+	added = BitcoinTool_createIndexBuilder(self, 2);
+	if (added) {
+		removed = BitcoinTool_createIndexBuilder(self, 2);
+	}
+	success = added && removed;
+
+	if (success) {
+		success = BitcoinTool_readIndexInput(self, self->options.input_file,
+			self->options.input_compression, added, removed, &read
+		);
+	}
+	if (success) {
+		success = BitcoinIndex_Update(self->options.update_index, added,
+			removed, &added_count, &removed_count, &compaction_due
+		) == BITCOIN_SUCCESS;
+	}
+	if (success) {
+		applog(APPLOG_NOTICE, __func__,
+			"Read %llu addresses, added %llu distinct hashes and removed %llu,"
+			" in [%s]", read, (unsigned long long)added_count,
+			(unsigned long long)removed_count, self->options.update_index
+		);
+	}
+
+	BitcoinIndexBuilder_destroy(removed);
+	BitcoinIndexBuilder_destroy(added);
+
+	/* after the builders are freed, so the process doesn't keep their
+	   memory */
+	if (success && compaction_due) {
+		BitcoinTool_compactInBackground(self->options.update_index);
+	}
+
+	return success;
+}
+
+int BitcoinTool_compactIndex(BitcoinTool *self)
+{
+	if (BitcoinIndex_Compact(self->options.compact_index) != BITCOIN_SUCCESS) {
+		return 0;
+	}
+	applog(APPLOG_NOTICE, __func__, "Compacted [%s]",
+		self->options.compact_index
+	);
+	return 1;
+}
+
+static void BitcoinTool_addToMatchSet(void *arg, const struct BitcoinRIPEMD160 *hash)
+{
+	BitcoinHashSet_Add((struct BitcoinHashSet *)arg, hash);
+}
+
+struct BitcoinHashSet *BitcoinTool_loadMatchSet(BitcoinTool *self)
+{
+	const char *filename = self->options.match_set;
+	struct BitcoinIndexBuilder *builder;
+	struct BitcoinHashSet *set = NULL;
+	unsigned long long read = 0;
+	uint64_t bound = 0, unique = 0, huge_bytes = 0;
+	enum BitcoinHugePageBacking backing;
+	int success;
+
+	builder = BitcoinTool_createIndexBuilder(self, 1);
+	if (!builder) {
+		return NULL;
+	}
+
+	/* the input's compression is the keys', so the list's is detected */
+	success = BitcoinTool_readIndexInput(self, filename,
+		BITCOIN_COMPRESSION_AUTO, builder, NULL, &read
+	) && BitcoinIndexBuilder_Prepare(builder, &bound) == BITCOIN_SUCCESS;
+	if (success) {
+		set = BitcoinHashSet_create(bound);
+		success = set != NULL;
+	}
+	if (success) {
+		success = BitcoinIndexBuilder_Scan(builder, BitcoinTool_addToMatchSet,
+			set, &unique
+		) == BITCOIN_SUCCESS;
+	}
+	BitcoinIndexBuilder_destroy(builder);
+
+	if (!success) {
+		BitcoinHashSet_destroy(set);
+		return NULL;
+	}
+
+	backing = BitcoinHashSet_GetBacking(set, &huge_bytes);
+	applog(APPLOG_INFO, __func__,
+		"Loaded %llu addresses, %llu distinct hashes, from [%s] into a %.1f MiB"
+		" set (%s tags, huge pages: %s, %.1f MiB)", read,
+		(unsigned long long)unique, filename,
+		BitcoinHashSet_GetMemorySize(set) / 1048576.0,
+		BitcoinHashSet_GetKernelName(), BitcoinHugePage_GetBackingName(backing),
+		huge_bytes / 1048576.0
+	);
+	return set;
+}
@@ -0,0 +1,225 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+
+#include "cache.h"
+#include "applog.h"
+
+/* no entry, in bucket chains and the recently used list */
+#define BITCOIN_CACHE_NONE ((uint32_t)-1)
+
+struct BitcoinCacheEntry {
+	struct BitcoinCacheValue value;
+
+	unsigned char key[BITCOIN_CACHE_KEY_MAX_SIZE];
+	uint8_t key_size;
+
+	/* next entry in the same bucket */
+	uint32_t next;
+
+	/* neighbours in the list of entries, from most to least recently
+	   used */
+	uint32_t newer, older;
+};
+
+struct BitcoinCache {
+	struct BitcoinCacheEntry *entries;
+	uint32_t capacity, used;
+
+	/* first entry of each bucket, bucket_mask + 1 of them */
+	uint32_t *buckets;
+	uint32_t bucket_mask;
+
+	/* ends of the recently used list */
+	uint32_t newest, oldest;
+};
+
+/* FNV-1a: keys are mostly random bytes already, so this just needs to
+   spread them over the buckets */
+static uint32_t BitcoinCache_hash(const unsigned char *key, size_t key_size)
+{
+	uint32_t hash = 2166136261u;
+	size_t i;
+
+	for (i = 0; i < key_size; i++) {
+		hash = (hash ^ key[i]) * 16777619u;
+	}
+	return hash;
+}
+
+struct BitcoinCache *BitcoinCache_create(size_t entries)
+{
+	struct BitcoinCache *self;
+	size_t buckets = 1;
+
+	assert(entries > 0 && entries <= BITCOIN_CACHE_MAX_ENTRIES);
+
+	/* about one entry per bucket when full */
+	while (buckets < entries) {
+		buckets <<= 1;
+	}
+
+	self = calloc(1, sizeof(*self));
+	if (self) {
+		self->entries = calloc(entries, sizeof(*self->entries));
+		self->buckets = malloc(buckets * sizeof(*self->buckets));
+	}
+	if (!self || !self->entries || !self->buckets) {
+		applog(APPLOG_ERROR, __func__, "Failed to allocate cache of %lu entries.",
+			(unsigned long)entries
+		);
+		if (self) {
+			free(self->entries);
+			free(self->buckets);
+			free(self);
+		}
+		return NULL;
+	}
+
+	memset(self->buckets, 0xff, buckets * sizeof(*self->buckets));
+	self->capacity = (uint32_t)entries;
+	self->bucket_mask = (uint32_t)(buckets - 1);
+	self->newest = self->oldest = BITCOIN_CACHE_NONE;
+
+	return self;
+}
+
+void BitcoinCache_destroy(struct BitcoinCache *self)
+{
+	if (!self) {
+		return;
+	}
+	memset(self->entries, 0, self->capacity * sizeof(*self->entries));
+	free(self->entries);
+	free(self->buckets);
+	memset(self, 0, sizeof(*self));
+	free(self);
+}
+
+/* Take an entry out of the recently used list */
+static void BitcoinCache_unlink(struct BitcoinCache *self, uint32_t index)
+{
+	struct BitcoinCacheEntry *entry = &self->entries[index];
+
+	if (entry->newer != BITCOIN_CACHE_NONE) {
+		self->entries[entry->newer].older = entry->older;
+	} else {
+		self->newest = entry->older;
+	}
+	if (entry->older != BITCOIN_CACHE_NONE) {
+		self->entries[entry->older].newer = entry->newer;
+	} else {
+		self->oldest = entry->newer;
+	}
+}
+
+/* Put an entry at the most recently used end of the list */
+static void BitcoinCache_pushNewest(struct BitcoinCache *self, uint32_t index)
+{
+	struct BitcoinCacheEntry *entry = &self->entries[index];
+
+	entry->newer = BITCOIN_CACHE_NONE;
+	entry->older = self->newest;
+	if (self->newest != BITCOIN_CACHE_NONE) {
+		self->entries[self->newest].newer = index;
+	} else {
+		self->oldest = index;
+	}
+	self->newest = index;
+}
+
+/* Find the entry of a key in its bucket, and make it the most recently
+   used */
+static struct BitcoinCacheEntry *BitcoinCache_find(struct BitcoinCache *self,
+	uint32_t bucket, const unsigned char *key, size_t key_size
+)
+{
+	uint32_t index = self->buckets[bucket];
+
+	while (index != BITCOIN_CACHE_NONE) {
+		struct BitcoinCacheEntry *entry = &self->entries[index];
+
+		if (entry->key_size == key_size && !memcmp(entry->key, key, key_size)) {
+			if (self->newest != index) {
+				BitcoinCache_unlink(self, index);
+				BitcoinCache_pushNewest(self, index);
+			}
+			return entry;
+		}
+		index = entry->next;
+	}
+
+	return NULL;
+}
+
+const struct BitcoinCacheValue *BitcoinCache_Get(struct BitcoinCache *self,
+	const unsigned char *key, size_t key_size
+)
+{
+	struct BitcoinCacheEntry *entry = BitcoinCache_find(self,
+		BitcoinCache_hash(key, key_size) & self->bucket_mask, key, key_size
+	);
+
+	return entry ? &entry->value : NULL;
+}
+
+/* Evict the least recently used entry, wiping it, and return its index */
+static uint32_t BitcoinCache_evict(struct BitcoinCache *self)
+{
+	uint32_t index = self->oldest;
+	struct BitcoinCacheEntry *entry = &self->entries[index];
+	uint32_t *link;
+
+	link = &self->buckets[
+		BitcoinCache_hash(entry->key, entry->key_size) & self->bucket_mask
+	];
+	while (*link != index) {
+		assert(*link != BITCOIN_CACHE_NONE);
+		link = &self->entries[*link].next;
+	}
+	*link = entry->next;
+
+	BitcoinCache_unlink(self, index);
+	memset(entry, 0, sizeof(*entry));
+
+	return index;
+}
+
+int BitcoinCache_Put(struct BitcoinCache *self, const unsigned char *key,
+	size_t key_size, const struct BitcoinCacheValue *value
+)
+{
+	const uint32_t bucket = BitcoinCache_hash(key, key_size) & self->bucket_mask;
+	struct BitcoinCacheEntry *entry;
+	uint32_t index;
+	int evicted = 0;
+
+	assert(key_size <= BITCOIN_CACHE_KEY_MAX_SIZE);
+
+	/* eg: a key repeated within a batch, missed by each lookup */
+	entry = BitcoinCache_find(self, bucket, key, key_size);
+	if (entry) {
+		entry->value = *value;
+		return 0;
+	}
+
+	if (self->used < self->capacity) {
+		index = self->used++;
+	} else {
+		index = BitcoinCache_evict(self);
+		evicted = 1;
+	}
+
+	entry = &self->entries[index];
+	entry->value = *value;
+	memcpy(entry->key, key, key_size);
+	entry->key_size = (uint8_t)key_size;
+
+	entry->next = self->buckets[bucket];
+	self->buckets[bucket] = index;
+
+	BitcoinCache_pushNewest(self, index);
+
+	return evicted;
+}
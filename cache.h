@@ -0,0 +1,69 @@
+#ifndef BITCOIN_INCLUDE_CACHE_H
+#define BITCOIN_INCLUDE_CACHE_H
+
+/** @file cache.h
+ *  @brief Bounded least-recently-used cache of derived keys.
+ *
+ *  Inputs which repeat (the same private key or public key converted again
+ *  and again) skip deriving the public key and hashing it, by keeping what
+ *  was derived from the most recent inputs.  When the cache is full the
+ *  least recently used entry is evicted, and wiped, since the key of an
+ *  entry may be a private key.  A cache must not be used by more than one
+ *  thread at the same time: each thread converting keys owns its own.
+ */
+
+#include <stddef.h> /* size_t */
+
+#include "keys.h"
+
+/* largest key of an entry: a tag byte and an uncompressed public key */
+#define BITCOIN_CACHE_KEY_MAX_SIZE (1 + BITCOIN_PUBLIC_KEY_MAX_SIZE)
+
+/* most entries a cache can have */
+#define BITCOIN_CACHE_MAX_ENTRIES (16 * 1024 * 1024)
+
+/* what was derived from a key */
+struct BitcoinCacheValue {
+	/* which of the fields below are set, as BITCOIN_RECORD_* flags */
+	unsigned flags;
+
+	struct BitcoinPublicKey public_key;
+	struct BitcoinSHA256 public_key_sha256;
+	struct BitcoinRIPEMD160 public_key_ripemd160;
+
+	/* the address, for the network it was made for */
+	struct BitcoinAddress address;
+	const struct BitcoinNetworkType *address_network_type;
+};
+
+struct BitcoinCache;
+
+/** @brief Allocate a cache of up to entries entries.
+ *
+ *  @return Pointer to cache, or NULL if failure.
+ */
+struct BitcoinCache *BitcoinCache_create(size_t entries);
+
+/** @brief Wipe and free a cache. */
+void BitcoinCache_destroy(struct BitcoinCache *self);
+
+/** @brief Look up a key, and make it the most recently used if found.
+ *
+ *  @return The value stored for the key, valid until the next
+ *          BitcoinCache_Put(), or NULL if the key is not cached.
+ */
+const struct BitcoinCacheValue *BitcoinCache_Get(struct BitcoinCache *self,
+	const unsigned char *key, size_t key_size
+);
+
+/** @brief Store the value for a key as the most recently used, replacing
+ *         the value if the key is cached already, or else evicting the
+ *         least recently used entry if the cache is full.
+ *
+ *  @return 1 if an entry was evicted, otherwise 0.
+ */
+int BitcoinCache_Put(struct BitcoinCache *self, const unsigned char *key,
+	size_t key_size, const struct BitcoinCacheValue *value
+);
+
+#endif
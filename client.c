@@ -0,0 +1,382 @@
+/*
+Client for bitcoin-tool --serve.
+
+Sends each line of stdin as a request and writes each reply to stdout as a
+line, with requests pipelined (sent without waiting for replies).  With
+--latency, sends the first line of stdin repeatedly, one request at a time,
+and reports the distribution of round trip times.
+*/
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "applog.h"
+
+#define CLIENT_BUFFER_SIZE 65536
+#define CLIENT_MAX_REQUEST_SIZE 255
+
+/* binary protocol framing, see serve.c */
+#define CLIENT_REQUEST_HEADER_SIZE 2
+#define CLIENT_REPLY_HEADER_SIZE 3
+
+struct ClientBuffer {
+	char data[CLIENT_BUFFER_SIZE];
+	size_t start, end;
+};
+
+static double Client_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void Client_help(void)
+{
+	fprintf(stderr,
+		"Usage: bitcoin-tool-client --socket <path> [options] < requests\n"
+		"\n"
+		"Sends each line of stdin to a bitcoin-tool --serve server, and writes\n"
+		"each reply to stdout.\n"
+		"\n"
+		"  --socket <path>       : Socket the server is listening on\n"
+		"  --protocol <protocol> : line (default) or binary, must match the\n"
+		"                          server's --serve-protocol\n"
+		"  --latency <requests>  : Send the first line of stdin this many times,\n"
+		"                          waiting for each reply, and report round trip\n"
+		"                          times as tab-separated values\n"
+	);
+}
+
+static int Client_connect(const char *path)
+{
+	struct sockaddr_un address;
+	int fd;
+
+	if (strlen(path) >= sizeof(address.sun_path)) {
+		applog(APPLOG_ERROR, __func__, "Socket path too long [%s]", path);
+		return -1;
+	}
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		applog(APPLOG_ERROR, __func__, "socket failed (%s)", strerror(errno));
+		return -1;
+	}
+
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, path);
+
+	if (connect(fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
+		applog(APPLOG_ERROR, __func__, "Failed to connect to [%s] (%s)",
+			path, strerror(errno)
+		);
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+/* Append one request to a buffer, which must have room for it.
+   Returns 0 if the request is too large. */
+static int Client_appendRequest(struct ClientBuffer *b, int binary,
+	const char *line, size_t size
+)
+{
+	char *out = b->data + b->end;
+
+	if (size > CLIENT_MAX_REQUEST_SIZE) {
+		applog(APPLOG_ERROR, __func__, "Request too large (%u bytes)", (unsigned)size);
+		return 0;
+	}
+	if (binary) {
+		out[0] = (char)(size >> 8);
+		out[1] = (char)size;
+		memcpy(out + CLIENT_REQUEST_HEADER_SIZE, line, size);
+		b->end += CLIENT_REQUEST_HEADER_SIZE + size;
+	} else {
+		memcpy(out, line, size);
+		out[size] = '\n';
+		b->end += size + 1;
+	}
+	return 1;
+}
+
+/* Write out each complete reply in the buffer as a line, and return the
+   number of replies written. */
+static unsigned long Client_writeReplies(struct ClientBuffer *b, int binary, FILE *file)
+{
+	unsigned long replies = 0;
+
+	for (;;) {
+		const char *start = b->data + b->start;
+		const size_t available = b->end - b->start;
+
+		if (binary) {
+			size_t size;
+			if (available < CLIENT_REPLY_HEADER_SIZE) {
+				break;
+			}
+			size = ((size_t)(unsigned char)start[1] << 8) | (unsigned char)start[2];
+			if (available < CLIENT_REPLY_HEADER_SIZE + size) {
+				break;
+			}
+			if (file) {
+				if (start[0]) {
+					fputs("error: ", file);
+				}
+				fwrite(start + CLIENT_REPLY_HEADER_SIZE, 1, size, file);
+				fputc('\n', file);
+			}
+			b->start += CLIENT_REPLY_HEADER_SIZE + size;
+		} else {
+			const char *newline = memchr(start, '\n', available);
+			if (!newline) {
+				break;
+			}
+			if (file) {
+				fwrite(start, 1, newline + 1 - start, file);
+			}
+			b->start += newline + 1 - start;
+		}
+		replies++;
+	}
+
+	memmove(b->data, b->data + b->start, b->end - b->start);
+	b->end -= b->start;
+	b->start = 0;
+
+	return replies;
+}
+
+static size_t Client_chomp(char *line)
+{
+	size_t size = strlen(line);
+	if (size && line[size - 1] == '\n') {
+		line[--size] = '\0';
+	}
+	return size;
+}
+
+/* Send every line of stdin, reading replies as they arrive so that neither
+   side blocks with a full socket buffer. */
+static int Client_pipeline(int fd, int binary)
+{
+	static struct ClientBuffer requests, replies;
+	char line[CLIENT_MAX_REQUEST_SIZE + 2];
+	int input_done = 0, write_done = 0;
+
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+	for (;;) {
+		struct pollfd p;
+
+		/* refill the request buffer once it has been sent */
+		if (requests.start == requests.end && !input_done) {
+			requests.start = requests.end = 0;
+			while (requests.end + sizeof(line) + CLIENT_REQUEST_HEADER_SIZE < sizeof(requests.data)) {
+				if (!fgets(line, sizeof(line), stdin)) {
+					input_done = 1;
+					break;
+				}
+				if (!Client_appendRequest(&requests, binary, line, Client_chomp(line))) {
+					return 0;
+				}
+			}
+		}
+		if (requests.start == requests.end && input_done && !write_done) {
+			shutdown(fd, SHUT_WR);
+			write_done = 1;
+		}
+
+		p.fd = fd;
+		p.events = POLLIN | (requests.start < requests.end ? POLLOUT : 0);
+		if (poll(&p, 1, -1) < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			applog(APPLOG_ERROR, __func__, "poll failed (%s)", strerror(errno));
+			return 0;
+		}
+
+		if (p.revents & POLLOUT) {
+			ssize_t n = write(fd, requests.data + requests.start,
+				requests.end - requests.start
+			);
+			if (n < 0 && errno != EAGAIN && errno != EINTR) {
+				applog(APPLOG_ERROR, __func__, "write failed (%s)", strerror(errno));
+				return 0;
+			}
+			if (n > 0) {
+				requests.start += n;
+			}
+		}
+
+		if (p.revents & (POLLIN | POLLHUP | POLLERR)) {
+			ssize_t n = read(fd, replies.data + replies.end,
+				sizeof(replies.data) - replies.end
+			);
+			if (n == 0) {
+				break;
+			}
+			if (n < 0) {
+				if (errno == EAGAIN || errno == EINTR) {
+					continue;
+				}
+				applog(APPLOG_ERROR, __func__, "read failed (%s)", strerror(errno));
+				return 0;
+			}
+			replies.end += n;
+			Client_writeReplies(&replies, binary, stdout);
+		}
+	}
+
+	return 1;
+}
+
+static int Client_compareTimes(const void *a, const void *b)
+{
+	const double x = *(const double *)a, y = *(const double *)b;
+	return x < y ? -1 : x > y;
+}
+
+/* Send one request at a time and report round trip times. */
+static int Client_latency(int fd, int binary, unsigned long count)
+{
+	static struct ClientBuffer request, replies;
+	char line[CLIENT_MAX_REQUEST_SIZE + 2];
+	double *times, start, total;
+	unsigned long i;
+
+	if (!fgets(line, sizeof(line), stdin)) {
+		applog(APPLOG_ERROR, __func__, "No request on stdin.");
+		return 0;
+	}
+	if (!Client_appendRequest(&request, binary, line, Client_chomp(line))) {
+		return 0;
+	}
+
+	times = calloc(count, sizeof(*times));
+	if (!times) {
+		applog(APPLOG_ERROR, __func__, "Failed to allocate %lu times.", count);
+		return 0;
+	}
+
+	start = Client_now();
+	for (i = 0; i < count; i++) {
+		const double request_start = Client_now();
+		size_t written = 0;
+
+		while (written < request.end) {
+			ssize_t n = write(fd, request.data + written, request.end - written);
+			if (n < 0 && errno != EINTR) {
+				applog(APPLOG_ERROR, __func__, "write failed (%s)", strerror(errno));
+				free(times);
+				return 0;
+			}
+			if (n > 0) {
+				written += n;
+			}
+		}
+
+		while (!Client_writeReplies(&replies, binary, NULL)) {
+			ssize_t n = read(fd, replies.data + replies.end,
+				sizeof(replies.data) - replies.end
+			);
+			if (n <= 0 && !(n < 0 && errno == EINTR)) {
+				applog(APPLOG_ERROR, __func__, "Connection closed by server.");
+				free(times);
+				return 0;
+			}
+			if (n > 0) {
+				replies.end += n;
+			}
+		}
+
+		times[i] = Client_now() - request_start;
+	}
+	total = Client_now() - start;
+
+	qsort(times, count, sizeof(*times), Client_compareTimes);
+
+	printf("# requests\twall_ns\trequests_per_sec\tmean_us\tp50_us\tp99_us\tmax_us\n");
+	printf("%lu\t%.0f\t%.2f\t%.2f\t%.2f\t%.2f\t%.2f\n",
+		count,
+		total,
+		count / (total / 1e9),
+		total / count / 1e3,
+		times[count / 2] / 1e3,
+		times[(count * 99) / 100 < count ? (count * 99) / 100 : count - 1] / 1e3,
+		times[count - 1] / 1e3
+	);
+
+	free(times);
+	return 1;
+}
+
+int main(int argc, char *argv[])
+{
+	const char *socket_path = NULL;
+	unsigned long latency = 0;
+	int binary = 0;
+	int fd, success;
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		const char *a = argv[i];
+		if (!strcmp(a, "--socket") && i + 1 < argc) {
+			socket_path = argv[++i];
+		} else if (!strcmp(a, "--protocol") && i + 1 < argc) {
+			const char *v = argv[++i];
+			if (!strcmp(v, "binary")) {
+				binary = 1;
+			} else if (strcmp(v, "line")) {
+				applog(APPLOG_ERROR, __func__,
+					"Unknown protocol \"%s\", must be one of: line, binary", v
+				);
+				return EXIT_FAILURE;
+			}
+		} else if (!strcmp(a, "--latency") && i + 1 < argc) {
+			latency = strtoul(argv[++i], NULL, 0);
+		} else if (!strcmp(a, "--help")) {
+			Client_help();
+			return EXIT_SUCCESS;
+		} else {
+			applog(APPLOG_ERROR, __func__, "unknown option \"%s\"", a);
+			Client_help();
+			return EXIT_FAILURE;
+		}
+	}
+
+	if (!socket_path) {
+		applog(APPLOG_ERROR, __func__, "--socket must be specified.");
+		return EXIT_FAILURE;
+	}
+
+	fd = Client_connect(socket_path);
+	if (fd < 0) {
+		return EXIT_FAILURE;
+	}
+
+	if (latency) {
+		success = Client_latency(fd, binary, latency);
+	} else {
+		success = Client_pipeline(fd, binary);
+	}
+	close(fd);
+
+	return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,418 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef BITCOIN_HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef BITCOIN_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "applog.h"
+#include "compress.h"
+
+/* compressed data read or written at a time */
+#define BITCOIN_COMPRESS_BUFFER_SIZE (256 * 1024)
+
+struct BitcoinCompress {
+	enum BitcoinCompression compression;
+	int encoding;
+	FILE *file;
+
+	/* decoding: compressed input, of which start to end is unused;
+	   encoding: compressed output */
+	unsigned char *buffer;
+	size_t start, end;
+
+	/* decoding: the file has ended, and whether the stream ended at the
+	   end of a gzip member or zstd frame */
+	int at_end, frame_complete;
+
+#ifdef BITCOIN_HAVE_ZLIB
+	z_stream zlib;
+	int zlib_ready;
+#endif
+#ifdef BITCOIN_HAVE_ZSTD
+	ZSTD_DCtx *zstd_decoder;
+	ZSTD_CCtx *zstd_encoder;
+#endif
+};
+
+int BitcoinCompress_Parse(const char *name, enum BitcoinCompression *compression)
+{
+	if (strcmp(name, "none") == 0) {
+		*compression = BITCOIN_COMPRESSION_NONE;
+	} else if (strcmp(name, "auto") == 0) {
+		*compression = BITCOIN_COMPRESSION_AUTO;
+	} else if (strcmp(name, "gzip") == 0) {
+		*compression = BITCOIN_COMPRESSION_GZIP;
+	} else if (strcmp(name, "zstd") == 0) {
+		*compression = BITCOIN_COMPRESSION_ZSTD;
+	} else {
+		return 0;
+	}
+	return 1;
+}
+
+const char *BitcoinCompress_GetName(enum BitcoinCompression compression)
+{
+	switch (compression) {
+		case BITCOIN_COMPRESSION_NONE : return "none";
+		case BITCOIN_COMPRESSION_AUTO : return "auto";
+		case BITCOIN_COMPRESSION_GZIP : return "gzip";
+		case BITCOIN_COMPRESSION_ZSTD : return "zstd";
+	}
+	return "unknown";
+}
+
+int BitcoinCompress_IsAvailable(enum BitcoinCompression compression)
+{
+	switch (compression) {
+		case BITCOIN_COMPRESSION_NONE :
+		case BITCOIN_COMPRESSION_AUTO :
+			return 1;
+		case BITCOIN_COMPRESSION_GZIP :
+#ifdef BITCOIN_HAVE_ZLIB
+			return 1;
+#else
+			return 0;
+#endif
+		case BITCOIN_COMPRESSION_ZSTD :
+#ifdef BITCOIN_HAVE_ZSTD
+			return 1;
+#else
+			return 0;
+#endif
+	}
+	return 0;
+}
+
+enum BitcoinCompression BitcoinCompress_Detect(int first_byte)
+{
+	switch (first_byte) {
+		case 0x1f : return BITCOIN_COMPRESSION_GZIP;
+		case 0x28 : return BITCOIN_COMPRESSION_ZSTD;
+	}
+	return BITCOIN_COMPRESSION_NONE;
+}
+
+static struct BitcoinCompress *BitcoinCompress_create(
+	enum BitcoinCompression compression, int encoding, FILE *file
+)
+{
+	struct BitcoinCompress *self;
+
+	if (!BitcoinCompress_IsAvailable(compression)
+		|| compression == BITCOIN_COMPRESSION_NONE
+		|| compression == BITCOIN_COMPRESSION_AUTO
+	) {
+		applog(APPLOG_ERROR, __func__,
+			"%s compression is not available in this build.",
+			BitcoinCompress_GetName(compression)
+		);
+		return NULL;
+	}
+
+	self = calloc(1, sizeof(*self));
+	if (!self) {
+		return NULL;
+	}
+	self->buffer = malloc(BITCOIN_COMPRESS_BUFFER_SIZE);
+	if (!self->buffer) {
+		free(self);
+		return NULL;
+	}
+	self->compression = compression;
+	self->encoding = encoding;
+	self->file = file;
+	self->frame_complete = 1;
+
+	return self;
+}
+
+struct BitcoinCompress *BitcoinCompress_createDecoder(
+	enum BitcoinCompression compression, FILE *file
+)
+{
+	struct BitcoinCompress *self = BitcoinCompress_create(compression, 0, file);
+
+	if (!self) {
+		return NULL;
+	}
+#ifdef BITCOIN_HAVE_ZLIB
+	if (compression == BITCOIN_COMPRESSION_GZIP) {
+		/* 16: gzip header and trailer */
+		self->zlib_ready = inflateInit2(&self->zlib, 15 + 16) == Z_OK;
+		if (!self->zlib_ready) {
+			BitcoinCompress_destroy(self);
+			return NULL;
+		}
+	}
+#endif
+#ifdef BITCOIN_HAVE_ZSTD
+	if (compression == BITCOIN_COMPRESSION_ZSTD) {
+		self->zstd_decoder = ZSTD_createDCtx();
+		if (!self->zstd_decoder) {
+			BitcoinCompress_destroy(self);
+			return NULL;
+		}
+	}
+#endif
+	return self;
+}
+
+struct BitcoinCompress *BitcoinCompress_createEncoder(
+	enum BitcoinCompression compression, int level, FILE *file
+)
+{
+	struct BitcoinCompress *self = BitcoinCompress_create(compression, 1, file);
+
+	if (!self) {
+		return NULL;
+	}
+#ifdef BITCOIN_HAVE_ZLIB
+	if (compression == BITCOIN_COMPRESSION_GZIP) {
+		self->zlib_ready = deflateInit2(&self->zlib,
+			level ? level : Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8,
+			Z_DEFAULT_STRATEGY
+		) == Z_OK;
+		if (!self->zlib_ready) {
+			applog(APPLOG_ERROR, __func__, "Invalid gzip compression level %d",
+				level
+			);
+			BitcoinCompress_destroy(self);
+			return NULL;
+		}
+	}
+#endif
+#ifdef BITCOIN_HAVE_ZSTD
+	if (compression == BITCOIN_COMPRESSION_ZSTD) {
+		self->zstd_encoder = ZSTD_createCCtx();
+		if (!self->zstd_encoder || ZSTD_isError(ZSTD_CCtx_setParameter(
+			self->zstd_encoder, ZSTD_c_compressionLevel, level
+		))) {
+			applog(APPLOG_ERROR, __func__, "Invalid zstd compression level %d",
+				level
+			);
+			BitcoinCompress_destroy(self);
+			return NULL;
+		}
+	}
+#endif
+	return self;
+}
+
+void BitcoinCompress_destroy(struct BitcoinCompress *self)
+{
+#ifdef BITCOIN_HAVE_ZLIB
+	if (self->zlib_ready) {
+		if (self->encoding) {
+			deflateEnd(&self->zlib);
+		} else {
+			inflateEnd(&self->zlib);
+		}
+	}
+#endif
+#ifdef BITCOIN_HAVE_ZSTD
+	if (self->zstd_decoder) {
+		ZSTD_freeDCtx(self->zstd_decoder);
+	}
+	if (self->zstd_encoder) {
+		ZSTD_freeCCtx(self->zstd_encoder);
+	}
+#endif
+	free(self->buffer);
+	free(self);
+}
+
+/* Decompress from the input buffer into data.  Returns 0 if success, or
+   EIO if the data is corrupt. */
+static int BitcoinCompress_decode(struct BitcoinCompress *self,
+	unsigned char *data, size_t size, size_t *bytes
+)
+{
+#ifdef BITCOIN_HAVE_ZLIB
+	if (self->compression == BITCOIN_COMPRESSION_GZIP) {
+		int result;
+
+		self->zlib.next_in = self->buffer + self->start;
+		self->zlib.avail_in = (uInt)(self->end - self->start);
+		self->zlib.next_out = data + *bytes;
+		self->zlib.avail_out = (uInt)(size - *bytes);
+		result = inflate(&self->zlib, Z_NO_FLUSH);
+		self->start = self->end - self->zlib.avail_in;
+		*bytes = size - self->zlib.avail_out;
+
+		if (result == Z_STREAM_END) {
+			/* the next member, if any, starts a new stream */
+			self->frame_complete = 1;
+			inflateReset(&self->zlib);
+		} else if (result == Z_OK || result == Z_BUF_ERROR) {
+			self->frame_complete = 0;
+		} else {
+			applog(APPLOG_ERROR, __func__, "Corrupt gzip input (%s)",
+				self->zlib.msg ? self->zlib.msg : "unknown error"
+			);
+			return EIO;
+		}
+	}
+#endif
+#ifdef BITCOIN_HAVE_ZSTD
+	if (self->compression == BITCOIN_COMPRESSION_ZSTD) {
+		ZSTD_inBuffer in;
+		ZSTD_outBuffer out;
+		size_t result;
+
+		in.src = self->buffer;
+		in.size = self->end;
+		in.pos = self->start;
+		out.dst = data;
+		out.size = size;
+		out.pos = *bytes;
+		result = ZSTD_decompressStream(self->zstd_decoder, &out, &in);
+		if (ZSTD_isError(result)) {
+			applog(APPLOG_ERROR, __func__, "Corrupt zstd input (%s)",
+				ZSTD_getErrorName(result)
+			);
+			return EIO;
+		}
+		self->start = in.pos;
+		*bytes = out.pos;
+		self->frame_complete = result == 0;
+	}
+#endif
+	return 0;
+}
+
+int BitcoinCompress_Read(struct BitcoinCompress *self, unsigned char *data,
+	size_t size, size_t *bytes
+)
+{
+	*bytes = 0;
+
+	while (*bytes < size) {
+		int error;
+
+		if (self->start == self->end) {
+			size_t got;
+
+			/* rather than waiting for more input */
+			if (*bytes) {
+				break;
+			}
+			if (self->at_end) {
+				if (!self->frame_complete) {
+					applog(APPLOG_ERROR, __func__, "%s input is truncated.",
+						BitcoinCompress_GetName(self->compression)
+					);
+					return EIO;
+				}
+				break;
+			}
+			got = fread(self->buffer, 1, BITCOIN_COMPRESS_BUFFER_SIZE, self->file);
+			if (got == 0) {
+				if (ferror(self->file)) {
+					return errno ? errno : EIO;
+				}
+				self->at_end = 1;
+				continue;
+			}
+			self->start = 0;
+			self->end = got;
+		}
+
+		error = BitcoinCompress_decode(self, data, size, bytes);
+		if (error) {
+			return error;
+		}
+	}
+	return 0;
+}
+
+#if defined(BITCOIN_HAVE_ZLIB) || defined(BITCOIN_HAVE_ZSTD)
+/* Write the compressed output buffer to the file */
+static int BitcoinCompress_flushBuffer(struct BitcoinCompress *self, size_t size)
+{
+	if (size && fwrite(self->buffer, 1, size, self->file) != size) {
+		return errno ? errno : EIO;
+	}
+	return 0;
+}
+#endif
+
+/* Compress data, or with finish, the end of the stream */
+static int BitcoinCompress_encode(struct BitcoinCompress *self,
+	const unsigned char *data, size_t size, int finish
+)
+{
+	int error = 0;
+
+#ifdef BITCOIN_HAVE_ZLIB
+	if (self->compression == BITCOIN_COMPRESSION_GZIP) {
+		int result;
+
+		self->zlib.next_in = (unsigned char *)data;
+		self->zlib.avail_in = (uInt)size;
+		do {
+			self->zlib.next_out = self->buffer;
+			self->zlib.avail_out = BITCOIN_COMPRESS_BUFFER_SIZE;
+			result = deflate(&self->zlib, finish ? Z_FINISH : Z_NO_FLUSH);
+			if (result == Z_STREAM_ERROR) {
+				return EIO;
+			}
+			error = BitcoinCompress_flushBuffer(self,
+				BITCOIN_COMPRESS_BUFFER_SIZE - self->zlib.avail_out
+			);
+		} while (!error && (self->zlib.avail_out == 0
+			|| self->zlib.avail_in > 0 || (finish && result != Z_STREAM_END)
+		));
+	}
+#endif
+#ifdef BITCOIN_HAVE_ZSTD
+	if (self->compression == BITCOIN_COMPRESSION_ZSTD) {
+		ZSTD_inBuffer in;
+		size_t remaining;
+
+		in.src = data;
+		in.size = size;
+		in.pos = 0;
+		do {
+			ZSTD_outBuffer out;
+
+			out.dst = self->buffer;
+			out.size = BITCOIN_COMPRESS_BUFFER_SIZE;
+			out.pos = 0;
+			remaining = ZSTD_compressStream2(self->zstd_encoder, &out, &in,
+				finish ? ZSTD_e_end : ZSTD_e_continue
+			);
+			if (ZSTD_isError(remaining)) {
+				applog(APPLOG_ERROR, __func__, "Failed to compress output (%s)",
+					ZSTD_getErrorName(remaining)
+				);
+				return EIO;
+			}
+			error = BitcoinCompress_flushBuffer(self, out.pos);
+		} while (!error && (in.pos < in.size || (finish && remaining)));
+	}
+#endif
+	return error;
+}
+
+int BitcoinCompress_Write(struct BitcoinCompress *self,
+	const unsigned char *data, size_t size
+)
+{
+	return size ? BitcoinCompress_encode(self, data, size, 0) : 0;
+}
+
+int BitcoinCompress_Finish(struct BitcoinCompress *self)
+{
+	int error = BitcoinCompress_encode(self, NULL, 0, 1);
+
+	if (!error && fflush(self->file)) {
+		error = errno ? errno : EIO;
+	}
+	return error;
+}
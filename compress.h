@@ -0,0 +1,94 @@
+#ifndef BITCOIN_INCLUDE_COMPRESS_H
+#define BITCOIN_INCLUDE_COMPRESS_H
+
+/** @file compress.h
+ *  @brief gzip and zstd streams for batch input and output.
+ *
+ *  A decoder reads compressed data from a stdio stream and returns it
+ *  decompressed, and an encoder compresses data and writes it to a stdio
+ *  stream.  Concatenated gzip members and zstd frames are read as one
+ *  stream.  Each format is only available if the library for it was found
+ *  when building (see the Makefile).
+ */
+
+#include <stdio.h>
+#include <stddef.h> /* size_t */
+
+enum BitcoinCompression {
+	/* input: whichever the start of the input says; output: none */
+	BITCOIN_COMPRESSION_AUTO,
+
+	BITCOIN_COMPRESSION_NONE,
+
+	BITCOIN_COMPRESSION_GZIP,
+	BITCOIN_COMPRESSION_ZSTD
+};
+
+struct BitcoinCompress;
+
+/** @brief Parse a compression name: none, auto, gzip or zstd.
+ *
+ *  @return 1 if success, 0 if the name is unknown.
+ */
+int BitcoinCompress_Parse(const char *name, enum BitcoinCompression *compression);
+
+/** @brief Get the name of a compression format, for messages. */
+const char *BitcoinCompress_GetName(enum BitcoinCompression compression);
+
+/** @brief Returns 1 if this build can read and write a format. */
+int BitcoinCompress_IsAvailable(enum BitcoinCompression compression);
+
+/** @brief Work out the format of a stream from its first byte, which is
+ *         never text for gzip (0x1f) and never hex, Base58 or a newline
+ *         for zstd (0x28, '(').
+ */
+enum BitcoinCompression BitcoinCompress_Detect(int first_byte);
+
+/** @brief Create a decoder reading compressed data from file.
+ *
+ *  @return Decoder, or NULL if failure.
+ */
+struct BitcoinCompress *BitcoinCompress_createDecoder(
+	enum BitcoinCompression compression, FILE *file
+);
+
+/** @brief Create an encoder writing compressed data to file.
+ *
+ *  @param[in] level Compression level, or 0 for the format's default.
+ *
+ *  @return Encoder, or NULL if failure.
+ */
+struct BitcoinCompress *BitcoinCompress_createEncoder(
+	enum BitcoinCompression compression, int level, FILE *file
+);
+
+/** @brief Free a decoder or encoder.  The file is not closed. */
+void BitcoinCompress_destroy(struct BitcoinCompress *self);
+
+/** @brief Decompress up to size bytes of the stream.  Blocks only if there
+ *         is nothing decompressed to return yet.
+ *
+ *  @param[out] bytes Bytes decompressed, 0 at the end of the stream.
+ *
+ *  @return 0 if success, or errno (EIO if the data is corrupt or ends in
+ *          the middle of a frame).
+ */
+int BitcoinCompress_Read(struct BitcoinCompress *self, unsigned char *data,
+	size_t size, size_t *bytes
+);
+
+/** @brief Compress data and write it to the file.
+ *
+ *  @return 0 if success, or errno.
+ */
+int BitcoinCompress_Write(struct BitcoinCompress *self,
+	const unsigned char *data, size_t size
+);
+
+/** @brief End the compressed stream, and flush the file.
+ *
+ *  @return 0 if success, or errno.
+ */
+int BitcoinCompress_Finish(struct BitcoinCompress *self);
+
+#endif
@@ -0,0 +1,75 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "context.h"
+#include "applog.h"
+#include "cpu.h"
+#include "secp256k1.h"
+
+struct BitcoinContext {
+	/* working memory for record arrays, wiped when the context is
+	   destroyed */
+	struct BitcoinArena *arena;
+	unsigned node; /* NUMA node of the thread using it */
+};
+
+struct BitcoinContext *BitcoinContext_create(void)
+{
+	struct BitcoinContext *context = calloc(1, sizeof(*context));
+
+	if (!context) {
+		applog(APPLOG_ERROR, __func__, "Failed to allocate context.");
+		return NULL;
+	}
+
+	context->arena = BitcoinArena_create(BITCOIN_CONTEXT_ARENA_SIZE);
+	if (!context->arena) {
+		free(context);
+		return NULL;
+	}
+
+	/* the kernels are normally selected before main(), but make sure of
+	   it before the first conversion */
+	BitcoinCPU_SelectKernels();
+
+	return context;
+}
+
+void BitcoinContext_destroy(struct BitcoinContext *context)
+{
+	if (!context) {
+		return;
+	}
+	BitcoinArena_destroy(context->arena);
+	memset(context, 0, sizeof(*context));
+	free(context);
+}
+
+struct BitcoinArena *BitcoinContext_GetArena(struct BitcoinContext *context)
+{
+	return context->arena;
+}
+
+void BitcoinContext_SetNode(struct BitcoinContext *context, unsigned node)
+{
+	context->node = node;
+	BitcoinArena_Bind(context->arena, node);
+}
+
+unsigned BitcoinContext_GetNode(const struct BitcoinContext *context)
+{
+	return context->node;
+}
+
+BitcoinResult BitcoinContext_MakePublicKey(struct BitcoinContext *context,
+	struct BitcoinPublicKey *public_key,
+	const struct BitcoinPrivateKey *private_key
+)
+{
+	BitcoinResult result = BITCOIN_ERROR;
+
+	BitcoinSecp256k1_MakePublicKeysOnNode(context->node, public_key,
+		private_key, 1, &result
+	);
+	return result;
+}
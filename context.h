@@ -0,0 +1,59 @@
+#ifndef BITCOIN_INCLUDE_CONTEXT_H
+#define BITCOIN_INCLUDE_CONTEXT_H
+
+/** @file context.h
+ *  @brief Reusable state for converting keys.
+ *
+ *  A context holds the state a thread needs for converting keys: an arena
+ *  of working memory for record arrays.  Public keys are derived with a
+ *  table compiled into the program (see secp256k1.h), so each thread can
+ *  use its own context without locking.  A context must not be used by
+ *  more than one thread at the same time.
+ */
+
+#include "arena.h"
+#include "keys.h"
+#include "result.h"
+
+/* size of a context's arena, only the pages used are touched */
+#define BITCOIN_CONTEXT_ARENA_SIZE (1024 * 1024)
+
+struct BitcoinContext;
+
+/** @brief Allocate a new context.
+ *
+ *  @return Pointer to context, or NULL if failure.
+ */
+struct BitcoinContext *BitcoinContext_create(void);
+
+/** @brief Free a context, and wipe any key material it holds. */
+void BitcoinContext_destroy(struct BitcoinContext *context);
+
+/** @brief Get the context's arena, for allocating working memory which
+ *         lives as long as the context.
+ */
+struct BitcoinArena *BitcoinContext_GetArena(struct BitcoinContext *context);
+
+/** @brief Set the NUMA node (see numa.h) the thread using a context runs
+ *         on: its arena is placed there, and conversions read the copy of
+ *         the secp256k1 tables there if there is one.
+ */
+void BitcoinContext_SetNode(struct BitcoinContext *context, unsigned node);
+
+/** @brief Get the NUMA node set for a context, 0 if none was. */
+unsigned BitcoinContext_GetNode(const struct BitcoinContext *context);
+
+/** @brief Convert a private key to a public key.  Same results as
+ *         Bitcoin_MakePublicKeyFromPrivateKey().
+ *
+ *  @param public_key[output] Pointer to public key to write.
+ *  @param private_key Pointer to private key to read.
+ *
+ *  @return BitcoinResult indicating error state.
+ */
+BitcoinResult BitcoinContext_MakePublicKey(struct BitcoinContext *context,
+	struct BitcoinPublicKey *public_key,
+	const struct BitcoinPrivateKey *private_key
+);
+
+#endif
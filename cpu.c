@@ -0,0 +1,173 @@
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cpu.h"
+#include "base58.h"
+#include "hash.h"
+#include "secp256k1.h"
+#include "utility.h"
+
+#ifdef BITCOIN_HAVE_X86_SIMD
+#include <cpuid.h>
+#endif
+
+static const struct BitcoinCPUFeatureName {
+	unsigned feature;
+	const char *name;
+} feature_names[] = {
+	{ BITCOIN_CPU_SSSE3, "ssse3" },
+	{ BITCOIN_CPU_SSE41, "sse4.1" },
+	{ BITCOIN_CPU_AVX2,  "avx2" },
+	{ BITCOIN_CPU_BMI2,  "bmi2" },
+	{ BITCOIN_CPU_SHA,   "sha" },
+	{ BITCOIN_CPU_AVX512F,    "avx512f" },
+	{ BITCOIN_CPU_AVX512IFMA, "avx512ifma" }
+};
+
+#define BITCOIN_CPU_FEATURE_COUNT (sizeof(feature_names) / sizeof(feature_names[0]))
+
+/* Features are detected, and kernels selected, under pthread_once() so
+that no thread can see them half set.  They are separate, since selecting
+the kernels needs the features. */
+static pthread_once_t cpu_features_once = PTHREAD_ONCE_INIT;
+static pthread_once_t cpu_kernels_once = PTHREAD_ONCE_INIT;
+static unsigned cpu_features = 0;
+
+static unsigned BitcoinCPU_detect(void)
+{
+	unsigned features = 0;
+#ifdef BITCOIN_HAVE_X86_SIMD
+	unsigned eax, ebx, ecx, edx;
+	unsigned max_leaf = __get_cpuid_max(0, NULL);
+	int avx_state = 0, avx512_state = 0;
+
+	if (max_leaf >= 1) {
+		__cpuid(1, eax, ebx, ecx, edx);
+		if (ecx & bit_SSSE3) {
+			features |= BITCOIN_CPU_SSSE3;
+		}
+		if (ecx & bit_SSE4_1) {
+			features |= BITCOIN_CPU_SSE41;
+		}
+		/* AVX registers are only usable if the OS saves them */
+		if ((ecx & bit_OSXSAVE) && (ecx & bit_AVX)) {
+			unsigned xcr0_low, xcr0_high;
+			__asm__ ("xgetbv" : "=a" (xcr0_low), "=d" (xcr0_high) : "c" (0));
+			avx_state = (xcr0_low & 0x6) == 0x6;
+			/* and AVX-512 needs the mask and upper register state too */
+			avx512_state = (xcr0_low & 0xe6) == 0xe6;
+		}
+	}
+	if (max_leaf >= 7) {
+		__cpuid_count(7, 0, eax, ebx, ecx, edx);
+		if ((ebx & bit_AVX2) && avx_state) {
+			features |= BITCOIN_CPU_AVX2;
+		}
+		if (ebx & bit_BMI2) {
+			features |= BITCOIN_CPU_BMI2;
+		}
+		if (ebx & bit_SHA) {
+			features |= BITCOIN_CPU_SHA;
+		}
+		if ((ebx & bit_AVX512F) && avx512_state) {
+			features |= BITCOIN_CPU_AVX512F;
+		}
+		if ((ebx & bit_AVX512IFMA) && avx512_state) {
+			features |= BITCOIN_CPU_AVX512IFMA;
+		}
+	}
+#endif
+	return features;
+}
+
+/* Parse a list of feature names to disable. */
+static unsigned BitcoinCPU_parseDisabled(const char *list)
+{
+	unsigned disabled = 0;
+
+	while (list && *list) {
+		const size_t size = strcspn(list, ", ");
+		unsigned i;
+
+		if (size == 3 && !strncmp(list, "all", size)) {
+			disabled = ~0u;
+		}
+		for (i = 0; i < BITCOIN_CPU_FEATURE_COUNT; i++) {
+			if (strlen(feature_names[i].name) == size
+				&& !strncmp(list, feature_names[i].name, size)
+			) {
+				disabled |= feature_names[i].feature;
+			}
+		}
+		list += size;
+		list += strspn(list, ", ");
+	}
+
+	return disabled;
+}
+
+static void BitcoinCPU_detectOnce(void)
+{
+	cpu_features = BitcoinCPU_detect()
+		& ~BitcoinCPU_parseDisabled(getenv("BITCOIN_TOOL_DISABLE_CPU_FEATURES"));
+}
+
+unsigned BitcoinCPU_GetFeatures(void)
+{
+	pthread_once(&cpu_features_once, BitcoinCPU_detectOnce);
+	return cpu_features;
+}
+
+int BitcoinCPU_Has(unsigned features)
+{
+	return (BitcoinCPU_GetFeatures() & features) == features;
+}
+
+static void BitcoinCPU_selectOnce(void)
+{
+	Bitcoin_SelectSHA256Kernel();
+	Bitcoin_SelectHexKernels();
+	Bitcoin_SelectBase58Kernels();
+	BitcoinSecp256k1_SelectKernel();
+}
+
+void BitcoinCPU_SelectKernels(void)
+{
+	pthread_once(&cpu_kernels_once, BitcoinCPU_selectOnce);
+}
+
+/* select before main(), so the kernels are in place before any thread
+   a program starts, even one which never creates a context */
+__attribute__((constructor)) static void BitcoinCPU_init(void)
+{
+	BitcoinCPU_SelectKernels();
+}
+
+void BitcoinCPU_Report(FILE *file)
+{
+	const unsigned features = BitcoinCPU_GetFeatures();
+	const unsigned detected = BitcoinCPU_detect();
+	unsigned i;
+
+	fprintf(file, "features:");
+	for (i = 0; i < BITCOIN_CPU_FEATURE_COUNT; i++) {
+		if (features & feature_names[i].feature) {
+			fprintf(file, " %s", feature_names[i].name);
+		}
+	}
+	fprintf(file, "\n");
+
+	fprintf(file, "disabled:");
+	for (i = 0; i < BITCOIN_CPU_FEATURE_COUNT; i++) {
+		if ((detected & ~features) & feature_names[i].feature) {
+			fprintf(file, " %s", feature_names[i].name);
+		}
+	}
+	fprintf(file, "\n");
+
+	fprintf(file, "sha256: %s\n", Bitcoin_GetSHA256KernelName());
+	fprintf(file, "hex: %s\n", Bitcoin_GetHexKernelName());
+	fprintf(file, "base58: %s\n", Bitcoin_GetBase58KernelName());
+	fprintf(file, "secp256k1: %s\n", BitcoinSecp256k1_GetKernelName());
+}
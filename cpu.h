@@ -0,0 +1,62 @@
+#ifndef BITCOIN_INCLUDE_CPU_H
+#define BITCOIN_INCLUDE_CPU_H
+
+/** @file cpu.h
+ *  @brief CPU feature detection, for selecting kernels at run-time.
+ *
+ *  The hashing, hex, Base58 and secp256k1 kernels are compiled for several
+ *  instruction sets in the same binary, and the best kernel the CPU
+ *  supports is picked for each module once, by BitcoinCPU_SelectKernels()
+ *  under pthread_once().  That runs before main(), and again (doing
+ *  nothing) from BitcoinContext_create(), so no kernel is selected while
+ *  threads are running.
+ *
+ *  Features can be hidden from kernel selection by listing them in the
+ *  BITCOIN_TOOL_DISABLE_CPU_FEATURES environment variable (comma or space
+ *  separated names as printed by BitcoinCPU_Report(), or "all"), to run the
+ *  fallback kernels on a CPU which has the features.
+ */
+
+#include <stdio.h>
+
+/* the x86 kernels need GCC style target attributes and intrinsics */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) \
+	&& !defined(BITCOIN_NO_SIMD)
+#define BITCOIN_HAVE_X86_SIMD 1
+#endif
+
+enum BitcoinCPUFeature {
+	BITCOIN_CPU_SSSE3  = 1 << 0,
+	BITCOIN_CPU_SSE41  = 1 << 1,
+	BITCOIN_CPU_AVX2   = 1 << 2,
+	BITCOIN_CPU_BMI2   = 1 << 3,
+	BITCOIN_CPU_SHA    = 1 << 4,
+	BITCOIN_CPU_AVX512F    = 1 << 5,
+	BITCOIN_CPU_AVX512IFMA = 1 << 6
+};
+
+/** @brief Get the features which kernels may use: those supported by the
+ *         CPU (and OS), less any disabled through the environment.
+ *
+ *  @return Bitwise OR of BitcoinCPUFeature values.
+ */
+unsigned BitcoinCPU_GetFeatures(void);
+
+/** @brief Check that kernels may use all of the given features.
+ *
+ *  @param[in] features Bitwise OR of BitcoinCPUFeature values.
+ *  @return Non-zero if all the features are available.
+ */
+int BitcoinCPU_Has(unsigned features);
+
+/** @brief Select the kernels of every module, if that has not been done
+ *         yet.  Safe to call from any thread.
+ */
+void BitcoinCPU_SelectKernels(void);
+
+/** @brief Write the available features and the selected kernels to a
+ *         file, one "<name>: <value>" line each.
+ */
+void BitcoinCPU_Report(FILE *file);
+
+#endif
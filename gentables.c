@@ -0,0 +1,203 @@
+/* Generate the precomputed tables as C source, at build time.
+
+	gentables secp256k1 > secp256k1_table.h
+	gentables base58 > base58_table.h
+
+The tables are compiled into the programs as const data, so they are in
+read-only pages shared between processes, and cost nothing at startup.
+The secp256k1 table is computed with OpenSSL, independently of the curve
+code which uses it.  This program runs on the build host, so it only uses
+what is needed for that.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <openssl/bn.h>
+#include <openssl/ec.h>
+#include <openssl/obj_mac.h>
+
+/* keep in step with secp256k1.c */
+#define GENTABLES_SECP256K1_WINDOWS 64
+#define GENTABLES_SECP256K1_WINDOW_POINTS 16
+
+/* keep in step with base58.c */
+static const char base58_digits[] =
+	"123456789"
+	"ABCDEFGHJKLMNPQRSTUVWXYZ"
+	"abcdefghijkmnopqrstuvwxyz";
+#define GENTABLES_BASE58_LIMB_DIGITS 5
+
+static void Gentables_header(const char *what)
+{
+	printf("/* %s, generated by gentables, do not edit */\n\n", what);
+}
+
+/* Write one coordinate, as 32 big-endian bytes, as limbs of 'bits' bits
+in 'limbs' limbs, least significant first. */
+static void Gentables_limbs(const unsigned char *bytes, unsigned bits,
+	unsigned limbs, const char *suffix
+)
+{
+	unsigned i, bit;
+
+	printf("{ ");
+	for (i = 0; i < limbs; i++) {
+		unsigned long long limb = 0;
+		for (bit = 0; bit < bits && i * bits + bit < 256; bit++) {
+			const unsigned n = i * bits + bit;
+			if (bytes[31 - n / 8] & (1u << (n % 8))) {
+				limb |= 1ULL << bit;
+			}
+		}
+		printf("0x%llx%s%s", limb, suffix, i + 1 < limbs ? ", " : " ");
+	}
+	printf("}");
+}
+
+/* table[w][j] = j * 16^w * G, as affine x, y (entry 0 is unused, and 0) */
+static int Gentables_secp256k1(void)
+{
+	EC_GROUP *group = EC_GROUP_new_by_curve_name(NID_secp256k1);
+	BN_CTX *ctx = BN_CTX_new();
+	EC_POINT *base = group ? EC_POINT_new(group) : NULL;
+	EC_POINT *point = group ? EC_POINT_new(group) : NULL;
+	BIGNUM *x = BN_new(), *y = BN_new();
+	unsigned char x_bytes[GENTABLES_SECP256K1_WINDOWS][GENTABLES_SECP256K1_WINDOW_POINTS][32];
+	unsigned char y_bytes[GENTABLES_SECP256K1_WINDOWS][GENTABLES_SECP256K1_WINDOW_POINTS][32];
+	unsigned w, j, pass;
+
+	if (!group || !ctx || !base || !point || !x || !y
+		|| !EC_POINT_copy(base, EC_GROUP_get0_generator(group))
+	) {
+		fprintf(stderr, "gentables: failed to set up secp256k1\n");
+		return 0;
+	}
+
+	memset(x_bytes, 0, sizeof(x_bytes));
+	memset(y_bytes, 0, sizeof(y_bytes));
+	for (w = 0; w < GENTABLES_SECP256K1_WINDOWS; w++) {
+		if (!EC_POINT_copy(point, base)) {
+			return 0;
+		}
+		for (j = 1; j < GENTABLES_SECP256K1_WINDOW_POINTS; j++) {
+			if (
+				!EC_POINT_get_affine_coordinates(group, point, x, y, ctx)
+				|| BN_bn2binpad(x, x_bytes[w][j], 32) != 32
+				|| BN_bn2binpad(y, y_bytes[w][j], 32) != 32
+				|| !EC_POINT_add(group, point, point, base, ctx)
+			) {
+				fprintf(stderr, "gentables: point arithmetic failed\n");
+				return 0;
+			}
+		}
+		/* point is now 16 times base, the next window's base */
+		if (!EC_POINT_copy(base, point)) {
+			return 0;
+		}
+	}
+
+	Gentables_header("j * 16^w * G for secp256k1.c");
+
+	/* 5x52 for the generic and IFMA code, 10x26 for AVX2 */
+	for (pass = 0; pass < 2; pass++) {
+		if (pass) {
+			printf("\n#ifdef BITCOIN_HAVE_X86_SIMD\n");
+			printf("static const struct BitcoinSecp256k1AffineAVX2\n"
+				"\tsecp256k1_table_avx2[%u][%u] = {\n",
+				GENTABLES_SECP256K1_WINDOWS, GENTABLES_SECP256K1_WINDOW_POINTS
+			);
+		} else {
+			printf("static const struct BitcoinSecp256k1Affine\n"
+				"\tsecp256k1_table[%u][%u] = {\n",
+				GENTABLES_SECP256K1_WINDOWS, GENTABLES_SECP256K1_WINDOW_POINTS
+			);
+		}
+		for (w = 0; w < GENTABLES_SECP256K1_WINDOWS; w++) {
+			printf("{\n");
+			for (j = 0; j < GENTABLES_SECP256K1_WINDOW_POINTS; j++) {
+				printf("\t{ ");
+				if (pass) {
+					Gentables_limbs(x_bytes[w][j], 26, 10, "");
+					printf(", ");
+					Gentables_limbs(y_bytes[w][j], 26, 10, "");
+				} else {
+					printf("{ ");
+					Gentables_limbs(x_bytes[w][j], 52, 5, "ULL");
+					printf(" }, { ");
+					Gentables_limbs(y_bytes[w][j], 52, 5, "ULL");
+					printf(" }");
+				}
+				printf(" }%s\n", j + 1 < GENTABLES_SECP256K1_WINDOW_POINTS ? "," : "");
+			}
+			printf("}%s\n", w + 1 < GENTABLES_SECP256K1_WINDOWS ? "," : "");
+		}
+		printf("};\n");
+		if (pass) {
+			printf("#endif\n");
+		}
+	}
+
+	BN_free(x);
+	BN_free(y);
+	EC_POINT_free(point);
+	EC_POINT_free(base);
+	BN_CTX_free(ctx);
+	EC_GROUP_free(group);
+	return 1;
+}
+
+/* The character to digit value map, and the powers of 58 up to one limb. */
+static int Gentables_base58(void)
+{
+	unsigned long power = 1;
+	int values[128];
+	unsigned i;
+
+	for (i = 0; i < 128; i++) {
+		values[i] = -1;
+	}
+	for (i = 0; i < 58; i++) {
+		values[(unsigned char)base58_digits[i]] = (int)i;
+	}
+
+	Gentables_header("Base58 tables for base58.c");
+
+	printf("/* ASCII characters to digit values, or -1 if the character is"
+		" invalid */\n"
+	);
+	printf("static const signed char base58_values[128] = {");
+	for (i = 0; i < 128; i++) {
+		printf("%s%2d", i % 16 ? "," : (i ? ",\n\t" : "\n\t"), values[i]);
+	}
+	printf("\n};\n\n");
+
+	printf("/* 58^i, up to one limb */\n");
+	printf("static const uint32_t base58_powers[%u] = {",
+		GENTABLES_BASE58_LIMB_DIGITS + 1
+	);
+	for (i = 0; i <= GENTABLES_BASE58_LIMB_DIGITS; i++) {
+		printf("%s%lu", i ? ", " : " ", power);
+		power *= 58;
+	}
+	printf(" };\n");
+	return 1;
+}
+
+int main(int argc, char *argv[])
+{
+	int ok = 0;
+
+	if (argc == 2 && !strcmp(argv[1], "secp256k1")) {
+		ok = Gentables_secp256k1();
+	} else if (argc == 2 && !strcmp(argv[1], "base58")) {
+		ok = Gentables_base58();
+	} else {
+		fprintf(stderr, "Usage: gentables secp256k1|base58\n");
+	}
+	if (ok && (fflush(stdout) || ferror(stdout))) {
+		ok = 0;
+	}
+	return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
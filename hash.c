@@ -1,23 +1,196 @@
+#include <string.h>
+
 #include "hash.h"
+#include "cpu.h"
 
-void Bitcoin_SHA256(struct BitcoinSHA256 *output, const void *input, size_t size)
+#ifdef BITCOIN_HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+/* A SHA256 kernel hashes one complete message. */
+typedef void (*BitcoinSHA256Kernel)(uint8_t *output,
+	const void *input, size_t size
+);
+
+static void Bitcoin_SHA256KernelOpenSSL(uint8_t *output,
+	const void *input, size_t size
+)
 {
 	SHA256_CTX ctx;
 	SHA256_Init(&ctx);
 	SHA256_Update(&ctx, input, size);
-	SHA256_Final(output->data, &ctx);
+	SHA256_Final(output, &ctx);
+}
+
+#ifdef BITCOIN_HAVE_X86_SIMD
+
+static const uint32_t sha256_round_constants[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+	0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+	0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+	0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+	0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+	0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+	0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+	0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+	0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+/* Four rounds, with message words w plus round constants from i. */
+#define BITCOIN_SHA256_ROUNDS(i, w) \
+	k = _mm_add_epi32((w), \
+		_mm_loadu_si128((const __m128i *)&sha256_round_constants[(i) * 4]) \
+	); \
+	cdgh = _mm_sha256rnds2_epu32(cdgh, abef, k); \
+	abef = _mm_sha256rnds2_epu32(abef, cdgh, _mm_shuffle_epi32(k, 0x0e))
+
+/* Replace the oldest four message words w0 with the next four, from the
+previous sixteen in w0, w1, w2, w3. */
+#define BITCOIN_SHA256_SCHEDULE(w0, w1, w2, w3) \
+	w0 = _mm_sha256msg2_epu32( \
+		_mm_add_epi32(_mm_sha256msg1_epu32(w0, w1), _mm_alignr_epi8(w3, w2, 4)), \
+		w3 \
+	)
+
+/* Compress 64 byte blocks into the state with the SHA extensions.  The
+round instructions want the state as ABEF and CDGH, with A in the top word,
+so it is kept that way from start to finish. */
+__attribute__((target("sha,sse4.1")))
+static __inline__ void Bitcoin_SHA256BlocksSHANI(__m128i *state_abef,
+	__m128i *state_cdgh, const uint8_t *data, size_t blocks
+)
+{
+	const __m128i byte_swap = _mm_set_epi64x(
+		0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL
+	);
+	__m128i abef = *state_abef, cdgh = *state_cdgh;
+
+	for (; blocks; blocks--, data += 64) {
+		const __m128i abef_save = abef, cdgh_save = cdgh;
+		__m128i w0, w1, w2, w3, k;
+
+		w0 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 0)), byte_swap);
+		w1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 16)), byte_swap);
+		w2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 32)), byte_swap);
+		w3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 48)), byte_swap);
+
+		BITCOIN_SHA256_ROUNDS(0, w0);
+		BITCOIN_SHA256_ROUNDS(1, w1);
+		BITCOIN_SHA256_ROUNDS(2, w2);
+		BITCOIN_SHA256_ROUNDS(3, w3);
+		BITCOIN_SHA256_SCHEDULE(w0, w1, w2, w3); BITCOIN_SHA256_ROUNDS(4, w0);
+		BITCOIN_SHA256_SCHEDULE(w1, w2, w3, w0); BITCOIN_SHA256_ROUNDS(5, w1);
+		BITCOIN_SHA256_SCHEDULE(w2, w3, w0, w1); BITCOIN_SHA256_ROUNDS(6, w2);
+		BITCOIN_SHA256_SCHEDULE(w3, w0, w1, w2); BITCOIN_SHA256_ROUNDS(7, w3);
+		BITCOIN_SHA256_SCHEDULE(w0, w1, w2, w3); BITCOIN_SHA256_ROUNDS(8, w0);
+		BITCOIN_SHA256_SCHEDULE(w1, w2, w3, w0); BITCOIN_SHA256_ROUNDS(9, w1);
+		BITCOIN_SHA256_SCHEDULE(w2, w3, w0, w1); BITCOIN_SHA256_ROUNDS(10, w2);
+		BITCOIN_SHA256_SCHEDULE(w3, w0, w1, w2); BITCOIN_SHA256_ROUNDS(11, w3);
+		BITCOIN_SHA256_SCHEDULE(w0, w1, w2, w3); BITCOIN_SHA256_ROUNDS(12, w0);
+		BITCOIN_SHA256_SCHEDULE(w1, w2, w3, w0); BITCOIN_SHA256_ROUNDS(13, w1);
+		BITCOIN_SHA256_SCHEDULE(w2, w3, w0, w1); BITCOIN_SHA256_ROUNDS(14, w2);
+		BITCOIN_SHA256_SCHEDULE(w3, w0, w1, w2); BITCOIN_SHA256_ROUNDS(15, w3);
+
+		abef = _mm_add_epi32(abef, abef_save);
+		cdgh = _mm_add_epi32(cdgh, cdgh_save);
+	}
+
+	*state_abef = abef;
+	*state_cdgh = cdgh;
+}
+
+__attribute__((target("sha,sse4.1")))
+static void Bitcoin_SHA256KernelSHANI(uint8_t *output,
+	const void *input, size_t size
+)
+{
+	const __m128i byte_swap = _mm_set_epi64x(
+		0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL
+	);
+	const uint8_t *bytes = (const uint8_t *)input;
+	const size_t full_blocks = size / 64;
+	const size_t tail_size = size % 64;
+	/* the padding needs one more block if there is no room for the 0x80
+	   byte and the 8 byte length after the tail */
+	const size_t tail_blocks = tail_size < 56 ? 1 : 2;
+	const uint64_t bits = __builtin_bswap64((uint64_t)size * 8);
+	__m128i abef = _mm_set_epi32(0x6a09e667, 0xbb67ae85, 0x510e527f, 0x9b05688c);
+	__m128i cdgh = _mm_set_epi32(0x3c6ef372, 0xa54ff53a, 0x1f83d9ab, 0x5be0cd19);
+	__m128i tail[8], tmp;
+
+	Bitcoin_SHA256BlocksSHANI(&abef, &cdgh, bytes, full_blocks);
+
+	/* cleared one vector at a time, since a memset() this small costs as
+	   much as hashing a block */
+	tail[0] = tail[1] = tail[2] = tail[3] = _mm_setzero_si128();
+	tail[4] = tail[5] = tail[6] = tail[7] = _mm_setzero_si128();
+	memcpy(tail, bytes + full_blocks * 64, tail_size);
+	((uint8_t *)tail)[tail_size] = 0x80;
+	memcpy((uint8_t *)tail + tail_blocks * 64 - sizeof(bits), &bits, sizeof(bits));
+	Bitcoin_SHA256BlocksSHANI(&abef, &cdgh, (const uint8_t *)tail, tail_blocks);
+
+	/* back to ABCD and EFGH, then big-endian */
+	tmp = _mm_shuffle_epi32(abef, 0x1b);
+	cdgh = _mm_shuffle_epi32(cdgh, 0xb1);
+	_mm_storeu_si128((__m128i *)output,
+		_mm_shuffle_epi8(_mm_blend_epi16(tmp, cdgh, 0xf0), byte_swap)
+	);
+	_mm_storeu_si128((__m128i *)(output + 16),
+		_mm_shuffle_epi8(_mm_alignr_epi8(cdgh, tmp, 8), byte_swap)
+	);
+}
+
+#endif /* BITCOIN_HAVE_X86_SIMD */
+
+static BitcoinSHA256Kernel sha256_kernel = NULL;
+static const char *sha256_kernel_name = NULL;
+
+/* called once, through BitcoinCPU_SelectKernels() */
+void Bitcoin_SelectSHA256Kernel(void)
+{
+	BitcoinSHA256Kernel kernel = Bitcoin_SHA256KernelOpenSSL;
+	const char *name = "openssl";
+
+#ifdef BITCOIN_HAVE_X86_SIMD
+	if (BitcoinCPU_Has(BITCOIN_CPU_SHA | BITCOIN_CPU_SSE41)) {
+		name = "sha-ni";
+		kernel = Bitcoin_SHA256KernelSHANI;
+	}
+#endif
+	sha256_kernel_name = name;
+	sha256_kernel = kernel;
+}
+
+const char *Bitcoin_GetSHA256KernelName(void)
+{
+	BitcoinCPU_SelectKernels();
+	return sha256_kernel_name;
+}
+
+void Bitcoin_SHA256(struct BitcoinSHA256 *output, const void *input, size_t size)
+{
+	if (!sha256_kernel) {
+		BitcoinCPU_SelectKernels();
+	}
+	sha256_kernel(output->data, input, size);
 }
 
 void Bitcoin_DoubleSHA256(struct BitcoinSHA256 *output, const void *input, size_t size)
 {
 	struct BitcoinSHA256 round1;
-	SHA256_CTX ctx;
-	SHA256_Init(&ctx);
-	SHA256_Update(&ctx, input, size);
-	SHA256_Final(round1.data, &ctx);
-	SHA256_Init(&ctx);
-	SHA256_Update(&ctx, &round1.data, BITCOIN_SHA256_SIZE);
-	SHA256_Final(output->data, &ctx);
+
+	if (!sha256_kernel) {
+		BitcoinCPU_SelectKernels();
+	}
+	sha256_kernel(round1.data, input, size);
+	sha256_kernel(output->data, round1.data, BITCOIN_SHA256_SIZE);
 }
 
 void Bitcoin_RIPEMD160(struct BitcoinRIPEMD160 *output, const void *input, size_t size)
@@ -27,4 +200,3 @@ void Bitcoin_RIPEMD160(struct BitcoinRIPEMD160 *output, const void *input, size_
 	RIPEMD160_Update(&ctx, input, size);
 	RIPEMD160_Final(output->data, &ctx);
 }
-
@@ -8,6 +8,9 @@
  *  @author Matthew Anger
  */
 
+#include <stdlib.h> /* size_t */
+#include <stdint.h> /* uint8_t */
+
 #include <openssl/sha.h> /* SHA256_DIGEST_LENGTH */
 #include <openssl/ripemd.h> /* RIPEMD160_DIGEST_LENGTH */
 
@@ -46,6 +49,14 @@ void Bitcoin_DoubleSHA256(struct BitcoinSHA256 *output,
 	const void *input, size_t size
 );
 
+/** @brief Select the SHA256 kernel for this CPU.  Only to be called by
+ *         BitcoinCPU_SelectKernels(), which does it once.
+ */
+void Bitcoin_SelectSHA256Kernel(void);
+
+/** @brief Get the name of the SHA256 kernel selected for this CPU. */
+const char *Bitcoin_GetSHA256KernelName(void);
+
 /** @brief Calculate RIPEMD160 hash and write to output buffer.
  *
  *  @param[out] output Pointer to hash output buffer.
@@ -0,0 +1,326 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+
+#include "hashset.h"
+#include "applog.h"
+#include "cpu.h"
+#include "numa.h"
+
+#if defined(BITCOIN_HAVE_X86_SIMD) && defined(__SSE2__)
+#define BITCOIN_HASH_SET_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#define BITCOIN_HASH_SET_GROUP_SIZE 16
+
+/* the tag of an empty slot; the tag of a full one is 7 bits of its hash */
+#define BITCOIN_HASH_SET_EMPTY 0x80
+
+/* lookups of a batch whose memory is prefetched together */
+#define BITCOIN_HASH_SET_PROBE_GROUP 16
+
+struct BitcoinHashSet {
+	/* a tag per slot, and the hash in each full slot, in group_count
+	   groups of BITCOIN_HASH_SET_GROUP_SIZE, one after the other in table */
+	uint8_t *tags;
+	struct BitcoinRIPEMD160 *hashes;
+	uint64_t group_count;
+	void *table;
+	size_t table_size;
+	enum BitcoinHugePageBacking backing;
+
+	uint64_t count, capacity;
+};
+
+/* The hash of a hash: its bytes are random already, but an address list
+   could have been ground to share the bits picking a group, so all of
+   them are mixed (with the MurmurHash3 finalizer) */
+static __inline__ uint64_t BitcoinHashSet_hash(const struct BitcoinRIPEMD160 *hash)
+{
+	uint64_t a, b;
+	uint32_t c;
+
+	memcpy(&a, hash->data, 8);
+	memcpy(&b, hash->data + 8, 8);
+	memcpy(&c, hash->data + 16, 4);
+
+	a ^= (b << 32 | b >> 32) ^ c;
+	a ^= a >> 33;
+	a *= 0xff51afd7ed558ccdULL;
+	a ^= a >> 33;
+	a *= 0xc4ceb9fe1a85ec53ULL;
+	a ^= a >> 33;
+	return a;
+}
+
+/* The first group to look in, from the top bits of the hash */
+static __inline__ uint64_t BitcoinHashSet_group(const struct BitcoinHashSet *self,
+	uint64_t hash
+)
+{
+	return ((hash >> 32) * self->group_count) >> 32;
+}
+
+/* The tag of a hash, from the bottom bits of its hash */
+static __inline__ uint8_t BitcoinHashSet_tag(uint64_t hash)
+{
+	return (uint8_t)(hash & 0x7f);
+}
+
+/* The slots of a group whose tag is tag, bit i for slot i */
+static __inline__ unsigned BitcoinHashSet_match(const uint8_t *tags, uint8_t tag)
+{
+#ifdef BITCOIN_HASH_SET_SSE2
+	return (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(
+		_mm_loadu_si128((const __m128i *)tags), _mm_set1_epi8((char)tag)
+	));
+#else
+	unsigned mask = 0, i;
+
+	for (i = 0; i < BITCOIN_HASH_SET_GROUP_SIZE; i++) {
+		mask |= (unsigned)(tags[i] == tag) << i;
+	}
+	return mask;
+#endif
+}
+
+const char *BitcoinHashSet_GetKernelName(void)
+{
+#ifdef BITCOIN_HASH_SET_SSE2
+	return "sse2";
+#else
+	return "scalar";
+#endif
+}
+
+struct BitcoinHashSet *BitcoinHashSet_create(uint64_t capacity)
+{
+	struct BitcoinHashSet *self;
+	uint64_t slots, bytes;
+
+	if (capacity > BITCOIN_HASH_SET_MAX_CAPACITY) {
+		applog(APPLOG_ERROR, __func__,
+			"Too many hashes for a set (%llu, at most %llu).",
+			(unsigned long long)capacity,
+			(unsigned long long)BITCOIN_HASH_SET_MAX_CAPACITY
+		);
+		return NULL;
+	}
+
+	self = calloc(1, sizeof(*self));
+	if (!self) {
+		applog(APPLOG_ERROR, __func__, "Failed to allocate hash set.");
+		return NULL;
+	}
+
+	/* at most 7/8 full, so a search soon finds an empty slot */
+	self->capacity = capacity;
+	self->group_count = (capacity * 8 / 7 + BITCOIN_HASH_SET_GROUP_SIZE - 1)
+		/ BITCOIN_HASH_SET_GROUP_SIZE;
+	if (!self->group_count) {
+		self->group_count = 1;
+	}
+	slots = self->group_count * BITCOIN_HASH_SET_GROUP_SIZE;
+
+	/* lookups land anywhere in the table, so it is in huge pages if it
+	   can be, for the TLB to cover it */
+	bytes = slots * (1 + sizeof(*self->hashes));
+	if (bytes == (size_t)bytes) {
+		self->table_size = (size_t)bytes;
+		self->table = BitcoinHugePage_Alloc(self->table_size, &self->backing);
+	}
+	if (!self->table) {
+		applog(APPLOG_ERROR, __func__,
+			"Failed to allocate hash set of %llu hashes.",
+			(unsigned long long)capacity
+		);
+		BitcoinHashSet_destroy(self);
+		return NULL;
+	}
+	self->tags = (uint8_t *)self->table;
+	self->hashes = (struct BitcoinRIPEMD160 *)(self->tags + slots);
+	memset(self->tags, BITCOIN_HASH_SET_EMPTY, (size_t)slots);
+
+	return self;
+}
+
+struct BitcoinHashSet *BitcoinHashSet_clone(const struct BitcoinHashSet *other,
+	unsigned node
+)
+{
+	struct BitcoinHashSet *self = malloc(sizeof(*self));
+
+	if (!self) {
+		applog(APPLOG_ERROR, __func__, "Failed to allocate hash set.");
+		return NULL;
+	}
+	*self = *other;
+
+	/* placed before it is written, so the pages start out on the node */
+	self->table = BitcoinHugePage_Alloc(self->table_size, &self->backing);
+	if (!self->table) {
+		free(self);
+		return NULL;
+	}
+	/* the whole mapping, or the kernel splits it where huge pages can't
+	   back it */
+	if (!BitcoinNUMA_Bind(self->table,
+		BitcoinHugePage_GetMappedSize(self->table_size), node)
+	) {
+		applog(APPLOG_WARNING, __func__,
+			"Failed to place hash set on node %u (%s)", node, strerror(errno)
+		);
+	}
+	memcpy(self->table, other->table, self->table_size);
+	self->tags = (uint8_t *)self->table;
+	self->hashes = (struct BitcoinRIPEMD160 *)(self->tags
+		+ self->group_count * BITCOIN_HASH_SET_GROUP_SIZE
+	);
+
+	return self;
+}
+
+void BitcoinHashSet_destroy(struct BitcoinHashSet *self)
+{
+	if (!self) {
+		return;
+	}
+	BitcoinHugePage_Free(self->table, self->table_size);
+	free(self);
+}
+
+/* Search for a hash from group on.  Returns its slot, or if it's not in
+   the set, the one's complement of the first empty slot found. */
+static uint64_t BitcoinHashSet_find(const struct BitcoinHashSet *self,
+	const struct BitcoinRIPEMD160 *hash, uint64_t group, uint8_t tag
+)
+{
+	uint64_t searched;
+
+	for (searched = 0; searched < self->group_count; searched++) {
+		const uint64_t first = group * BITCOIN_HASH_SET_GROUP_SIZE;
+		const uint8_t *tags = self->tags + first;
+		unsigned mask = BitcoinHashSet_match(tags, tag);
+
+		while (mask) {
+			const unsigned slot = (unsigned)__builtin_ctz(mask);
+
+			if (!memcmp(&self->hashes[first + slot], hash, sizeof(*hash))) {
+				return first + slot;
+			}
+			mask &= mask - 1;
+		}
+
+		/* nothing is ever removed, so a hash would be in the first group
+		   with room */
+		mask = BitcoinHashSet_match(tags, BITCOIN_HASH_SET_EMPTY);
+		if (mask) {
+			return ~(first + (unsigned)__builtin_ctz(mask));
+		}
+
+		if (++group == self->group_count) {
+			group = 0;
+		}
+	}
+
+	/* not reached: the table is never full */
+	return ~(uint64_t)0;
+}
+
+int BitcoinHashSet_Add(struct BitcoinHashSet *self,
+	const struct BitcoinRIPEMD160 *hash
+)
+{
+	const uint64_t value = BitcoinHashSet_hash(hash);
+	uint64_t slot;
+
+	slot = BitcoinHashSet_find(self, hash, BitcoinHashSet_group(self, value),
+		BitcoinHashSet_tag(value)
+	);
+	if (!(slot >> 63)) {
+		return 0;
+	}
+	if (self->count == self->capacity) {
+		return -1;
+	}
+
+	slot = ~slot;
+	self->tags[slot] = BitcoinHashSet_tag(value);
+	self->hashes[slot] = *hash;
+	self->count++;
+	return 1;
+}
+
+int BitcoinHashSet_Contains(const struct BitcoinHashSet *self,
+	const struct BitcoinRIPEMD160 *hash
+)
+{
+	const uint64_t value = BitcoinHashSet_hash(hash);
+
+	return !(BitcoinHashSet_find(self, hash, BitcoinHashSet_group(self, value),
+		BitcoinHashSet_tag(value)) >> 63
+	);
+}
+
+void BitcoinHashSet_ContainsBatch(const struct BitcoinHashSet *self,
+	const struct BitcoinRIPEMD160 *hashes, size_t count,
+	unsigned char *results
+)
+{
+	uint64_t groups[BITCOIN_HASH_SET_PROBE_GROUP];
+	uint8_t tags[BITCOIN_HASH_SET_PROBE_GROUP];
+	size_t start, i;
+
+	for (start = 0; start < count; start += BITCOIN_HASH_SET_PROBE_GROUP) {
+		const size_t size = count - start < BITCOIN_HASH_SET_PROBE_GROUP
+			? count - start : BITCOIN_HASH_SET_PROBE_GROUP;
+
+		/* the tags of each lookup's group, then the hash its fingerprint
+		   first matches, then the searches, mostly from cache */
+		for (i = 0; i < size; i++) {
+			const uint64_t value = BitcoinHashSet_hash(&hashes[start + i]);
+
+			groups[i] = BitcoinHashSet_group(self, value);
+			tags[i] = BitcoinHashSet_tag(value);
+			__builtin_prefetch(self->tags + groups[i] * BITCOIN_HASH_SET_GROUP_SIZE);
+		}
+		for (i = 0; i < size; i++) {
+			const uint64_t first = groups[i] * BITCOIN_HASH_SET_GROUP_SIZE;
+			const unsigned mask = BitcoinHashSet_match(self->tags + first, tags[i]);
+
+			if (mask) {
+				__builtin_prefetch(&self->hashes[first + (unsigned)__builtin_ctz(mask)]);
+			}
+		}
+		for (i = 0; i < size; i++) {
+			results[start + i] = !(BitcoinHashSet_find(self, &hashes[start + i],
+				groups[i], tags[i]) >> 63
+			);
+		}
+	}
+}
+
+uint64_t BitcoinHashSet_GetCount(const struct BitcoinHashSet *self)
+{
+	return self->count;
+}
+
+uint64_t BitcoinHashSet_GetMemorySize(const struct BitcoinHashSet *self)
+{
+	return self->group_count * BITCOIN_HASH_SET_GROUP_SIZE
+		* (1 + sizeof(*self->hashes));
+}
+
+enum BitcoinHugePageBacking BitcoinHashSet_GetBacking(
+	const struct BitcoinHashSet *self, uint64_t *huge_bytes
+)
+{
+	if (huge_bytes) {
+		*huge_bytes = BitcoinHugePage_GetHugeBytes(self->table,
+			self->table_size
+		);
+	}
+	return self->backing;
+}
@@ -0,0 +1,100 @@
+#ifndef BITCOIN_INCLUDE_HASHSET_H
+#define BITCOIN_INCLUDE_HASHSET_H
+
+/** @file hashset.h
+ *  @brief In-memory set of address hashes, for matching converted keys
+ *         against a watch-list which fits in memory.
+ *
+ *  An open addressing hash table in the style of a Swiss table: slots are
+ *  in groups of 16, each with a tag byte holding 7 bits of the hash of the
+ *  hash in it (its fingerprint), or marking the slot empty.  A lookup
+ *  starts at a group picked by the hash, compares the 16 tags of the group
+ *  with its fingerprint at once (with SSE2 where the build has it), and
+ *  compares the full 20 bytes only in the slots whose tags match, about one
+ *  in 128 of them by chance.  A group with an empty slot ends the search,
+ *  otherwise it goes on to the next group.  The table is never more than
+ *  7/8 full, so a lookup is usually one group of tags and at most one
+ *  hash: a cache miss or two, where a binary search of an index takes a
+ *  dozen steps.
+ *
+ *  The table is allocated in huge pages where possible (see hugepage.h).
+ *
+ *  Hashes are only ever added, up to the capacity the set was created
+ *  with.  A set can be read by many threads at the same time once
+ *  complete.
+ */
+
+#include <stddef.h> /* size_t */
+#include <stdint.h>
+
+#include "hash.h"
+#include "hugepage.h"
+
+/* most hashes a set can hold (2^32 groups of 16 slots, 7/8 full) */
+#define BITCOIN_HASH_SET_MAX_CAPACITY ((uint64_t)7 << 33)
+
+struct BitcoinHashSet;
+
+/** @brief Allocate an empty set.
+ *
+ *  @param[in] capacity Most hashes the set will hold.
+ *
+ *  @return Pointer to set, or NULL if failure.
+ */
+struct BitcoinHashSet *BitcoinHashSet_create(uint64_t capacity);
+
+/** @brief Copy a complete set to memory on a NUMA node (see numa.h), for
+ *         the threads running there to look up.
+ *
+ *  @return Pointer to set, or NULL if failure.
+ */
+struct BitcoinHashSet *BitcoinHashSet_clone(const struct BitcoinHashSet *other,
+	unsigned node
+);
+
+/** @brief Free a set. */
+void BitcoinHashSet_destroy(struct BitcoinHashSet *self);
+
+/** @brief Add a hash.
+ *
+ *  @return 1 if added, 0 if the set has it already, -1 if the set is full.
+ */
+int BitcoinHashSet_Add(struct BitcoinHashSet *self,
+	const struct BitcoinRIPEMD160 *hash
+);
+
+/** @brief Returns 1 if the set contains hash, otherwise 0. */
+int BitcoinHashSet_Contains(const struct BitcoinHashSet *self,
+	const struct BitcoinRIPEMD160 *hash
+);
+
+/** @brief Look up many hashes at once, as BitcoinHashSet_Contains() would,
+ *         with the tags and then the hashes each needs prefetched for a
+ *         group of lookups before any of them is compared.
+ *
+ *  @param[out] results Array of count flags, set to 1 for each hash in the
+ *                      set, otherwise 0.
+ */
+void BitcoinHashSet_ContainsBatch(const struct BitcoinHashSet *self,
+	const struct BitcoinRIPEMD160 *hashes, size_t count,
+	unsigned char *results
+);
+
+/** @brief Get the number of hashes in a set. */
+uint64_t BitcoinHashSet_GetCount(const struct BitcoinHashSet *self);
+
+/** @brief Get the bytes of memory a set's table takes. */
+uint64_t BitcoinHashSet_GetMemorySize(const struct BitcoinHashSet *self);
+
+/** @brief Get the backing of a set's table.
+ *
+ *  @param[out] huge_bytes Bytes of the table in huge pages, may be NULL.
+ */
+enum BitcoinHugePageBacking BitcoinHashSet_GetBacking(
+	const struct BitcoinHashSet *self, uint64_t *huge_bytes
+);
+
+/** @brief Get the name of the tag comparison used: "sse2" or "scalar". */
+const char *BitcoinHashSet_GetKernelName(void);
+
+#endif
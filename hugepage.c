@@ -0,0 +1,226 @@
+#define _GNU_SOURCE /* MAP_ANONYMOUS, MAP_HUGETLB, MADV_HUGEPAGE */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+#include "hugepage.h"
+#include "applog.h"
+
+#define BITCOIN_HUGE_PAGE_THP_ENABLED "/sys/kernel/mm/transparent_hugepage/enabled"
+
+static enum BitcoinHugePageMode huge_page_mode = BITCOIN_HUGE_PAGES_TRANSPARENT;
+
+/* whether the kernel has transparent huge pages turned on, -1 until
+   checked */
+static int huge_page_transparent = -1;
+
+int BitcoinHugePage_ParseMode(const char *name, enum BitcoinHugePageMode *mode)
+{
+	if (strcmp(name, "off") == 0) {
+		*mode = BITCOIN_HUGE_PAGES_OFF;
+	} else if (strcmp(name, "transparent") == 0) {
+		*mode = BITCOIN_HUGE_PAGES_TRANSPARENT;
+	} else if (strcmp(name, "explicit") == 0) {
+		*mode = BITCOIN_HUGE_PAGES_EXPLICIT;
+	} else {
+		return 0;
+	}
+	return 1;
+}
+
+const char *BitcoinHugePage_GetBackingName(enum BitcoinHugePageBacking backing)
+{
+	switch (backing) {
+		case BITCOIN_HUGE_PAGE_BACKING_NONE        : return "none";
+		case BITCOIN_HUGE_PAGE_BACKING_TRANSPARENT : return "transparent";
+		case BITCOIN_HUGE_PAGE_BACKING_EXPLICIT    : return "explicit";
+	}
+	return "unknown";
+}
+
+/* "always [madvise] never" has the setting in brackets: anything but never
+   honours MADV_HUGEPAGE */
+static int BitcoinHugePage_transparentEnabled(void)
+{
+	if (huge_page_transparent < 0) {
+		FILE *file = fopen(BITCOIN_HUGE_PAGE_THP_ENABLED, "r");
+		char setting[64];
+
+		huge_page_transparent = 0;
+		if (file) {
+			if (fgets(setting, sizeof(setting), file)) {
+				huge_page_transparent = strstr(setting, "[never]") == NULL;
+			}
+			fclose(file);
+		}
+	}
+	return huge_page_transparent;
+}
+
+void BitcoinHugePage_SetMode(enum BitcoinHugePageMode mode)
+{
+	huge_page_mode = mode;
+	BitcoinHugePage_transparentEnabled();
+}
+
+enum BitcoinHugePageMode BitcoinHugePage_GetMode(void)
+{
+	return huge_page_mode;
+}
+
+/* size in whole huge pages, or 0 if that overflows */
+static size_t BitcoinHugePage_round(size_t size)
+{
+	const size_t rounded = (size + BITCOIN_HUGE_PAGE_SIZE - 1)
+		& ~(BITCOIN_HUGE_PAGE_SIZE - 1);
+
+	return rounded < size ? 0 : rounded;
+}
+
+static unsigned char *BitcoinHugePage_map(size_t size, int flags)
+{
+	void *memory = mmap(NULL, size, PROT_READ | PROT_WRITE,
+		MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0
+	);
+
+	return memory == MAP_FAILED ? NULL : (unsigned char *)memory;
+}
+
+/* Map size bytes starting on a huge page boundary, as transparent huge
+   pages only back whole aligned huge pages: map a huge page more than
+   needed, and unmap what is either side of the aligned part */
+static unsigned char *BitcoinHugePage_mapAligned(size_t size)
+{
+	unsigned char *memory, *aligned;
+	size_t head;
+
+	if (size + BITCOIN_HUGE_PAGE_SIZE < size) {
+		return NULL;
+	}
+	memory = BitcoinHugePage_map(size + BITCOIN_HUGE_PAGE_SIZE, 0);
+	if (!memory) {
+		return NULL;
+	}
+
+	head = (BITCOIN_HUGE_PAGE_SIZE - (size_t)memory % BITCOIN_HUGE_PAGE_SIZE)
+		% BITCOIN_HUGE_PAGE_SIZE;
+	aligned = memory + head;
+	if (head) {
+		munmap(memory, head);
+	}
+	munmap(aligned + size, BITCOIN_HUGE_PAGE_SIZE - head);
+	return aligned;
+}
+
+void *BitcoinHugePage_Alloc(size_t size, enum BitcoinHugePageBacking *backing)
+{
+	const size_t rounded = BitcoinHugePage_round(size);
+	enum BitcoinHugePageBacking used = BITCOIN_HUGE_PAGE_BACKING_NONE;
+	unsigned char *memory = NULL;
+
+	if (!rounded) {
+		applog(APPLOG_ERROR, __func__, "Failed to allocate %lu bytes.",
+			(unsigned long)size
+		);
+		return NULL;
+	}
+
+#ifdef MAP_HUGETLB
+	/* fails at once, rather than on first use, if the pool is short */
+	if (huge_page_mode == BITCOIN_HUGE_PAGES_EXPLICIT) {
+		memory = BitcoinHugePage_map(rounded, MAP_HUGETLB);
+		if (memory) {
+			used = BITCOIN_HUGE_PAGE_BACKING_EXPLICIT;
+		}
+	}
+#endif
+#ifdef MADV_HUGEPAGE
+	if (!memory && huge_page_mode != BITCOIN_HUGE_PAGES_OFF
+		&& BitcoinHugePage_transparentEnabled()
+	) {
+		memory = BitcoinHugePage_mapAligned(rounded);
+		if (memory && !madvise(memory, rounded, MADV_HUGEPAGE)) {
+			used = BITCOIN_HUGE_PAGE_BACKING_TRANSPARENT;
+		}
+	}
+#endif
+	if (!memory) {
+		memory = BitcoinHugePage_map(rounded, 0);
+	}
+	if (!memory) {
+		applog(APPLOG_ERROR, __func__, "Failed to allocate %lu bytes (%s)",
+			(unsigned long)size, strerror(errno)
+		);
+		return NULL;
+	}
+
+	if (backing) {
+		*backing = used;
+	}
+	return memory;
+}
+
+size_t BitcoinHugePage_GetMappedSize(size_t size)
+{
+	return BitcoinHugePage_round(size);
+}
+
+void BitcoinHugePage_Free(void *memory, size_t size)
+{
+	if (memory) {
+		munmap(memory, BitcoinHugePage_round(size));
+	}
+}
+
+enum BitcoinHugePageBacking BitcoinHugePage_Advise(void *memory, size_t size)
+{
+#ifdef MADV_HUGEPAGE
+	if (huge_page_mode != BITCOIN_HUGE_PAGES_OFF
+		&& BitcoinHugePage_transparentEnabled()
+		&& !madvise(memory, size, MADV_HUGEPAGE)
+	) {
+		return BITCOIN_HUGE_PAGE_BACKING_TRANSPARENT;
+	}
+#else
+	(void)memory;
+	(void)size;
+#endif
+	return BITCOIN_HUGE_PAGE_BACKING_NONE;
+}
+
+uint64_t BitcoinHugePage_GetHugeBytes(const void *memory, size_t size)
+{
+	const unsigned long address = (unsigned long)memory;
+	FILE *file = fopen("/proc/self/smaps", "r");
+	char line[256], key[32];
+	unsigned long start, end, kb;
+	uint64_t bytes = 0;
+	int inside = 0;
+
+	if (!file) {
+		return 0;
+	}
+
+	/* each mapping is a "start-end perms ..." line, then "Key: n kB" lines */
+	while (fgets(line, sizeof(line), file)) {
+		if (sscanf(line, "%lx-%lx ", &start, &end) == 2) {
+			if (inside) {
+				break;
+			}
+			inside = address >= start && address < end;
+		} else if (inside && sscanf(line, "%31[^:]: %lu kB", key, &kb) == 2
+			&& (!strcmp(key, "AnonHugePages") || !strcmp(key, "FilePmdMapped")
+				|| !strcmp(key, "ShmemPmdMapped")
+				|| !strcmp(key, "Private_Hugetlb")
+				|| !strcmp(key, "Shared_Hugetlb"))
+		) {
+			bytes += (uint64_t)kb << 10;
+		}
+	}
+	fclose(file);
+
+	return bytes < size ? bytes : size;
+}
@@ -0,0 +1,91 @@
+#ifndef BITCOIN_INCLUDE_HUGEPAGE_H
+#define BITCOIN_INCLUDE_HUGEPAGE_H
+
+/** @file hugepage.h
+ *  @brief Memory for large read-mostly structures (the secp256k1 tables,
+ *         match sets and indexes) backed by 2 MiB pages where possible.
+ *
+ *  A lookup in a structure of gigabytes lands on a different 4 KiB page
+ *  each time, and the CPU's TLB covers only a few megabytes of those, so
+ *  most lookups wait for a page walk as well as for the data.  The same
+ *  memory in 2 MiB pages is covered 512 times further.
+ *
+ *  Memory is allocated with mmap(), in whole huge pages, as the mode
+ *  allows: from the pool of explicit huge pages the administrator reserved
+ *  (MAP_HUGETLB, see vm.nr_hugepages), or aligned to 2 MiB and advised for
+ *  transparent huge pages (MADV_HUGEPAGE), or in normal pages, falling back
+ *  in that order.  Each allocation reports the backing it got.  With
+ *  transparent huge pages the kernel may still use normal pages, eg: when
+ *  memory is fragmented, so how much of a structure is in huge pages is
+ *  read back from /proc/self/smaps.
+ */
+
+#include <stddef.h> /* size_t */
+#include <stdint.h>
+
+#define BITCOIN_HUGE_PAGE_SIZE ((size_t)2 << 20)
+
+enum BitcoinHugePageMode {
+	BITCOIN_HUGE_PAGES_OFF,
+	BITCOIN_HUGE_PAGES_TRANSPARENT, /* the default */
+	BITCOIN_HUGE_PAGES_EXPLICIT
+};
+
+enum BitcoinHugePageBacking {
+	BITCOIN_HUGE_PAGE_BACKING_NONE,
+	BITCOIN_HUGE_PAGE_BACKING_TRANSPARENT,
+	BITCOIN_HUGE_PAGE_BACKING_EXPLICIT
+};
+
+/** @brief Parse a mode name: off, transparent or explicit.
+ *
+ *  @return Non-zero if name is valid.
+ */
+int BitcoinHugePage_ParseMode(const char *name, enum BitcoinHugePageMode *mode);
+
+/** @brief Set the mode of later allocations.  Should be called before
+ *         starting threads.
+ */
+void BitcoinHugePage_SetMode(enum BitcoinHugePageMode mode);
+
+/** @brief Get the mode of allocations. */
+enum BitcoinHugePageMode BitcoinHugePage_GetMode(void);
+
+/** @brief Allocate zeroed memory, in huge pages as the mode allows.
+ *
+ *  @param[out] backing The backing used, may be NULL.
+ *
+ *  @return Pointer to memory, aligned to BITCOIN_HUGE_PAGE_SIZE unless
+ *          the mode is off, or NULL if failure.
+ */
+void *BitcoinHugePage_Alloc(size_t size, enum BitcoinHugePageBacking *backing);
+
+/** @brief Get the length of the mapping BitcoinHugePage_Alloc() makes for
+ *         size bytes, whole huge pages, for calls which must cover all of
+ *         it (eg: BitcoinNUMA_Bind(), which would otherwise split it).
+ */
+size_t BitcoinHugePage_GetMappedSize(size_t size);
+
+/** @brief Free memory from BitcoinHugePage_Alloc(), of the same size. */
+void BitcoinHugePage_Free(void *memory, size_t size);
+
+/** @brief Advise the kernel to back a mapping of a file with transparent
+ *         huge pages, if the mode allows.
+ *
+ *  @return The backing used.
+ */
+enum BitcoinHugePageBacking BitcoinHugePage_Advise(void *memory, size_t size);
+
+/** @brief Get the bytes of size bytes of memory which are in huge pages,
+ *         of any kind, or 0 if that can't be found out.  The kernel counts
+ *         them by mapping, and merges neighbouring mappings alike, so this
+ *         is an upper bound.
+ */
+uint64_t BitcoinHugePage_GetHugeBytes(const void *memory, size_t size);
+
+/** @brief Get the name of a backing: "explicit", "transparent" or
+ *         "none".
+ */
+const char *BitcoinHugePage_GetBackingName(enum BitcoinHugePageBacking backing);
+
+#endif
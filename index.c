@@ -0,0 +1,2197 @@
+/*
+Watch-list index: building it from a list of addresses, and matching hashes
+against it (see index.h for the file format).
+
+Building, the hashes are collected into a run buffer.  When it is full, the
+run is sorted by a parallel MSD radix sort: the threads count the first
+bytes of their slices, scatter the hashes into the scratch buffer by first
+byte, then take the 256 buckets in turn and sort each in place on the
+following bytes (an American flag sort, with insertion sort for small
+buckets).  The sorted run is deduplicated and spilled to a temporary file.
+Finishing, a run which is still in memory and nothing else is written out
+directly, otherwise the spilled runs are merged through a heap into the
+index file, with duplicates across runs dropped as they meet.
+
+Updating, the hashes added and removed are built the same way into the two
+sections of a delta file.  A lookup asks the deltas from the newest down,
+and the base last.  Compacting merges files through a heap of cursors into
+their sorted sections, the newest file mentioning a hash deciding whether
+it is kept.  Writers (building, updating, compacting) hold a lock on the
+index, while readers never lock: every file is written under a temporary
+name and renamed into place, and merged deltas are removed only after the
+file they were merged into is in place.
+*/
+
+#define _XOPEN_SOURCE 600 /* mkstemp() */
+#define _FILE_OFFSET_BITS 64
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <dirent.h>
+
+#include "index.h"
+#include "applog.h"
+#include "batch.h"
+#include "context.h"
+
+#define BITCOIN_INDEX_HASH_SIZE BITCOIN_RIPEMD160_SIZE
+
+/* most threads a builder runs */
+#define BITCOIN_INDEX_MAX_THREADS 256
+
+/* addresses decoded at a time */
+#define BITCOIN_INDEX_DECODE_CHUNK 65536
+
+/* addresses below this many per thread aren't worth another thread */
+#define BITCOIN_INDEX_DECODE_MIN_SLICE 1024
+
+/* buckets of this many hashes or fewer are insertion sorted */
+#define BITCOIN_INDEX_INSERTION_SORT_SIZE 32
+
+/* hashes read at a time from each run while merging */
+#define BITCOIN_INDEX_MERGE_BUFFER 65536
+
+/* bytes of the index file buffered at a time while writing it */
+#define BITCOIN_INDEX_WRITE_BUFFER (1024 * 1024)
+
+/* suffixes of the files written next to an index */
+#define BITCOIN_INDEX_TEMPORARY_SUFFIX ".tmp"
+#define BITCOIN_INDEX_LOCK_SUFFIX ".lock"
+
+/* times to open an index which changes while it is opened, before giving
+   up */
+#define BITCOIN_INDEX_OPEN_ATTEMPTS 16
+
+/* lookups of a batch in flight at a time: enough for the cache misses of
+   each to overlap the others', few enough for their lines to stay cached */
+#define BITCOIN_INDEX_PROBE_GROUP 16
+
+/* a sorted run spilled to a temporary file */
+struct BitcoinIndexRun {
+	FILE *file;
+	uint64_t count;
+
+	/* while merging: hashes read from the file, and the next one */
+	struct BitcoinRIPEMD160 *buffer;
+	size_t position, available;
+};
+
+struct BitcoinIndexBuilder {
+	unsigned threads;
+
+	/* one per thread, for the batch decoder */
+	struct BitcoinContext **contexts;
+
+	/* the current run, and scratch space of the same size for sorting */
+	struct BitcoinRIPEMD160 *hashes, *scratch;
+	size_t count, capacity;
+
+	/* addresses of the chunk being decoded */
+	struct BitcoinAddress *addresses;
+
+	struct BitcoinIndexRun *runs;
+	size_t run_count, run_capacity;
+};
+
+/* hashes in an index file, and the fan-out table finding them */
+struct BitcoinIndexSection {
+	unsigned fanout_bits;
+	const unsigned char *fanout;
+	const struct BitcoinRIPEMD160 *hashes;
+	uint64_t count;
+};
+
+/* an index file mapped into memory: the base, or a delta */
+struct BitcoinIndexSegment {
+	unsigned char *map;
+	size_t map_size;
+
+	/* whether map is the file read into huge pages rather than mapped */
+	int loaded;
+	enum BitcoinHugePageBacking backing;
+
+	/* the hashes it holds and, in a delta, the hashes it removes */
+	struct BitcoinIndexSection hashes, removed;
+
+	/* of the base, the first delta not merged into it; of a delta, its
+	   number */
+	uint64_t first_delta, number;
+};
+
+struct BitcoinIndex {
+	struct BitcoinIndexSegment base;
+
+	/* oldest first */
+	struct BitcoinIndexSegment *deltas;
+	size_t delta_count;
+};
+
+static uint64_t BitcoinIndex_load64(const unsigned char *p)
+{
+	return (uint64_t)p[0] | (uint64_t)p[1] << 8 | (uint64_t)p[2] << 16
+		| (uint64_t)p[3] << 24 | (uint64_t)p[4] << 32 | (uint64_t)p[5] << 40
+		| (uint64_t)p[6] << 48 | (uint64_t)p[7] << 56;
+}
+
+static uint32_t BitcoinIndex_load32(const unsigned char *p)
+{
+	return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16
+		| (uint32_t)p[3] << 24;
+}
+
+static void BitcoinIndex_store64(unsigned char *p, uint64_t value)
+{
+	unsigned i;
+
+	for (i = 0; i < 8; i++) {
+		p[i] = (unsigned char)(value >> (i * 8));
+	}
+}
+
+static void BitcoinIndex_store32(unsigned char *p, uint32_t value)
+{
+	unsigned i;
+
+	for (i = 0; i < 4; i++) {
+		p[i] = (unsigned char)(value >> (i * 8));
+	}
+}
+
+/* The fan-out bucket of a hash: its top bits */
+static __inline__ uint32_t BitcoinIndex_prefix(const struct BitcoinRIPEMD160 *hash,
+	unsigned bits
+)
+{
+	return ((uint32_t)hash->data[0] << 16 | (uint32_t)hash->data[1] << 8
+		| hash->data[2]) >> (24 - bits);
+}
+
+/* Enough fan-out bits for count hashes to average at most
+   BITCOIN_INDEX_FANOUT_BUCKET_SIZE per bucket */
+static unsigned BitcoinIndex_fanoutBits(uint64_t count)
+{
+	unsigned bits = BITCOIN_INDEX_MIN_FANOUT_BITS;
+
+	while (bits < BITCOIN_INDEX_MAX_FANOUT_BITS
+		&& (count >> bits) > BITCOIN_INDEX_FANOUT_BUCKET_SIZE
+	) {
+		bits++;
+	}
+	return bits;
+}
+
+/* a thread running its part of a task */
+struct BitcoinIndexWorker {
+	pthread_t thread;
+	int started;
+
+	void (*task)(void *arg, unsigned thread, unsigned threads);
+	void *arg;
+	unsigned index, count;
+};
+
+static void *BitcoinIndex_worker(void *arg)
+{
+	struct BitcoinIndexWorker *worker = (struct BitcoinIndexWorker *)arg;
+	worker->task(worker->arg, worker->index, worker->count);
+	return NULL;
+}
+
+/* Run task on threads threads, the calling thread being thread 0.  A thread
+   which can't be started has its part run by the calling thread. */
+static void BitcoinIndex_parallel(unsigned threads,
+	void (*task)(void *arg, unsigned thread, unsigned threads), void *arg
+)
+{
+	struct BitcoinIndexWorker workers[BITCOIN_INDEX_MAX_THREADS];
+	unsigned i;
+
+	assert(threads >= 1 && threads <= BITCOIN_INDEX_MAX_THREADS);
+
+	for (i = 1; i < threads; i++) {
+		workers[i].task = task;
+		workers[i].arg = arg;
+		workers[i].index = i;
+		workers[i].count = threads;
+		workers[i].started = !pthread_create(&workers[i].thread, NULL,
+			BitcoinIndex_worker, &workers[i]
+		);
+	}
+	task(arg, 0, threads);
+	for (i = 1; i < threads; i++) {
+		if (workers[i].started) {
+			pthread_join(workers[i].thread, NULL);
+		} else {
+			task(arg, i, threads);
+		}
+	}
+}
+
+/* The slice of count items for a thread */
+static void BitcoinIndex_slice(size_t count, unsigned thread, unsigned threads,
+	size_t *start, size_t *end
+)
+{
+	*start = (size_t)((double)count * thread / threads);
+	*end = (size_t)((double)count * (thread + 1) / threads);
+	if (thread + 1 == threads) {
+		*end = count;
+	}
+}
+
+static __inline__ int BitcoinIndex_compare(const struct BitcoinRIPEMD160 *a,
+	const struct BitcoinRIPEMD160 *b
+)
+{
+	return memcmp(a->data, b->data, BITCOIN_INDEX_HASH_SIZE);
+}
+
+/* Sort hashes which have their first byte bytes in common */
+static void BitcoinIndex_insertionSort(struct BitcoinRIPEMD160 *hashes,
+	size_t count, unsigned byte
+)
+{
+	size_t i, j;
+
+	for (i = 1; i < count; i++) {
+		struct BitcoinRIPEMD160 hash = hashes[i];
+
+		for (j = i; j > 0 && memcmp(hash.data + byte, hashes[j - 1].data + byte,
+			BITCOIN_INDEX_HASH_SIZE - byte) < 0; j--
+		) {
+			hashes[j] = hashes[j - 1];
+		}
+		hashes[j] = hash;
+	}
+}
+
+/* Sort hashes which have their first byte bytes in common, in place, by
+   permuting them into buckets on the next byte and sorting each bucket */
+static void BitcoinIndex_sortBytes(struct BitcoinRIPEMD160 *hashes,
+	size_t count, unsigned byte
+)
+{
+	size_t next[256], end[256], position;
+	unsigned b;
+
+	if (byte >= BITCOIN_INDEX_HASH_SIZE) {
+		return;
+	}
+	if (count <= BITCOIN_INDEX_INSERTION_SORT_SIZE) {
+		BitcoinIndex_insertionSort(hashes, count, byte);
+		return;
+	}
+
+	memset(end, 0, sizeof(end));
+	for (position = 0; position < count; position++) {
+		end[hashes[position].data[byte]]++;
+	}
+	for (b = 0, position = 0; b < 256; b++) {
+		next[b] = position;
+		position += end[b];
+		end[b] = position;
+	}
+
+	for (b = 0; b < 256; b++) {
+		while (next[b] < end[b]) {
+			unsigned value = hashes[next[b]].data[byte];
+
+			if (value == b) {
+				next[b]++;
+			} else {
+				struct BitcoinRIPEMD160 hash = hashes[next[b]];
+				hashes[next[b]] = hashes[next[value]];
+				hashes[next[value]++] = hash;
+			}
+		}
+	}
+
+	for (b = 0, position = 0; b < 256; b++) {
+		if (end[b] - position > 1) {
+			BitcoinIndex_sortBytes(hashes + position, end[b] - position, byte + 1);
+		}
+		position = end[b];
+	}
+}
+
+/* A parallel sort of a run: the first byte out of place, from source to
+   destination, then each bucket in place */
+struct BitcoinIndexSort {
+	const struct BitcoinRIPEMD160 *source;
+	struct BitcoinRIPEMD160 *destination;
+	size_t count;
+
+	/* each thread's count of each first byte, then where it puts the
+	   next hash with that first byte */
+	size_t (*offsets)[256];
+
+	/* where each bucket starts, and the next one to sort */
+	size_t buckets[257];
+	unsigned next_bucket;
+};
+
+static void BitcoinIndex_countTask(void *arg, unsigned thread, unsigned threads)
+{
+	struct BitcoinIndexSort *sort = (struct BitcoinIndexSort *)arg;
+	size_t *counts = sort->offsets[thread];
+	size_t i, start, end;
+
+	BitcoinIndex_slice(sort->count, thread, threads, &start, &end);
+	memset(counts, 0, sizeof(sort->offsets[thread]));
+	for (i = start; i < end; i++) {
+		counts[sort->source[i].data[0]]++;
+	}
+}
+
+static void BitcoinIndex_scatterTask(void *arg, unsigned thread, unsigned threads)
+{
+	struct BitcoinIndexSort *sort = (struct BitcoinIndexSort *)arg;
+	size_t *offsets = sort->offsets[thread];
+	size_t i, start, end;
+
+	BitcoinIndex_slice(sort->count, thread, threads, &start, &end);
+	for (i = start; i < end; i++) {
+		sort->destination[offsets[sort->source[i].data[0]]++] = sort->source[i];
+	}
+}
+
+static void BitcoinIndex_bucketTask(void *arg, unsigned thread, unsigned threads)
+{
+	struct BitcoinIndexSort *sort = (struct BitcoinIndexSort *)arg;
+	unsigned b;
+
+	(void)thread;
+	(void)threads;
+
+	while ((b = __atomic_fetch_add(&sort->next_bucket, 1, __ATOMIC_RELAXED)) < 256) {
+		BitcoinIndex_sortBytes(sort->destination + sort->buckets[b],
+			sort->buckets[b + 1] - sort->buckets[b], 1
+		);
+	}
+}
+
+/* Sort the current run into the scratch buffer, and swap the two */
+static int BitcoinIndexBuilder_sort(struct BitcoinIndexBuilder *self)
+{
+	struct BitcoinIndexSort sort;
+	struct BitcoinRIPEMD160 *sorted;
+	unsigned threads = self->threads, t, b;
+	size_t position;
+
+	memset(&sort, 0, sizeof(sort));
+	sort.source = self->hashes;
+	sort.destination = self->scratch;
+	sort.count = self->count;
+	sort.offsets = malloc(threads * sizeof(*sort.offsets));
+	if (!sort.offsets) {
+		applog(APPLOG_ERROR, __func__, "Failed to allocate sort counts.");
+		return 0;
+	}
+
+	BitcoinIndex_parallel(threads, BitcoinIndex_countTask, &sort);
+
+	/* turn the counts into each thread's offsets in each bucket */
+	for (b = 0, position = 0; b < 256; b++) {
+		sort.buckets[b] = position;
+		for (t = 0; t < threads; t++) {
+			size_t count = sort.offsets[t][b];
+			sort.offsets[t][b] = position;
+			position += count;
+		}
+	}
+	sort.buckets[256] = position;
+	assert(position == self->count);
+
+	BitcoinIndex_parallel(threads, BitcoinIndex_scatterTask, &sort);
+	BitcoinIndex_parallel(threads, BitcoinIndex_bucketTask, &sort);
+
+	free(sort.offsets);
+
+	sorted = self->scratch;
+	self->scratch = self->hashes;
+	self->hashes = sorted;
+
+	return 1;
+}
+
+/* Drop duplicates from sorted hashes, returning how many are left */
+static size_t BitcoinIndex_unique(struct BitcoinRIPEMD160 *hashes, size_t count)
+{
+	size_t i, unique = 0;
+
+	for (i = 0; i < count; i++) {
+		if (!unique || BitcoinIndex_compare(&hashes[i], &hashes[unique - 1])) {
+			hashes[unique++] = hashes[i];
+		}
+	}
+	return unique;
+}
+
+/* Create a temporary file in TMPDIR (or /tmp), which is removed once
+   closed */
+static FILE *BitcoinIndex_temporaryFile(void)
+{
+	const char *directory = getenv("TMPDIR");
+	char *name;
+	FILE *file = NULL;
+	int fd;
+
+	if (!directory || !*directory) {
+		directory = "/tmp";
+	}
+	name = malloc(strlen(directory) + 32);
+	if (!name) {
+		return NULL;
+	}
+	sprintf(name, "%s/bitcoin-tool-index-XXXXXX", directory);
+
+	fd = mkstemp(name);
+	if (fd >= 0) {
+		unlink(name);
+		file = fdopen(fd, "w+b");
+		if (!file) {
+			close(fd);
+		}
+	}
+	free(name);
+
+	return file;
+}
+
+/* Sort the current run, and spill it to a temporary file */
+static int BitcoinIndexBuilder_spill(struct BitcoinIndexBuilder *self)
+{
+	struct BitcoinIndexRun *run;
+
+	if (!BitcoinIndexBuilder_sort(self)) {
+		return 0;
+	}
+	self->count = BitcoinIndex_unique(self->hashes, self->count);
+
+	if (self->run_count == self->run_capacity) {
+		size_t capacity = self->run_capacity ? self->run_capacity * 2 : 16;
+		struct BitcoinIndexRun *runs = realloc(self->runs,
+			capacity * sizeof(*runs)
+		);
+		if (!runs) {
+			applog(APPLOG_ERROR, __func__, "Failed to allocate runs.");
+			return 0;
+		}
+		self->runs = runs;
+		self->run_capacity = capacity;
+	}
+
+	run = &self->runs[self->run_count];
+	memset(run, 0, sizeof(*run));
+	run->file = BitcoinIndex_temporaryFile();
+	if (!run->file) {
+		applog(APPLOG_ERROR, __func__, "Failed to create temporary file (%s)",
+			strerror(errno)
+		);
+		return 0;
+	}
+	self->run_count++;
+
+	if (fwrite(self->hashes, sizeof(*self->hashes), self->count, run->file)
+			!= self->count
+		|| fflush(run->file)
+	) {
+		applog(APPLOG_ERROR, __func__, "Failed to write temporary file (%s)",
+			strerror(errno)
+		);
+		return 0;
+	}
+	run->count = self->count;
+	self->count = 0;
+
+	return 1;
+}
+
+struct BitcoinIndexBuilder *BitcoinIndexBuilder_create(unsigned threads,
+	size_t memory_budget
+)
+{
+	struct BitcoinIndexBuilder *self;
+	unsigned i;
+
+	if (threads < 1) {
+		threads = 1;
+	} else if (threads > BITCOIN_INDEX_MAX_THREADS) {
+		threads = BITCOIN_INDEX_MAX_THREADS;
+	}
+
+	self = calloc(1, sizeof(*self));
+	if (!self) {
+		applog(APPLOG_ERROR, __func__, "Failed to allocate index builder.");
+		return NULL;
+	}
+	self->threads = threads;
+
+	/* the run and its scratch space share the budget */
+	self->capacity = memory_budget / (2 * sizeof(*self->hashes));
+	if (self->capacity < BITCOIN_INDEX_DECODE_CHUNK) {
+		self->capacity = BITCOIN_INDEX_DECODE_CHUNK;
+	}
+	self->hashes = malloc(self->capacity * sizeof(*self->hashes));
+	self->scratch = malloc(self->capacity * sizeof(*self->scratch));
+	self->addresses = malloc(BITCOIN_INDEX_DECODE_CHUNK * sizeof(*self->addresses));
+	self->contexts = calloc(threads, sizeof(*self->contexts));
+	if (!self->hashes || !self->scratch || !self->addresses || !self->contexts) {
+		applog(APPLOG_ERROR, __func__,
+			"Failed to allocate %lu MiB for the index builder.",
+			(unsigned long)(memory_budget >> 20)
+		);
+		BitcoinIndexBuilder_destroy(self);
+		return NULL;
+	}
+	for (i = 0; i < threads; i++) {
+		self->contexts[i] = BitcoinContext_create();
+		if (!self->contexts[i]) {
+			BitcoinIndexBuilder_destroy(self);
+			return NULL;
+		}
+	}
+
+	return self;
+}
+
+void BitcoinIndexBuilder_destroy(struct BitcoinIndexBuilder *self)
+{
+	size_t i;
+
+	if (!self) {
+		return;
+	}
+	for (i = 0; i < self->run_count; i++) {
+		fclose(self->runs[i].file);
+		free(self->runs[i].buffer);
+	}
+	free(self->runs);
+	if (self->contexts) {
+		for (i = 0; i < self->threads; i++) {
+			BitcoinContext_destroy(self->contexts[i]);
+		}
+		free(self->contexts);
+	}
+	free(self->addresses);
+	free(self->scratch);
+	free(self->hashes);
+	free(self);
+}
+
+struct BitcoinIndexDecode {
+	struct BitcoinIndexBuilder *builder;
+	const char *const *texts;
+	const struct BitcoinNetworkType *network_type;
+	size_t count;
+	BitcoinResult *results;
+};
+
+static void BitcoinIndex_decodeTask(void *arg, unsigned thread, unsigned threads)
+{
+	struct BitcoinIndexDecode *decode = (struct BitcoinIndexDecode *)arg;
+	size_t start, end;
+
+	BitcoinIndex_slice(decode->count, thread, threads, &start, &end);
+	BitcoinBatch_DecodeAddresses(decode->builder->contexts[thread],
+		decode->builder->addresses + start, decode->texts + start,
+		decode->network_type, end - start, decode->results + start
+	);
+}
+
+size_t BitcoinIndexBuilder_AddAddresses(struct BitcoinIndexBuilder *self,
+	const char *const *texts, const struct BitcoinNetworkType *network_type,
+	size_t count, BitcoinResult *results
+)
+{
+	struct BitcoinIndexDecode decode;
+	size_t done, i, added = 0;
+
+	decode.builder = self;
+	decode.network_type = network_type;
+
+	for (done = 0; done < count; done += decode.count) {
+		unsigned threads;
+
+		if (self->count == self->capacity && !BitcoinIndexBuilder_spill(self)) {
+			return (size_t)-1;
+		}
+
+		decode.texts = texts + done;
+		decode.results = results + done;
+		decode.count = count - done;
+		if (decode.count > BITCOIN_INDEX_DECODE_CHUNK) {
+			decode.count = BITCOIN_INDEX_DECODE_CHUNK;
+		}
+		if (decode.count > self->capacity - self->count) {
+			decode.count = self->capacity - self->count;
+		}
+
+		threads = (unsigned)(decode.count / BITCOIN_INDEX_DECODE_MIN_SLICE) + 1;
+		if (threads > self->threads) {
+			threads = self->threads;
+		}
+		BitcoinIndex_parallel(threads, BitcoinIndex_decodeTask, &decode);
+
+		for (i = 0; i < decode.count; i++) {
+			if (decode.results[i] == BITCOIN_SUCCESS) {
+				memcpy(self->hashes[self->count++].data,
+					self->addresses[i].data + BITCOIN_ADDRESS_VERSION_SIZE,
+					BITCOIN_INDEX_HASH_SIZE
+				);
+				added++;
+			}
+		}
+	}
+
+	return added;
+}
+
+size_t BitcoinIndexBuilder_AddHashes(struct BitcoinIndexBuilder *self,
+	const struct BitcoinRIPEMD160 *hashes, size_t count
+)
+{
+	size_t done, size;
+
+	for (done = 0; done < count; done += size) {
+		if (self->count == self->capacity && !BitcoinIndexBuilder_spill(self)) {
+			return (size_t)-1;
+		}
+		size = count - done;
+		if (size > self->capacity - self->count) {
+			size = self->capacity - self->count;
+		}
+		memcpy(self->hashes + self->count, hashes + done,
+			size * sizeof(*hashes)
+		);
+		self->count += size;
+	}
+
+	return count;
+}
+
+/* Writes a section of an index file: a fan-out table at offset, then the
+   hashes put, counted into the table with duplicates dropped.  Or, with
+   visit set, passes each distinct hash put to visit instead. */
+struct BitcoinIndexWriter {
+	void (*visit)(void *arg, const struct BitcoinRIPEMD160 *hash);
+	void *arg;
+
+	FILE *file;
+	uint64_t offset;
+	unsigned fanout_bits;
+	uint64_t *fanout;
+	struct BitcoinRIPEMD160 last;
+
+	/* for the header, and where the next section can start once ended */
+	uint64_t count, entries_offset, end;
+};
+
+/* Start a section at offset in a file, for up to bound distinct hashes */
+static int BitcoinIndexWriter_begin(struct BitcoinIndexWriter *writer,
+	FILE *file, uint64_t offset, uint64_t bound
+)
+{
+	uint64_t fanout_size;
+
+	memset(writer, 0, sizeof(*writer));
+	writer->file = file;
+	writer->offset = offset;
+	writer->fanout_bits = BitcoinIndex_fanoutBits(bound);
+	fanout_size = ((uint64_t)1 << writer->fanout_bits) + 1;
+	writer->entries_offset = offset + fanout_size * 8;
+
+	writer->fanout = calloc(fanout_size, sizeof(*writer->fanout));
+	if (!writer->fanout) {
+		applog(APPLOG_ERROR, __func__, "Failed to allocate fan-out table.");
+		return 0;
+	}
+	if (fseeko(file, (off_t)writer->entries_offset, SEEK_SET)) {
+		applog(APPLOG_ERROR, __func__, "Error writing index (%s)",
+			strerror(errno)
+		);
+		return 0;
+	}
+	return 1;
+}
+
+static int BitcoinIndexWriter_put(struct BitcoinIndexWriter *writer,
+	const struct BitcoinRIPEMD160 *hash
+)
+{
+	if (writer->count && !BitcoinIndex_compare(hash, &writer->last)) {
+		return 1;
+	}
+	writer->last = *hash;
+	writer->count++;
+	if (writer->visit) {
+		writer->visit(writer->arg, hash);
+		return 1;
+	}
+	writer->fanout[BitcoinIndex_prefix(hash, writer->fanout_bits) + 1]++;
+	return fwrite(hash, sizeof(*hash), 1, writer->file) == 1;
+}
+
+/* Free a section's fan-out table, written or not */
+static void BitcoinIndexWriter_discard(struct BitcoinIndexWriter *writer)
+{
+	free(writer->fanout);
+	writer->fanout = NULL;
+}
+
+/* Write a section's fan-out table, leaving the file at the section's end */
+static int BitcoinIndexWriter_end(struct BitcoinIndexWriter *writer)
+{
+	const uint64_t fanout_size = ((uint64_t)1 << writer->fanout_bits) + 1;
+	uint64_t i;
+	int success;
+
+	for (i = 1; i < fanout_size; i++) {
+		writer->fanout[i] += writer->fanout[i - 1];
+	}
+	/* little-endian in place, to write as it is */
+	for (i = 0; i < fanout_size; i++) {
+		BitcoinIndex_store64((unsigned char *)&writer->fanout[i],
+			writer->fanout[i]
+		);
+	}
+	writer->end = writer->entries_offset
+		+ writer->count * BITCOIN_INDEX_HASH_SIZE;
+
+	success = !fseeko(writer->file, (off_t)writer->offset, SEEK_SET)
+		&& fwrite(writer->fanout, 8, (size_t)fanout_size, writer->file)
+			== fanout_size
+		&& !fseeko(writer->file, (off_t)writer->end, SEEK_SET);
+	if (!success) {
+		applog(APPLOG_ERROR, __func__, "Error writing index (%s)",
+			strerror(errno)
+		);
+	}
+
+	BitcoinIndexWriter_discard(writer);
+	return success;
+}
+
+/* Write the header of an index file, for the hashes it holds and, in a
+   delta, the hashes it removes (NULL otherwise) */
+static int BitcoinIndex_writeHeader(FILE *file,
+	const struct BitcoinIndexWriter *hashes,
+	const struct BitcoinIndexWriter *removed, uint64_t first_delta
+)
+{
+	unsigned char header[BITCOIN_INDEX_HEADER_SIZE];
+
+	memset(header, 0, sizeof(header));
+	memcpy(header, BITCOIN_INDEX_MAGIC, 8);
+	BitcoinIndex_store32(header + 8, BITCOIN_INDEX_VERSION);
+	BitcoinIndex_store32(header + 12, hashes->fanout_bits);
+	BitcoinIndex_store64(header + 16, hashes->count);
+	BitcoinIndex_store64(header + 24, hashes->offset);
+	BitcoinIndex_store64(header + 32, hashes->entries_offset);
+	BitcoinIndex_store32(header + 40, BITCOIN_INDEX_HASH_SIZE);
+	if (removed) {
+		BitcoinIndex_store32(header + 44, removed->fanout_bits);
+		BitcoinIndex_store64(header + 48, removed->count);
+		BitcoinIndex_store64(header + 56, removed->offset);
+		BitcoinIndex_store64(header + 64, removed->entries_offset);
+	}
+	BitcoinIndex_store64(header + 72, first_delta);
+
+	if (fseeko(file, 0, SEEK_SET)
+		|| fwrite(header, sizeof(header), 1, file) != 1
+	) {
+		applog(APPLOG_ERROR, __func__, "Error writing index (%s)",
+			strerror(errno)
+		);
+		return 0;
+	}
+	return 1;
+}
+
+/* Create the temporary file an index file is written to */
+static FILE *BitcoinIndex_createFile(const char *temporary)
+{
+	FILE *file = fopen(temporary, "wb");
+
+	if (!file) {
+		applog(APPLOG_ERROR, __func__, "Failed to create file [%s] (%s)",
+			temporary, strerror(errno)
+		);
+		return NULL;
+	}
+	if (setvbuf(file, NULL, _IOFBF, BITCOIN_INDEX_WRITE_BUFFER)) {
+		applog(APPLOG_ERROR, __func__, "Error writing index (%s)",
+			strerror(errno)
+		);
+		fclose(file);
+		remove(temporary);
+		return NULL;
+	}
+	return file;
+}
+
+/* Close a temporary index file and, if it was written successfully, sync
+   it and rename it over filename, otherwise remove it.  Syncing first means
+   a crash can't leave a partly written file in place of the files it
+   replaces. */
+static int BitcoinIndex_commitFile(FILE *file, const char *temporary,
+	const char *filename, int success
+)
+{
+	if (success && (fflush(file) || fsync(fileno(file)))) {
+		applog(APPLOG_ERROR, __func__, "Error writing index (%s)",
+			strerror(errno)
+		);
+		success = 0;
+	}
+	if (fclose(file) && success) {
+		applog(APPLOG_ERROR, __func__, "Error writing index (%s)",
+			strerror(errno)
+		);
+		success = 0;
+	}
+	if (success && rename(temporary, filename)) {
+		applog(APPLOG_ERROR, __func__, "Failed to rename [%s] to [%s] (%s)",
+			temporary, filename, strerror(errno)
+		);
+		success = 0;
+	}
+	if (!success) {
+		remove(temporary);
+	}
+	return success;
+}
+
+/* filename with a suffix appended, allocated */
+static char *BitcoinIndex_name(const char *filename, const char *suffix)
+{
+	char *name = malloc(strlen(filename) + strlen(suffix) + 1);
+
+	if (!name) {
+		applog(APPLOG_ERROR, __func__, "Failed to allocate file name.");
+		return NULL;
+	}
+	sprintf(name, "%s%s", filename, suffix);
+	return name;
+}
+
+/* The name of delta number of an index, allocated */
+static char *BitcoinIndex_deltaName(const char *filename, uint64_t number)
+{
+	char *name = malloc(strlen(filename) + sizeof(BITCOIN_INDEX_DELTA_SUFFIX)
+		+ 20
+	);
+
+	if (!name) {
+		applog(APPLOG_ERROR, __func__, "Failed to allocate file name.");
+		return NULL;
+	}
+	sprintf(name, "%s" BITCOIN_INDEX_DELTA_SUFFIX "%llu", filename,
+		(unsigned long long)number
+	);
+	return name;
+}
+
+/* Refill a run's buffer from its file.  Returns 1 if it has a hash to
+   merge, 0 if it is finished, -1 if the file couldn't be read. */
+static int BitcoinIndexRun_fill(struct BitcoinIndexRun *run)
+{
+	if (run->position < run->available) {
+		return 1;
+	}
+	run->position = 0;
+	run->available = fread(run->buffer, sizeof(*run->buffer),
+		BITCOIN_INDEX_MERGE_BUFFER, run->file
+	);
+	if (run->available) {
+		return 1;
+	}
+	return ferror(run->file) ? -1 : 0;
+}
+
+/* Move heap[i] down to its place in a heap of runs ordered by their next
+   hash */
+static void BitcoinIndex_siftDown(struct BitcoinIndexRun **heap, size_t size,
+	size_t i
+)
+{
+	for (;;) {
+		size_t child = 2 * i + 1, smallest = i;
+		struct BitcoinIndexRun *run;
+
+		if (child < size && BitcoinIndex_compare(
+			&heap[child]->buffer[heap[child]->position],
+			&heap[smallest]->buffer[heap[smallest]->position]) < 0
+		) {
+			smallest = child;
+		}
+		child++;
+		if (child < size && BitcoinIndex_compare(
+			&heap[child]->buffer[heap[child]->position],
+			&heap[smallest]->buffer[heap[smallest]->position]) < 0
+		) {
+			smallest = child;
+		}
+		if (smallest == i) {
+			return;
+		}
+		run = heap[i];
+		heap[i] = heap[smallest];
+		heap[smallest] = run;
+		i = smallest;
+	}
+}
+
+/* Merge the spilled runs into the writer */
+static int BitcoinIndexBuilder_merge(struct BitcoinIndexBuilder *self,
+	struct BitcoinIndexWriter *writer
+)
+{
+	struct BitcoinIndexRun **heap;
+	size_t i, size = 0;
+	int success = 1;
+
+	heap = calloc(self->run_count, sizeof(*heap));
+	if (!heap) {
+		applog(APPLOG_ERROR, __func__, "Failed to allocate merge heap.");
+		return 0;
+	}
+
+	for (i = 0; i < self->run_count; i++) {
+		struct BitcoinIndexRun *run = &self->runs[i];
+
+		run->buffer = malloc(BITCOIN_INDEX_MERGE_BUFFER * sizeof(*run->buffer));
+		if (!run->buffer) {
+			applog(APPLOG_ERROR, __func__, "Failed to allocate merge buffers.");
+			free(heap);
+			return 0;
+		}
+		if (fseeko(run->file, 0, SEEK_SET)) {
+			success = 0;
+			break;
+		}
+		switch (BitcoinIndexRun_fill(run)) {
+			case 1 :
+				heap[size++] = run;
+				break;
+			case 0 :
+				break;
+			default :
+				success = 0;
+				break;
+		}
+	}
+	for (i = size; success && i-- > 0;) {
+		BitcoinIndex_siftDown(heap, size, i);
+	}
+
+	while (success && size) {
+		struct BitcoinIndexRun *run = heap[0];
+
+		if (!BitcoinIndexWriter_put(writer, &run->buffer[run->position++])) {
+			applog(APPLOG_ERROR, __func__, "Error writing index (%s)",
+				strerror(errno)
+			);
+			success = 0;
+			break;
+		}
+		switch (BitcoinIndexRun_fill(run)) {
+			case 1 :
+				break;
+			case 0 :
+				heap[0] = heap[--size];
+				break;
+			default :
+				success = 0;
+				break;
+		}
+		BitcoinIndex_siftDown(heap, size, 0);
+	}
+	if (!success && (writer->visit || !ferror(writer->file))) {
+		applog(APPLOG_ERROR, __func__, "Failed to read temporary file (%s)",
+			strerror(errno)
+		);
+	}
+
+	free(heap);
+	return success;
+}
+
+BitcoinResult BitcoinIndexBuilder_Prepare(struct BitcoinIndexBuilder *self,
+	uint64_t *bound
+)
+{
+	size_t i;
+
+	*bound = 0;
+	if (self->run_count) {
+		if (self->count && !BitcoinIndexBuilder_spill(self)) {
+			return BITCOIN_ERROR_FILE;
+		}
+		for (i = 0; i < self->run_count; i++) {
+			*bound += self->runs[i].count;
+		}
+	} else {
+		if (!BitcoinIndexBuilder_sort(self)) {
+			return BITCOIN_ERROR;
+		}
+		self->count = BitcoinIndex_unique(self->hashes, self->count);
+		*bound = self->count;
+	}
+	return BITCOIN_SUCCESS;
+}
+
+/* Write everything added, once prepared, into a section.  The fan-out is
+   sized before duplicates across runs are dropped, by the bound. */
+static int BitcoinIndexBuilder_write(struct BitcoinIndexBuilder *self,
+	FILE *file, uint64_t offset, uint64_t bound,
+	struct BitcoinIndexWriter *writer
+)
+{
+	size_t i;
+	int success;
+
+	success = BitcoinIndexWriter_begin(writer, file, offset, bound);
+	if (success && self->run_count) {
+		success = BitcoinIndexBuilder_merge(self, writer);
+	} else if (success) {
+		for (i = 0; i < self->count; i++) {
+			if (!BitcoinIndexWriter_put(writer, &self->hashes[i])) {
+				applog(APPLOG_ERROR, __func__, "Error writing index (%s)",
+					strerror(errno)
+				);
+				success = 0;
+				break;
+			}
+		}
+	}
+	if (success) {
+		return BitcoinIndexWriter_end(writer);
+	}
+	BitcoinIndexWriter_discard(writer);
+	return 0;
+}
+
+BitcoinResult BitcoinIndexBuilder_Scan(struct BitcoinIndexBuilder *self,
+	void (*visit)(void *arg, const struct BitcoinRIPEMD160 *hash), void *arg,
+	uint64_t *unique
+)
+{
+	struct BitcoinIndexWriter writer;
+	size_t i;
+	int success = 1;
+
+	memset(&writer, 0, sizeof(writer));
+	writer.visit = visit;
+	writer.arg = arg;
+
+	if (self->run_count) {
+		success = BitcoinIndexBuilder_merge(self, &writer);
+	} else {
+		for (i = 0; i < self->count; i++) {
+			BitcoinIndexWriter_put(&writer, &self->hashes[i]);
+		}
+	}
+
+	if (unique) {
+		*unique = writer.count;
+	}
+	return success ? BITCOIN_SUCCESS : BITCOIN_ERROR_FILE;
+}
+
+/* Take the lock which serializes the writers of an index, <file>.lock,
+   waiting for it.  Returns its descriptor, closed to unlock, or -1 if
+   failure.  The lock file is left behind: removing it would race with
+   the next writer opening it.  If existing is set, the index must exist,
+   so no lock file is left next to a mistyped name. */
+static int BitcoinIndex_lock(const char *filename, int existing)
+{
+	struct flock lock;
+	char *name;
+	int fd;
+
+	if (existing && access(filename, F_OK)) {
+		applog(APPLOG_ERROR, __func__, "Failed to open file [%s] (%s)",
+			filename, strerror(errno)
+		);
+		return -1;
+	}
+
+	name = BitcoinIndex_name(filename, BITCOIN_INDEX_LOCK_SUFFIX);
+	if (!name) {
+		return -1;
+	}
+
+	fd = open(name, O_RDWR | O_CREAT, 0666);
+	if (fd < 0) {
+		applog(APPLOG_ERROR, __func__, "Failed to open file [%s] (%s)",
+			name, strerror(errno)
+		);
+		free(name);
+		return -1;
+	}
+
+	memset(&lock, 0, sizeof(lock));
+	lock.l_type = F_WRLCK;
+	lock.l_whence = SEEK_SET;
+	while (fcntl(fd, F_SETLKW, &lock)) {
+		if (errno != EINTR) {
+			applog(APPLOG_ERROR, __func__, "Failed to lock [%s] (%s)",
+				name, strerror(errno)
+			);
+			close(fd);
+			fd = -1;
+			break;
+		}
+	}
+
+	free(name);
+	return fd;
+}
+
+static int BitcoinIndex_compareNumbers(const void *a, const void *b)
+{
+	const uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* List the numbers of the deltas of an index from first on, in order.
+   Numbers need not be consecutive, as compaction leaves gaps. */
+static int BitcoinIndex_listDeltas(const char *filename, uint64_t first,
+	uint64_t **numbers, size_t *count
+)
+{
+	const char *slash = strrchr(filename, '/');
+	const char *name = slash ? slash + 1 : filename;
+	const size_t name_size = strlen(name);
+	const size_t suffix_size = strlen(BITCOIN_INDEX_DELTA_SUFFIX);
+	size_t capacity = 0;
+	char *directory;
+	struct dirent *entry;
+	DIR *dir;
+
+	*numbers = NULL;
+	*count = 0;
+
+	directory = malloc(strlen(filename) + 2);
+	if (!directory) {
+		applog(APPLOG_ERROR, __func__, "Failed to allocate file name.");
+		return 0;
+	}
+	if (!slash) {
+		strcpy(directory, ".");
+	} else if (slash == filename) {
+		strcpy(directory, "/");
+	} else {
+		memcpy(directory, filename, (size_t)(slash - filename));
+		directory[slash - filename] = '\0';
+	}
+
+	dir = opendir(directory);
+	if (!dir) {
+		applog(APPLOG_ERROR, __func__, "Failed to open directory [%s] (%s)",
+			directory, strerror(errno)
+		);
+		free(directory);
+		return 0;
+	}
+
+	while ((entry = readdir(dir)) != NULL) {
+		const char *p = entry->d_name;
+		uint64_t number = 0;
+		unsigned digits = 0;
+
+		if (strncmp(p, name, name_size)
+			|| strncmp(p + name_size, BITCOIN_INDEX_DELTA_SUFFIX, suffix_size)
+		) {
+			continue;
+		}
+		/* only <file>.delta.<number>, not a temporary file */
+		for (p += name_size + suffix_size; *p >= '0' && *p <= '9'; p++) {
+			number = number * 10 + (uint64_t)(*p - '0');
+			digits++;
+		}
+		if (*p || !digits || digits > 19 || number < first) {
+			continue;
+		}
+
+		if (*count == capacity) {
+			uint64_t *grown;
+
+			capacity = capacity ? capacity * 2 : 16;
+			grown = realloc(*numbers, capacity * sizeof(**numbers));
+			if (!grown) {
+				applog(APPLOG_ERROR, __func__, "Failed to allocate delta list.");
+				free(*numbers);
+				*numbers = NULL;
+				*count = 0;
+				closedir(dir);
+				free(directory);
+				return 0;
+			}
+			*numbers = grown;
+		}
+		(*numbers)[(*count)++] = number;
+	}
+
+	closedir(dir);
+	free(directory);
+
+	if (*count) {
+		qsort(*numbers, *count, sizeof(**numbers), BitcoinIndex_compareNumbers);
+	}
+	return 1;
+}
+
+/* Remove the deltas numbered below end, oldest first: a reader finding
+   some of them missing would see older removals without newer additions
+   otherwise */
+static void BitcoinIndex_removeDeltas(const char *filename, uint64_t end)
+{
+	uint64_t *numbers;
+	size_t count, i;
+
+	if (!BitcoinIndex_listDeltas(filename, 0, &numbers, &count)) {
+		return;
+	}
+	for (i = 0; i < count && numbers[i] < end; i++) {
+		char *name = BitcoinIndex_deltaName(filename, numbers[i]);
+
+		if (name && remove(name) && errno != ENOENT) {
+			applog(APPLOG_ERROR, __func__, "Failed to remove file [%s] (%s)",
+				name, strerror(errno)
+			);
+		}
+		free(name);
+	}
+	free(numbers);
+}
+
+BitcoinResult BitcoinIndexBuilder_Finish(struct BitcoinIndexBuilder *self,
+	const char *filename, uint64_t *unique
+)
+{
+	struct BitcoinIndexWriter writer;
+	uint64_t bound, *numbers = NULL, first_delta = 0;
+	BitcoinResult result;
+	size_t count = 0;
+	char *temporary;
+	FILE *file;
+	int lock, success;
+
+	memset(&writer, 0, sizeof(writer));
+
+	result = BitcoinIndexBuilder_Prepare(self, &bound);
+	if (result != BITCOIN_SUCCESS) {
+		return result;
+	}
+
+	/* the new index replaces the deltas of an old one, so numbers it past
+	   them and removes them */
+	lock = BitcoinIndex_lock(filename, 0);
+	if (lock < 0) {
+		return BITCOIN_ERROR_FILE;
+	}
+	if (!BitcoinIndex_listDeltas(filename, 0, &numbers, &count)) {
+		close(lock);
+		return BITCOIN_ERROR_FILE;
+	}
+	if (count) {
+		first_delta = numbers[count - 1] + 1;
+	}
+	free(numbers);
+
+	temporary = BitcoinIndex_name(filename, BITCOIN_INDEX_TEMPORARY_SUFFIX);
+	file = temporary ? BitcoinIndex_createFile(temporary) : NULL;
+	success = file != NULL;
+
+	if (success) {
+		success = BitcoinIndexBuilder_write(self, file,
+				BITCOIN_INDEX_HEADER_SIZE, bound, &writer
+			)
+			&& BitcoinIndex_writeHeader(file, &writer, NULL, first_delta);
+		success = BitcoinIndex_commitFile(file, temporary, filename, success);
+	}
+	if (success) {
+		BitcoinIndex_removeDeltas(filename, first_delta);
+	}
+
+	close(lock);
+	free(temporary);
+
+	if (unique) {
+		*unique = writer.count;
+	}
+
+	return success ? BITCOIN_SUCCESS : BITCOIN_ERROR_FILE;
+}
+
+/* Point a section at its part of a mapped index file, checking it */
+static int BitcoinIndexSection_load(struct BitcoinIndexSection *section,
+	const unsigned char *map, size_t map_size, unsigned fanout_bits,
+	uint64_t count, uint64_t fanout_offset, uint64_t entries_offset,
+	const char *filename
+)
+{
+	const uint64_t fanout_size = ((uint64_t)1 << (fanout_bits & 31)) + 1;
+	uint64_t i;
+
+	if (fanout_bits < BITCOIN_INDEX_MIN_FANOUT_BITS
+		|| fanout_bits > BITCOIN_INDEX_MAX_FANOUT_BITS
+		|| fanout_offset > map_size
+		|| fanout_size * 8 > map_size - fanout_offset
+		|| entries_offset > map_size
+		|| count > (map_size - entries_offset) / BITCOIN_INDEX_HASH_SIZE
+	) {
+		applog(APPLOG_ERROR, __func__, "Index file [%s] is truncated or corrupt.",
+			filename
+		);
+		return 0;
+	}
+	section->fanout_bits = fanout_bits;
+	section->count = count;
+	section->fanout = map + fanout_offset;
+	section->hashes = (const struct BitcoinRIPEMD160 *)(map + entries_offset);
+
+	/* lookups trust the fan-out table, so check it once here */
+	for (i = 0; i < fanout_size; i++) {
+		uint64_t value = BitcoinIndex_load64(section->fanout + i * 8);
+
+		if ((i == 0 && value != 0)
+			|| (i > 0 && value < BitcoinIndex_load64(section->fanout + (i - 1) * 8))
+			|| (i + 1 == fanout_size && value != count)
+		) {
+			applog(APPLOG_ERROR, __func__,
+				"Index file [%s] has a corrupt fan-out table.", filename
+			);
+			return 0;
+		}
+	}
+	return 1;
+}
+
+static void BitcoinIndexSegment_close(struct BitcoinIndexSegment *segment)
+{
+	if (segment->loaded) {
+		BitcoinHugePage_Free(segment->map, segment->map_size);
+	} else if (segment->map) {
+		munmap(segment->map, segment->map_size);
+	}
+	memset(segment, 0, sizeof(*segment));
+}
+
+/* Read a file into explicit huge pages, in that mode, since a mapping of a
+   file can't use them.  Returns NULL if the file is under a huge page, the
+   pool is short or reading fails, for it to be mapped instead. */
+static unsigned char *BitcoinIndexSegment_read(struct BitcoinIndexSegment *segment,
+	int fd
+)
+{
+	enum BitcoinHugePageBacking backing;
+	unsigned char *memory;
+	size_t done = 0;
+
+	if (BitcoinHugePage_GetMode() != BITCOIN_HUGE_PAGES_EXPLICIT
+		|| segment->map_size < BITCOIN_HUGE_PAGE_SIZE
+	) {
+		return NULL;
+	}
+	memory = BitcoinHugePage_Alloc(segment->map_size, &backing);
+	if (memory && backing != BITCOIN_HUGE_PAGE_BACKING_EXPLICIT) {
+		BitcoinHugePage_Free(memory, segment->map_size);
+		return NULL;
+	}
+
+	while (memory && done < segment->map_size) {
+		const ssize_t got = pread(fd, memory + done, segment->map_size - done,
+			(off_t)done
+		);
+		if (got > 0) {
+			done += (size_t)got;
+		} else if (got == 0 || errno != EINTR) {
+			BitcoinHugePage_Free(memory, segment->map_size);
+			memory = NULL;
+		}
+	}
+	return memory;
+}
+
+/* Map an index file into memory, and check its header.  Returns 1 if
+   done, 0 if failure, or -1 if missing is set and the file doesn't exist
+   (without logging it). */
+static int BitcoinIndexSegment_open(struct BitcoinIndexSegment *segment,
+	const char *filename, int missing
+)
+{
+	const unsigned char *map;
+	struct stat st;
+	uint64_t fanout_offset;
+	int fd;
+
+	memset(segment, 0, sizeof(*segment));
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		if (missing && errno == ENOENT) {
+			return -1;
+		}
+		applog(APPLOG_ERROR, __func__, "Failed to open file [%s] (%s)",
+			filename, strerror(errno)
+		);
+		return 0;
+	}
+	if (fstat(fd, &st)) {
+		applog(APPLOG_ERROR, __func__, "Failed to read file [%s] (%s)",
+			filename, strerror(errno)
+		);
+		close(fd);
+		return 0;
+	}
+
+	segment->map_size = (size_t)st.st_size;
+	if (segment->map_size >= BITCOIN_INDEX_MIN_HEADER_SIZE) {
+		segment->map = BitcoinIndexSegment_read(segment, fd);
+		if (segment->map) {
+			segment->loaded = 1;
+			segment->backing = BITCOIN_HUGE_PAGE_BACKING_EXPLICIT;
+		} else {
+			segment->map = mmap(NULL, segment->map_size, PROT_READ, MAP_SHARED,
+				fd, 0
+			);
+		}
+		if (segment->map == MAP_FAILED) {
+			applog(APPLOG_ERROR, __func__, "Failed to map file [%s] (%s)",
+				filename, strerror(errno)
+			);
+			segment->map = NULL;
+			close(fd);
+			return 0;
+		}
+	}
+	close(fd);
+	map = segment->map;
+
+	if (!map || memcmp(map, BITCOIN_INDEX_MAGIC, 8)
+		|| BitcoinIndex_load32(map + 8) != BITCOIN_INDEX_VERSION
+		|| BitcoinIndex_load32(map + 40) != BITCOIN_INDEX_HASH_SIZE
+	) {
+		applog(APPLOG_ERROR, __func__, "[%s] is not an index file.", filename);
+		BitcoinIndexSegment_close(segment);
+		return 0;
+	}
+
+	fanout_offset = BitcoinIndex_load64(map + 24);
+	if (!BitcoinIndexSection_load(&segment->hashes, map, segment->map_size,
+		BitcoinIndex_load32(map + 12), BitcoinIndex_load64(map + 16),
+		fanout_offset, BitcoinIndex_load64(map + 32), filename)
+	) {
+		BitcoinIndexSegment_close(segment);
+		return 0;
+	}
+
+	/* the header of an index written before deltas is only the first
+	   BITCOIN_INDEX_MIN_HEADER_SIZE bytes */
+	if (fanout_offset >= BITCOIN_INDEX_HEADER_SIZE) {
+		segment->first_delta = BitcoinIndex_load64(map + 72);
+		if (BitcoinIndex_load64(map + 56) && !BitcoinIndexSection_load(
+			&segment->removed, map, segment->map_size,
+			BitcoinIndex_load32(map + 44), BitcoinIndex_load64(map + 48),
+			BitcoinIndex_load64(map + 56), BitcoinIndex_load64(map + 64),
+			filename)
+		) {
+			BitcoinIndexSegment_close(segment);
+			return 0;
+		}
+	}
+
+	/* lookups land anywhere, so reading ahead only wastes memory, and
+	   the TLB covers more of the file in huge pages, where the file
+	   system can map it in them */
+	if (!segment->loaded) {
+		posix_madvise(segment->map, segment->map_size, POSIX_MADV_RANDOM);
+		segment->backing = BitcoinHugePage_Advise(segment->map,
+			segment->map_size
+		);
+	}
+
+	return 1;
+}
+
+static void BitcoinIndex_unload(struct BitcoinIndex *self)
+{
+	size_t i;
+
+	for (i = 0; i < self->delta_count; i++) {
+		BitcoinIndexSegment_close(&self->deltas[i]);
+	}
+	free(self->deltas);
+	BitcoinIndexSegment_close(&self->base);
+	memset(self, 0, sizeof(*self));
+}
+
+/* Map an index and its deltas.  Returns 1 if done, 0 if failure, or -1
+   if a delta was removed, by a compaction, before it could be opened. */
+static int BitcoinIndex_load(struct BitcoinIndex *self, const char *filename)
+{
+	uint64_t *numbers;
+	size_t count, i;
+	int result = 1;
+
+	memset(self, 0, sizeof(*self));
+
+	if (BitcoinIndexSegment_open(&self->base, filename, 0) != 1) {
+		return 0;
+	}
+	if (!BitcoinIndex_listDeltas(filename, self->base.first_delta,
+		&numbers, &count)
+	) {
+		BitcoinIndex_unload(self);
+		return 0;
+	}
+	if (count) {
+		self->deltas = calloc(count, sizeof(*self->deltas));
+		if (!self->deltas) {
+			applog(APPLOG_ERROR, __func__, "Failed to allocate index.");
+			result = 0;
+		}
+	}
+
+	for (i = 0; result == 1 && i < count; i++) {
+		char *name = BitcoinIndex_deltaName(filename, numbers[i]);
+
+		result = name ? BitcoinIndexSegment_open(&self->deltas[i], name, 1) : 0;
+		free(name);
+		if (result == 1) {
+			self->deltas[i].number = numbers[i];
+			self->delta_count++;
+		}
+	}
+
+	free(numbers);
+	if (result != 1) {
+		BitcoinIndex_unload(self);
+	}
+	return result;
+}
+
+struct BitcoinIndex *BitcoinIndex_open(const char *filename)
+{
+	struct BitcoinIndex *self;
+	unsigned attempt;
+
+	self = calloc(1, sizeof(*self));
+	if (!self) {
+		applog(APPLOG_ERROR, __func__, "Failed to allocate index.");
+		return NULL;
+	}
+
+	/* readers don't lock: files are only ever replaced by renaming, so a
+	   delta vanishing means a compaction ran, and the index it left is
+	   complete to open again */
+	for (attempt = 0; attempt < BITCOIN_INDEX_OPEN_ATTEMPTS; attempt++) {
+		switch (BitcoinIndex_load(self, filename)) {
+			case 1 :
+				return self;
+			case 0 :
+				free(self);
+				return NULL;
+			default :
+				break;
+		}
+	}
+
+	applog(APPLOG_ERROR, __func__,
+		"Index [%s] kept changing while it was opened.", filename
+	);
+	free(self);
+	return NULL;
+}
+
+void BitcoinIndex_close(struct BitcoinIndex *self)
+{
+	if (!self) {
+		return;
+	}
+	BitcoinIndex_unload(self);
+	free(self);
+}
+
+uint64_t BitcoinIndex_GetCount(const struct BitcoinIndex *self)
+{
+	return self->base.hashes.count;
+}
+
+size_t BitcoinIndex_GetDeltaCount(const struct BitcoinIndex *self)
+{
+	return self->delta_count;
+}
+
+enum BitcoinHugePageBacking BitcoinIndex_GetBacking(const struct BitcoinIndex *self,
+	uint64_t *huge_bytes
+)
+{
+	if (huge_bytes) {
+		*huge_bytes = BitcoinHugePage_GetHugeBytes(self->base.map,
+			self->base.map_size
+		);
+	}
+	return self->base.backing;
+}
+
+static int BitcoinIndexSection_contains(const struct BitcoinIndexSection *section,
+	const struct BitcoinRIPEMD160 *hash
+)
+{
+	const unsigned char *fanout;
+	uint64_t low, high;
+
+	if (!section->count) {
+		return 0;
+	}
+	fanout = section->fanout
+		+ (size_t)BitcoinIndex_prefix(hash, section->fanout_bits) * 8;
+	low = BitcoinIndex_load64(fanout);
+	high = BitcoinIndex_load64(fanout + 8);
+
+	while (low < high) {
+		const uint64_t middle = low + (high - low) / 2;
+		const int order = BitcoinIndex_compare(&section->hashes[middle], hash);
+
+		if (order == 0) {
+			return 1;
+		} else if (order < 0) {
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
+	}
+	return 0;
+}
+
+int BitcoinIndex_Contains(const struct BitcoinIndex *self,
+	const struct BitcoinRIPEMD160 *hash
+)
+{
+	size_t i;
+
+	/* the newest delta which mentions the hash decides, removing first */
+	for (i = self->delta_count; i-- > 0;) {
+		if (BitcoinIndexSection_contains(&self->deltas[i].removed, hash)) {
+			return 0;
+		}
+		if (BitcoinIndexSection_contains(&self->deltas[i].hashes, hash)) {
+			return 1;
+		}
+	}
+	return BitcoinIndexSection_contains(&self->base.hashes, hash);
+}
+
+/* a binary search of a batch lookup, in flight */
+struct BitcoinIndexProbe {
+	size_t index;
+	const unsigned char *fanout;
+	uint64_t low, high;
+	int found;
+};
+
+/* Look up the pending hashes of a batch (indexes into hashes) in a
+   section, setting the results of those found to value.  A group of
+   lookups goes at a time: the fan-out entries of them all are prefetched,
+   then the first middle hash of each range, then the searches take a step
+   each in turn, prefetching their next middle, so each waits for memory
+   while the others compare.  Returns the number of hashes left pending,
+   moved to the start of pending. */
+static size_t BitcoinIndexSection_probe(const struct BitcoinIndexSection *section,
+	const struct BitcoinRIPEMD160 *hashes, size_t *pending, size_t count,
+	unsigned char *results, unsigned char value
+)
+{
+	struct BitcoinIndexProbe probes[BITCOIN_INDEX_PROBE_GROUP];
+	size_t start, left = 0;
+
+	if (!section->count) {
+		return count;
+	}
+
+	for (start = 0; start < count; start += BITCOIN_INDEX_PROBE_GROUP) {
+		const size_t size = count - start < BITCOIN_INDEX_PROBE_GROUP
+			? count - start : BITCOIN_INDEX_PROBE_GROUP;
+		size_t i, active;
+
+		for (i = 0; i < size; i++) {
+			struct BitcoinIndexProbe *probe = &probes[i];
+
+			probe->index = pending[start + i];
+			probe->fanout = section->fanout + (size_t)BitcoinIndex_prefix(
+				&hashes[probe->index], section->fanout_bits
+			) * 8;
+			probe->found = 0;
+			__builtin_prefetch(probe->fanout);
+		}
+		for (i = 0; i < size; i++) {
+			struct BitcoinIndexProbe *probe = &probes[i];
+
+			probe->low = BitcoinIndex_load64(probe->fanout);
+			probe->high = BitcoinIndex_load64(probe->fanout + 8);
+			if (probe->low < probe->high) {
+				__builtin_prefetch(&section->hashes[
+					probe->low + (probe->high - probe->low) / 2
+				]);
+			}
+		}
+
+		do {
+			active = 0;
+			for (i = 0; i < size; i++) {
+				struct BitcoinIndexProbe *probe = &probes[i];
+				uint64_t middle;
+				int order;
+
+				if (probe->low >= probe->high) {
+					continue;
+				}
+				middle = probe->low + (probe->high - probe->low) / 2;
+				order = BitcoinIndex_compare(&section->hashes[middle],
+					&hashes[probe->index]
+				);
+				if (order == 0) {
+					probe->found = 1;
+					probe->high = probe->low;
+					continue;
+				} else if (order < 0) {
+					probe->low = middle + 1;
+				} else {
+					probe->high = middle;
+				}
+				if (probe->low < probe->high) {
+					__builtin_prefetch(&section->hashes[
+						probe->low + (probe->high - probe->low) / 2
+					]);
+					active++;
+				}
+			}
+		} while (active);
+
+		for (i = 0; i < size; i++) {
+			if (probes[i].found) {
+				results[probes[i].index] = value;
+			} else {
+				pending[left++] = probes[i].index;
+			}
+		}
+	}
+
+	return left;
+}
+
+void BitcoinIndex_ContainsBatch(const struct BitcoinIndex *self,
+	const struct BitcoinRIPEMD160 *hashes, size_t count,
+	unsigned char *results
+)
+{
+	size_t pending[BITCOIN_INDEX_BATCH_SIZE];
+	size_t done, i, left;
+
+	memset(results, 0, count);
+
+	for (done = 0; done < count; done += BITCOIN_INDEX_BATCH_SIZE) {
+		left = count - done < BITCOIN_INDEX_BATCH_SIZE
+			? count - done : BITCOIN_INDEX_BATCH_SIZE;
+		for (i = 0; i < left; i++) {
+			pending[i] = done + i;
+		}
+
+		/* as BitcoinIndex_Contains(), the hashes a delta decides are
+		   settled there and not looked up further down */
+		for (i = self->delta_count; left && i-- > 0;) {
+			left = BitcoinIndexSection_probe(&self->deltas[i].removed, hashes,
+				pending, left, results, 0
+			);
+			left = BitcoinIndexSection_probe(&self->deltas[i].hashes, hashes,
+				pending, left, results, 1
+			);
+		}
+		BitcoinIndexSection_probe(&self->base.hashes, hashes, pending, left,
+			results, 1
+		);
+	}
+}
+
+/* the next hash of a section, while merging index files */
+struct BitcoinIndexCursor {
+	const struct BitcoinRIPEMD160 *next, *end;
+
+	/* of its file, oldest first, and whether the section is of removals */
+	size_t age;
+	int removed;
+};
+
+/* Cursors meeting at a hash are ordered newest file first, and removals
+   first within a file, so the first decides the hash */
+static int BitcoinIndexCursor_before(const struct BitcoinIndexCursor *a,
+	const struct BitcoinIndexCursor *b
+)
+{
+	const int order = BitcoinIndex_compare(a->next, b->next);
+
+	if (order) {
+		return order < 0;
+	}
+	if (a->age != b->age) {
+		return a->age > b->age;
+	}
+	return a->removed > b->removed;
+}
+
+static void BitcoinIndexCursor_siftDown(struct BitcoinIndexCursor *heap,
+	size_t size, size_t i
+)
+{
+	for (;;) {
+		size_t child = 2 * i + 1, first = i;
+		struct BitcoinIndexCursor cursor;
+
+		if (child < size && BitcoinIndexCursor_before(&heap[child], &heap[first])) {
+			first = child;
+		}
+		child++;
+		if (child < size && BitcoinIndexCursor_before(&heap[child], &heap[first])) {
+			first = child;
+		}
+		if (first == i) {
+			return;
+		}
+		cursor = heap[i];
+		heap[i] = heap[first];
+		heap[first] = cursor;
+		i = first;
+	}
+}
+
+/* Merge index files, oldest first, into a writer of the hashes they hold
+   and a writer of the hashes they remove, the newest file mentioning a
+   hash deciding which.  Without a writer of removals, the removals are
+   applied and dropped. */
+static int BitcoinIndex_mergeSegments(struct BitcoinIndexSegment *const *segments,
+	size_t count, struct BitcoinIndexWriter *hashes,
+	struct BitcoinIndexWriter *removed
+)
+{
+	struct BitcoinIndexCursor *heap;
+	size_t i, size = 0;
+	int success = 1;
+
+	heap = malloc(2 * count * sizeof(*heap));
+	if (!heap) {
+		applog(APPLOG_ERROR, __func__, "Failed to allocate merge heap.");
+		return 0;
+	}
+	for (i = 0; i < count; i++) {
+		const struct BitcoinIndexSection *sections[2];
+		int j;
+
+		sections[0] = &segments[i]->hashes;
+		sections[1] = &segments[i]->removed;
+		for (j = 0; j < 2; j++) {
+			if (sections[j]->count) {
+				heap[size].next = sections[j]->hashes;
+				heap[size].end = sections[j]->hashes + sections[j]->count;
+				heap[size].age = i;
+				heap[size].removed = j;
+				size++;
+			}
+		}
+	}
+	for (i = size; i-- > 0;) {
+		BitcoinIndexCursor_siftDown(heap, size, i);
+	}
+
+	while (size) {
+		const struct BitcoinRIPEMD160 *hash = heap[0].next;
+		struct BitcoinIndexWriter *writer = heap[0].removed ? removed : hashes;
+
+		if (writer && !BitcoinIndexWriter_put(writer, hash)) {
+			applog(APPLOG_ERROR, __func__, "Error writing index (%s)",
+				strerror(errno)
+			);
+			success = 0;
+			break;
+		}
+		/* and the older mentions of it are passed over */
+		do {
+			if (++heap[0].next == heap[0].end) {
+				heap[0] = heap[--size];
+			}
+			BitcoinIndexCursor_siftDown(heap, size, 0);
+		} while (size && !BitcoinIndex_compare(heap[0].next, hash));
+	}
+
+	free(heap);
+	return success;
+}
+
+/* Hashes a segment adds and removes */
+static uint64_t BitcoinIndexSegment_size(const struct BitcoinIndexSegment *segment)
+{
+	return segment->hashes.count + segment->removed.count;
+}
+
+/* Compact a loaded index, holding its lock.  A full compaction merges the
+   deltas into a new base, numbered past them, then removes them.  Otherwise
+   the newest deltas are merged into one, which replaces the newest of them:
+   at least two, and older ones while they are no larger than those merged so
+   far, or while there would be more than BITCOIN_INDEX_MAX_DELTAS.  Merging
+   deltas of like sizes keeps each hash from being rewritten more than a few
+   times before a full compaction. */
+static BitcoinResult BitcoinIndex_compact(struct BitcoinIndex *self,
+	const char *filename, int full
+)
+{
+	struct BitcoinIndexSegment **segments;
+	struct BitcoinIndexWriter hashes, removed;
+	uint64_t bound = 0, removed_bound = 0, first_delta = 0;
+	size_t start, count, i;
+	char *target = NULL, *temporary = NULL;
+	FILE *file = NULL;
+	int success = 1;
+
+	memset(&hashes, 0, sizeof(hashes));
+	memset(&removed, 0, sizeof(removed));
+
+	/* nothing to merge, eg: a compaction which was due has been done */
+	if (self->delta_count < (full ? 1 : 2)) {
+		return BITCOIN_SUCCESS;
+	}
+
+	segments = malloc((self->delta_count + 1) * sizeof(*segments));
+	if (!segments) {
+		applog(APPLOG_ERROR, __func__, "Failed to allocate segment list.");
+		return BITCOIN_ERROR;
+	}
+
+	count = 0;
+	if (full) {
+		start = 0;
+		segments[count++] = &self->base;
+		first_delta = self->delta_count
+			? self->deltas[self->delta_count - 1].number + 1
+			: self->base.first_delta;
+		target = BitcoinIndex_name(filename, "");
+		temporary = BitcoinIndex_name(filename, BITCOIN_INDEX_TEMPORARY_SUFFIX);
+	} else {
+		uint64_t merged;
+
+		start = self->delta_count - 2;
+		merged = BitcoinIndexSegment_size(&self->deltas[start])
+			+ BitcoinIndexSegment_size(&self->deltas[start + 1]);
+		while (start > 0 && (start >= BITCOIN_INDEX_MAX_DELTAS
+			|| BitcoinIndexSegment_size(&self->deltas[start - 1]) <= merged)
+		) {
+			start--;
+			merged += BitcoinIndexSegment_size(&self->deltas[start]);
+		}
+		target = BitcoinIndex_deltaName(filename,
+			self->deltas[self->delta_count - 1].number
+		);
+		temporary = BitcoinIndex_name(filename,
+			BITCOIN_INDEX_DELTA_SUFFIX BITCOIN_INDEX_TEMPORARY_SUFFIX
+		);
+	}
+	for (i = start; i < self->delta_count; i++) {
+		segments[count++] = &self->deltas[i];
+	}
+	for (i = 0; i < count; i++) {
+		bound += segments[i]->hashes.count;
+		removed_bound += segments[i]->removed.count;
+	}
+
+	if (!target || !temporary) {
+		success = 0;
+	}
+	if (success) {
+		file = BitcoinIndex_createFile(temporary);
+		success = file != NULL;
+	}
+	if (success) {
+		success = BitcoinIndexWriter_begin(&hashes, file,
+			BITCOIN_INDEX_HEADER_SIZE, bound
+		);
+	}
+	if (success && !full) {
+		/* the removals go after the hashes, so are merged into a second
+		   pass over the files with nothing written for the hashes */
+		success = BitcoinIndex_mergeSegments(segments, count, &hashes, NULL)
+			&& BitcoinIndexWriter_end(&hashes)
+			&& BitcoinIndexWriter_begin(&removed, file, hashes.end,
+				removed_bound
+			)
+			&& BitcoinIndex_mergeSegments(segments, count, NULL, &removed)
+			&& BitcoinIndexWriter_end(&removed)
+			&& BitcoinIndex_writeHeader(file, &hashes, &removed, 0);
+	} else if (success) {
+		success = BitcoinIndex_mergeSegments(segments, count, &hashes, NULL)
+			&& BitcoinIndexWriter_end(&hashes)
+			&& BitcoinIndex_writeHeader(file, &hashes, NULL, first_delta);
+	}
+	BitcoinIndexWriter_discard(&hashes);
+	BitcoinIndexWriter_discard(&removed);
+	if (file) {
+		success = BitcoinIndex_commitFile(file, temporary, target, success);
+	}
+
+	/* the merged file is in place, so the files merged into it go */
+	if (success && full) {
+		BitcoinIndex_removeDeltas(filename, first_delta);
+	} else if (success) {
+		for (i = start; i + 1 < self->delta_count; i++) {
+			char *name = BitcoinIndex_deltaName(filename, self->deltas[i].number);
+
+			if (name && remove(name) && errno != ENOENT) {
+				applog(APPLOG_ERROR, __func__, "Failed to remove file [%s] (%s)",
+					name, strerror(errno)
+				);
+			}
+			free(name);
+		}
+	}
+
+	free(temporary);
+	free(target);
+	free(segments);
+
+	return success ? BITCOIN_SUCCESS : BITCOIN_ERROR_FILE;
+}
+
+BitcoinResult BitcoinIndex_Update(const char *filename,
+	struct BitcoinIndexBuilder *added, struct BitcoinIndexBuilder *removed,
+	uint64_t *added_count, uint64_t *removed_count, int *compaction_due
+)
+{
+	struct BitcoinIndex index;
+	struct BitcoinIndexWriter added_writer, removed_writer;
+	uint64_t added_bound, removed_bound, number, delta_size = 0;
+	BitcoinResult result;
+	char *name = NULL, *temporary = NULL;
+	FILE *file = NULL;
+	size_t i;
+	int lock, success, compact = 0;
+
+	memset(&added_writer, 0, sizeof(added_writer));
+	memset(&removed_writer, 0, sizeof(removed_writer));
+	if (compaction_due) {
+		*compaction_due = 0;
+	}
+
+	result = BitcoinIndexBuilder_Prepare(added, &added_bound);
+	if (result == BITCOIN_SUCCESS) {
+		result = BitcoinIndexBuilder_Prepare(removed, &removed_bound);
+	}
+	if (result != BITCOIN_SUCCESS) {
+		return result;
+	}
+	if (!added_bound && !removed_bound) {
+		return BITCOIN_SUCCESS;
+	}
+
+	/* holding the lock, nothing changes the index while it is loaded */
+	lock = BitcoinIndex_lock(filename, 1);
+	if (lock < 0) {
+		return BITCOIN_ERROR_FILE;
+	}
+	if (BitcoinIndex_load(&index, filename) != 1) {
+		close(lock);
+		return BITCOIN_ERROR_FILE;
+	}
+	number = index.delta_count
+		? index.deltas[index.delta_count - 1].number + 1
+		: index.base.first_delta;
+
+	name = BitcoinIndex_deltaName(filename, number);
+	temporary = BitcoinIndex_name(filename,
+		BITCOIN_INDEX_DELTA_SUFFIX BITCOIN_INDEX_TEMPORARY_SUFFIX
+	);
+	if (name && temporary) {
+		file = BitcoinIndex_createFile(temporary);
+	}
+	success = file != NULL;
+
+	if (success) {
+		success = BitcoinIndexBuilder_write(added, file,
+				BITCOIN_INDEX_HEADER_SIZE, added_bound, &added_writer
+			)
+			&& BitcoinIndexBuilder_write(removed, file, added_writer.end,
+				removed_bound, &removed_writer
+			)
+			&& BitcoinIndex_writeHeader(file, &added_writer, &removed_writer, 0);
+		success = BitcoinIndex_commitFile(file, temporary, name, success);
+	}
+
+	if (added_count) {
+		*added_count = added_writer.count;
+	}
+	if (removed_count) {
+		*removed_count = removed_writer.count;
+	}
+
+	/* merge the newest deltas once there are enough to slow lookups down.
+	   Merging them into the base rewrites all of it, so once they hold
+	   enough hashes to be worth that it is only reported as due, for the
+	   caller to do apart from the update. */
+	if (success) {
+		delta_size = added_writer.count + removed_writer.count;
+		for (i = 0; i < index.delta_count; i++) {
+			delta_size += BitcoinIndexSegment_size(&index.deltas[i]);
+		}
+		if (compaction_due) {
+			*compaction_due = delta_size
+				> index.base.hashes.count / BITCOIN_INDEX_COMPACT_RATIO;
+		}
+		compact = index.delta_count + 1 > BITCOIN_INDEX_MAX_DELTAS;
+	}
+	BitcoinIndex_unload(&index);
+
+	if (compact) {
+		if (BitcoinIndex_load(&index, filename) == 1) {
+			success = BitcoinIndex_compact(&index, filename, 0)
+				== BITCOIN_SUCCESS;
+			BitcoinIndex_unload(&index);
+		} else {
+			success = 0;
+		}
+	}
+
+	close(lock);
+	free(temporary);
+	free(name);
+
+	return success ? BITCOIN_SUCCESS : BITCOIN_ERROR_FILE;
+}
+
+BitcoinResult BitcoinIndex_Compact(const char *filename)
+{
+	struct BitcoinIndex index;
+	BitcoinResult result = BITCOIN_ERROR_FILE;
+	int lock;
+
+	lock = BitcoinIndex_lock(filename, 1);
+	if (lock < 0) {
+		return BITCOIN_ERROR_FILE;
+	}
+	if (BitcoinIndex_load(&index, filename) == 1) {
+		result = BitcoinIndex_compact(&index, filename, 1);
+		BitcoinIndex_unload(&index);
+	}
+	close(lock);
+
+	return result;
+}
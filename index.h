@@ -0,0 +1,231 @@
+#ifndef BITCOIN_INCLUDE_INDEX_H
+#define BITCOIN_INCLUDE_INDEX_H
+
+/** @file index.h
+ *  @brief Sorted file of address hashes, for matching converted keys
+ *         against a watch-list.
+ *
+ *  An index holds the RIPEMD160 hashes of a list of addresses, sorted and
+ *  without duplicates, so it is found by a binary search in the file
+ *  mapped into memory.  A fan-out table of where the hashes starting with
+ *  each prefix begin narrows the search to a few dozen hashes first.
+ *
+ *  The file is, with every number little-endian:
+ *
+ *      header    128 bytes: magic "BTCINDEX", version (uint32), fan-out
+ *                bits (uint32), hash count (uint64), offsets of the
+ *                fan-out table and the hashes (uint64), hash size (uint32);
+ *                the same for the removed section (bits uint32, count and
+ *                offsets uint64, offsets 0 if there is none); the number of
+ *                the first delta not merged into this file (uint64); zeros
+ *      fan-out   (1 << bits) + 1 uint64s: entry p is the number of hashes
+ *                whose top bits are less than p
+ *      hashes    count 20 byte hashes, in memcmp() order
+ *      removed   in a delta only, a fan-out table and hashes as above
+ *
+ *  An index written before deltas has a 64 byte header, with the fan-out
+ *  table following it.
+ *
+ *  The file is advised for transparent huge pages, which the file system
+ *  may or may not use, or in explicit huge page mode (see hugepage.h) is
+ *  read into huge pages from the pool if there are enough.
+ *
+ *  An index is built by adding hashes (decoded from addresses) to a
+ *  builder, which sorts them with a parallel radix sort in runs that fit a
+ *  memory budget, spills each run to a temporary file, and merges the runs
+ *  into the index file at the end.
+ *
+ *  An index is updated without rewriting it, log-structured: each update
+ *  writes a small delta file, <file>.delta.<number>, of the hashes added
+ *  and removed, and a lookup asks the deltas from the newest down before
+ *  the index itself (the base).  After an update, deltas of like sizes are
+ *  merged once there are more than BITCOIN_INDEX_MAX_DELTAS, so lookups
+ *  stay within a few binary searches and updates take time in proportion
+ *  to their size.  Once the deltas hold more than 1 /
+ *  BITCOIN_INDEX_COMPACT_RATIO as many hashes as the base, merging them
+ *  into a new base (rewriting all of it) is due, which the update reports
+ *  rather than doing, for it to be done by BitcoinIndex_Compact() apart
+ *  from the update.
+ */
+
+#include <stddef.h> /* size_t */
+#include <stdint.h>
+
+#include "hash.h"
+#include "hugepage.h"
+#include "prefix.h"
+#include "result.h"
+
+#define BITCOIN_INDEX_MAGIC "BTCINDEX"
+#define BITCOIN_INDEX_VERSION 1
+#define BITCOIN_INDEX_HEADER_SIZE 128
+#define BITCOIN_INDEX_MIN_HEADER_SIZE 64
+
+/* delta files are named <file>.delta.<number> */
+#define BITCOIN_INDEX_DELTA_SUFFIX ".delta."
+
+/* compaction after an update, and when a full one is due, as above */
+#define BITCOIN_INDEX_MAX_DELTAS 4
+#define BITCOIN_INDEX_COMPACT_RATIO 8
+
+/* hashes looked up together by BitcoinIndex_ContainsBatch(), which takes
+   larger batches this many at a time */
+#define BITCOIN_INDEX_BATCH_SIZE 256
+
+/* the fan-out table has between 2^8 and 2^24 entries, enough for a few
+   dozen hashes each */
+#define BITCOIN_INDEX_MIN_FANOUT_BITS 8
+#define BITCOIN_INDEX_MAX_FANOUT_BITS 24
+#define BITCOIN_INDEX_FANOUT_BUCKET_SIZE 64
+
+struct BitcoinIndex;
+struct BitcoinIndexBuilder;
+
+/** @brief Allocate a builder.
+ *
+ *  @param[in] threads Threads decoding and sorting.
+ *  @param[in] memory_budget Bytes of hashes to hold before sorting and
+ *                           spilling them to a temporary file, including
+ *                           the sort's scratch space.
+ *
+ *  @return Pointer to builder, or NULL if failure.
+ */
+struct BitcoinIndexBuilder *BitcoinIndexBuilder_create(unsigned threads,
+	size_t memory_budget
+);
+
+/** @brief Free a builder, and its temporary files. */
+void BitcoinIndexBuilder_destroy(struct BitcoinIndexBuilder *self);
+
+/** @brief Decode Base58Check addresses, in parallel, and add their hashes.
+ *
+ *  @param[in] texts Array of NUL-terminated address strings.
+ *  @param[in] network_type Network the addresses must belong to, or NULL
+ *                          to accept any.
+ *  @param[out] results Array of count results, set to the result of
+ *                      decoding each address.
+ *
+ *  @return Number of addresses added, or (size_t)-1 if a run couldn't be
+ *          spilled.
+ */
+size_t BitcoinIndexBuilder_AddAddresses(struct BitcoinIndexBuilder *self,
+	const char *const *texts, const struct BitcoinNetworkType *network_type,
+	size_t count, BitcoinResult *results
+);
+
+/** @brief Add hashes.
+ *
+ *  @return Number of hashes added, or (size_t)-1 if a run couldn't be
+ *          spilled.
+ */
+size_t BitcoinIndexBuilder_AddHashes(struct BitcoinIndexBuilder *self,
+	const struct BitcoinRIPEMD160 *hashes, size_t count
+);
+
+/** @brief Get everything added ready to scan: sorted and deduplicated in
+ *         memory if it all fit there, otherwise spilled with the other
+ *         runs to merge.  BitcoinIndexBuilder_Finish() does this itself.
+ *
+ *  @param[out] bound The most distinct hashes there can be.
+ *
+ *  @return BitcoinResult indicating error state.
+ */
+BitcoinResult BitcoinIndexBuilder_Prepare(struct BitcoinIndexBuilder *self,
+	uint64_t *bound
+);
+
+/** @brief Pass each distinct hash added, in order, to visit, once
+ *         prepared: to fill another structure rather than an index file.
+ *
+ *  @param[out] unique Number of distinct hashes visited, may be NULL.
+ *
+ *  @return BitcoinResult indicating error state.
+ */
+BitcoinResult BitcoinIndexBuilder_Scan(struct BitcoinIndexBuilder *self,
+	void (*visit)(void *arg, const struct BitcoinRIPEMD160 *hash), void *arg,
+	uint64_t *unique
+);
+
+/** @brief Sort and merge everything added, and write it to an index file,
+ *         through a temporary file renamed over filename once complete.
+ *         The deltas of an index it replaces are removed.
+ *
+ *  @param[out] unique Number of distinct hashes written, may be NULL.
+ *
+ *  @return BitcoinResult indicating error state.
+ */
+BitcoinResult BitcoinIndexBuilder_Finish(struct BitcoinIndexBuilder *self,
+	const char *filename, uint64_t *unique
+);
+
+/** @brief Add a delta to an index: the hashes added to one builder and
+ *         the hashes removed to the other, a hash in both being removed.
+ *         The newest deltas are merged afterwards if needed (see above).
+ *
+ *  @param[out] added_count Number of distinct hashes added, may be NULL.
+ *  @param[out] removed_count Number of distinct hashes removed, may be
+ *                            NULL.
+ *  @param[out] compaction_due Set to 1 if the deltas should now be merged
+ *                             into the base with BitcoinIndex_Compact(),
+ *                             otherwise 0, may be NULL.
+ *
+ *  @return BitcoinResult indicating error state.
+ */
+BitcoinResult BitcoinIndex_Update(const char *filename,
+	struct BitcoinIndexBuilder *added, struct BitcoinIndexBuilder *removed,
+	uint64_t *added_count, uint64_t *removed_count, int *compaction_due
+);
+
+/** @brief Merge the deltas of an index into a new base, and remove them.
+ *         Waits for any update or compaction of the index to finish first,
+ *         and does nothing if there are no deltas by then.
+ *
+ *  @return BitcoinResult indicating error state.
+ */
+BitcoinResult BitcoinIndex_Compact(const char *filename);
+
+/** @brief Map an index file and its deltas into memory, and check their
+ *         headers.
+ *
+ *  @return Pointer to index, or NULL if failure.
+ */
+struct BitcoinIndex *BitcoinIndex_open(const char *filename);
+
+/** @brief Unmap an index. */
+void BitcoinIndex_close(struct BitcoinIndex *self);
+
+/** @brief Get the number of hashes in the base of an index. */
+uint64_t BitcoinIndex_GetCount(const struct BitcoinIndex *self);
+
+/** @brief Get the number of deltas of an index. */
+size_t BitcoinIndex_GetDeltaCount(const struct BitcoinIndex *self);
+
+/** @brief Get the backing of the base of an index.
+ *
+ *  @param[out] huge_bytes Bytes of the base in huge pages, may be NULL.
+ */
+enum BitcoinHugePageBacking BitcoinIndex_GetBacking(const struct BitcoinIndex *self,
+	uint64_t *huge_bytes
+);
+
+/** @brief Returns 1 if the index contains hash, otherwise 0. */
+int BitcoinIndex_Contains(const struct BitcoinIndex *self,
+	const struct BitcoinRIPEMD160 *hash
+);
+
+/** @brief Look up many hashes at once, as BitcoinIndex_Contains() would.
+ *
+ *  The lookups are interleaved, with the memory each needs next
+ *  prefetched, so an index much larger than the CPU caches costs about
+ *  one cache miss's latency per group of lookups rather than several per
+ *  lookup.
+ *
+ *  @param[out] results Array of count flags, set to 1 for each hash in the
+ *                      index, otherwise 0.
+ */
+void BitcoinIndex_ContainsBatch(const struct BitcoinIndex *self,
+	const struct BitcoinRIPEMD160 *hashes, size_t count,
+	unsigned char *results
+);
+
+#endif
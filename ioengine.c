@@ -0,0 +1,1211 @@
+/*
+I/O engines for batch mode: read-ahead input and write-behind output.
+
+A stream is a ring of BITCOIN_IO_BLOCKS blocks of BITCOIN_IO_BLOCK_SIZE
+bytes.  Reading, the blocks are filled in order ahead of the reader, and
+each is refilled once the reader has consumed it.  Writing, the writer fills
+the blocks in order, and each full block is written while the next one is
+being filled.  Streams are exposed as stdio FILEs with fopencookie(), so
+the rest of batch mode reads lines and writes records the same way whatever
+the engine.
+
+The uring engine drives io_uring through the raw system calls (there is no
+dependency on liburing), with the blocks registered as fixed buffers when
+the kernel allows it.  Regular files have every free block in flight at
+once, at explicit offsets.  Writes are submitted one at a time, so they
+land in order even without offsets (which keeps O_APPEND and pipes
+working).  Kernels older than 5.6, without IORING_OP_READ and
+IORING_OP_WRITE, get the thread engine instead.  The thread engine does the
+same with one thread per stream doing blocking read() and write().
+Platforms without fopencookie() only have stdio.
+
+Compressed input is decompressed, and compressed output compressed, by a
+thread engine stream whose thread reads from or writes to another stream
+(see compress.h), so I/O, decompression, conversion and compression can
+each run on their own core.
+
+Pipes, FIFOs and terminals are always read by a thread, as io_uring can
+only have one read of them in flight.  The reader thread and the consumer
+share the blocks as a single-producer, single-consumer ring: the thread
+publishes each block it fills by moving tail, the consumer hands it back by
+moving head, and neither takes a lock unless the ring is empty or full and
+it has to sleep.  The thread keeps filling a block while more input is
+waiting, so a fast writer to the pipe is consumed in large blocks.
+*/
+
+#define _GNU_SOURCE
+#define _FILE_OFFSET_BITS 64
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+
+#include "applog.h"
+#include "compress.h"
+#include "ioengine.h"
+
+#if defined(__linux__) && defined(__GLIBC__)
+#define BITCOIN_IO_HAVE_COOKIE 1
+#endif
+
+#ifdef BITCOIN_IO_HAVE_COOKIE
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <poll.h>
+#include <sys/syscall.h>
+
+#if defined(__has_include) && defined(__NR_io_uring_setup)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define BITCOIN_IO_HAVE_URING 1
+#endif
+#endif
+#endif
+
+/* the kernel has IORING_OP_READ and IORING_OP_WRITE, and takes an offset of
+   -1 as the file position (5.6), from <linux/io_uring.h> */
+#if defined(BITCOIN_IO_HAVE_URING) && !defined(IORING_FEAT_RW_CUR_POS)
+#define IORING_FEAT_RW_CUR_POS (1U << 3)
+#endif
+
+#define BITCOIN_IO_BLOCK_SIZE (1024 * 1024)
+#define BITCOIN_IO_BLOCKS 4
+
+/* size of the stdio buffer in front of a stream; lines are short, so this
+   only needs to be large enough that stdio rarely calls into the engine */
+#define BITCOIN_IO_STDIO_BUFFER_SIZE 65536
+
+int BitcoinIO_ParseEngine(const char *name, enum BitcoinIOEngine *engine)
+{
+	if (strcmp(name, "auto") == 0) {
+		*engine = BITCOIN_IO_ENGINE_AUTO;
+	} else if (strcmp(name, "stdio") == 0) {
+		*engine = BITCOIN_IO_ENGINE_STDIO;
+	} else if (strcmp(name, "thread") == 0) {
+		*engine = BITCOIN_IO_ENGINE_THREAD;
+	} else if (strcmp(name, "uring") == 0) {
+		*engine = BITCOIN_IO_ENGINE_URING;
+	} else {
+		return 0;
+	}
+	return 1;
+}
+
+const char *BitcoinIO_GetEngineName(enum BitcoinIOEngine engine)
+{
+	switch (engine) {
+		case BITCOIN_IO_ENGINE_AUTO   : return "auto";
+		case BITCOIN_IO_ENGINE_STDIO  : return "stdio";
+		case BITCOIN_IO_ENGINE_THREAD : return "thread";
+		case BITCOIN_IO_ENGINE_URING  : return "uring";
+	}
+	return "unknown";
+}
+
+#ifdef BITCOIN_IO_HAVE_COOKIE
+
+enum BitcoinIOBlockState {
+	BITCOIN_IO_BLOCK_EMPTY,
+
+	/* reading: read submitted; writing: full, waiting to be written */
+	BITCOIN_IO_BLOCK_PENDING,
+
+	/* reading: read complete */
+	BITCOIN_IO_BLOCK_READY
+};
+
+struct BitcoinIOBlock {
+	unsigned char *data;
+	enum BitcoinIOBlockState state;
+
+	/* file offset the block was read from */
+	uint64_t offset;
+
+	/* bytes read or filled, bytes consumed or written */
+	size_t size, used;
+
+	/* errno of a failed read or write */
+	int error;
+};
+
+#ifdef BITCOIN_IO_HAVE_URING
+struct BitcoinIOUring {
+	int fd;
+	unsigned entries;
+	int registered;
+
+	void *sq_ring, *cq_ring;
+	size_t sq_ring_size, cq_ring_size;
+	struct io_uring_sqe *sqes;
+	size_t sqes_size;
+
+	unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+	unsigned *cq_head, *cq_tail, *cq_mask;
+	struct io_uring_cqe *cqes;
+};
+#endif
+
+struct BitcoinIOStream {
+	enum BitcoinIOEngine engine;
+	int fd, close_fd;
+	int writing;
+
+	/* regular files are read at explicit offsets, several blocks at once */
+	int seekable;
+	uint64_t offset;
+
+	unsigned char *memory;
+	struct BitcoinIOBlock blocks[BITCOIN_IO_BLOCKS];
+
+	/* reading: block being consumed, next block to fill;
+	   writing: block being filled, next block to write.  The thread reader
+	   counts blocks instead, modulo the number of blocks being the index,
+	   the reader thread only storing tail and the consumer only head. */
+	unsigned head, tail;
+
+	/* the thread reader's consumer or producer is asleep, waiting for the
+	   other to move tail or head */
+	int consumer_waiting, producer_waiting;
+
+	/* reading: end of file has been reached, so stop filling blocks */
+	int at_end;
+
+	/* blocks the engine is working on */
+	unsigned in_flight;
+
+	/* errno of the first failed write */
+	int error;
+
+	/* the thread engine decompressing from or compressing to file, rather
+	   than reading or writing fd */
+	struct BitcoinCompress *codec;
+	FILE *file;
+	int close_file;
+
+#ifdef BITCOIN_IO_HAVE_URING
+	struct BitcoinIOUring ring;
+#endif
+
+	pthread_t thread;
+	int thread_started;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	int stopping;
+};
+
+static int BitcoinIO_isSeekable(int fd)
+{
+	struct stat st;
+	return fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+}
+
+/* Returns 1 if a read of fd wouldn't block */
+static int BitcoinIO_isReadable(int fd)
+{
+	struct pollfd poll_fd;
+
+	poll_fd.fd = fd;
+	poll_fd.events = POLLIN;
+	poll_fd.revents = 0;
+	return poll(&poll_fd, 1, 0) > 0 && (poll_fd.revents & POLLIN);
+}
+
+/* Write all of a buffer with write(), retrying short writes.  Returns 0 if
+   success, or errno. */
+static int BitcoinIO_writeAll(int fd, const unsigned char *data, size_t size)
+{
+	while (size) {
+		ssize_t bytes = write(fd, data, size);
+		if (bytes < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return errno;
+		}
+		data += bytes;
+		size -= (size_t)bytes;
+	}
+	return 0;
+}
+
+#ifdef BITCOIN_IO_HAVE_URING
+
+/* io_uring */
+
+static int BitcoinIO_uringSetup(struct BitcoinIOUring *ring, unsigned entries)
+{
+	struct io_uring_params params;
+	unsigned char *sq_ring;
+
+	memset(ring, 0, sizeof(*ring));
+	memset(&params, 0, sizeof(params));
+
+	ring->fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+	if (ring->fd < 0) {
+		return 0;
+	}
+	/* older kernels set up a ring, then fail every read and write on it */
+	if (!(params.features & IORING_FEAT_RW_CUR_POS)) {
+		close(ring->fd);
+		ring->fd = -1;
+		return 0;
+	}
+	ring->entries = params.sq_entries;
+
+	ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+	ring->cq_ring_size = params.cq_off.cqes
+		+ params.cq_entries * sizeof(struct io_uring_cqe);
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		if (ring->cq_ring_size > ring->sq_ring_size) {
+			ring->sq_ring_size = ring->cq_ring_size;
+		}
+		ring->cq_ring_size = ring->sq_ring_size;
+	}
+
+	ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING
+	);
+	if (ring->sq_ring == MAP_FAILED) {
+		ring->sq_ring = NULL;
+		goto fail;
+	}
+	if (params.features & IORING_FEAT_SINGLE_MMAP) {
+		ring->cq_ring = ring->sq_ring;
+	} else {
+		ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING
+		);
+		if (ring->cq_ring == MAP_FAILED) {
+			ring->cq_ring = NULL;
+			goto fail;
+		}
+	}
+	ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+	ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES
+	);
+	if (ring->sqes == MAP_FAILED) {
+		ring->sqes = NULL;
+		goto fail;
+	}
+
+	sq_ring = (unsigned char *)ring->sq_ring;
+	ring->sq_head = (unsigned *)(sq_ring + params.sq_off.head);
+	ring->sq_tail = (unsigned *)(sq_ring + params.sq_off.tail);
+	ring->sq_mask = (unsigned *)(sq_ring + params.sq_off.ring_mask);
+	ring->sq_array = (unsigned *)(sq_ring + params.sq_off.array);
+	ring->cq_head = (unsigned *)((unsigned char *)ring->cq_ring + params.cq_off.head);
+	ring->cq_tail = (unsigned *)((unsigned char *)ring->cq_ring + params.cq_off.tail);
+	ring->cq_mask = (unsigned *)((unsigned char *)ring->cq_ring + params.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe *)(
+		(unsigned char *)ring->cq_ring + params.cq_off.cqes
+	);
+
+	return 1;
+
+fail:
+	if (ring->sqes) {
+		munmap(ring->sqes, ring->sqes_size);
+	}
+	if (ring->cq_ring && ring->cq_ring != ring->sq_ring) {
+		munmap(ring->cq_ring, ring->cq_ring_size);
+	}
+	if (ring->sq_ring) {
+		munmap(ring->sq_ring, ring->sq_ring_size);
+	}
+	close(ring->fd);
+	ring->fd = -1;
+	return 0;
+}
+
+static void BitcoinIO_uringDestroy(struct BitcoinIOUring *ring)
+{
+	munmap(ring->sqes, ring->sqes_size);
+	if (ring->cq_ring != ring->sq_ring) {
+		munmap(ring->cq_ring, ring->cq_ring_size);
+	}
+	munmap(ring->sq_ring, ring->sq_ring_size);
+	close(ring->fd);
+	ring->fd = -1;
+}
+
+/* Register the stream's blocks as fixed buffers, so the kernel doesn't map
+   them for every request.  This can fail for lack of locked memory, in which
+   case the blocks are used as ordinary buffers. */
+static void BitcoinIO_uringRegister(struct BitcoinIOStream *stream)
+{
+	struct iovec iov[BITCOIN_IO_BLOCKS];
+	unsigned i;
+
+	for (i = 0; i < BITCOIN_IO_BLOCKS; i++) {
+		iov[i].iov_base = stream->blocks[i].data;
+		iov[i].iov_len = BITCOIN_IO_BLOCK_SIZE;
+	}
+	stream->ring.registered = syscall(__NR_io_uring_register, stream->ring.fd,
+		IORING_REGISTER_BUFFERS, iov, BITCOIN_IO_BLOCKS
+	) == 0;
+}
+
+/* Queue a read or write of a block and submit it */
+static int BitcoinIO_uringSubmit(struct BitcoinIOStream *stream, unsigned index,
+	uint64_t offset
+)
+{
+	struct BitcoinIOUring *ring = &stream->ring;
+	struct BitcoinIOBlock *block = &stream->blocks[index];
+	struct io_uring_sqe *sqe;
+	unsigned tail = *ring->sq_tail, slot;
+	int result;
+
+	if (tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) >= ring->entries) {
+		return EBUSY;
+	}
+	slot = tail & *ring->sq_mask;
+	sqe = &ring->sqes[slot];
+	memset(sqe, 0, sizeof(*sqe));
+
+	if (stream->writing) {
+		sqe->opcode = ring->registered ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+		sqe->addr = (uint64_t)(uintptr_t)(block->data + block->used);
+		sqe->len = (unsigned)(block->size - block->used);
+	} else {
+		sqe->opcode = ring->registered ? IORING_OP_READ_FIXED : IORING_OP_READ;
+		sqe->addr = (uint64_t)(uintptr_t)block->data;
+		sqe->len = BITCOIN_IO_BLOCK_SIZE;
+	}
+	sqe->fd = stream->fd;
+	sqe->off = offset;
+	sqe->buf_index = (uint16_t)(ring->registered ? index : 0);
+	sqe->user_data = index;
+
+	ring->sq_array[slot] = slot;
+	__atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+	do {
+		result = (int)syscall(__NR_io_uring_enter, ring->fd, 1, 0, 0, NULL, 0);
+	} while (result < 0 && errno == EINTR);
+	if (result < 0) {
+		return errno;
+	}
+
+	stream->in_flight++;
+	return 0;
+}
+
+/* Wait for at least one request to complete, and update the blocks */
+static int BitcoinIO_uringWait(struct BitcoinIOStream *stream)
+{
+	struct BitcoinIOUring *ring = &stream->ring;
+	unsigned head, tail;
+
+	head = *ring->cq_head;
+	tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+	while (head == tail) {
+		if (syscall(__NR_io_uring_enter, ring->fd, 0, 1, IORING_ENTER_GETEVENTS,
+			NULL, 0
+		) < 0 && errno != EINTR) {
+			return errno;
+		}
+		tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+	}
+
+	for (; head != tail; head++) {
+		struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+		struct BitcoinIOBlock *block = &stream->blocks[cqe->user_data];
+
+		stream->in_flight--;
+		if (stream->writing) {
+			if (cqe->res < 0) {
+				block->error = -cqe->res;
+			} else {
+				block->used += (size_t)cqe->res;
+			}
+		} else {
+			if (cqe->res < 0) {
+				block->error = -cqe->res;
+			} else {
+				block->size = (size_t)cqe->res;
+			}
+			block->state = BITCOIN_IO_BLOCK_READY;
+		}
+	}
+	__atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+/* Start reads into every free block */
+static int BitcoinIO_uringFill(struct BitcoinIOStream *stream)
+{
+	while (!stream->at_end
+		&& stream->blocks[stream->tail].state == BITCOIN_IO_BLOCK_EMPTY
+	) {
+		struct BitcoinIOBlock *block = &stream->blocks[stream->tail];
+		int error;
+
+		block->offset = stream->offset;
+		block->size = block->used = 0;
+		block->error = 0;
+		error = BitcoinIO_uringSubmit(stream, stream->tail, stream->offset);
+		if (error) {
+			return error;
+		}
+		block->state = BITCOIN_IO_BLOCK_PENDING;
+		stream->offset += BITCOIN_IO_BLOCK_SIZE;
+		stream->tail = (stream->tail + 1) % BITCOIN_IO_BLOCKS;
+	}
+	return 0;
+}
+
+/* Wait for everything in flight, so the blocks can be reused or freed */
+static void BitcoinIO_uringDrain(struct BitcoinIOStream *stream)
+{
+	while (stream->in_flight) {
+		if (BitcoinIO_uringWait(stream)) {
+			break;
+		}
+	}
+}
+
+/* Write the next full block, if nothing is being written.  Returns 0 if
+   success, or errno. */
+static int BitcoinIO_uringFlush(struct BitcoinIOStream *stream)
+{
+	struct BitcoinIOBlock *block = &stream->blocks[stream->tail];
+
+	if (stream->in_flight || block->state != BITCOIN_IO_BLOCK_PENDING) {
+		return 0;
+	}
+	if (block->error) {
+		return block->error;
+	}
+	if (block->used < block->size) {
+		return BitcoinIO_uringSubmit(stream, stream->tail, (uint64_t)-1);
+	}
+	block->state = BITCOIN_IO_BLOCK_EMPTY;
+	block->size = block->used = 0;
+	stream->tail = (stream->tail + 1) % BITCOIN_IO_BLOCKS;
+
+	return BitcoinIO_uringFlush(stream);
+}
+
+#endif
+
+/* thread */
+
+/* Wait until *index is no longer value.  The ring is lock-free while the
+   consumer and producer keep up with each other; only when one has to wait
+   does it sleep, and the other wakes it after moving its index. */
+static void BitcoinIO_ringWait(struct BitcoinIOStream *stream, int *waiting,
+	const unsigned *index, unsigned value
+)
+{
+	if (__atomic_load_n(index, __ATOMIC_SEQ_CST) != value) {
+		return;
+	}
+	pthread_mutex_lock(&stream->mutex);
+	__atomic_store_n(waiting, 1, __ATOMIC_SEQ_CST);
+	while (__atomic_load_n(index, __ATOMIC_SEQ_CST) == value
+		&& !__atomic_load_n(&stream->stopping, __ATOMIC_SEQ_CST)
+	) {
+		pthread_cond_wait(&stream->cond, &stream->mutex);
+	}
+	__atomic_store_n(waiting, 0, __ATOMIC_SEQ_CST);
+	pthread_mutex_unlock(&stream->mutex);
+}
+
+/* Move *index on, waking the other side if it is waiting for it */
+static void BitcoinIO_ringAdvance(struct BitcoinIOStream *stream, int *waiting,
+	unsigned *index
+)
+{
+	__atomic_store_n(index, *index + 1, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(waiting, __ATOMIC_SEQ_CST)) {
+		pthread_mutex_lock(&stream->mutex);
+		pthread_cond_broadcast(&stream->cond);
+		pthread_mutex_unlock(&stream->mutex);
+	}
+}
+
+/* Fill blocks from a pipe, FIFO, terminal or file, so whatever writes to
+   the pipe and the conversion both run at full speed. */
+static void *BitcoinIO_readerThread(void *arg)
+{
+	struct BitcoinIOStream *stream = (struct BitcoinIOStream *)arg;
+
+	for (;;) {
+		unsigned tail = stream->tail;
+		struct BitcoinIOBlock *block = &stream->blocks[tail % BITCOIN_IO_BLOCKS];
+		ssize_t bytes;
+
+		BitcoinIO_ringWait(stream, &stream->producer_waiting, &stream->head,
+			tail - BITCOIN_IO_BLOCKS
+		);
+		if (__atomic_load_n(&stream->stopping, __ATOMIC_SEQ_CST)) {
+			break;
+		}
+
+		block->size = block->used = 0;
+		block->error = 0;
+		if (stream->codec) {
+			block->error = BitcoinCompress_Read(stream->codec, block->data,
+				BITCOIN_IO_BLOCK_SIZE, &block->size
+			);
+		} else {
+			/* keep reading while there is more to read straight away, so
+			   blocks are large when the writer is fast, but pass on what
+			   has arrived as soon as the pipe is empty */
+			do {
+				bytes = read(stream->fd, block->data + block->size,
+					BITCOIN_IO_BLOCK_SIZE - block->size
+				);
+				if (bytes > 0) {
+					block->size += (size_t)bytes;
+				} else if (bytes < 0 && errno == EINTR) {
+					bytes = 1;
+				} else if (bytes < 0 && block->size == 0) {
+					block->error = errno;
+				}
+			} while (bytes > 0 && block->size < BITCOIN_IO_BLOCK_SIZE
+				&& BitcoinIO_isReadable(stream->fd)
+			);
+		}
+
+		BitcoinIO_ringAdvance(stream, &stream->consumer_waiting, &stream->tail);
+
+		if (block->size == 0) {
+			/* end of file or error, which the consumer will find */
+			break;
+		}
+	}
+	return NULL;
+}
+
+static void *BitcoinIO_writerThread(void *arg)
+{
+	struct BitcoinIOStream *stream = (struct BitcoinIOStream *)arg;
+	unsigned index = 0;
+
+	for (;;) {
+		struct BitcoinIOBlock *block = &stream->blocks[index];
+		int error;
+
+		pthread_mutex_lock(&stream->mutex);
+		while (block->state != BITCOIN_IO_BLOCK_PENDING && !stream->stopping) {
+			pthread_cond_wait(&stream->cond, &stream->mutex);
+		}
+		if (block->state != BITCOIN_IO_BLOCK_PENDING) {
+			/* stopping, and everything has been written */
+			pthread_mutex_unlock(&stream->mutex);
+			break;
+		}
+		pthread_mutex_unlock(&stream->mutex);
+
+		if (stream->error) {
+			error = 0;
+		} else if (stream->codec) {
+			error = BitcoinCompress_Write(stream->codec, block->data, block->size);
+		} else {
+			error = BitcoinIO_writeAll(stream->fd, block->data, block->size);
+		}
+
+		pthread_mutex_lock(&stream->mutex);
+		if (error && !stream->error) {
+			stream->error = error;
+		}
+		block->size = block->used = 0;
+		block->state = BITCOIN_IO_BLOCK_EMPTY;
+		pthread_cond_broadcast(&stream->cond);
+		pthread_mutex_unlock(&stream->mutex);
+
+		index = (index + 1) % BITCOIN_IO_BLOCKS;
+	}
+	return NULL;
+}
+
+/* stream */
+
+/* Wait until the block being consumed has been read.  Returns 0 if success,
+   or errno. */
+static int BitcoinIO_waitForRead(struct BitcoinIOStream *stream,
+	struct BitcoinIOBlock *block
+)
+{
+	int error = 0;
+
+	if (stream->engine == BITCOIN_IO_ENGINE_THREAD) {
+		(void)block;
+		BitcoinIO_ringWait(stream, &stream->consumer_waiting, &stream->tail,
+			stream->head
+		);
+	}
+#ifdef BITCOIN_IO_HAVE_URING
+	else {
+		while (!error && block->state != BITCOIN_IO_BLOCK_READY) {
+			error = BitcoinIO_uringWait(stream);
+		}
+	}
+#endif
+	return error;
+}
+
+/* Hand a consumed block back to be refilled */
+static int BitcoinIO_recycle(struct BitcoinIOStream *stream,
+	struct BitcoinIOBlock *block
+)
+{
+	if (stream->engine == BITCOIN_IO_ENGINE_THREAD) {
+		BitcoinIO_ringAdvance(stream, &stream->producer_waiting, &stream->head);
+		return 0;
+	}
+#ifdef BITCOIN_IO_HAVE_URING
+	block->state = BITCOIN_IO_BLOCK_EMPTY;
+	stream->head = (stream->head + 1) % BITCOIN_IO_BLOCKS;
+
+	if (stream->seekable && block->size < BITCOIN_IO_BLOCK_SIZE) {
+		unsigned i;
+
+		/* a short read, so the reads after it were at the wrong offsets:
+		   throw them away and carry on from where this one ended */
+		BitcoinIO_uringDrain(stream);
+		for (i = 0; i < BITCOIN_IO_BLOCKS; i++) {
+			stream->blocks[i].state = BITCOIN_IO_BLOCK_EMPTY;
+		}
+		stream->tail = stream->head;
+		stream->offset = block->offset + block->size;
+	}
+	return BitcoinIO_uringFill(stream);
+#else
+	return 0;
+#endif
+}
+
+static ssize_t BitcoinIO_read(void *cookie, char *buffer, size_t size)
+{
+	struct BitcoinIOStream *stream = (struct BitcoinIOStream *)cookie;
+
+	for (;;) {
+		struct BitcoinIOBlock *block = &stream->blocks[stream->head % BITCOIN_IO_BLOCKS];
+		size_t bytes;
+		int error;
+
+		error = BitcoinIO_waitForRead(stream, block);
+		if (!error) {
+			error = block->error;
+		}
+		if (error) {
+			errno = error;
+			return -1;
+		}
+		if (block->size == 0) {
+			/* end of file, and nothing more is read after it */
+			stream->at_end = 1;
+			return 0;
+		}
+
+		bytes = block->size - block->used;
+		if (bytes) {
+			if (bytes > size) {
+				bytes = size;
+			}
+			memcpy(buffer, block->data + block->used, bytes);
+			block->used += bytes;
+			return (ssize_t)bytes;
+		}
+
+		error = BitcoinIO_recycle(stream, block);
+		if (error) {
+			errno = error;
+			return -1;
+		}
+	}
+}
+
+/* Pass the block being filled to the engine, and move on to the next one,
+   waiting for it to be written if necessary.  Returns 0 if success, or
+   errno. */
+static int BitcoinIO_queueWrite(struct BitcoinIOStream *stream)
+{
+	struct BitcoinIOBlock *block = &stream->blocks[stream->head];
+	int error = 0;
+
+	if (stream->engine == BITCOIN_IO_ENGINE_THREAD) {
+		pthread_mutex_lock(&stream->mutex);
+		block->state = BITCOIN_IO_BLOCK_PENDING;
+		pthread_cond_broadcast(&stream->cond);
+		stream->head = (stream->head + 1) % BITCOIN_IO_BLOCKS;
+		block = &stream->blocks[stream->head];
+		while (block->state != BITCOIN_IO_BLOCK_EMPTY) {
+			pthread_cond_wait(&stream->cond, &stream->mutex);
+		}
+		error = stream->error;
+		pthread_mutex_unlock(&stream->mutex);
+		return error;
+	}
+#ifdef BITCOIN_IO_HAVE_URING
+	block->state = BITCOIN_IO_BLOCK_PENDING;
+	stream->head = (stream->head + 1) % BITCOIN_IO_BLOCKS;
+	block = &stream->blocks[stream->head];
+	error = BitcoinIO_uringFlush(stream);
+	while (!error && block->state != BITCOIN_IO_BLOCK_EMPTY) {
+		error = BitcoinIO_uringWait(stream);
+		if (!error) {
+			error = BitcoinIO_uringFlush(stream);
+		}
+	}
+#endif
+	return error;
+}
+
+static ssize_t BitcoinIO_write(void *cookie, const char *buffer, size_t size)
+{
+	struct BitcoinIOStream *stream = (struct BitcoinIOStream *)cookie;
+	size_t written = 0;
+
+	if (stream->error) {
+		errno = stream->error;
+		return -1;
+	}
+
+	while (written < size) {
+		struct BitcoinIOBlock *block = &stream->blocks[stream->head];
+		size_t bytes = BITCOIN_IO_BLOCK_SIZE - block->size;
+
+		if (bytes > size - written) {
+			bytes = size - written;
+		}
+		memcpy(block->data + block->size, buffer + written, bytes);
+		block->size += bytes;
+		written += bytes;
+
+		if (block->size == BITCOIN_IO_BLOCK_SIZE) {
+			int error = BitcoinIO_queueWrite(stream);
+			if (error) {
+				stream->error = error;
+				errno = error;
+				return -1;
+			}
+		}
+	}
+	return (ssize_t)written;
+}
+
+static void BitcoinIO_free(struct BitcoinIOStream *stream)
+{
+	if (stream->engine == BITCOIN_IO_ENGINE_THREAD) {
+		pthread_mutex_destroy(&stream->mutex);
+		pthread_cond_destroy(&stream->cond);
+	}
+#ifdef BITCOIN_IO_HAVE_URING
+	else if (stream->ring.fd >= 0) {
+		BitcoinIO_uringDestroy(&stream->ring);
+	}
+#endif
+	if (stream->codec) {
+		BitcoinCompress_destroy(stream->codec);
+	}
+	if (stream->close_fd) {
+		close(stream->fd);
+	}
+	free(stream->memory);
+	free(stream);
+}
+
+static int BitcoinIO_close(void *cookie)
+{
+	struct BitcoinIOStream *stream = (struct BitcoinIOStream *)cookie;
+	int error = 0;
+
+	if (stream->writing && stream->blocks[stream->head].size && !stream->error) {
+		error = BitcoinIO_queueWrite(stream);
+	}
+
+	if (stream->engine == BITCOIN_IO_ENGINE_THREAD) {
+		if (stream->thread_started) {
+			pthread_mutex_lock(&stream->mutex);
+			__atomic_store_n(&stream->stopping, 1, __ATOMIC_SEQ_CST);
+			pthread_cond_broadcast(&stream->cond);
+			pthread_mutex_unlock(&stream->mutex);
+			pthread_join(stream->thread, NULL);
+		}
+		if (stream->codec && stream->writing && !error && !stream->error) {
+			error = BitcoinCompress_Finish(stream->codec);
+		}
+		if (stream->close_file && fclose(stream->file) && !error
+			&& stream->writing
+		) {
+			error = errno;
+		}
+	}
+#ifdef BITCOIN_IO_HAVE_URING
+	else if (stream->writing) {
+		while (!error && stream->blocks[stream->tail].state == BITCOIN_IO_BLOCK_PENDING) {
+			error = BitcoinIO_uringFlush(stream);
+			if (!error && stream->in_flight) {
+				error = BitcoinIO_uringWait(stream);
+			}
+		}
+		BitcoinIO_uringDrain(stream);
+	} else {
+		BitcoinIO_uringDrain(stream);
+	}
+#endif
+
+	if (!error) {
+		error = stream->error;
+	}
+	BitcoinIO_free(stream);
+
+	if (error) {
+		errno = error;
+		return -1;
+	}
+	return 0;
+}
+
+/* Set up a stream on fd with an engine, or with the thread engine and a
+   codec.  Returns NULL if the engine can't be used. */
+static struct BitcoinIOStream *BitcoinIO_createStream(int fd, int writing,
+	enum BitcoinIOEngine engine, struct BitcoinCompress *codec
+)
+{
+	struct BitcoinIOStream *stream;
+	unsigned i;
+
+	stream = calloc(1, sizeof(*stream));
+	if (!stream) {
+		return NULL;
+	}
+	stream->engine = engine;
+	stream->fd = fd;
+	stream->writing = writing;
+	stream->codec = codec;
+	stream->seekable = !writing && !codec && BitcoinIO_isSeekable(fd);
+	if (stream->seekable) {
+		off_t offset = lseek(fd, 0, SEEK_CUR);
+		stream->seekable = offset >= 0;
+		stream->offset = (uint64_t)offset;
+	}
+#ifdef BITCOIN_IO_HAVE_URING
+	stream->ring.fd = -1;
+#endif
+
+	stream->memory = malloc(BITCOIN_IO_BLOCKS * BITCOIN_IO_BLOCK_SIZE);
+	if (!stream->memory) {
+		free(stream);
+		return NULL;
+	}
+	for (i = 0; i < BITCOIN_IO_BLOCKS; i++) {
+		stream->blocks[i].data = stream->memory + (size_t)i * BITCOIN_IO_BLOCK_SIZE;
+	}
+
+	if (engine == BITCOIN_IO_ENGINE_THREAD) {
+		pthread_mutex_init(&stream->mutex, NULL);
+		pthread_cond_init(&stream->cond, NULL);
+		if (pthread_create(&stream->thread, NULL,
+			writing ? BitcoinIO_writerThread : BitcoinIO_readerThread, stream
+		)) {
+			stream->codec = NULL;
+			BitcoinIO_free(stream);
+			return NULL;
+		}
+		stream->thread_started = 1;
+		return stream;
+	}
+
+#ifdef BITCOIN_IO_HAVE_URING
+	if (engine == BITCOIN_IO_ENGINE_URING
+		&& BitcoinIO_uringSetup(&stream->ring, BITCOIN_IO_BLOCKS * 2)
+	) {
+		BitcoinIO_uringRegister(stream);
+		if (writing || BitcoinIO_uringFill(stream) == 0) {
+			return stream;
+		}
+		BitcoinIO_uringDrain(stream);
+	}
+#endif
+
+	BitcoinIO_free(stream);
+	return NULL;
+}
+
+/* Make a FILE of a stream.  Returns NULL if failure, having closed the
+   stream. */
+static FILE *BitcoinIO_wrap(struct BitcoinIOStream *stream)
+{
+	cookie_io_functions_t functions;
+	FILE *file;
+
+	memset(&functions, 0, sizeof(functions));
+	if (stream->writing) {
+		functions.write = BitcoinIO_write;
+	} else {
+		functions.read = BitcoinIO_read;
+	}
+	functions.close = BitcoinIO_close;
+
+	file = fopencookie(stream, stream->writing ? "wb" : "rb", functions);
+	if (!file) {
+		BitcoinIO_close(stream);
+		return NULL;
+	}
+	setvbuf(file, NULL, _IOFBF, BITCOIN_IO_STDIO_BUFFER_SIZE);
+
+	return file;
+}
+
+/* Open a FILE on fd with an engine, falling back to the next best engine.
+   Returns NULL if there is no engine to use, in which case fd is left
+   open. */
+static FILE *BitcoinIO_open(int fd, int close_fd, int writing,
+	enum BitcoinIOEngine engine
+)
+{
+	struct BitcoinIOStream *stream = NULL;
+
+	engine = BitcoinIO_SelectEngine(engine);
+	if (engine == BITCOIN_IO_ENGINE_URING && !writing && !BitcoinIO_isSeekable(fd)) {
+		/* io_uring can only have one read of a pipe in flight, so it is
+		   read by a thread which can keep several blocks ahead */
+		engine = BITCOIN_IO_ENGINE_THREAD;
+	}
+	if (engine == BITCOIN_IO_ENGINE_URING) {
+		stream = BitcoinIO_createStream(fd, writing, engine, NULL);
+		if (!stream) {
+			applog(APPLOG_NOTICE, __func__,
+				"io_uring is not available, using the thread engine."
+			);
+			engine = BITCOIN_IO_ENGINE_THREAD;
+		}
+	}
+	if (engine == BITCOIN_IO_ENGINE_THREAD) {
+		stream = BitcoinIO_createStream(fd, writing, engine, NULL);
+	}
+	if (!stream) {
+		return NULL;
+	}
+	stream->close_fd = close_fd;
+
+	return BitcoinIO_wrap(stream);
+}
+
+/* Open a FILE decompressing from or compressing to file on a thread of its
+   own.  file is closed when the FILE is if close_file is set, even if this
+   fails.  Returns NULL if failure. */
+static FILE *BitcoinIO_openCodec(FILE *file, int close_file, int writing,
+	enum BitcoinCompression compression, int level
+)
+{
+	struct BitcoinCompress *codec;
+	struct BitcoinIOStream *stream = NULL;
+
+	if (writing) {
+		codec = BitcoinCompress_createEncoder(compression, level, file);
+	} else {
+		codec = BitcoinCompress_createDecoder(compression, file);
+	}
+	if (codec) {
+		stream = BitcoinIO_createStream(-1, writing, BITCOIN_IO_ENGINE_THREAD,
+			codec
+		);
+		if (!stream) {
+			BitcoinCompress_destroy(codec);
+		}
+	}
+	if (!stream) {
+		if (close_file) {
+			fclose(file);
+		}
+		errno = codec ? ENOMEM : ENOTSUP;
+		return NULL;
+	}
+	stream->file = file;
+	stream->close_file = close_file;
+
+	return BitcoinIO_wrap(stream);
+}
+
+enum BitcoinIOEngine BitcoinIO_SelectEngine(enum BitcoinIOEngine requested)
+{
+#ifdef BITCOIN_IO_HAVE_URING
+	static int uring_available = -1;
+
+	if (uring_available < 0) {
+		struct BitcoinIOUring ring;
+		uring_available = BitcoinIO_uringSetup(&ring, 1);
+		if (uring_available) {
+			BitcoinIO_uringDestroy(&ring);
+		}
+	}
+	if (requested == BITCOIN_IO_ENGINE_AUTO) {
+		return uring_available ? BITCOIN_IO_ENGINE_URING : BITCOIN_IO_ENGINE_THREAD;
+	}
+	if (requested == BITCOIN_IO_ENGINE_URING && !uring_available) {
+		return BITCOIN_IO_ENGINE_THREAD;
+	}
+	return requested;
+#else
+	if (requested == BITCOIN_IO_ENGINE_AUTO || requested == BITCOIN_IO_ENGINE_URING) {
+		return BITCOIN_IO_ENGINE_THREAD;
+	}
+	return requested;
+#endif
+}
+
+/* Open a file for reading with an engine, without decompressing it */
+static FILE *BitcoinIO_openRaw(const char *filename, uint64_t offset,
+	enum BitcoinIOEngine engine
+)
+{
+	FILE *file;
+	int fd, close_fd;
+
+	if (BitcoinIO_SelectEngine(engine) == BITCOIN_IO_ENGINE_STDIO) {
+		if (strcmp(filename, "-") == 0) {
+			return stdin;
+		}
+		file = fopen(filename, "rb");
+		if (file && offset && fseeko(file, (off_t)offset, SEEK_SET)) {
+			fclose(file);
+			return NULL;
+		}
+		return file;
+	}
+
+	if (strcmp(filename, "-") == 0) {
+		fd = STDIN_FILENO;
+		close_fd = 0;
+	} else {
+		fd = open(filename, O_RDONLY);
+		if (fd < 0) {
+			return NULL;
+		}
+		close_fd = 1;
+		if (offset && lseek(fd, (off_t)offset, SEEK_SET) < 0) {
+			close(fd);
+			return NULL;
+		}
+	}
+	file = BitcoinIO_open(fd, close_fd, 0, engine);
+	if (!file) {
+		file = close_fd ? fdopen(fd, "rb") : stdin;
+	}
+	return file;
+}
+
+FILE *BitcoinIO_OpenInput(const char *filename, uint64_t offset,
+	enum BitcoinIOEngine engine, enum BitcoinCompression compression
+)
+{
+	FILE *file = BitcoinIO_openRaw(filename, offset, engine);
+
+	if (!file) {
+		return NULL;
+	}
+
+	if (compression == BITCOIN_COMPRESSION_AUTO) {
+		/* the first byte is enough to tell text from gzip or zstd, and it
+		   can always be pushed back */
+		int c = getc(file);
+		if (c == EOF) {
+			return file;
+		}
+		ungetc(c, file);
+		compression = BitcoinCompress_Detect(c);
+	}
+	if (compression == BITCOIN_COMPRESSION_NONE) {
+		return file;
+	}
+
+	return BitcoinIO_openCodec(file, file != stdin, 0, compression, 0);
+}
+
+FILE *BitcoinIO_OpenOutput(FILE *file, enum BitcoinIOEngine engine,
+	enum BitcoinCompression compression, int level
+)
+{
+	FILE *output = file;
+
+	engine = BitcoinIO_SelectEngine(engine);
+	if (engine != BITCOIN_IO_ENGINE_STDIO && !isatty(fileno(file)) && !fflush(file)) {
+		output = BitcoinIO_open(fileno(file), 0, 1, engine);
+		if (!output) {
+			output = file;
+		}
+	}
+
+	if (compression == BITCOIN_COMPRESSION_NONE
+		|| compression == BITCOIN_COMPRESSION_AUTO
+	) {
+		return output;
+	}
+	return BitcoinIO_openCodec(output, output != file, 1, compression, level);
+}
+
+#else
+
+/* stdio only */
+
+enum BitcoinIOEngine BitcoinIO_SelectEngine(enum BitcoinIOEngine requested)
+{
+	(void)requested;
+	return BITCOIN_IO_ENGINE_STDIO;
+}
+
+/* Compressed streams need a thread of their own too */
+static int BitcoinIO_checkCompression(enum BitcoinCompression compression)
+{
+	if (compression == BITCOIN_COMPRESSION_NONE
+		|| compression == BITCOIN_COMPRESSION_AUTO
+	) {
+		return 1;
+	}
+	applog(APPLOG_ERROR, __func__,
+		"%s compression is not available on this platform.",
+		BitcoinCompress_GetName(compression)
+	);
+	errno = EINVAL;
+	return 0;
+}
+
+FILE *BitcoinIO_OpenInput(const char *filename, uint64_t offset,
+	enum BitcoinIOEngine engine, enum BitcoinCompression compression
+)
+{
+	FILE *file;
+
+	(void)engine;
+	if (!BitcoinIO_checkCompression(compression)) {
+		return NULL;
+	}
+	if (strcmp(filename, "-") == 0) {
+		return stdin;
+	}
+	file = fopen(filename, "rb");
+	if (file && offset && fseek(file, (long)offset, SEEK_SET)) {
+		fclose(file);
+		return NULL;
+	}
+	return file;
+}
+
+FILE *BitcoinIO_OpenOutput(FILE *file, enum BitcoinIOEngine engine,
+	enum BitcoinCompression compression, int level
+)
+{
+	(void)engine;
+	(void)level;
+	if (!BitcoinIO_checkCompression(compression)) {
+		return NULL;
+	}
+	return file;
+}
+
+#endif
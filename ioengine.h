@@ -0,0 +1,80 @@
+#ifndef BITCOIN_INCLUDE_IOENGINE_H
+#define BITCOIN_INCLUDE_IOENGINE_H
+
+/** @file ioengine.h
+ *  @brief Read-ahead input and write-behind output for batch mode.
+ *
+ *  The streams are stdio FILEs, so batch mode still reads lines with
+ *  fgets() and writes with fwrite(), but underneath the file is read in
+ *  large blocks ahead of the conversion, and written in large blocks
+ *  behind it, so the conversion doesn't wait for each read and write.
+ *  The I/O is done with io_uring on Linux, into registered buffers, or by
+ *  a thread per stream where io_uring is not available.  gzip and zstd
+ *  input is detected and decompressed, and output can be compressed, each
+ *  on a thread of its own.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "compress.h"
+
+enum BitcoinIOEngine {
+	/* io_uring if available, otherwise thread */
+	BITCOIN_IO_ENGINE_AUTO,
+
+	/* plain blocking stdio */
+	BITCOIN_IO_ENGINE_STDIO,
+
+	/* a thread per stream reading ahead or writing behind */
+	BITCOIN_IO_ENGINE_THREAD,
+
+	/* io_uring, with registered buffers if allowed */
+	BITCOIN_IO_ENGINE_URING
+};
+
+/** @brief Parse an engine name: auto, stdio, thread or uring.
+ *
+ *  @return 1 if success, 0 if the name is unknown.
+ */
+int BitcoinIO_ParseEngine(const char *name, enum BitcoinIOEngine *engine);
+
+/** @brief Get the name of an engine, for reporting. */
+const char *BitcoinIO_GetEngineName(enum BitcoinIOEngine engine);
+
+/** @brief Work out which engine to use for a requested one: auto becomes
+ *         uring or thread, and engines this platform doesn't have fall
+ *         back to the next best one.
+ */
+enum BitcoinIOEngine BitcoinIO_SelectEngine(enum BitcoinIOEngine requested);
+
+/** @brief Open a file for reading with an engine, starting at offset,
+ *         decompressing it if it is compressed.
+ *
+ *  @param[in] filename Name of the file, or "-" for stdin (in which case
+ *                      offset must be 0).
+ *  @param[in] compression Format of the file, or auto to detect it from
+ *                         its first byte.
+ *
+ *  @return Stream to read with stdio and close with fclose(), or NULL if
+ *          failure, with errno set.
+ */
+FILE *BitcoinIO_OpenInput(const char *filename, uint64_t offset,
+	enum BitcoinIOEngine engine, enum BitcoinCompression compression
+);
+
+/** @brief Wrap an open output stream with an engine, and compress what is
+ *         written to it.  The stream is flushed first, and terminals are
+ *         left to stdio.
+ *
+ *  @param[in] level Compression level, or 0 for the format's default.
+ *
+ *  @return The stream to write to and close with fclose() (which doesn't
+ *          close file), file itself if it is not wrapped, or NULL if the
+ *          compression can't be set up.
+ */
+FILE *BitcoinIO_OpenOutput(FILE *file, enum BitcoinIOEngine engine,
+	enum BitcoinCompression compression, int level
+);
+
+#endif
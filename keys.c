@@ -195,17 +195,22 @@ err:
 	return group;
 }
 
+EC_GROUP *Bitcoin_NewSecp256k1Group(void)
+{
+#ifdef HAVE_NID_secp256k1
+	return EC_GROUP_new_by_curve_name(NID_secp256k1);
+#else
+	return ec_group_new_from_data(&EC_SECG_PRIME_256K1.h);
+#endif
+}
+
 EC_KEY *EC_KEY_new_by_curve_name_NID_secp256k1(void)
 {
 	static EC_GROUP *group = NULL;
 	EC_KEY *ret = NULL;
 
 	if (group == NULL) {
-#ifdef HAVE_NID_secp256k1
-		group = EC_GROUP_new_by_curve_name(NID_secp256k1);
-#else
-		group = ec_group_new_from_data(&EC_SECG_PRIME_256K1.h);
-#endif
+		group = Bitcoin_NewSecp256k1Group();
 		if (group == NULL) {
 			return NULL;
 		}
@@ -236,6 +241,7 @@ BitcoinResult Bitcoin_MakePublicKeyFromPrivateKey(
 	unsigned compression = private_key->public_key_compression;
 	size_t expected_public_key_size = 0;
 	enum BitcoinPublicKeyCompression public_key_compression;
+	char error[256];
 
 	switch (compression) {
 		case BITCOIN_PUBLIC_KEY_COMPRESSED :
@@ -255,7 +261,7 @@ BitcoinResult Bitcoin_MakePublicKeyFromPrivateKey(
 	if (!key) {
 		applog(APPLOG_ERROR, __func__,
 			"EC_KEY_new_by_curve_name failed: %s",
-			ERR_error_string(ERR_get_error(), NULL)
+			Bitcoin_LibraryErrorString(error, sizeof(error))
 		);
 		return BITCOIN_ERROR_LIBRARY_FAILURE;
 	}
@@ -264,7 +270,7 @@ BitcoinResult Bitcoin_MakePublicKeyFromPrivateKey(
 	if (!group) {
 		applog(APPLOG_ERROR, __func__,
 			"EC_KEY_get0_group failed: %s",
-			ERR_error_string(ERR_get_error(), NULL)
+			Bitcoin_LibraryErrorString(error, sizeof(error))
 		);
 		EC_KEY_free(key);
 		return BITCOIN_ERROR_LIBRARY_FAILURE;
@@ -278,7 +284,7 @@ BitcoinResult Bitcoin_MakePublicKeyFromPrivateKey(
 	if (!ctx) {
 		applog(APPLOG_ERROR, __func__,
 			"BN_CTX_new failed: %s",
-			ERR_error_string(ERR_get_error(), NULL)
+			Bitcoin_LibraryErrorString(error, sizeof(error))
 		);
 		EC_KEY_free(key);
 		return BITCOIN_ERROR_LIBRARY_FAILURE;
@@ -287,7 +293,7 @@ BitcoinResult Bitcoin_MakePublicKeyFromPrivateKey(
 	if (!EC_POINT_mul(group, ec_public, private_key_bn, NULL, NULL, ctx)) {
 		applog(APPLOG_ERROR, __func__,
 			"EC_POINT_mul failed: %s",
-			ERR_error_string(ERR_get_error(), NULL)
+			Bitcoin_LibraryErrorString(error, sizeof(error))
 		);
 		EC_KEY_free(key);
 		return BITCOIN_ERROR_LIBRARY_FAILURE;
@@ -343,3 +349,99 @@ BitcoinResult Bitcoin_MakePublicKeyFromPrivateKey(
 
 	return BITCOIN_SUCCESS;
 }
+
+void Bitcoin_MakeAddressFromRIPEMD160(
+	struct BitcoinAddress *address,
+	const struct BitcoinRIPEMD160 *hash,
+	const struct BitcoinNetworkType *network_type
+)
+{
+	memcpy(address->data+1, hash->data, BITCOIN_RIPEMD160_SIZE);
+	address->data[0] = BitcoinNetworkType_GetPublicKeyPrefix(network_type);;
+}
+
+void Bitcoin_MakeRIPEMD160FromAddress(
+	struct BitcoinRIPEMD160 *hash,
+	const struct BitcoinAddress *address
+)
+{
+	memcpy(&hash->data, address->data+BITCOIN_ADDRESS_VERSION_SIZE, BITCOIN_RIPEMD160_SIZE);
+}
+
+void Bitcoin_MakeRIPEMD160FromSHA256(
+	struct BitcoinRIPEMD160 *output_hash,
+	const struct BitcoinSHA256 *input_hash
+)
+{
+	Bitcoin_RIPEMD160(output_hash, &input_hash->data, BITCOIN_SHA256_SIZE);
+}
+
+void Bitcoin_MakeSHA256FromPublicKey(
+	struct BitcoinSHA256 *output_hash,
+	const struct BitcoinPublicKey *public_key
+)
+{
+	Bitcoin_SHA256(output_hash, &public_key->data, BitcoinPublicKey_GetSize(public_key));
+}
+
+BitcoinResult Bitcoin_MakeAddressFromPublicKey(
+	struct BitcoinAddress *address,
+	const struct BitcoinPublicKey *public_key
+)
+{
+	struct BitcoinSHA256 sha256;
+	struct BitcoinRIPEMD160 ripemd160;
+
+	if (!BitcoinPublicKey_GetSize(public_key) || !public_key->network_type) {
+		return BITCOIN_ERROR_PUBLIC_KEY_INVALID_FORMAT;
+	}
+
+	Bitcoin_MakeSHA256FromPublicKey(&sha256, public_key);
+	Bitcoin_MakeRIPEMD160FromSHA256(&ripemd160, &sha256);
+	Bitcoin_MakeAddressFromRIPEMD160(address, &ripemd160, public_key->network_type);
+
+	return BITCOIN_SUCCESS;
+}
+
+BitcoinResult Bitcoin_LoadPrivateKeyFromBase58(
+	struct BitcoinPrivateKey *output_private_key,
+	const char *input_text, size_t input_size
+)
+{
+	uint8_t raw[BITCOIN_PRIVATE_KEY_WIF_COMPRESSED_SIZE + BITCOIN_BASE58CHECK_CHECKSUM_SIZE];
+	size_t raw_size = 0;
+	BitcoinResult result;
+
+	result = Bitcoin_DecodeBase58Check(raw, sizeof(raw), &raw_size,
+		input_text, input_size
+	);
+	if (result != BITCOIN_SUCCESS) {
+		return result;
+	}
+
+	switch (raw_size) {
+		case BITCOIN_PRIVATE_KEY_WIF_UNCOMPRESSED_SIZE :
+			output_private_key->public_key_compression = BITCOIN_PUBLIC_KEY_UNCOMPRESSED;
+			break;
+		case BITCOIN_PRIVATE_KEY_WIF_COMPRESSED_SIZE :
+			if (raw[raw_size - 1] != BITCOIN_PRIVATE_KEY_WIF_COMPRESSION_FLAG_COMPRESSED) {
+				return BITCOIN_ERROR_PRIVATE_KEY_INVALID_FORMAT;
+			}
+			output_private_key->public_key_compression = BITCOIN_PUBLIC_KEY_COMPRESSED;
+			break;
+		default :
+			return BITCOIN_ERROR_PRIVATE_KEY_INVALID_FORMAT;
+	}
+
+	output_private_key->network_type = Bitcoin_GetNetworkTypeByPrivateKeyPrefix(raw[0]);
+	if (!output_private_key->network_type) {
+		return BITCOIN_ERROR_PRIVATE_KEY_INVALID_FORMAT;
+	}
+
+	memcpy(output_private_key->data, raw + BITCOIN_PRIVATE_KEY_WIF_VERSION_SIZE,
+		BITCOIN_PRIVATE_KEY_SIZE
+	);
+	memset(raw, 0, sizeof(raw));
+
+	return BITCOIN_SUCCESS;
+}
@@ -10,6 +10,7 @@
 #include "hash.h" /* BITCOIN_RIPEMD160_SIZE */
 #include "result.h" /* BitcoinResult */
 #include "utility.h" /* uint_max2 */
+#include "prefix.h" /* struct BitcoinNetworkType */
 
 /* declare Bitcoin address format */
 
@@ -144,6 +145,43 @@ BitcoinResult Bitcoin_MakePublicKeyFromPrivateKey(
 	const struct BitcoinPrivateKey *private_key
 );
 
+/** @brief Make a new OpenSSL EC_GROUP for the secp256k1 curve, to be
+ *         freed by the caller with EC_GROUP_free().
+ *
+ *  @return EC_GROUP, or NULL if failure.
+ */
+struct ec_group_st *Bitcoin_NewSecp256k1Group(void);
+
+/** @brief Make an address from the RIPEMD160 hash of a public key.
+ *
+ *  @param address[output] Pointer to address to write.
+ *  @param hash[input] RIPEMD160 of the SHA256 of the public key.
+ *  @param network_type[input] Network whose address prefix to use.
+ */
+void Bitcoin_MakeAddressFromRIPEMD160(
+	struct BitcoinAddress *address,
+	const struct BitcoinRIPEMD160 *hash,
+	const struct BitcoinNetworkType *network_type
+);
+
+/** @brief Extract the public key RIPEMD160 hash from an address. */
+void Bitcoin_MakeRIPEMD160FromAddress(
+	struct BitcoinRIPEMD160 *hash,
+	const struct BitcoinAddress *address
+);
+
+/** @brief Hash the SHA256 hash of a public key into its RIPEMD160 hash. */
+void Bitcoin_MakeRIPEMD160FromSHA256(
+	struct BitcoinRIPEMD160 *output_hash,
+	const struct BitcoinSHA256 *input_hash
+);
+
+/** @brief Calculate the SHA256 hash of a public key. */
+void Bitcoin_MakeSHA256FromPublicKey(
+	struct BitcoinSHA256 *output_hash,
+	const struct BitcoinPublicKey *public_key
+);
+
 /** @brief Convert a public key to a Bitcoin address structure.
  *
  *  @param address[output] Pointer to address to write.
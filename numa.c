@@ -0,0 +1,256 @@
+#define _GNU_SOURCE /* cpu_set_t, sched_setaffinity() */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#include "numa.h"
+#include "applog.h"
+
+#define BITCOIN_NUMA_SYSFS "/sys/devices/system/node"
+
+/* mbind() arguments, from <linux/mempolicy.h> */
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED 1
+#endif
+#ifndef MPOL_MF_MOVE
+#define MPOL_MF_MOVE (1 << 1)
+#endif
+
+struct BitcoinNUMANode {
+	unsigned id; /* the kernel's number */
+	int *cpus;
+	unsigned cpu_count;
+};
+
+static struct BitcoinNUMANode numa_nodes[BITCOIN_NUMA_MAX_NODES];
+static unsigned numa_node_count = 0;
+static unsigned numa_cpu_count = 0;
+
+int BitcoinNUMA_ParseMode(const char *name, enum BitcoinNUMAMode *mode)
+{
+	if (strcmp(name, "off") == 0) {
+		*mode = BITCOIN_NUMA_OFF;
+	} else if (strcmp(name, "pin") == 0) {
+		*mode = BITCOIN_NUMA_PIN;
+	} else if (strcmp(name, "replicate") == 0) {
+		*mode = BITCOIN_NUMA_REPLICATE;
+	} else {
+		return 0;
+	}
+	return 1;
+}
+
+static int BitcoinNUMA_compareNodes(const void *a, const void *b)
+{
+	const unsigned x = ((const struct BitcoinNUMANode *)a)->id;
+	const unsigned y = ((const struct BitcoinNUMANode *)b)->id;
+
+	return x < y ? -1 : x > y;
+}
+
+/* Add the CPUs of a list like "0-3,8,10-11" which are in allowed to a
+   node.  Returns 1 if success, 0 if failure. */
+static int BitcoinNUMA_addCPUs(struct BitcoinNUMANode *node, const char *list,
+	const cpu_set_t *allowed
+)
+{
+	while (*list && *list != '\n') {
+		char *end;
+		long first, last, cpu;
+
+		first = last = strtol(list, &end, 10);
+		if (end == list || first < 0) {
+			return 0;
+		}
+		if (*end == '-') {
+			list = end + 1;
+			last = strtol(list, &end, 10);
+			if (end == list || last < first) {
+				return 0;
+			}
+		}
+		for (cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++) {
+			int *cpus;
+
+			if (!CPU_ISSET(cpu, allowed)) {
+				continue;
+			}
+			cpus = realloc(node->cpus, (node->cpu_count + 1) * sizeof(*cpus));
+			if (!cpus) {
+				return 0;
+			}
+			node->cpus = cpus;
+			node->cpus[node->cpu_count++] = (int)cpu;
+		}
+		list = *end == ',' ? end + 1 : end;
+	}
+	return 1;
+}
+
+/* Read the nodes and their CPUs, keeping the nodes with CPUs the process
+   may run on.  Returns 1 if success, 0 if there is no topology to read. */
+static int BitcoinNUMA_readNodes(const cpu_set_t *allowed)
+{
+	DIR *directory = opendir(BITCOIN_NUMA_SYSFS);
+	struct dirent *entry;
+
+	if (!directory) {
+		return 0;
+	}
+	while ((entry = readdir(directory)) != NULL) {
+		struct BitcoinNUMANode *node = &numa_nodes[numa_node_count];
+		char filename[sizeof(BITCOIN_NUMA_SYSFS) + 64], list[4096];
+		unsigned id;
+		char end;
+		FILE *file;
+		int success;
+
+		if (sscanf(entry->d_name, "node%u%c", &id, &end) != 1
+			|| strlen(entry->d_name) > 32
+			|| numa_node_count == BITCOIN_NUMA_MAX_NODES
+		) {
+			continue;
+		}
+		sprintf(filename, "%s/%s/cpulist", BITCOIN_NUMA_SYSFS, entry->d_name);
+		file = fopen(filename, "r");
+		if (!file) {
+			continue;
+		}
+		success = fgets(list, sizeof(list), file) != NULL;
+		fclose(file);
+
+		node->id = id;
+		if (success && BitcoinNUMA_addCPUs(node, list, allowed)
+			&& node->cpu_count
+		) {
+			numa_cpu_count += node->cpu_count;
+			numa_node_count++;
+		} else {
+			free(node->cpus);
+			memset(node, 0, sizeof(*node));
+		}
+	}
+	closedir(directory);
+
+	qsort(numa_nodes, numa_node_count, sizeof(numa_nodes[0]),
+		BitcoinNUMA_compareNodes
+	);
+	return numa_node_count > 0;
+}
+
+static void BitcoinNUMA_detect(void)
+{
+	cpu_set_t allowed;
+	int cpu;
+
+	if (numa_node_count) {
+		return;
+	}
+
+	if (sched_getaffinity(0, sizeof(allowed), &allowed)) {
+		const long online = sysconf(_SC_NPROCESSORS_ONLN);
+
+		CPU_ZERO(&allowed);
+		for (cpu = 0; cpu < (online > 0 ? online : 1) && cpu < CPU_SETSIZE; cpu++) {
+			CPU_SET(cpu, &allowed);
+		}
+	}
+	if (BitcoinNUMA_readNodes(&allowed)) {
+		return;
+	}
+
+	/* no topology: one node of every CPU allowed */
+	numa_nodes[0].id = 0;
+	for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+		if (CPU_ISSET(cpu, &allowed)) {
+			int *cpus = realloc(numa_nodes[0].cpus,
+				(numa_nodes[0].cpu_count + 1) * sizeof(*cpus)
+			);
+			if (!cpus) {
+				break;
+			}
+			numa_nodes[0].cpus = cpus;
+			numa_nodes[0].cpus[numa_nodes[0].cpu_count++] = cpu;
+		}
+	}
+	numa_cpu_count = numa_nodes[0].cpu_count;
+	numa_node_count = 1;
+}
+
+unsigned BitcoinNUMA_GetNodeCount(void)
+{
+	BitcoinNUMA_detect();
+	return numa_node_count;
+}
+
+unsigned BitcoinNUMA_GetCPUCount(void)
+{
+	BitcoinNUMA_detect();
+	return numa_cpu_count ? numa_cpu_count : 1;
+}
+
+int BitcoinNUMA_PinThread(unsigned worker, unsigned *node)
+{
+	const struct BitcoinNUMANode *placed;
+	cpu_set_t cpus;
+	int cpu;
+
+	BitcoinNUMA_detect();
+	*node = worker % numa_node_count;
+	placed = &numa_nodes[*node];
+	if (!placed->cpu_count) {
+		return -1;
+	}
+	cpu = placed->cpus[(worker / numa_node_count) % placed->cpu_count];
+
+	CPU_ZERO(&cpus);
+	CPU_SET(cpu, &cpus);
+	if (sched_setaffinity(0, sizeof(cpus), &cpus)) {
+		applog(APPLOG_WARNING, __func__, "Failed to pin worker %u to CPU %d (%s)",
+			worker, cpu, strerror(errno)
+		);
+		return -1;
+	}
+	return cpu;
+}
+
+int BitcoinNUMA_Bind(void *memory, size_t size, unsigned node)
+{
+#ifdef SYS_mbind
+	const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+	unsigned long mask[BITCOIN_NUMA_MAX_NODES / (8 * sizeof(unsigned long)) + 1];
+	unsigned long start, end;
+	unsigned id;
+
+	BitcoinNUMA_detect();
+	if (node >= numa_node_count || numa_nodes[node].id >= 8 * sizeof(mask)) {
+		errno = EINVAL;
+		return 0;
+	}
+	id = numa_nodes[node].id;
+
+	start = ((unsigned long)memory + page - 1) & ~(unsigned long)(page - 1);
+	end = ((unsigned long)memory + size) & ~(unsigned long)(page - 1);
+	if (end <= start) {
+		return 1;
+	}
+
+	memset(mask, 0, sizeof(mask));
+	mask[id / (8 * sizeof(unsigned long))] |= 1UL << (id % (8 * sizeof(unsigned long)));
+	return !syscall(SYS_mbind, start, end - start, MPOL_PREFERRED, mask,
+		(unsigned long)(8 * sizeof(mask)), MPOL_MF_MOVE
+	);
+#else
+	(void)memory;
+	(void)size;
+	(void)node;
+	errno = ENOSYS;
+	return 0;
+#endif
+}
@@ -0,0 +1,70 @@
+#ifndef BITCOIN_INCLUDE_NUMA_H
+#define BITCOIN_INCLUDE_NUMA_H
+
+/** @file numa.h
+ *  @brief NUMA placement of worker threads and their memory, for hosts
+ *         with more than one memory node (usually a socket each).
+ *
+ *  A thread reading memory attached to another socket waits for the
+ *  interconnect on every cache miss.  Worker threads are pinned to one CPU
+ *  each, spread over the nodes in turn, and their working memory and
+ *  copies of the read-only tables they look up can be placed on their own
+ *  node.
+ *
+ *  The topology is read from /sys/devices/system/node, and threads and
+ *  memory are placed with the sched_setaffinity() and mbind() system
+ *  calls, so libnuma is not needed.  Only the CPUs the process may run on
+ *  count, and a host without NUMA (or without sysfs) is one node.  Nodes
+ *  are numbered here from 0 to BitcoinNUMA_GetNodeCount() - 1, in the
+ *  order of the kernel's node numbers, which may have gaps.
+ */
+
+#include <stddef.h> /* size_t */
+
+/* most nodes placed on, any more are left out */
+#define BITCOIN_NUMA_MAX_NODES 64
+
+enum BitcoinNUMAMode {
+	BITCOIN_NUMA_OFF,
+	BITCOIN_NUMA_PIN,       /* pin workers, and place their memory */
+	BITCOIN_NUMA_REPLICATE  /* the same, and copy tables to each node */
+};
+
+/** @brief Parse a mode name: off, pin or replicate.
+ *
+ *  @return Non-zero if name is valid.
+ */
+int BitcoinNUMA_ParseMode(const char *name, enum BitcoinNUMAMode *mode);
+
+/** @brief Get the number of nodes with CPUs the process may run on, at
+ *         least 1.  Should be called before starting threads, since the
+ *         topology is read on first use.
+ */
+unsigned BitcoinNUMA_GetNodeCount(void);
+
+/** @brief Get the number of CPUs the process may run on, at least 1. */
+unsigned BitcoinNUMA_GetCPUCount(void);
+
+/** @brief Pin the calling thread to the CPU for a worker: workers go to
+ *         each node in turn, and to each CPU of a node in turn, so n
+ *         workers use n CPUs if there are that many.
+ *
+ *  @param[in] worker Number of the worker, from 0.
+ *  @param[out] node Node the worker runs on.
+ *
+ *  @return CPU the thread is pinned to, or -1 if failure (node is still
+ *          set).
+ */
+int BitcoinNUMA_PinThread(unsigned worker, unsigned *node);
+
+/** @brief Prefer a node for memory: pages touched later are allocated on
+ *         it where it has room, and pages already touched are moved to it.
+ *         Only the whole pages of memory are placed, so memory from
+ *         BitcoinHugePage_Alloc() should be passed with its whole mapped
+ *         size (see BitcoinHugePage_GetMappedSize()).
+ *
+ *  @return Non-zero if success, 0 if failure, with errno set.
+ */
+int BitcoinNUMA_Bind(void *memory, size_t size, unsigned node);
+
+#endif
@@ -0,0 +1,60 @@
+#include <string.h>
+
+#include "records.h"
+
+#define BITCOIN_RECORDS_ALLOC(records, arena, field, capacity) \
+	((records)->field = BitcoinArena_Alloc((arena), \
+		(capacity) * sizeof((records)->field[0]) \
+	))
+
+int BitcoinRecords_Init(struct BitcoinRecords *records,
+	struct BitcoinArena *arena, size_t capacity
+)
+{
+	memset(records, 0, sizeof(*records));
+
+	if (
+		!BITCOIN_RECORDS_ALLOC(records, arena, input, capacity)
+		|| !BITCOIN_RECORDS_ALLOC(records, arena, input_size, capacity)
+		|| !BITCOIN_RECORDS_ALLOC(records, arena, input_raw, capacity)
+		|| !BITCOIN_RECORDS_ALLOC(records, arena, input_raw_size, capacity)
+		|| !BITCOIN_RECORDS_ALLOC(records, arena, private_keys, capacity)
+		|| !BITCOIN_RECORDS_ALLOC(records, arena, public_keys, capacity)
+		|| !BITCOIN_RECORDS_ALLOC(records, arena, public_key_sha256, capacity)
+		|| !BITCOIN_RECORDS_ALLOC(records, arena, public_key_ripemd160, capacity)
+		|| !BITCOIN_RECORDS_ALLOC(records, arena, addresses, capacity)
+		|| !BITCOIN_RECORDS_ALLOC(records, arena, flags, capacity)
+		|| !BITCOIN_RECORDS_ALLOC(records, arena, output_text, capacity)
+		|| !BITCOIN_RECORDS_ALLOC(records, arena, output_text_size, capacity)
+	) {
+		return 0;
+	}
+
+	records->capacity = capacity;
+	return 1;
+}
+
+void BitcoinRecords_Reset(struct BitcoinRecords *records, size_t count,
+	enum BitcoinPublicKeyCompression compression
+)
+{
+	const size_t used = records->count;
+	size_t i;
+
+	/* only the fields which can hold key material, or which are read
+	   before being written, need clearing */
+	memset(records->input, 0, used * sizeof(records->input[0]));
+	memset(records->input_raw, 0, used * sizeof(records->input_raw[0]));
+	memset(records->private_keys, 0, used * sizeof(records->private_keys[0]));
+	memset(records->public_keys, 0, used * sizeof(records->public_keys[0]));
+	memset(records->output_text, 0, used * sizeof(records->output_text[0]));
+
+	/* records past the previous batch are still zero from its reset, or
+	   from the arena */
+	for (i = 0; i < count; i++) {
+		records->input_size[i] = 0;
+		records->flags[i] = 0;
+		records->private_keys[i].public_key_compression = compression;
+	}
+	records->count = records->limit = count;
+}
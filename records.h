@@ -0,0 +1,93 @@
+#ifndef BITCOIN_INCLUDE_RECORDS_H
+#define BITCOIN_INCLUDE_RECORDS_H
+
+/** @file records.h
+ *  @brief A batch of records for bitcoin-tool, in struct-of-arrays layout.
+ *
+ *  Each conversion stage processes every record of the batch before the
+ *  next stage starts, so each field of every record is kept in its own
+ *  array: a stage reads and writes contiguous arrays (eg: all the private
+ *  keys, then all the public keys), and batch kernels such as
+ *  BitcoinSecp256k1_MakePublicKeys() can work on them in place.  The
+ *  arrays are allocated from an arena (see arena.h), aligned for SIMD.
+ */
+
+#include <stddef.h> /* size_t */
+
+#include "arena.h"
+#include "hash.h"
+#include "keys.h"
+#include "result.h"
+
+/* records read per batch in batch mode */
+#define BITCOIN_RECORDS_BATCH_SIZE 256
+
+/* size of the text and raw buffers of each record */
+#define BITCOIN_RECORD_TEXT_SIZE 256
+
+/* flags of each record, set as each type is loaded or converted into */
+enum BitcoinRecordFlag {
+	BITCOIN_RECORD_MINI_PRIVATE_KEY     = 1 << 0,
+	BITCOIN_RECORD_PRIVATE_KEY          = 1 << 1,
+	BITCOIN_RECORD_PRIVATE_KEY_WIF      = 1 << 2,
+	BITCOIN_RECORD_PUBLIC_KEY           = 1 << 3,
+	BITCOIN_RECORD_PUBLIC_KEY_SHA256    = 1 << 4,
+	BITCOIN_RECORD_PUBLIC_KEY_RIPEMD160 = 1 << 5,
+	BITCOIN_RECORD_ADDRESS              = 1 << 6,
+
+	/* an invalid input which is being ignored, it has no output */
+	BITCOIN_RECORD_SKIPPED              = 1 << 7,
+
+	/* converted from the derived key cache, so already in it */
+	BITCOIN_RECORD_CACHED               = 1 << 8
+};
+
+struct BitcoinRecords {
+	size_t capacity;
+
+	/* records in the batch */
+	size_t count;
+
+	/* records before this one are processed, it is less than count once a
+	   record has failed, and the batch stops there */
+	size_t limit;
+
+	/* input provided by user on command line or from file */
+	char (*input)[BITCOIN_RECORD_TEXT_SIZE];
+	size_t *input_size;
+
+	/* input format converted to raw input type */
+	uint8_t (*input_raw)[BITCOIN_RECORD_TEXT_SIZE];
+	size_t *input_raw_size;
+
+	struct BitcoinPrivateKey *private_keys;
+	struct BitcoinPublicKey *public_keys;
+	struct BitcoinSHA256 *public_key_sha256;
+	struct BitcoinRIPEMD160 *public_key_ripemd160;
+	struct BitcoinAddress *addresses;
+
+	/* BitcoinRecordFlag values */
+	unsigned *flags;
+
+	/* raw output type converted to output format */
+	char (*output_text)[BITCOIN_RECORD_TEXT_SIZE];
+	size_t *output_text_size;
+};
+
+/** @brief Allocate the arrays for a batch of records from an arena.
+ *
+ *  @return 1 if success, 0 if the arena is too small.
+ */
+int BitcoinRecords_Init(struct BitcoinRecords *records,
+	struct BitcoinArena *arena, size_t capacity
+);
+
+/** @brief Wipe the records of the previous batch, and start a new batch of
+ *         'count' empty records, with 'compression' as the public key
+ *         compression of their private keys.
+ */
+void BitcoinRecords_Reset(struct BitcoinRecords *records, size_t count,
+	enum BitcoinPublicKeyCompression compression
+);
+
+#endif
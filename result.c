@@ -1,5 +1,8 @@
 #include "result.h"
 
+#include <openssl/crypto.h>
+#include <openssl/err.h>
+
 const char *Bitcoin_ResultString(BitcoinResult result)
 {
 	const char *m = "";
@@ -17,3 +20,18 @@ const char *Bitcoin_ResultString(BitcoinResult result)
 	return m;
 }
 
+const char *Bitcoin_LibraryErrorString(char *buffer, size_t buffer_size)
+{
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+	/* safe to call from several threads, and cheap after the first time */
+	OPENSSL_init_crypto(OPENSSL_INIT_LOAD_CRYPTO_STRINGS, NULL);
+#else
+	static int loaded = 0;
+	if (!loaded) {
+		ERR_load_crypto_strings();
+		loaded = 1;
+	}
+#endif
+	ERR_error_string_n(ERR_get_error(), buffer, buffer_size);
+	return buffer;
+}
@@ -1,6 +1,8 @@
 #ifndef BITCOIN_INCLUDE_RESULT_H
 #define BITCOIN_INCLUDE_RESULT_H
 
+#include <stddef.h> /* size_t */
+
 /** @file result.h
  *  @brief Definitions of different return values from Bitcoin functions.
  *
@@ -31,5 +33,19 @@ typedef enum BitcoinResult {
  */
 const char *Bitcoin_ResultString(BitcoinResult result);
 
+/** @brief Describe the oldest error queued by the crypto library (OpenSSL)
+ *         in this thread, and remove it from the queue.
+ *
+ *         The library's error strings are only loaded the first time this is
+ *         called, so that runs which have no errors don't pay for loading
+ *         them at startup.
+ *
+ *  @param[out] buffer Buffer to write the description into.
+ *  @param[in] buffer_size Size of buffer in bytes.
+ *
+ *  @return buffer
+ */
+const char *Bitcoin_LibraryErrorString(char *buffer, size_t buffer_size);
+
 #endif
 
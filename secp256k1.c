@@ -0,0 +1,1109 @@
+/*
+secp256k1 public key derivation.
+
+Field elements (integers modulo p = 2^256 - 2^32 - 977) are held in limbs
+which are allowed to be a little larger than their nominal size, so that
+carries only need to be propagated once per operation.  An element is
+"weakly normalized" when every limb is within its nominal size, except the
+top limb which may be one more than its nominal maximum, so the value is
+less than 2p but not necessarily less than p.  Every operation takes and
+returns weakly normalized elements, and elements are only fully reduced
+when they are written out.
+
+The generic representation is 5 limbs of 52 bits in 64-bit words, using
+128-bit products.  The AVX-512 IFMA representation is the same, with 8 keys
+in each vector, using the 52-bit multiply-add instructions.  The AVX2
+representation is 10 limbs of 26 bits, with 4 keys in each vector, since
+AVX2 only multiplies 32-bit values.
+*/
+
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include "secp256k1.h"
+#include "applog.h"
+#include "cpu.h"
+#include "numa.h"
+
+#ifdef BITCOIN_HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+#if defined(__SIZEOF_INT128__)
+
+__extension__ typedef unsigned __int128 BitcoinUInt128;
+
+#define BITCOIN_SECP256K1_WINDOWS 64
+#define BITCOIN_SECP256K1_WINDOW_POINTS 16
+#define BITCOIN_SECP256K1_MAX_LANES 8
+
+#define M52 0xfffffffffffffULL
+#define M48 0xffffffffffffULL
+/* 2^260 and 2^256 modulo p */
+#define R260 0x1000003d10ULL
+#define R256 0x1000003d1ULL
+
+/* generic field element, value = sum of n[i] * 2^(52 * i) */
+struct BitcoinSecp256k1Field {
+	uint64_t n[5];
+};
+
+/* 2p in 52-bit limbs, added before subtracting so that limbs stay positive */
+static const uint64_t p2_52[5] = {
+	0x1ffffdfffff85eULL, 0x1ffffffffffffeULL, 0x1ffffffffffffeULL,
+	0x1ffffffffffffeULL, 0x1fffffffffffeULL
+};
+
+/* the curve order n, big-endian */
+static const uint8_t secp256k1_order[32] = {
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+	0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xfe,
+	0xba, 0xae, 0xdc, 0xe6, 0xaf, 0x48, 0xa0, 0x3b,
+	0xbf, 0xd2, 0x5e, 0x8c, 0xd0, 0x36, 0x41, 0x41
+};
+
+/* table[w][j] = j * 16^w * G, in affine coordinates (entry 0 is unused),
+   generated by gentables at build time */
+struct BitcoinSecp256k1Affine {
+	struct BitcoinSecp256k1Field x, y;
+};
+#ifdef BITCOIN_HAVE_X86_SIMD
+/* the same in 26-bit limbs, for AVX2 */
+struct BitcoinSecp256k1AffineAVX2 {
+	uint32_t x[10], y[10];
+};
+#endif
+#include "secp256k1_table.h"
+
+#ifdef BITCOIN_HAVE_X86_SIMD
+#define BITCOIN_SECP256K1_TABLES_SIZE \
+	(sizeof(secp256k1_table) + sizeof(secp256k1_table_avx2))
+#else
+#define BITCOIN_SECP256K1_TABLES_SIZE sizeof(secp256k1_table)
+#endif
+
+/* the tables a kernel reads, passed down to its lookups */
+struct BitcoinSecp256k1Tables {
+	const struct BitcoinSecp256k1Affine
+		(*points)[BITCOIN_SECP256K1_WINDOW_POINTS];
+#ifdef BITCOIN_HAVE_X86_SIMD
+	const struct BitcoinSecp256k1AffineAVX2
+		(*points_avx2)[BITCOIN_SECP256K1_WINDOW_POINTS];
+#endif
+};
+
+/* the ones above, or a copy of them in a huge page once
+   BitcoinSecp256k1_PlaceTables() has run */
+static struct BitcoinSecp256k1Tables secp256k1_tables = {
+	secp256k1_table
+#ifdef BITCOIN_HAVE_X86_SIMD
+	, secp256k1_table_avx2
+#endif
+};
+static void *secp256k1_placed = NULL;
+static enum BitcoinHugePageBacking secp256k1_placed_backing =
+	BITCOIN_HUGE_PAGE_BACKING_NONE;
+
+/* a copy on each node once BitcoinSecp256k1_ReplicateTables() has run */
+static struct BitcoinSecp256k1Tables secp256k1_node_tables[BITCOIN_NUMA_MAX_NODES];
+static unsigned secp256k1_node_count = 0;
+
+/* ---- generic 5x52 representation ---- */
+
+static void BitcoinSecp256k1_NormalizeWeakGeneric(struct BitcoinSecp256k1Field *r)
+{
+	uint64_t t0 = r->n[0], t1 = r->n[1], t2 = r->n[2], t3 = r->n[3], t4 = r->n[4];
+	uint64_t top;
+
+	t1 += t0 >> 52; t0 &= M52;
+	t2 += t1 >> 52; t1 &= M52;
+	t3 += t2 >> 52; t2 &= M52;
+	t4 += t3 >> 52; t3 &= M52;
+
+	/* fold the bits above 2^256 back in */
+	top = t4 >> 48; t4 &= M48;
+	t0 += top * R256;
+
+	t1 += t0 >> 52; t0 &= M52;
+	t2 += t1 >> 52; t1 &= M52;
+	t3 += t2 >> 52; t2 &= M52;
+	t4 += t3 >> 52; t3 &= M52;
+
+	r->n[0] = t0; r->n[1] = t1; r->n[2] = t2; r->n[3] = t3; r->n[4] = t4;
+}
+
+static void BitcoinSecp256k1_SubGeneric(struct BitcoinSecp256k1Field *r,
+	const struct BitcoinSecp256k1Field *a, const struct BitcoinSecp256k1Field *b
+)
+{
+	unsigned i;
+	for (i = 0; i < 5; i++) {
+		r->n[i] = a->n[i] + p2_52[i] - b->n[i];
+	}
+	BitcoinSecp256k1_NormalizeWeakGeneric(r);
+}
+
+static void BitcoinSecp256k1_MulGeneric(struct BitcoinSecp256k1Field *r,
+	const struct BitcoinSecp256k1Field *a, const struct BitcoinSecp256k1Field *b
+)
+{
+	BitcoinUInt128 c[9], carry;
+	uint64_t d[10], e[5];
+	unsigned i, j;
+
+	for (i = 0; i < 9; i++) {
+		c[i] = 0;
+	}
+	for (i = 0; i < 5; i++) {
+		for (j = 0; j < 5; j++) {
+			c[i + j] += (BitcoinUInt128)a->n[i] * b->n[j];
+		}
+	}
+
+	/* columns to 52-bit digits */
+	carry = 0;
+	for (i = 0; i < 9; i++) {
+		carry += c[i];
+		d[i] = (uint64_t)carry & M52;
+		carry >>= 52;
+	}
+	d[9] = (uint64_t)carry;
+
+	/* fold digits 5 to 9, which are multiples of 2^260 */
+	carry = 0;
+	for (i = 0; i < 5; i++) {
+		carry += d[i] + (BitcoinUInt128)d[i + 5] * R260;
+		e[i] = (uint64_t)carry & M52;
+		carry >>= 52;
+	}
+
+	/* and the bits above 2^256 */
+	carry = (((carry << 4) | (e[4] >> 48)) * R256) + e[0];
+	e[4] &= M48;
+	e[0] = (uint64_t)carry & M52;
+	carry >>= 52;
+	for (i = 1; i < 5; i++) {
+		carry += e[i];
+		e[i] = (uint64_t)carry & (i < 4 ? M52 : ~0ULL);
+		carry >>= 52;
+	}
+
+	memcpy(r->n, e, sizeof(e));
+}
+
+static void BitcoinSecp256k1_SqrGeneric(struct BitcoinSecp256k1Field *r,
+	const struct BitcoinSecp256k1Field *a
+)
+{
+	BitcoinSecp256k1_MulGeneric(r, a, a);
+}
+
+static void BitcoinSecp256k1_SetOneGeneric(struct BitcoinSecp256k1Field *r)
+{
+	memset(r, 0, sizeof(*r));
+	r->n[0] = 1;
+}
+
+static void BitcoinSecp256k1_SelectGeneric(struct BitcoinSecp256k1Field *r,
+	const struct BitcoinSecp256k1Field *a, uint64_t mask
+)
+{
+	unsigned i;
+	for (i = 0; i < 5; i++) {
+		r->n[i] = (r->n[i] & ~mask) | (a->n[i] & mask);
+	}
+}
+
+static void BitcoinSecp256k1_LookupGeneric(
+	const struct BitcoinSecp256k1Tables *tables, struct BitcoinSecp256k1Field *x,
+	struct BitcoinSecp256k1Field *y, unsigned window, const uint8_t *nibbles
+)
+{
+	unsigned j;
+	for (j = 0; j < BITCOIN_SECP256K1_WINDOW_POINTS; j++) {
+		const uint64_t mask = (uint64_t)0 - (uint64_t)(nibbles[0] == j);
+		BitcoinSecp256k1_SelectGeneric(x, &tables->points[window][j].x, mask);
+		BitcoinSecp256k1_SelectGeneric(y, &tables->points[window][j].y, mask);
+	}
+}
+
+static uint64_t BitcoinSecp256k1_MaskAllGeneric(void)
+{
+	return ~(uint64_t)0;
+}
+
+static uint64_t BitcoinSecp256k1_MaskZeroGeneric(const uint8_t *nibbles)
+{
+	return (uint64_t)0 - (uint64_t)(nibbles[0] == 0);
+}
+
+static uint64_t BitcoinSecp256k1_MaskAndGeneric(uint64_t a, uint64_t b)
+{
+	return a & b;
+}
+
+static uint64_t BitcoinSecp256k1_MaskNotGeneric(uint64_t a)
+{
+	return ~a;
+}
+
+static void BitcoinSecp256k1_GetLaneGeneric(struct BitcoinSecp256k1Field *r,
+	const struct BitcoinSecp256k1Field *a, unsigned lane
+)
+{
+	*r = *a;
+}
+
+#define LANES_COUNT 1
+#define LANES_FIELD struct BitcoinSecp256k1Field
+#define LANES_MASK uint64_t
+#define LANES_TARGET
+#define LANES_FN(name) BitcoinSecp256k1_##name##Generic
+#include "secp256k1_lanes.h"
+#undef LANES_COUNT
+#undef LANES_FIELD
+#undef LANES_MASK
+#undef LANES_TARGET
+#undef LANES_FN
+
+/* Fully reduce, and write as 32 big-endian bytes. */
+static void BitcoinSecp256k1_GetBytes(uint8_t *output,
+	const struct BitcoinSecp256k1Field *a
+)
+{
+	struct BitcoinSecp256k1Field t = *a, u;
+	uint64_t words[4], mask;
+	unsigned i;
+
+	BitcoinSecp256k1_NormalizeWeakGeneric(&t);
+
+	/* t < 2p, so t - p = t + (2^256 - p) - 2^256 is the answer if that
+	   reaches 2^256 */
+	u = t;
+	u.n[0] += R256;
+	for (i = 0; i < 4; i++) {
+		u.n[i + 1] += u.n[i] >> 52;
+		u.n[i] &= M52;
+	}
+	mask = (uint64_t)0 - (u.n[4] >> 48);
+	u.n[4] &= M48;
+	BitcoinSecp256k1_SelectGeneric(&t, &u, mask);
+
+	words[0] = t.n[0] | (t.n[1] << 52);
+	words[1] = (t.n[1] >> 12) | (t.n[2] << 40);
+	words[2] = (t.n[2] >> 24) | (t.n[3] << 28);
+	words[3] = (t.n[3] >> 36) | (t.n[4] << 16);
+	for (i = 0; i < 32; i++) {
+		output[31 - i] = (uint8_t)(words[i / 8] >> ((i % 8) * 8));
+	}
+}
+
+#ifdef BITCOIN_HAVE_X86_SIMD
+
+/* ---- AVX2 10x26 representation, 4 lanes ---- */
+
+#define M26 0x3ffffff
+#define M22 0x3fffff
+
+struct BitcoinSecp256k1FieldAVX2 {
+	__m256i n[10];
+};
+
+static const uint32_t p2_26[10] = {
+	0x7fff85e, 0x7ffff7e, 0x7fffffe, 0x7fffffe, 0x7fffffe,
+	0x7fffffe, 0x7fffffe, 0x7fffffe, 0x7fffffe, 0x7ffffe
+};
+
+#define AVX2_TARGET __attribute__((target("avx2")))
+
+AVX2_TARGET
+static __inline__ void BitcoinSecp256k1_CarryAVX2(__m256i *n)
+{
+	const __m256i mask = _mm256_set1_epi64x(M26);
+	unsigned i;
+	for (i = 0; i < 9; i++) {
+		n[i + 1] = _mm256_add_epi64(n[i + 1], _mm256_srli_epi64(n[i], 26));
+		n[i] = _mm256_and_si256(n[i], mask);
+	}
+}
+
+/* fold the bits above 2^256, in the top limb, back in */
+AVX2_TARGET
+static __inline__ void BitcoinSecp256k1_FoldTopAVX2(__m256i *n)
+{
+	const __m256i top = _mm256_srli_epi64(n[9], 22);
+	n[9] = _mm256_and_si256(n[9], _mm256_set1_epi64x(M22));
+	n[0] = _mm256_add_epi64(n[0], _mm256_mul_epu32(top, _mm256_set1_epi64x(0x3d1)));
+	n[1] = _mm256_add_epi64(n[1], _mm256_slli_epi64(top, 6));
+}
+
+AVX2_TARGET
+static __inline__ void BitcoinSecp256k1_NormalizeWeakAVX2(__m256i *n)
+{
+	BitcoinSecp256k1_CarryAVX2(n);
+	BitcoinSecp256k1_FoldTopAVX2(n);
+	BitcoinSecp256k1_CarryAVX2(n);
+}
+
+AVX2_TARGET
+static void BitcoinSecp256k1_SubAVX2(struct BitcoinSecp256k1FieldAVX2 *r,
+	const struct BitcoinSecp256k1FieldAVX2 *a, const struct BitcoinSecp256k1FieldAVX2 *b
+)
+{
+	unsigned i;
+	for (i = 0; i < 10; i++) {
+		r->n[i] = _mm256_sub_epi64(
+			_mm256_add_epi64(a->n[i], _mm256_set1_epi64x(p2_26[i])), b->n[i]
+		);
+	}
+	BitcoinSecp256k1_NormalizeWeakAVX2(r->n);
+}
+
+/* Reduce a 20 column product to a weakly normalized element. */
+AVX2_TARGET
+static __inline__ void BitcoinSecp256k1_ReduceAVX2(__m256i *r, __m256i *c)
+{
+	const __m256i mask = _mm256_set1_epi64x(M26);
+	const __m256i r0 = _mm256_set1_epi64x(0x3d10);
+	__m256i e[11];
+	unsigned i;
+
+	/* columns to 26-bit digits */
+	for (i = 0; i < 19; i++) {
+		c[i + 1] = _mm256_add_epi64(c[i + 1], _mm256_srli_epi64(c[i], 26));
+		c[i] = _mm256_and_si256(c[i], mask);
+	}
+
+	/* digit 10 + i is a multiple of 2^260 = 0x3d10 + (2^10 << 26) */
+	e[0] = c[0];
+	for (i = 1; i < 11; i++) {
+		e[i] = _mm256_slli_epi64(c[i + 9], 10);
+		if (i < 10) {
+			e[i] = _mm256_add_epi64(e[i], c[i]);
+		}
+	}
+	for (i = 0; i < 10; i++) {
+		e[i] = _mm256_add_epi64(e[i], _mm256_mul_epu32(c[i + 10], r0));
+	}
+
+	for (i = 0; i < 10; i++) {
+		e[i + 1] = _mm256_add_epi64(e[i + 1], _mm256_srli_epi64(e[i], 26));
+		e[i] = _mm256_and_si256(e[i], mask);
+	}
+	e[0] = _mm256_add_epi64(e[0], _mm256_mul_epu32(e[10], r0));
+	e[1] = _mm256_add_epi64(e[1], _mm256_slli_epi64(e[10], 10));
+
+	BitcoinSecp256k1_NormalizeWeakAVX2(e);
+	for (i = 0; i < 10; i++) {
+		r[i] = e[i];
+	}
+}
+
+AVX2_TARGET
+static void BitcoinSecp256k1_MulAVX2(struct BitcoinSecp256k1FieldAVX2 *r,
+	const struct BitcoinSecp256k1FieldAVX2 *a, const struct BitcoinSecp256k1FieldAVX2 *b
+)
+{
+	__m256i c[20];
+	unsigned i, j;
+
+	for (i = 0; i < 20; i++) {
+		c[i] = _mm256_setzero_si256();
+	}
+	for (i = 0; i < 10; i++) {
+		for (j = 0; j < 10; j++) {
+			c[i + j] = _mm256_add_epi64(c[i + j], _mm256_mul_epu32(a->n[i], b->n[j]));
+		}
+	}
+	BitcoinSecp256k1_ReduceAVX2(r->n, c);
+}
+
+AVX2_TARGET
+static void BitcoinSecp256k1_SqrAVX2(struct BitcoinSecp256k1FieldAVX2 *r,
+	const struct BitcoinSecp256k1FieldAVX2 *a
+)
+{
+	__m256i c[20], doubled[10];
+	unsigned i, j;
+
+	for (i = 0; i < 10; i++) {
+		doubled[i] = _mm256_add_epi64(a->n[i], a->n[i]);
+	}
+	for (i = 0; i < 20; i++) {
+		c[i] = _mm256_setzero_si256();
+	}
+	for (i = 0; i < 10; i++) {
+		c[i + i] = _mm256_add_epi64(c[i + i], _mm256_mul_epu32(a->n[i], a->n[i]));
+		for (j = i + 1; j < 10; j++) {
+			c[i + j] = _mm256_add_epi64(c[i + j], _mm256_mul_epu32(a->n[i], doubled[j]));
+		}
+	}
+	BitcoinSecp256k1_ReduceAVX2(r->n, c);
+}
+
+AVX2_TARGET
+static void BitcoinSecp256k1_SetOneAVX2(struct BitcoinSecp256k1FieldAVX2 *r)
+{
+	unsigned i;
+	r->n[0] = _mm256_set1_epi64x(1);
+	for (i = 1; i < 10; i++) {
+		r->n[i] = _mm256_setzero_si256();
+	}
+}
+
+AVX2_TARGET
+static void BitcoinSecp256k1_SelectAVX2(struct BitcoinSecp256k1FieldAVX2 *r,
+	const struct BitcoinSecp256k1FieldAVX2 *a, __m256i mask
+)
+{
+	unsigned i;
+	for (i = 0; i < 10; i++) {
+		r->n[i] = _mm256_blendv_epi8(r->n[i], a->n[i], mask);
+	}
+}
+
+AVX2_TARGET
+static __inline__ __m256i BitcoinSecp256k1_NibblesAVX2(const uint8_t *nibbles)
+{
+	return _mm256_set_epi64x(nibbles[3], nibbles[2], nibbles[1], nibbles[0]);
+}
+
+AVX2_TARGET
+static void BitcoinSecp256k1_LookupAVX2(
+	const struct BitcoinSecp256k1Tables *tables, struct BitcoinSecp256k1FieldAVX2 *x,
+	struct BitcoinSecp256k1FieldAVX2 *y, unsigned window, const uint8_t *nibbles
+)
+{
+	const __m256i index = BitcoinSecp256k1_NibblesAVX2(nibbles);
+	unsigned i, j;
+
+	for (i = 0; i < 10; i++) {
+		x->n[i] = y->n[i] = _mm256_setzero_si256();
+	}
+	for (j = 0; j < BITCOIN_SECP256K1_WINDOW_POINTS; j++) {
+		const struct BitcoinSecp256k1AffineAVX2 *entry = &tables->points_avx2[window][j];
+		const __m256i mask = _mm256_cmpeq_epi64(index, _mm256_set1_epi64x(j));
+		for (i = 0; i < 10; i++) {
+			x->n[i] = _mm256_or_si256(x->n[i],
+				_mm256_and_si256(mask, _mm256_set1_epi64x(entry->x[i]))
+			);
+			y->n[i] = _mm256_or_si256(y->n[i],
+				_mm256_and_si256(mask, _mm256_set1_epi64x(entry->y[i]))
+			);
+		}
+	}
+}
+
+AVX2_TARGET
+static __m256i BitcoinSecp256k1_MaskAllAVX2(void)
+{
+	return _mm256_set1_epi64x(-1);
+}
+
+AVX2_TARGET
+static __m256i BitcoinSecp256k1_MaskZeroAVX2(const uint8_t *nibbles)
+{
+	return _mm256_cmpeq_epi64(BitcoinSecp256k1_NibblesAVX2(nibbles),
+		_mm256_setzero_si256()
+	);
+}
+
+AVX2_TARGET
+static __m256i BitcoinSecp256k1_MaskAndAVX2(__m256i a, __m256i b)
+{
+	return _mm256_and_si256(a, b);
+}
+
+AVX2_TARGET
+static __m256i BitcoinSecp256k1_MaskNotAVX2(__m256i a)
+{
+	return _mm256_xor_si256(a, _mm256_set1_epi64x(-1));
+}
+
+AVX2_TARGET
+static void BitcoinSecp256k1_GetLaneAVX2(struct BitcoinSecp256k1Field *r,
+	const struct BitcoinSecp256k1FieldAVX2 *a, unsigned lane
+)
+{
+	uint64_t limbs[10][4];
+	unsigned i;
+
+	for (i = 0; i < 10; i++) {
+		_mm256_storeu_si256((__m256i *)limbs[i], a->n[i]);
+	}
+	for (i = 0; i < 5; i++) {
+		r->n[i] = limbs[i * 2][lane] + (limbs[i * 2 + 1][lane] << 26);
+	}
+	BitcoinSecp256k1_NormalizeWeakGeneric(r);
+}
+
+#define LANES_COUNT 4
+#define LANES_FIELD struct BitcoinSecp256k1FieldAVX2
+#define LANES_MASK __m256i
+#define LANES_TARGET AVX2_TARGET
+#define LANES_FN(name) BitcoinSecp256k1_##name##AVX2
+#include "secp256k1_lanes.h"
+#undef LANES_COUNT
+#undef LANES_FIELD
+#undef LANES_MASK
+#undef LANES_TARGET
+#undef LANES_FN
+
+/* ---- AVX-512 IFMA 5x52 representation, 8 lanes ---- */
+
+struct BitcoinSecp256k1FieldIFMA {
+	__m512i n[5];
+};
+
+#define IFMA_TARGET __attribute__((target("avx512f,avx512ifma")))
+
+IFMA_TARGET
+static __inline__ void BitcoinSecp256k1_CarryIFMA(__m512i *n)
+{
+	const __m512i mask = _mm512_set1_epi64(M52);
+	unsigned i;
+	for (i = 0; i < 4; i++) {
+		n[i + 1] = _mm512_add_epi64(n[i + 1], _mm512_srli_epi64(n[i], 52));
+		n[i] = _mm512_and_si512(n[i], mask);
+	}
+}
+
+IFMA_TARGET
+static __inline__ void BitcoinSecp256k1_NormalizeWeakIFMA(__m512i *n)
+{
+	__m512i top;
+
+	BitcoinSecp256k1_CarryIFMA(n);
+	top = _mm512_srli_epi64(n[4], 48);
+	n[4] = _mm512_and_si512(n[4], _mm512_set1_epi64(M48));
+	n[0] = _mm512_madd52lo_epu64(n[0], top, _mm512_set1_epi64(R256));
+	BitcoinSecp256k1_CarryIFMA(n);
+}
+
+IFMA_TARGET
+static void BitcoinSecp256k1_SubIFMA(struct BitcoinSecp256k1FieldIFMA *r,
+	const struct BitcoinSecp256k1FieldIFMA *a, const struct BitcoinSecp256k1FieldIFMA *b
+)
+{
+	unsigned i;
+	for (i = 0; i < 5; i++) {
+		r->n[i] = _mm512_sub_epi64(
+			_mm512_add_epi64(a->n[i], _mm512_set1_epi64(p2_52[i])), b->n[i]
+		);
+	}
+	BitcoinSecp256k1_NormalizeWeakIFMA(r->n);
+}
+
+IFMA_TARGET
+static void BitcoinSecp256k1_MulIFMA(struct BitcoinSecp256k1FieldIFMA *r,
+	const struct BitcoinSecp256k1FieldIFMA *a, const struct BitcoinSecp256k1FieldIFMA *b
+)
+{
+	const __m512i mask = _mm512_set1_epi64(M52);
+	const __m512i r260 = _mm512_set1_epi64(R260);
+	__m512i c[10], e[6];
+	unsigned i, j;
+
+	for (i = 0; i < 10; i++) {
+		c[i] = _mm512_setzero_si512();
+	}
+	for (i = 0; i < 5; i++) {
+		for (j = 0; j < 5; j++) {
+			c[i + j] = _mm512_madd52lo_epu64(c[i + j], a->n[i], b->n[j]);
+			c[i + j + 1] = _mm512_madd52hi_epu64(c[i + j + 1], a->n[i], b->n[j]);
+		}
+	}
+
+	/* columns to 52-bit digits, the product is less than 2^520 */
+	for (i = 0; i < 9; i++) {
+		c[i + 1] = _mm512_add_epi64(c[i + 1], _mm512_srli_epi64(c[i], 52));
+		c[i] = _mm512_and_si512(c[i], mask);
+	}
+
+	/* fold digits 5 to 9, which are multiples of 2^260 */
+	for (i = 0; i < 5; i++) {
+		e[i] = c[i];
+	}
+	e[5] = _mm512_setzero_si512();
+	for (i = 0; i < 5; i++) {
+		e[i] = _mm512_madd52lo_epu64(e[i], c[i + 5], r260);
+		e[i + 1] = _mm512_madd52hi_epu64(e[i + 1], c[i + 5], r260);
+	}
+	for (i = 0; i < 5; i++) {
+		e[i + 1] = _mm512_add_epi64(e[i + 1], _mm512_srli_epi64(e[i], 52));
+		e[i] = _mm512_and_si512(e[i], mask);
+	}
+	e[0] = _mm512_madd52lo_epu64(e[0], e[5], r260);
+	e[1] = _mm512_madd52hi_epu64(e[1], e[5], r260);
+
+	BitcoinSecp256k1_NormalizeWeakIFMA(e);
+	for (i = 0; i < 5; i++) {
+		r->n[i] = e[i];
+	}
+}
+
+IFMA_TARGET
+static void BitcoinSecp256k1_SqrIFMA(struct BitcoinSecp256k1FieldIFMA *r,
+	const struct BitcoinSecp256k1FieldIFMA *a
+)
+{
+	BitcoinSecp256k1_MulIFMA(r, a, a);
+}
+
+IFMA_TARGET
+static void BitcoinSecp256k1_SetOneIFMA(struct BitcoinSecp256k1FieldIFMA *r)
+{
+	unsigned i;
+	r->n[0] = _mm512_set1_epi64(1);
+	for (i = 1; i < 5; i++) {
+		r->n[i] = _mm512_setzero_si512();
+	}
+}
+
+IFMA_TARGET
+static void BitcoinSecp256k1_SelectIFMA(struct BitcoinSecp256k1FieldIFMA *r,
+	const struct BitcoinSecp256k1FieldIFMA *a, __mmask8 mask
+)
+{
+	unsigned i;
+	for (i = 0; i < 5; i++) {
+		r->n[i] = _mm512_mask_mov_epi64(r->n[i], mask, a->n[i]);
+	}
+}
+
+IFMA_TARGET
+static __inline__ __m512i BitcoinSecp256k1_NibblesIFMA(const uint8_t *nibbles)
+{
+	return _mm512_cvtepu8_epi64(_mm_loadl_epi64((const __m128i *)nibbles));
+}
+
+IFMA_TARGET
+static void BitcoinSecp256k1_LookupIFMA(
+	const struct BitcoinSecp256k1Tables *tables, struct BitcoinSecp256k1FieldIFMA *x,
+	struct BitcoinSecp256k1FieldIFMA *y, unsigned window, const uint8_t *nibbles
+)
+{
+	const __m512i index = BitcoinSecp256k1_NibblesIFMA(nibbles);
+	unsigned i, j;
+
+	for (i = 0; i < 5; i++) {
+		x->n[i] = y->n[i] = _mm512_setzero_si512();
+	}
+	for (j = 0; j < BITCOIN_SECP256K1_WINDOW_POINTS; j++) {
+		const struct BitcoinSecp256k1Affine *entry = &tables->points[window][j];
+		const __mmask8 mask = _mm512_cmpeq_epi64_mask(index, _mm512_set1_epi64(j));
+		for (i = 0; i < 5; i++) {
+			x->n[i] = _mm512_mask_mov_epi64(x->n[i], mask, _mm512_set1_epi64(entry->x.n[i]));
+			y->n[i] = _mm512_mask_mov_epi64(y->n[i], mask, _mm512_set1_epi64(entry->y.n[i]));
+		}
+	}
+}
+
+IFMA_TARGET
+static __mmask8 BitcoinSecp256k1_MaskAllIFMA(void)
+{
+	return 0xff;
+}
+
+IFMA_TARGET
+static __mmask8 BitcoinSecp256k1_MaskZeroIFMA(const uint8_t *nibbles)
+{
+	return _mm512_cmpeq_epi64_mask(BitcoinSecp256k1_NibblesIFMA(nibbles),
+		_mm512_setzero_si512()
+	);
+}
+
+IFMA_TARGET
+static __mmask8 BitcoinSecp256k1_MaskAndIFMA(__mmask8 a, __mmask8 b)
+{
+	return a & b;
+}
+
+IFMA_TARGET
+static __mmask8 BitcoinSecp256k1_MaskNotIFMA(__mmask8 a)
+{
+	return (__mmask8)~a;
+}
+
+IFMA_TARGET
+static void BitcoinSecp256k1_GetLaneIFMA(struct BitcoinSecp256k1Field *r,
+	const struct BitcoinSecp256k1FieldIFMA *a, unsigned lane
+)
+{
+	uint64_t limbs[5][8];
+	unsigned i;
+
+	for (i = 0; i < 5; i++) {
+		_mm512_storeu_si512(limbs[i], a->n[i]);
+		r->n[i] = limbs[i][lane];
+	}
+}
+
+#define LANES_COUNT 8
+#define LANES_FIELD struct BitcoinSecp256k1FieldIFMA
+#define LANES_MASK __mmask8
+#define LANES_TARGET IFMA_TARGET
+#define LANES_FN(name) BitcoinSecp256k1_##name##IFMA
+#include "secp256k1_lanes.h"
+#undef LANES_COUNT
+#undef LANES_FIELD
+#undef LANES_MASK
+#undef LANES_TARGET
+#undef LANES_FN
+
+#endif /* BITCOIN_HAVE_X86_SIMD */
+
+/* ---- kernel selection and the public interface ---- */
+
+typedef void (*BitcoinSecp256k1Kernel)(
+	const struct BitcoinSecp256k1Tables *tables, struct BitcoinSecp256k1Field *x,
+	struct BitcoinSecp256k1Field *y,
+	const uint8_t nibbles[BITCOIN_SECP256K1_WINDOWS][BITCOIN_SECP256K1_MAX_LANES]
+);
+
+static BitcoinSecp256k1Kernel secp256k1_kernel = NULL;
+static unsigned secp256k1_kernel_lanes = 1;
+static const char *secp256k1_kernel_name = NULL;
+
+/* Called once, through BitcoinCPU_SelectKernels().  The kernel is set
+last, since it is what callers check, and the lane count must match it. */
+void BitcoinSecp256k1_SelectKernel(void)
+{
+	BitcoinSecp256k1Kernel kernel = BitcoinSecp256k1_MakePointsGeneric;
+	unsigned lanes = 1;
+	const char *name = "generic";
+
+#ifdef BITCOIN_HAVE_X86_SIMD
+	if (BitcoinCPU_Has(BITCOIN_CPU_AVX512F | BITCOIN_CPU_AVX512IFMA)) {
+		name = "avx512ifma";
+		lanes = 8;
+		kernel = BitcoinSecp256k1_MakePointsIFMA;
+	} else if (BitcoinCPU_Has(BITCOIN_CPU_AVX2)) {
+		name = "avx2";
+		lanes = 4;
+		kernel = BitcoinSecp256k1_MakePointsAVX2;
+	}
+#endif
+	secp256k1_kernel_name = name;
+	secp256k1_kernel_lanes = lanes;
+	secp256k1_kernel = kernel;
+}
+
+const char *BitcoinSecp256k1_GetKernelName(void)
+{
+	BitcoinCPU_SelectKernels();
+	return secp256k1_kernel_name;
+}
+
+/* Copy the tables into memory from the huge page layer, preferring a node
+   for it if node isn't -1.  Returns the memory, or NULL if failure. */
+static void *BitcoinSecp256k1_copyTables(struct BitcoinSecp256k1Tables *tables,
+	int node, enum BitcoinHugePageBacking *backing
+)
+{
+	unsigned char *copy = BitcoinHugePage_Alloc(BITCOIN_SECP256K1_TABLES_SIZE,
+		backing
+	);
+
+	if (!copy) {
+		return NULL;
+	}
+	/* the whole mapping, or the kernel splits it where huge pages can't
+	   back it */
+	if (node >= 0 && !BitcoinNUMA_Bind(copy,
+		BitcoinHugePage_GetMappedSize(BITCOIN_SECP256K1_TABLES_SIZE),
+		(unsigned)node)
+	) {
+		applog(APPLOG_WARNING, __func__,
+			"Failed to place the secp256k1 tables on node %d (%s)", node,
+			strerror(errno)
+		);
+	}
+
+	memcpy(copy, secp256k1_table, sizeof(secp256k1_table));
+	tables->points = (const struct BitcoinSecp256k1Affine
+		(*)[BITCOIN_SECP256K1_WINDOW_POINTS])copy;
+#ifdef BITCOIN_HAVE_X86_SIMD
+	memcpy(copy + sizeof(secp256k1_table), secp256k1_table_avx2,
+		sizeof(secp256k1_table_avx2)
+	);
+	tables->points_avx2 = (const struct BitcoinSecp256k1AffineAVX2
+		(*)[BITCOIN_SECP256K1_WINDOW_POINTS])(copy + sizeof(secp256k1_table));
+#endif
+	return copy;
+}
+
+enum BitcoinHugePageBacking BitcoinSecp256k1_PlaceTables(uint64_t *huge_bytes)
+{
+	struct BitcoinSecp256k1Tables tables;
+	enum BitcoinHugePageBacking backing;
+	void *placed;
+
+	if (!secp256k1_placed
+		&& BitcoinHugePage_GetMode() != BITCOIN_HUGE_PAGES_OFF
+	) {
+		/* only worth it in a huge page, for the sake of the TLB */
+		placed = BitcoinSecp256k1_copyTables(&tables, -1, &backing);
+		if (placed && backing != BITCOIN_HUGE_PAGE_BACKING_NONE) {
+			secp256k1_tables = tables;
+			secp256k1_placed = placed;
+			secp256k1_placed_backing = backing;
+		} else if (placed) {
+			BitcoinHugePage_Free(placed, BITCOIN_SECP256K1_TABLES_SIZE);
+		}
+	}
+
+	if (huge_bytes) {
+		*huge_bytes = secp256k1_placed ? BitcoinHugePage_GetHugeBytes(
+			secp256k1_placed, BITCOIN_SECP256K1_TABLES_SIZE
+		) : 0;
+	}
+	return secp256k1_placed_backing;
+}
+
+unsigned BitcoinSecp256k1_ReplicateTables(void)
+{
+	const unsigned nodes = BitcoinNUMA_GetNodeCount();
+	enum BitcoinHugePageBacking backing;
+
+	/* with one node, the tables are local to every thread already */
+	while (nodes > 1 && secp256k1_node_count < nodes) {
+		if (!BitcoinSecp256k1_copyTables(
+			&secp256k1_node_tables[secp256k1_node_count],
+			(int)secp256k1_node_count, &backing)
+		) {
+			break;
+		}
+		secp256k1_node_count++;
+	}
+	return secp256k1_node_count;
+}
+
+/* Reduce a private key modulo n and split it into nibbles for one lane.
+Returns 0 if the key is zero modulo n, in which case the nibbles are those
+of 1 so that the lane still has a point to compute. */
+static int BitcoinSecp256k1_setNibbles(
+	uint8_t nibbles[BITCOIN_SECP256K1_WINDOWS][BITCOIN_SECP256K1_MAX_LANES],
+	unsigned lane, const uint8_t *key
+)
+{
+	uint8_t reduced[32];
+	unsigned borrow = 0, any = 0, i;
+	uint8_t mask;
+
+	/* reduced = key - n, which is the answer if it does not borrow */
+	for (i = 32; i-- > 0;) {
+		const unsigned d = (unsigned)key[i] - secp256k1_order[i] - borrow;
+		reduced[i] = (uint8_t)d;
+		borrow = (d >> 8) & 1;
+	}
+	mask = (uint8_t)(borrow - 1);
+	for (i = 0; i < 32; i++) {
+		reduced[i] = (reduced[i] & mask) | (key[i] & ~mask);
+		any |= reduced[i];
+	}
+	/* any is 0 for a zero key, so use 1 */
+	reduced[31] |= (uint8_t)((any - 1) >> 8) & 1;
+
+	for (i = 0; i < BITCOIN_SECP256K1_WINDOWS; i++) {
+		nibbles[i][lane] = (reduced[31 - i / 2] >> ((i & 1) * 4)) & 0xf;
+	}
+
+	memset(reduced, 0, sizeof(reduced));
+	return any != 0;
+}
+
+static size_t BitcoinSecp256k1_makePublicKeys(
+	const struct BitcoinSecp256k1Tables *tables, BitcoinSecp256k1Kernel kernel,
+	unsigned lanes,
+	struct BitcoinPublicKey *public_keys,
+	const struct BitcoinPrivateKey *private_keys,
+	size_t count, BitcoinResult *results
+)
+{
+	uint8_t nibbles[BITCOIN_SECP256K1_WINDOWS][BITCOIN_SECP256K1_MAX_LANES];
+	struct BitcoinSecp256k1Field x[BITCOIN_SECP256K1_MAX_LANES];
+	struct BitcoinSecp256k1Field y[BITCOIN_SECP256K1_MAX_LANES];
+	BitcoinResult lane_results[BITCOIN_SECP256K1_MAX_LANES];
+	static const uint8_t one[32] = { 0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,0,
+		0,0,0,0,0,0,0,0, 0,0,0,0,0,0,0,1 };
+	size_t start, valid = 0;
+	unsigned lane;
+
+	for (start = 0; start < count; start += lanes) {
+		const size_t n = count - start < lanes ? count - start : lanes;
+
+		/* a single key is quicker alone than in a vector of mostly padding */
+		if (n == 1 && lanes > 1) {
+			valid += BitcoinSecp256k1_makePublicKeys(tables,
+				BitcoinSecp256k1_MakePointsGeneric, 1,
+				&public_keys[start], &private_keys[start], 1,
+				results ? &results[start] : NULL
+			);
+			break;
+		}
+
+		for (lane = 0; lane < lanes; lane++) {
+			const struct BitcoinPrivateKey *private_key = &private_keys[start + lane];
+
+			if (lane >= n) {
+				BitcoinSecp256k1_setNibbles(nibbles, lane, one);
+				continue;
+			}
+			lane_results[lane] = BITCOIN_SUCCESS;
+			if (
+				private_key->public_key_compression != BITCOIN_PUBLIC_KEY_COMPRESSED
+				&& private_key->public_key_compression != BITCOIN_PUBLIC_KEY_UNCOMPRESSED
+			) {
+				applog(APPLOG_ERROR, __func__,
+					"public key compression is not specified, please set using"
+					" --public-key-compression compressed/uncompressed"
+				);
+				lane_results[lane] = BITCOIN_ERROR_PRIVATE_KEY_INVALID_FORMAT;
+			}
+			if (!BitcoinSecp256k1_setNibbles(nibbles, lane, private_key->data)
+				&& lane_results[lane] == BITCOIN_SUCCESS
+			) {
+				applog(APPLOG_ERROR, __func__,
+					"private key is zero (modulo the curve order), it has no"
+					" public key"
+				);
+				lane_results[lane] = BITCOIN_ERROR_PRIVATE_KEY_INVALID_FORMAT;
+			}
+		}
+
+		kernel(tables, x, y,
+			(const uint8_t (*)[BITCOIN_SECP256K1_MAX_LANES])nibbles
+		);
+
+		for (lane = 0; lane < n; lane++) {
+			const struct BitcoinPrivateKey *private_key = &private_keys[start + lane];
+			struct BitcoinPublicKey *public_key = &public_keys[start + lane];
+
+			if (results) {
+				results[start + lane] = lane_results[lane];
+			}
+			if (lane_results[lane] != BITCOIN_SUCCESS) {
+				continue;
+			}
+
+			BitcoinSecp256k1_GetBytes(public_key->data + 1, &x[lane]);
+			if (private_key->public_key_compression == BITCOIN_PUBLIC_KEY_COMPRESSED) {
+				uint8_t y_bytes[32];
+				BitcoinSecp256k1_GetBytes(y_bytes, &y[lane]);
+				public_key->data[0] = 0x02 | (y_bytes[31] & 1);
+			} else {
+				public_key->data[0] = 0x04;
+				BitcoinSecp256k1_GetBytes(public_key->data + 33, &y[lane]);
+			}
+			public_key->compression = private_key->public_key_compression;
+			public_key->network_type = private_key->network_type;
+			valid++;
+		}
+	}
+
+	memset(nibbles, 0, sizeof(nibbles));
+	return valid;
+}
+
+size_t BitcoinSecp256k1_MakePublicKeys(struct BitcoinPublicKey *public_keys,
+	const struct BitcoinPrivateKey *private_keys,
+	size_t count, BitcoinResult *results
+)
+{
+	if (!secp256k1_kernel) {
+		BitcoinCPU_SelectKernels();
+	}
+	return BitcoinSecp256k1_makePublicKeys(&secp256k1_tables, secp256k1_kernel,
+		secp256k1_kernel_lanes, public_keys, private_keys, count, results
+	);
+}
+
+size_t BitcoinSecp256k1_MakePublicKeysOnNode(unsigned node,
+	struct BitcoinPublicKey *public_keys,
+	const struct BitcoinPrivateKey *private_keys,
+	size_t count, BitcoinResult *results
+)
+{
+	if (!secp256k1_kernel) {
+		BitcoinCPU_SelectKernels();
+	}
+	return BitcoinSecp256k1_makePublicKeys(node < secp256k1_node_count
+			? &secp256k1_node_tables[node] : &secp256k1_tables,
+		secp256k1_kernel, secp256k1_kernel_lanes, public_keys, private_keys,
+		count, results
+	);
+}
+
+size_t BitcoinSecp256k1_MakePublicKeysGeneric(struct BitcoinPublicKey *public_keys,
+	const struct BitcoinPrivateKey *private_keys,
+	size_t count, BitcoinResult *results
+)
+{
+	return BitcoinSecp256k1_makePublicKeys(&secp256k1_tables,
+		BitcoinSecp256k1_MakePointsGeneric, 1, public_keys, private_keys, count,
+		results
+	);
+}
+
+#else /* no 128-bit integers, use OpenSSL */
+
+size_t BitcoinSecp256k1_MakePublicKeys(struct BitcoinPublicKey *public_keys,
+	const struct BitcoinPrivateKey *private_keys,
+	size_t count, BitcoinResult *results
+)
+{
+	size_t i, valid = 0;
+	for (i = 0; i < count; i++) {
+		const BitcoinResult result = Bitcoin_MakePublicKeyFromPrivateKey(
+			&public_keys[i], &private_keys[i]
+		);
+		if (results) {
+			results[i] = result;
+		}
+		valid += result == BITCOIN_SUCCESS;
+	}
+	return valid;
+}
+
+size_t BitcoinSecp256k1_MakePublicKeysGeneric(struct BitcoinPublicKey *public_keys,
+	const struct BitcoinPrivateKey *private_keys,
+	size_t count, BitcoinResult *results
+)
+{
+	return BitcoinSecp256k1_MakePublicKeys(public_keys, private_keys, count, results);
+}
+
+void BitcoinSecp256k1_SelectKernel(void)
+{
+}
+
+const char *BitcoinSecp256k1_GetKernelName(void)
+{
+	return "openssl";
+}
+
+size_t BitcoinSecp256k1_MakePublicKeysOnNode(unsigned node,
+	struct BitcoinPublicKey *public_keys,
+	const struct BitcoinPrivateKey *private_keys,
+	size_t count, BitcoinResult *results
+)
+{
+	return BitcoinSecp256k1_MakePublicKeys(public_keys, private_keys, count, results);
+}
+
+enum BitcoinHugePageBacking BitcoinSecp256k1_PlaceTables(uint64_t *huge_bytes)
+{
+	if (huge_bytes) {
+		*huge_bytes = 0;
+	}
+	return BITCOIN_HUGE_PAGE_BACKING_NONE;
+}
+
+unsigned BitcoinSecp256k1_ReplicateTables(void)
+{
+	return 0;
+}
+
+#endif
@@ -0,0 +1,87 @@
+#ifndef BITCOIN_INCLUDE_SECP256K1_H
+#define BITCOIN_INCLUDE_SECP256K1_H
+
+/** @file secp256k1.h
+ *  @brief Public key derivation on the secp256k1 curve, for many keys at
+ *         once.
+ *
+ *  Keys are derived several at a time, one key per SIMD lane: 8 with
+ *  AVX-512 IFMA, 4 with AVX2, or 1 with the generic 64-bit code.  The
+ *  kernel is selected at run-time (see cpu.h).  Each key is multiplied by
+ *  the generator using a fixed table of multiples of it, with the same
+ *  sequence of operations and memory accesses whatever the key, so no
+ *  timing depends on private key bits.
+ *
+ *  Every lookup reads the whole row of its window, so the tables (about
+ *  150 KiB) are read in full for each key; they can be copied into a huge
+ *  page, so they take one TLB entry rather than dozens.
+ */
+
+#include <stddef.h> /* size_t */
+
+#include "hugepage.h"
+#include "keys.h"
+#include "result.h"
+
+/** @brief Derive public keys from private keys.  Same results as
+ *         Bitcoin_MakePublicKeyFromPrivateKey().
+ *
+ *  @param[out] public_keys Array of count public keys to write.
+ *  @param[in] private_keys Array of count private keys, which must have
+ *                          their public_key_compression set.
+ *  @param[in] count Number of keys.
+ *  @param[out] results Optional array of count results, may be NULL.
+ *
+ *  @return Number of keys derived successfully.
+ */
+size_t BitcoinSecp256k1_MakePublicKeys(struct BitcoinPublicKey *public_keys,
+	const struct BitcoinPrivateKey *private_keys,
+	size_t count, BitcoinResult *results
+);
+
+/** @brief Derive public keys using the generic 64-bit code only, whatever
+ *         the CPU supports, for checking the SIMD kernels against.
+ */
+size_t BitcoinSecp256k1_MakePublicKeysGeneric(struct BitcoinPublicKey *public_keys,
+	const struct BitcoinPrivateKey *private_keys,
+	size_t count, BitcoinResult *results
+);
+
+/** @brief Copy the tables into a huge page, if the huge page mode allows
+ *         (see hugepage.h) and one is available, otherwise leave them
+ *         where they are.  Should be called before starting threads.
+ *
+ *  @param[out] huge_bytes Bytes of the tables' copy in huge pages, may be
+ *                         NULL.
+ *
+ *  @return The backing of the tables.
+ */
+enum BitcoinHugePageBacking BitcoinSecp256k1_PlaceTables(uint64_t *huge_bytes);
+
+/** @brief Copy the tables to memory on each NUMA node (see numa.h), if
+ *         there is more than one, for BitcoinSecp256k1_MakePublicKeysOnNode().
+ *         Should be called before starting threads, and after
+ *         BitcoinSecp256k1_PlaceTables().
+ *
+ *  @return Number of nodes with a copy, 0 if there is one node.
+ */
+unsigned BitcoinSecp256k1_ReplicateTables(void);
+
+/** @brief Derive public keys as BitcoinSecp256k1_MakePublicKeys() does,
+ *         reading the copy of the tables on a node if there is one.
+ */
+size_t BitcoinSecp256k1_MakePublicKeysOnNode(unsigned node,
+	struct BitcoinPublicKey *public_keys,
+	const struct BitcoinPrivateKey *private_keys,
+	size_t count, BitcoinResult *results
+);
+
+/** @brief Select the kernel for this CPU.  Only to be called by
+ *         BitcoinCPU_SelectKernels(), which does it once.
+ */
+void BitcoinSecp256k1_SelectKernel(void);
+
+/** @brief Get the name of the kernel selected for this CPU. */
+const char *BitcoinSecp256k1_GetKernelName(void);
+
+#endif
@@ -0,0 +1,185 @@
+/*
+Point multiplication for one secp256k1 field element representation.
+
+This file is included by secp256k1.c once for each representation (generic
+64-bit, AVX2, AVX-512 IFMA), so that the curve arithmetic is written once.
+Before including it, secp256k1.c defines:
+
+  LANES_COUNT     : number of keys in each field element
+  LANES_FIELD     : field element type, holding one element for each lane
+  LANES_MASK      : per-lane condition type
+  LANES_TARGET    : function attributes enabling the instruction set
+  LANES_FN(name)  : name with the representation's suffix
+
+and these functions, with names made by LANES_FN().  Every field element
+passed in or out is weakly normalized (see secp256k1.c), and outputs may be
+the same as inputs.
+
+  Sub(r, a, b), Mul(r, a, b), Sqr(r, a), SetOne(r)
+  Select(r, a, mask)          : r = a in the lanes where mask is set
+  Lookup(tables, x, y, window, nibbles) : load each lane's point for the
+                                window from tables, reading every entry of
+                                the window
+  MaskAll(), MaskZero(nibbles), MaskAnd(a, b), MaskNot(a)
+  GetLane(r, a, lane)         : copy one lane of a to a generic element
+*/
+
+/* r = a^(p - 2) = 1/a, with the addition chain from libsecp256k1: runs of
+   1 bits are built up from shorter runs, then put together. */
+LANES_TARGET
+static void LANES_FN(Invert)(LANES_FIELD *r, const LANES_FIELD *a)
+{
+	LANES_FIELD x2, x3, x6, x9, x11, x22, x44, x88, x176, x220, x223, t;
+	int i;
+
+	LANES_FN(Sqr)(&x2, a);
+	LANES_FN(Mul)(&x2, &x2, a);
+
+	LANES_FN(Sqr)(&x3, &x2);
+	LANES_FN(Mul)(&x3, &x3, a);
+
+	x6 = x3;
+	for (i = 0; i < 3; i++) {
+		LANES_FN(Sqr)(&x6, &x6);
+	}
+	LANES_FN(Mul)(&x6, &x6, &x3);
+
+	x9 = x6;
+	for (i = 0; i < 3; i++) {
+		LANES_FN(Sqr)(&x9, &x9);
+	}
+	LANES_FN(Mul)(&x9, &x9, &x3);
+
+	x11 = x9;
+	for (i = 0; i < 2; i++) {
+		LANES_FN(Sqr)(&x11, &x11);
+	}
+	LANES_FN(Mul)(&x11, &x11, &x2);
+
+	x22 = x11;
+	for (i = 0; i < 11; i++) {
+		LANES_FN(Sqr)(&x22, &x22);
+	}
+	LANES_FN(Mul)(&x22, &x22, &x11);
+
+	x44 = x22;
+	for (i = 0; i < 22; i++) {
+		LANES_FN(Sqr)(&x44, &x44);
+	}
+	LANES_FN(Mul)(&x44, &x44, &x22);
+
+	x88 = x44;
+	for (i = 0; i < 44; i++) {
+		LANES_FN(Sqr)(&x88, &x88);
+	}
+	LANES_FN(Mul)(&x88, &x88, &x44);
+
+	x176 = x88;
+	for (i = 0; i < 88; i++) {
+		LANES_FN(Sqr)(&x176, &x176);
+	}
+	LANES_FN(Mul)(&x176, &x176, &x88);
+
+	x220 = x176;
+	for (i = 0; i < 44; i++) {
+		LANES_FN(Sqr)(&x220, &x220);
+	}
+	LANES_FN(Mul)(&x220, &x220, &x44);
+
+	x223 = x220;
+	for (i = 0; i < 3; i++) {
+		LANES_FN(Sqr)(&x223, &x223);
+	}
+	LANES_FN(Mul)(&x223, &x223, &x3);
+
+	t = x223;
+	for (i = 0; i < 23; i++) {
+		LANES_FN(Sqr)(&t, &t);
+	}
+	LANES_FN(Mul)(&t, &t, &x22);
+	for (i = 0; i < 5; i++) {
+		LANES_FN(Sqr)(&t, &t);
+	}
+	LANES_FN(Mul)(&t, &t, a);
+	for (i = 0; i < 3; i++) {
+		LANES_FN(Sqr)(&t, &t);
+	}
+	LANES_FN(Mul)(&t, &t, &x2);
+	for (i = 0; i < 2; i++) {
+		LANES_FN(Sqr)(&t, &t);
+	}
+	LANES_FN(Mul)(r, &t, a);
+}
+
+/* Multiply the generator by one scalar in each lane, given as 64 nibbles,
+least significant first, and write the affine result of each lane.  The
+total starts as infinity, and each window adds the table point for its
+nibble with a mixed (Jacobian plus affine) addition.  Table points for
+window w are multiples of 16^w, so the total can never be equal to, or the
+negative of, the point being added, and the formula's only special cases
+are a zero nibble and an infinite total, which are handled by selecting
+the result rather than branching. */
+LANES_TARGET
+static void LANES_FN(MakePoints)(const struct BitcoinSecp256k1Tables *tables,
+	struct BitcoinSecp256k1Field *x_out, struct BitcoinSecp256k1Field *y_out,
+	const uint8_t nibbles[BITCOIN_SECP256K1_WINDOWS][BITCOIN_SECP256K1_MAX_LANES]
+)
+{
+	LANES_FIELD x, y, z, one, ax, ay, z2, u2, s2, h, r, hh, hhh, v, t, x3, y3, z3;
+	LANES_MASK infinity = LANES_FN(MaskAll)();
+	unsigned w, lane;
+
+	LANES_FN(SetOne)(&one);
+	x = y = z = one;
+
+	for (w = 0; w < BITCOIN_SECP256K1_WINDOWS; w++) {
+		const LANES_MASK skip = LANES_FN(MaskZero)(nibbles[w]);
+
+		LANES_FN(Lookup)(tables, &ax, &ay, w, nibbles[w]);
+
+		LANES_FN(Sqr)(&z2, &z);
+		LANES_FN(Mul)(&u2, &ax, &z2);
+		LANES_FN(Mul)(&s2, &ay, &z);
+		LANES_FN(Mul)(&s2, &s2, &z2);
+		LANES_FN(Sub)(&h, &u2, &x);
+		LANES_FN(Sub)(&r, &s2, &y);
+		LANES_FN(Sqr)(&hh, &h);
+		LANES_FN(Mul)(&hhh, &h, &hh);
+		LANES_FN(Mul)(&v, &x, &hh);
+
+		/* x3 = r^2 - h^3 - 2v */
+		LANES_FN(Sqr)(&x3, &r);
+		LANES_FN(Sub)(&x3, &x3, &hhh);
+		LANES_FN(Sub)(&x3, &x3, &v);
+		LANES_FN(Sub)(&x3, &x3, &v);
+
+		/* y3 = r(v - x3) - y h^3 */
+		LANES_FN(Sub)(&t, &v, &x3);
+		LANES_FN(Mul)(&y3, &r, &t);
+		LANES_FN(Mul)(&t, &y, &hhh);
+		LANES_FN(Sub)(&y3, &y3, &t);
+
+		LANES_FN(Mul)(&z3, &z, &h);
+
+		LANES_FN(Select)(&x3, &ax, infinity);
+		LANES_FN(Select)(&y3, &ay, infinity);
+		LANES_FN(Select)(&z3, &one, infinity);
+
+		LANES_FN(Select)(&x, &x3, LANES_FN(MaskNot)(skip));
+		LANES_FN(Select)(&y, &y3, LANES_FN(MaskNot)(skip));
+		LANES_FN(Select)(&z, &z3, LANES_FN(MaskNot)(skip));
+		infinity = LANES_FN(MaskAnd)(infinity, skip);
+	}
+
+	/* back to affine coordinates, x / z^2 and y / z^3 */
+	LANES_FN(Invert)(&t, &z);
+	LANES_FN(Sqr)(&z2, &t);
+	LANES_FN(Mul)(&x, &x, &z2);
+	LANES_FN(Mul)(&z2, &z2, &t);
+	LANES_FN(Mul)(&y, &y, &z2);
+
+	for (lane = 0; lane < LANES_COUNT; lane++) {
+		LANES_FN(GetLane)(&x_out[lane], &x, lane);
+		LANES_FN(GetLane)(&y_out[lane], &y, lane);
+	}
+}
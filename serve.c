@@ -0,0 +1,475 @@
+/*
+Serve mode: listen on a Unix domain socket and convert each request received,
+so that callers converting a few keys at a time don't pay for process startup
+and context setup on every call.
+
+Each worker thread owns a BitcoinTool (and so a warm context) for the life of
+the server, and takes connections by calling accept() on the shared listening
+socket.  Requests on a connection are converted in order, and replies are
+buffered until every complete request that has arrived has been converted,
+so pipelined requests are answered with few writes.
+*/
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "applog.h"
+#include "result.h"
+#include "stats.h"
+#include "tool.h"
+
+#define SERVE_BUFFER_SIZE 65536
+#define SERVE_LISTEN_BACKLOG 128
+
+/* binary protocol framing */
+#define SERVE_REQUEST_HEADER_SIZE 2
+#define SERVE_REPLY_HEADER_SIZE 3
+
+/* largest reply, for deciding when to flush the output buffer */
+#define SERVE_MAX_REPLY_SIZE (SERVE_REPLY_HEADER_SIZE + 256 + 1)
+
+struct BitcoinServer;
+
+struct BitcoinServeWorker {
+	struct BitcoinServer *server;
+	BitcoinTool *tool;
+	unsigned number;
+	pthread_t thread;
+	int started;
+
+	/* connection being served, or -1 if waiting for one.  Protected by the
+	   server mutex, so that it can be shut down when stopping. */
+	int connection_fd;
+
+	char input[SERVE_BUFFER_SIZE];
+	size_t input_start, input_end;
+
+	char output[SERVE_BUFFER_SIZE];
+	size_t output_size;
+};
+
+struct BitcoinServer {
+	int listen_fd;
+	enum ServeProtocol protocol;
+
+	pthread_mutex_t mutex;
+	int stopping;
+
+	unsigned worker_count;
+	struct BitcoinServeWorker *workers;
+};
+
+static int BitcoinServe_stopping(struct BitcoinServer *server)
+{
+	int stopping;
+
+	pthread_mutex_lock(&server->mutex);
+	stopping = server->stopping;
+	pthread_mutex_unlock(&server->mutex);
+
+	return stopping;
+}
+
+/* Write all buffered replies.  Returns 0 if the connection failed. */
+static int BitcoinServe_flush(struct BitcoinServeWorker *worker, int fd)
+{
+	size_t written = 0;
+
+	while (written < worker->output_size) {
+		ssize_t n = write(fd, worker->output + written, worker->output_size - written);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return 0;
+		}
+		written += n;
+	}
+	worker->output_size = 0;
+
+	return 1;
+}
+
+static void BitcoinServe_appendReply(struct BitcoinServeWorker *worker,
+	enum ServeProtocol protocol, BitcoinResult result,
+	const char *text, size_t text_size
+)
+{
+	char *out = worker->output + worker->output_size;
+
+	if (protocol == SERVE_PROTOCOL_BINARY) {
+		out[0] = (char)result;
+		out[1] = (char)(text_size >> 8);
+		out[2] = (char)text_size;
+		memcpy(out + SERVE_REPLY_HEADER_SIZE, text, text_size);
+		worker->output_size += SERVE_REPLY_HEADER_SIZE + text_size;
+	} else {
+		memcpy(out, text, text_size);
+		out[text_size] = '\n';
+		worker->output_size += text_size + 1;
+	}
+}
+
+/* Convert one request and buffer its reply. */
+static void BitcoinServe_convert(struct BitcoinServeWorker *worker,
+	enum ServeProtocol protocol, const char *request, size_t request_size
+)
+{
+	BitcoinTool *tool = worker->tool;
+	struct BitcoinRecords *records = &tool->records;
+	BitcoinResult result;
+
+	BitcoinTool_resetInput(tool);
+	memcpy(records->input[0], request, request_size);
+	records->input[0][request_size] = '\0';
+	records->input_size[0] = request_size;
+
+	result = BitcoinTool_convertInput(tool);
+	if (result == BITCOIN_SUCCESS) {
+		BitcoinServe_appendReply(worker, protocol, result,
+			records->output_text[0], records->output_text_size[0]
+		);
+	} else {
+		char error[128];
+		const char *format = protocol == SERVE_PROTOCOL_BINARY ? "%s" : "error: %s";
+		int size = snprintf(error, sizeof(error), format, Bitcoin_ResultString(result));
+		if (size < 0) {
+			size = 0;
+		} else if (size >= (int)sizeof(error)) {
+			size = sizeof(error) - 1;
+		}
+		BitcoinServe_appendReply(worker, protocol, result, error, size);
+	}
+}
+
+/* Find the next complete request in the input buffer.
+   Returns 1 if found, 0 if more input is needed, -1 if the request is too
+   large to convert. */
+static int BitcoinServe_nextRequest(struct BitcoinServeWorker *worker,
+	enum ServeProtocol protocol, const char **request, size_t *request_size
+)
+{
+	const size_t max_request_size = BITCOIN_RECORD_TEXT_SIZE - 1;
+	const char *start = worker->input + worker->input_start;
+	const size_t available = worker->input_end - worker->input_start;
+
+	if (protocol == SERVE_PROTOCOL_BINARY) {
+		size_t size;
+
+		if (available < SERVE_REQUEST_HEADER_SIZE) {
+			return 0;
+		}
+		size = ((size_t)(unsigned char)start[0] << 8) | (unsigned char)start[1];
+		if (size > max_request_size) {
+			return -1;
+		}
+		if (available < SERVE_REQUEST_HEADER_SIZE + size) {
+			return 0;
+		}
+		*request = start + SERVE_REQUEST_HEADER_SIZE;
+		*request_size = size;
+		worker->input_start += SERVE_REQUEST_HEADER_SIZE + size;
+	} else {
+		const char *newline = memchr(start, '\n', available);
+		size_t size;
+
+		if (!newline) {
+			return available > max_request_size ? -1 : 0;
+		}
+		size = newline - start;
+		worker->input_start += size + 1;
+		if (size && start[size - 1] == '\r') {
+			size--;
+		}
+		if (size > max_request_size) {
+			return -1;
+		}
+		*request = start;
+		*request_size = size;
+	}
+
+	return 1;
+}
+
+static void BitcoinServe_connection(struct BitcoinServeWorker *worker, int fd)
+{
+	const enum ServeProtocol protocol = worker->server->protocol;
+
+	worker->input_start = worker->input_end = 0;
+	worker->output_size = 0;
+
+	for (;;) {
+		const char *request = NULL;
+		size_t request_size = 0;
+		ssize_t n;
+		int found;
+
+		n = read(fd, worker->input + worker->input_end,
+			sizeof(worker->input) - worker->input_end
+		);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			break;
+		}
+		worker->input_end += n;
+
+		while ((found = BitcoinServe_nextRequest(worker, protocol,
+			&request, &request_size)) > 0
+		) {
+			BitcoinServe_convert(worker, protocol, request, request_size);
+			if (sizeof(worker->output) - worker->output_size < SERVE_MAX_REPLY_SIZE) {
+				if (!BitcoinServe_flush(worker, fd)) {
+					return;
+				}
+			}
+		}
+
+		if (found < 0) {
+			static const char message[] = "request too large";
+			applog(APPLOG_WARNING, __func__,
+				"Request too large, closing connection."
+			);
+			BitcoinServe_appendReply(worker, protocol, BITCOIN_ERROR_INVALID_FORMAT,
+				message, sizeof(message) - 1
+			);
+			BitcoinServe_flush(worker, fd);
+			return;
+		}
+
+		/* every complete request has been converted, so reply before
+		   waiting for more */
+		if (!BitcoinServe_flush(worker, fd)) {
+			return;
+		}
+
+		/* keep the partial request at the start of the buffer */
+		memmove(worker->input, worker->input + worker->input_start,
+			worker->input_end - worker->input_start
+		);
+		worker->input_end -= worker->input_start;
+		worker->input_start = 0;
+	}
+
+	BitcoinServe_flush(worker, fd);
+}
+
+static void *BitcoinServe_worker(void *arg)
+{
+	struct BitcoinServeWorker *worker = arg;
+	struct BitcoinServer *server = worker->server;
+
+	BitcoinTool_placeWorker(worker->tool, worker->number);
+
+	for (;;) {
+		int fd = accept(server->listen_fd, NULL, NULL);
+
+		if (fd < 0) {
+			if (BitcoinServe_stopping(server)) {
+				break;
+			}
+			if (errno == EINTR || errno == ECONNABORTED) {
+				continue;
+			}
+			applog(APPLOG_ERROR, __func__, "accept failed (%s)", strerror(errno));
+			break;
+		}
+
+		pthread_mutex_lock(&server->mutex);
+		if (server->stopping) {
+			pthread_mutex_unlock(&server->mutex);
+			close(fd);
+			break;
+		}
+		worker->connection_fd = fd;
+		pthread_mutex_unlock(&server->mutex);
+
+		BitcoinServe_connection(worker, fd);
+
+		pthread_mutex_lock(&server->mutex);
+		worker->connection_fd = -1;
+		pthread_mutex_unlock(&server->mutex);
+		close(fd);
+	}
+
+	return NULL;
+}
+
+static int BitcoinServe_listen(const char *path)
+{
+	struct sockaddr_un address;
+	struct stat st;
+	int fd;
+
+	if (strlen(path) >= sizeof(address.sun_path)) {
+		applog(APPLOG_ERROR, __func__, "Socket path too long [%s]", path);
+		return -1;
+	}
+
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	strcpy(address.sun_path, path);
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0) {
+		applog(APPLOG_ERROR, __func__, "socket failed (%s)", strerror(errno));
+		return -1;
+	}
+
+	/* Remove a socket left behind by a previous server, but nothing else:
+	   not a socket which a running server still accepts on.  The probe is
+	   a socket of its own, since one whose connect() failed can't be
+	   bound. */
+	if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+		int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+		int connected = probe >= 0
+			&& connect(probe, (struct sockaddr *)&address, sizeof(address)) == 0;
+		int refused = !connected && errno == ECONNREFUSED;
+
+		if (probe >= 0) {
+			close(probe);
+		}
+		if (connected) {
+			applog(APPLOG_ERROR, __func__, "Already serving on [%s]", path);
+			close(fd);
+			return -1;
+		}
+		if (refused) {
+			unlink(path);
+		}
+	}
+
+	if (bind(fd, (struct sockaddr *)&address, sizeof(address)) < 0
+		|| listen(fd, SERVE_LISTEN_BACKLOG) < 0
+	) {
+		applog(APPLOG_ERROR, __func__, "Failed to listen on [%s] (%s)",
+			path, strerror(errno)
+		);
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+static unsigned BitcoinServe_defaultThreads(void)
+{
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	return cpus > 0 ? (unsigned)cpus : 1;
+}
+
+int BitcoinTool_serve(BitcoinTool *self)
+{
+	const BitcoinToolOptions *o = &self->options;
+	struct BitcoinServer server;
+	struct sigaction ignore;
+	sigset_t signals, old_signals;
+	int signal_number = 0;
+	int success = 1;
+	unsigned i;
+
+	memset(&server, 0, sizeof(server));
+	server.protocol = o->serve_protocol;
+	server.worker_count = o->serve_threads ? o->serve_threads : BitcoinServe_defaultThreads();
+
+	/* a client closing its connection early must not kill the server */
+	memset(&ignore, 0, sizeof(ignore));
+	ignore.sa_handler = SIG_IGN;
+	sigaction(SIGPIPE, &ignore, NULL);
+
+	server.listen_fd = BitcoinServe_listen(o->serve_socket);
+	if (server.listen_fd < 0) {
+		return 0;
+	}
+
+	server.workers = calloc(server.worker_count, sizeof(*server.workers));
+	if (!server.workers) {
+		applog(APPLOG_ERROR, __func__, "Failed to allocate workers.");
+		close(server.listen_fd);
+		unlink(o->serve_socket);
+		return 0;
+	}
+	pthread_mutex_init(&server.mutex, NULL);
+
+	/* workers inherit the blocked signals, so only this thread receives
+	   them, in sigwait() */
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGINT);
+	sigaddset(&signals, SIGTERM);
+	sigaddset(&signals, SIGHUP);
+	pthread_sigmask(SIG_BLOCK, &signals, &old_signals);
+
+	for (i = 0; i < server.worker_count; i++) {
+		struct BitcoinServeWorker *worker = &server.workers[i];
+
+		worker->server = &server;
+		worker->number = i;
+		worker->connection_fd = -1;
+		worker->tool = BitcoinTool_clone(self);
+		if (!worker->tool) {
+			applog(APPLOG_ERROR, __func__, "Failed to create worker %u.", i);
+			success = 0;
+			break;
+		}
+		if (pthread_create(&worker->thread, NULL, BitcoinServe_worker, worker)) {
+			applog(APPLOG_ERROR, __func__, "Failed to start worker %u.", i);
+			success = 0;
+			break;
+		}
+		worker->started = 1;
+	}
+
+	if (success) {
+		applog(APPLOG_NOTICE, __func__, "Listening on [%s] with %u worker threads.",
+			o->serve_socket, server.worker_count
+		);
+		sigwait(&signals, &signal_number);
+		applog(APPLOG_NOTICE, __func__, "Stopping (signal %d).", signal_number);
+	}
+
+	/* wake up workers blocked in accept() or reading a connection */
+	pthread_mutex_lock(&server.mutex);
+	server.stopping = 1;
+	for (i = 0; i < server.worker_count; i++) {
+		if (server.workers[i].connection_fd >= 0) {
+			shutdown(server.workers[i].connection_fd, SHUT_RDWR);
+		}
+	}
+	pthread_mutex_unlock(&server.mutex);
+	shutdown(server.listen_fd, SHUT_RDWR);
+
+	for (i = 0; i < server.worker_count; i++) {
+		struct BitcoinServeWorker *worker = &server.workers[i];
+		if (worker->started) {
+			pthread_join(worker->thread, NULL);
+		}
+		if (worker->tool) {
+			BitcoinStats_Merge(&self->stats, &worker->tool->stats);
+			worker->tool->destroy(worker->tool);
+		}
+	}
+
+	close(server.listen_fd);
+	unlink(o->serve_socket);
+	pthread_mutex_destroy(&server.mutex);
+	free(server.workers);
+	pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+
+	if (o->stats) {
+		BitcoinStats_Report(&self->stats, stderr, "final");
+	}
+
+	return success;
+}
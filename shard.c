@@ -0,0 +1,362 @@
+/*
+Sharded batch mode: split a regular input file into byte ranges, one per
+thread, and convert each range independently.
+
+Range boundaries are moved forward to the start of the next line, so every
+line belongs to exactly one shard.  Each shard has its own BitcoinTool (so
+its own file handle, records, context and stats), and reads only its range.
+Output is either written to one file per shard (--shard-output), or
+buffered in a temporary file per shard and copied to the output in shard
+order once every shard has finished, so it is the same as converting the
+file with one thread.  Input which can't be split (stdin, pipes,
+compressed files) is converted as one shard.
+*/
+
+#define _POSIX_C_SOURCE 200112L
+#define _FILE_OFFSET_BITS 64
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "applog.h"
+#include "compress.h"
+#include "result.h"
+#include "stats.h"
+#include "tool.h"
+
+#define SHARD_COPY_BUFFER_SIZE 65536
+
+struct BitcoinShard {
+	BitcoinTool *tool;
+	unsigned number;
+	pthread_t thread;
+	int started;
+
+	/* byte range of the input file, and the file the output goes to */
+	off_t start, end;
+	FILE *output;
+
+	int success;
+};
+
+static void *BitcoinShard_worker(void *arg)
+{
+	struct BitcoinShard *shard = (struct BitcoinShard *)arg;
+	BitcoinTool_placeWorker(shard->tool, shard->number);
+	shard->success = BitcoinTool_convertAll(shard->tool);
+	BitcoinStats_Stop(&shard->tool->stats);
+	return NULL;
+}
+
+/* Move offset forward to the start of the next line, unless it is already
+   at the start of one.  Returns 1 if success, 0 if failure. */
+static int BitcoinShard_align(FILE *file, off_t size, off_t *offset)
+{
+	off_t position;
+	int c;
+
+	if (*offset <= 0 || *offset >= size) {
+		return 1;
+	}
+
+	/* the byte before the offset is a newline if a line starts there */
+	position = *offset - 1;
+	if (fseeko(file, position, SEEK_SET)) {
+		return 0;
+	}
+	while ((c = getc(file)) != EOF) {
+		position++;
+		if (c == '\n') {
+			*offset = position;
+			return 1;
+		}
+	}
+	if (ferror(file)) {
+		return 0;
+	}
+	*offset = size;
+	return 1;
+}
+
+/* Split the input file into count ranges aligned to lines.  Returns the
+   number of shards, which is 1 if the input is not a regular file. */
+static unsigned BitcoinShard_split(const char *filename,
+	enum BitcoinCompression compression, struct BitcoinShard *shards,
+	unsigned count
+)
+{
+	struct stat st;
+	FILE *file;
+	off_t size;
+	unsigned i;
+
+	if (strcmp(filename, "-") == 0 || stat(filename, &st) || !S_ISREG(st.st_mode)) {
+		if (count > 1) {
+			applog(APPLOG_NOTICE, __func__,
+				"Input [%s] is not a regular file, converting it with one"
+				" thread.", filename
+			);
+		}
+		shards[0].start = shards[0].end = -1;
+		return 1;
+	}
+
+	size = st.st_size;
+	file = fopen(filename, "rb");
+	if (!file) {
+		applog(APPLOG_ERROR, __func__, "Failed to open file [%s] (%s)",
+			filename, strerror(errno)
+		);
+		return 0;
+	}
+
+	if (compression == BITCOIN_COMPRESSION_AUTO) {
+		compression = BitcoinCompress_Detect(getc(file));
+	}
+	if (compression != BITCOIN_COMPRESSION_NONE) {
+		if (count > 1) {
+			applog(APPLOG_NOTICE, __func__,
+				"Input [%s] is compressed, converting it with one thread.",
+				filename
+			);
+		}
+		fclose(file);
+		shards[0].start = shards[0].end = -1;
+		return 1;
+	}
+
+	for (i = 0; i < count; i++) {
+		shards[i].start = i ? shards[i - 1].end : 0;
+		shards[i].end = (off_t)((double)size * (i + 1) / count);
+		if (i + 1 == count) {
+			shards[i].end = size;
+		} else if (!BitcoinShard_align(file, size, &shards[i].end)) {
+			applog(APPLOG_ERROR, __func__, "Failed to read file [%s] (%s)",
+				filename, strerror(errno)
+			);
+			fclose(file);
+			return 0;
+		}
+		if (shards[i].end < shards[i].start) {
+			shards[i].end = shards[i].start;
+		}
+	}
+
+	fclose(file);
+	return count;
+}
+
+/* Give a shard's tool its input range and output file */
+static int BitcoinShard_open(BitcoinTool *self, struct BitcoinShard *shard,
+	unsigned index
+)
+{
+	const BitcoinToolOptions *o = &self->options;
+	BitcoinTool *tool = shard->tool;
+
+	if (shard->start >= 0) {
+		tool->input_file_handle = BitcoinIO_OpenInput(o->input_file,
+			(uint64_t)shard->start, self->io_engine, BITCOIN_COMPRESSION_NONE
+		);
+		if (!tool->input_file_handle) {
+			applog(APPLOG_ERROR, __func__, "Failed to open file [%s] (%s)",
+				o->input_file, strerror(errno)
+			);
+			return 0;
+		}
+		tool->input_ranged = 1;
+		tool->input_offset = (uint64_t)shard->start;
+		tool->input_end = (uint64_t)shard->end;
+	}
+
+	if (o->shard_output) {
+		char *filename = malloc(strlen(o->shard_output) + 16);
+		if (!filename) {
+			return 0;
+		}
+		sprintf(filename, "%s.%u", o->shard_output, index);
+		shard->output = fopen(filename, "wb");
+		if (!shard->output) {
+			applog(APPLOG_ERROR, __func__, "Failed to create file [%s] (%s)",
+				filename, strerror(errno)
+			);
+		}
+		free(filename);
+	} else if (shard->start >= 0) {
+		shard->output = tmpfile();
+		if (!shard->output) {
+			applog(APPLOG_ERROR, __func__,
+				"Failed to create temporary file for shard %u (%s)",
+				index, strerror(errno)
+			);
+		}
+	} else {
+		/* the only shard, straight to the output */
+		shard->output = self->output_file_handle;
+	}
+	if (!shard->output) {
+		return 0;
+	}
+	tool->output_file_handle = shard->output;
+
+	/* shard files are compressed as the output would have been */
+	if (o->shard_output) {
+		tool->output_file_handle = BitcoinIO_OpenOutput(shard->output,
+			BITCOIN_IO_ENGINE_STDIO, o->output_compression, o->compression_level
+		);
+		if (!tool->output_file_handle) {
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+/* Copy a shard's buffered output to the output.  Returns 1 if success. */
+static int BitcoinShard_copyOutput(BitcoinTool *self, struct BitcoinShard *shard)
+{
+	char *buffer;
+	size_t bytes;
+	int success = 1;
+
+	if (fflush(shard->output) || fseeko(shard->output, 0, SEEK_SET)) {
+		return 0;
+	}
+
+	buffer = malloc(SHARD_COPY_BUFFER_SIZE);
+	if (!buffer) {
+		return 0;
+	}
+	while ((bytes = fread(buffer, 1, SHARD_COPY_BUFFER_SIZE, shard->output)) > 0) {
+		if (fwrite(buffer, 1, bytes, self->output_file_handle) != bytes) {
+			applog(APPLOG_ERROR, __func__, "Error writing output (%s)",
+				strerror(errno)
+			);
+			success = 0;
+			break;
+		}
+	}
+	if (ferror(shard->output)) {
+		success = 0;
+	}
+	free(buffer);
+
+	return success;
+}
+
+int BitcoinTool_convertShards(BitcoinTool *self)
+{
+	const BitcoinToolOptions *o = &self->options;
+	struct BitcoinShard *shards;
+	unsigned count = o->threads ? o->threads : 1;
+	int success = 1;
+	unsigned i;
+
+	shards = calloc(count, sizeof(*shards));
+	if (!shards) {
+		applog(APPLOG_ERROR, __func__, "Failed to allocate shards.");
+		return 0;
+	}
+
+	count = BitcoinShard_split(o->input_file, o->input_compression, shards,
+		count
+	);
+	if (!count) {
+		free(shards);
+		return 0;
+	}
+
+	for (i = 0; i < count; i++) {
+		struct BitcoinShard *shard = &shards[i];
+
+		shard->number = i;
+		shard->tool = BitcoinTool_clone(self);
+		if (!shard->tool) {
+			applog(APPLOG_ERROR, __func__, "Failed to create shard %u.", i);
+			success = 0;
+			break;
+		}
+		/* progress is only reported for the whole run, at the end */
+		shard->tool->options.stats_interval = 0;
+
+		if (!BitcoinShard_open(self, shard, i)) {
+			success = 0;
+			break;
+		}
+		if (pthread_create(&shard->thread, NULL, BitcoinShard_worker, shard)) {
+			applog(APPLOG_ERROR, __func__, "Failed to start shard %u.", i);
+			success = 0;
+			break;
+		}
+		shard->started = 1;
+	}
+
+	for (i = 0; i < count; i++) {
+		if (shards[i].started) {
+			pthread_join(shards[i].thread, NULL);
+		}
+	}
+
+	/* in shard order, stopping at the first shard which failed, so the
+	   output ends where it would have with one thread */
+	for (i = 0; i < count; i++) {
+		struct BitcoinShard *shard = &shards[i];
+
+		if (!success || !shard->started) {
+			success = 0;
+		} else if (!o->shard_output && shard->output != self->output_file_handle) {
+			if (!BitcoinShard_copyOutput(self, shard)) {
+				success = 0;
+			}
+		}
+		if (!shard->success) {
+			success = 0;
+		}
+		if (!success) {
+			break;
+		}
+	}
+
+	for (i = 0; i < count; i++) {
+		struct BitcoinShard *shard = &shards[i];
+
+		if (shard->tool && shard->tool->output_file_handle
+			&& shard->tool->output_file_handle != shard->output
+		) {
+			/* compressing a shard file */
+			if (fclose(shard->tool->output_file_handle)) {
+				applog(APPLOG_ERROR, __func__,
+					"Error writing output of shard %u (%s)", i, strerror(errno)
+				);
+				success = 0;
+			}
+		}
+		if (shard->output && shard->output != self->output_file_handle) {
+			if (fclose(shard->output) && o->shard_output) {
+				applog(APPLOG_ERROR, __func__,
+					"Error writing output of shard %u (%s)", i, strerror(errno)
+				);
+				success = 0;
+			}
+		}
+		if (shard->tool) {
+			/* a ranged shard's own file, or the only shard's stream over
+			   a compressed file or pipe, which stops its reader thread */
+			if (shard->tool->input_file_handle
+				&& shard->tool->input_file_handle != stdin
+			) {
+				fclose(shard->tool->input_file_handle);
+			}
+			BitcoinStats_Merge(&self->stats, &shard->tool->stats);
+			shard->tool->destroy(shard->tool);
+		}
+	}
+	free(shards);
+
+	return success;
+}
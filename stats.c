@@ -0,0 +1,145 @@
+#define _POSIX_C_SOURCE 199309L /* clock_gettime */
+
+#include "stats.h"
+
+#include <string.h>
+#include <time.h>
+
+static const char *stage_names[BITCOIN_STATS_STAGE_COUNT] = {
+	"parse-input",
+	"check-input-size",
+	"convert",
+	"write-output"
+};
+
+double BitcoinStats_Now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+uint64_t BitcoinStats_Ticks(void)
+{
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+	return __builtin_ia32_rdtsc();
+#else
+	return (uint64_t)BitcoinStats_Now();
+#endif
+}
+
+void BitcoinStats_Start(struct BitcoinStats *stats)
+{
+	memset(stats, 0, sizeof(*stats));
+	stats->start_ticks = BitcoinStats_Ticks();
+	stats->start_ns = BitcoinStats_Now();
+	stats->report_ns = stats->start_ns;
+}
+
+void BitcoinStats_AddStage(struct BitcoinStats *stats,
+	enum BitcoinStatsStage stage, uint64_t ticks, int error
+)
+{
+	BitcoinStats_AddStageRecords(stats, stage, ticks, 1, error ? 1 : 0);
+}
+
+void BitcoinStats_AddStageRecords(struct BitcoinStats *stats,
+	enum BitcoinStatsStage stage, uint64_t ticks, size_t calls, size_t errors
+)
+{
+	struct BitcoinStageStats *s = &stats->stages[stage];
+	s->calls += calls;
+	s->ticks += ticks;
+	s->errors += errors;
+}
+
+void BitcoinStats_Stop(struct BitcoinStats *stats)
+{
+	stats->end_ns = BitcoinStats_Now();
+}
+
+void BitcoinStats_Merge(struct BitcoinStats *total,
+	const struct BitcoinStats *part
+)
+{
+	unsigned i;
+
+	for (i = 0; i < BITCOIN_STATS_STAGE_COUNT; i++) {
+		total->stages[i].calls += part->stages[i].calls;
+		total->stages[i].errors += part->stages[i].errors;
+		total->stages[i].ticks += part->stages[i].ticks;
+	}
+	total->records += part->records;
+	total->cache_hits += part->cache_hits;
+	total->cache_misses += part->cache_misses;
+	total->cache_evictions += part->cache_evictions;
+	if (part->thread_ns) {
+		total->thread_ns += part->thread_ns;
+	} else {
+		total->thread_ns += (part->end_ns ? part->end_ns : BitcoinStats_Now())
+			- part->start_ns;
+	}
+	if (!total->pipeline) {
+		total->pipeline = part->pipeline;
+	}
+	if (!total->io_engine) {
+		total->io_engine = part->io_engine;
+	}
+
+	if (!total->start_ns || (part->start_ns && part->start_ns < total->start_ns)) {
+		total->start_ns = part->start_ns;
+		total->start_ticks = part->start_ticks;
+	}
+}
+
+void BitcoinStats_Report(const struct BitcoinStats *stats, FILE *file,
+	const char *title
+)
+{
+	const double elapsed_ns = BitcoinStats_Now() - stats->start_ns;
+	const uint64_t elapsed_ticks = BitcoinStats_Ticks() - stats->start_ticks;
+	const double ns_per_tick = elapsed_ticks ?
+		elapsed_ns / (double)elapsed_ticks : 1.0;
+	/* with several threads, each stage's share is of all their time */
+	const double share_ns = stats->thread_ns > 0 ? stats->thread_ns : elapsed_ns;
+	uint64_t errors = 0;
+	unsigned i;
+
+	fprintf(file, "stats (%s):\n", title);
+	if (stats->pipeline) {
+		fprintf(file, "  pipeline %s\n", stats->pipeline);
+	}
+	if (stats->io_engine) {
+		fprintf(file, "  io %s\n", stats->io_engine);
+	}
+	fprintf(file, "  %-16s %12s %10s %12s %10s %6s\n",
+		"stage", "calls", "errors", "total_ms", "ns/call", "share"
+	);
+	for (i = 0; i < BITCOIN_STATS_STAGE_COUNT; i++) {
+		const struct BitcoinStageStats *s = &stats->stages[i];
+		const double ns = s->ticks * ns_per_tick;
+		fprintf(file, "  %-16s %12llu %10llu %12.1f %10.0f %5.1f%%\n",
+			stage_names[i],
+			(unsigned long long)s->calls,
+			(unsigned long long)s->errors,
+			ns / 1e6,
+			s->calls ? ns / s->calls : 0.0,
+			share_ns > 0 ? ns * 100 / share_ns : 0.0
+		);
+		errors += s->errors;
+	}
+	fprintf(file, "  records %llu, errors %llu, %.3f s, %.1f records/s\n",
+		(unsigned long long)stats->records,
+		(unsigned long long)errors,
+		elapsed_ns / 1e9,
+		elapsed_ns > 0 ? stats->records / (elapsed_ns / 1e9) : 0.0
+	);
+	if (stats->cache_hits || stats->cache_misses) {
+		fprintf(file, "  cache hits %llu, misses %llu, evictions %llu, %.1f%% hit\n",
+			(unsigned long long)stats->cache_hits,
+			(unsigned long long)stats->cache_misses,
+			(unsigned long long)stats->cache_evictions,
+			stats->cache_hits * 100.0 / (stats->cache_hits + stats->cache_misses)
+		);
+	}
+}
@@ -0,0 +1,115 @@
+#ifndef BITCOIN_INCLUDE_STATS_H
+#define BITCOIN_INCLUDE_STATS_H
+
+/** @file stats.h
+ *  @brief Per-stage timing and counters for batch conversions.
+ *
+ *  Each thread doing conversions owns a BitcoinStats accumulator, so
+ *  recording is just a few additions with no locking.  Accumulators are
+ *  merged into one total when reporting.  Time is measured with the CPU
+ *  cycle counter where available, and converted to nanoseconds at report
+ *  time using the wall clock time elapsed over the whole run.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+
+enum BitcoinStatsStage {
+	BITCOIN_STATS_STAGE_PARSE_INPUT,
+	BITCOIN_STATS_STAGE_CHECK_INPUT_SIZE,
+	BITCOIN_STATS_STAGE_CONVERT,
+	BITCOIN_STATS_STAGE_WRITE_OUTPUT,
+	BITCOIN_STATS_STAGE_COUNT
+};
+
+struct BitcoinStageStats {
+	uint64_t calls;
+	uint64_t errors;
+	uint64_t ticks;
+};
+
+struct BitcoinStats {
+	struct BitcoinStageStats stages[BITCOIN_STATS_STAGE_COUNT];
+
+	/* records which made it through every stage */
+	uint64_t records;
+
+	/* clock readings at the start of the run, for converting ticks to
+	   nanoseconds and for working out records per second */
+	uint64_t start_ticks;
+	double start_ns;
+
+	/* time of the last periodic report */
+	double report_ns;
+
+	/* end of a thread's part of the run (see BitcoinStats_Stop()), and the
+	   time of the threads merged in, added up, which the stages' shares
+	   are of instead of the wall time if set */
+	double end_ns;
+	double thread_ns;
+
+	/* lookups of the derived key cache (--cache-size), and entries it
+	   evicted, reported if the cache was used */
+	uint64_t cache_hits, cache_misses, cache_evictions;
+
+	/* name of the conversion pipeline and I/O engine, reported if set */
+	const char *pipeline;
+	const char *io_engine;
+};
+
+/** @brief Read the cycle counter (or a nanosecond clock on platforms
+ *         without one).  Only differences between readings are meaningful.
+ */
+uint64_t BitcoinStats_Ticks(void);
+
+/** @brief Read the monotonic wall clock, in nanoseconds. */
+double BitcoinStats_Now(void);
+
+/** @brief Reset an accumulator and record the start time of the run. */
+void BitcoinStats_Start(struct BitcoinStats *stats);
+
+/** @brief Record one call of a stage.
+ *
+ *  @param[in] stage Stage which was called.
+ *  @param[in] ticks Ticks spent in the stage.
+ *  @param[in] error Non-zero if the stage failed.
+ */
+void BitcoinStats_AddStage(struct BitcoinStats *stats,
+	enum BitcoinStatsStage stage, uint64_t ticks, int error
+);
+
+/** @brief Record a stage run over a batch of records, timed as a whole.
+ *
+ *  @param[in] stage  Stage which was called.
+ *  @param[in] ticks  Ticks spent in the stage, for the whole batch.
+ *  @param[in] calls  Records the stage processed.
+ *  @param[in] errors Records for which the stage failed.
+ */
+void BitcoinStats_AddStageRecords(struct BitcoinStats *stats,
+	enum BitcoinStatsStage stage, uint64_t ticks, size_t calls, size_t errors
+);
+
+/** @brief Record the end of a thread's part of the run, before its
+ *         accumulator is merged into the run's.
+ */
+void BitcoinStats_Stop(struct BitcoinStats *stats);
+
+/** @brief Add the counters of one accumulator into another, eg: to combine
+ *         the accumulators of several threads.  The start time of the
+ *         earliest run is kept, and the time each part ran is added up.
+ */
+void BitcoinStats_Merge(struct BitcoinStats *total,
+	const struct BitcoinStats *part
+);
+
+/** @brief Write a report of time, calls and errors per stage, and overall
+ *         records per second.
+ *
+ *  @param[in] file File to write report to, normally stderr.
+ *  @param[in] title Text to identify the report, eg: "final".
+ */
+void BitcoinStats_Report(const struct BitcoinStats *stats, FILE *file,
+	const char *title
+);
+
+#endif
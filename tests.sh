@@ -1,6 +1,9 @@
 #!/usr/bin/env bash
 
 BITCOIN_TOOL="./bitcoin-tool"
+BITCOIN_TOOL_CLIENT="./bitcoin-tool-client"
+BITCOIN_TOOL_BENCH="./bitcoin-tool-bench"
+BATCHTEST="./batchtest"
 
 check () {
 	echo check $1
@@ -230,6 +233,454 @@ OUTPUT=$($BITCOIN_TOOL \
 check "${TEST}" "${OUTPUT}" "${EXPECTED}" || exit 1
 # -----------------------------------------------------------------------------
 
+# -----------------------------------------------------------------------------
+# Test hex decoding and encoding
+# -----------------------------------------------------------------------------
+TEST="hex1 - upper case hex public key, to lower case hex public key"
+EXPECTED="0479be667ef9dcbbac55a06295ce870b07029bfcdb2dce28d959f2815b16f81798483ada7726a3c4655da4fbfc0e1108a8fd17b448a68554199c47d08ffb10d4b8"
+INPUT="0479BE667EF9DCBBAC55A06295CE870B07029BFCDB2DCE28D959F2815B16F81798483ADA7726A3C4655DA4FBFC0E1108A8FD17B448A68554199C47D08FFB10D4B8"
+OUTPUT=$($BITCOIN_TOOL \
+	--input-type public-key \
+	--input-format hex \
+	--output-type public-key \
+	--output-format hex \
+	--input "${INPUT}")
+check "${TEST}" "${OUTPUT}" "${EXPECTED}" || exit 1
+# -----------------------------------------------------------------------------
+TEST="hex2 - invalid hex char is reported at its offset"
+EXPECTED="Invalid character (ASCII=103) at offset 128"
+INPUT="0479be667ef9dcbbac55a06295ce870b07029bfcdb2dce28d959f2815b16f81798483ada7726a3c4655da4fbfc0e1108a8fd17b448a68554199c47d08ffb10d4g8"
+OUTPUT=$($BITCOIN_TOOL \
+	--input-type public-key \
+	--input-format hex \
+	--output-type public-key \
+	--output-format hex \
+	--input "${INPUT}" 2>&1 | head -n 1)
+check "${TEST}" "${OUTPUT}" "${EXPECTED}" || exit 1
+# -----------------------------------------------------------------------------
+
+# -----------------------------------------------------------------------------
+# Test batch mode
+# -----------------------------------------------------------------------------
+TEST="batch1 - batch of hex private keys to addresses, exits successfully"
+EXPECTED="1BgGZ9tcN4rm9KBzDn7KprQz87SZ26SAMH 1cMh228HTCiwS8ZsaakH8A8wze1JR5ZsP 0"
+INPUT="0000000000000000000000000000000000000000000000000000000000000001
+0000000000000000000000000000000000000000000000000000000000000002"
+OUTPUT=$($BITCOIN_TOOL \
+	--batch \
+	--input-type private-key \
+	--input-format hex \
+	--output-type address \
+	--output-format base58check \
+	--public-key-compression compressed \
+	--network bitcoin \
+	--input-file <(echo "${INPUT}") )
+OUTPUT=$(echo ${OUTPUT} $?)
+check "${TEST}" "${OUTPUT}" "${EXPECTED}" || exit 1
+# -----------------------------------------------------------------------------
+TEST="batch2 - batch of addresses, leading zero byte after a non-zero prefix"
+EXPECTED="301e4d77d1f24d0ad40aafc746866c4174eb07aaea 0062e907b15cbf27d5425399ebf6f0fb50ebb88f18"
+INPUT="LMzBLYQG2opHvMBihMQgJBboxunoj5pssC
+1A1zP1eP5QGefi2DMPTfTL5SLmv7DivfNa"
+OUTPUT=$($BITCOIN_TOOL \
+	--batch \
+	--input-type address \
+	--input-format base58check \
+	--output-type address \
+	--output-format hex \
+	--input-file <(echo "${INPUT}") )
+OUTPUT=$(echo ${OUTPUT})
+check "${TEST}" "${OUTPUT}" "${EXPECTED}" || exit 1
+# -----------------------------------------------------------------------------
+TEST="batch3 - batch of private keys with --output-type all"
+EXPECTED="36"
+INPUT="0000000000000000000000000000000000000000000000000000000000000001
+0000000000000000000000000000000000000000000000000000000000000002"
+OUTPUT=$($BITCOIN_TOOL \
+	--batch \
+	--input-type private-key \
+	--input-format hex \
+	--output-type all \
+	--public-key-compression compressed \
+	--network bitcoin \
+	--input-file <(echo "${INPUT}") | wc -l)
+OUTPUT=$(echo ${OUTPUT})
+check "${TEST}" "${OUTPUT}" "${EXPECTED}" || exit 1
+# -----------------------------------------------------------------------------
+TEST="batch4 - --stats reports each stage to stderr"
+EXPECTED="parse-input 2 check-input-size 2 convert 2 write-output 2 records 2"
+INPUT="0000000000000000000000000000000000000000000000000000000000000001
+0000000000000000000000000000000000000000000000000000000000000002"
+OUTPUT=$($BITCOIN_TOOL \
+	--batch \
+	--stats \
+	--input-type private-key \
+	--input-format hex \
+	--output-type address \
+	--output-format base58check \
+	--public-key-compression compressed \
+	--network bitcoin \
+	--input-file <(echo "${INPUT}") 2>&1 >/dev/null \
+	| awk '/^  (parse|check|convert|write)/ { printf "%s %s ", $1, $2 }
+		/^  records/ { printf "records %d", $2 }')
+check "${TEST}" "${OUTPUT}" "${EXPECTED}" || exit 1
+# -----------------------------------------------------------------------------
+TEST="batch5 - --stats names the pipeline selected for the options"
+EXPECTED="private-key.hex>address.base58check public-key.hex>all"
+OUTPUT=$(
+	for options in "--input-type private-key --output-type address --output-format base58check" \
+		"--input-type public-key --output-type all"
+	do
+		$BITCOIN_TOOL \
+			--batch \
+			--stats \
+			--input-format hex \
+			${options} \
+			--network bitcoin \
+			--input-file /dev/null 2>&1 \
+			| awk '/^  pipeline/ { printf "%s ", $2 }'
+	done)
+OUTPUT=$(echo ${OUTPUT})
+check "${TEST}" "${OUTPUT}" "${EXPECTED}" || exit 1
+# -----------------------------------------------------------------------------
+TEST="log1 - repeated errors are limited by --log-repeat-limit"
+EXPECTED="3 1"
+INPUT="00g0000000000000000000000000000000000000000000000000000000000001
+00g0000000000000000000000000000000000000000000000000000000000002
+00g0000000000000000000000000000000000000000000000000000000000003
+00g0000000000000000000000000000000000000000000000000000000000004
+00g0000000000000000000000000000000000000000000000000000000000005"
+OUTPUT=$($BITCOIN_TOOL \
+	--batch \
+	--ignore-input-errors \
+	--log-repeat-limit 3 \
+	--input-type private-key \
+	--input-format hex \
+	--output-type address \
+	--output-format base58check \
+	--public-key-compression compressed \
+	--network bitcoin \
+	--input-file <(echo "${INPUT}") 2>&1 >/dev/null \
+	| awk '/^Invalid character/ { n++ } /2 repeats of .Invalid character/ { s++ }
+		END { printf "%d %d", n, s }')
+check "${TEST}" "${OUTPUT}" "${EXPECTED}" || exit 1
+# -----------------------------------------------------------------------------
+TEST="log2 - --log-level none silences errors"
+EXPECTED=""
+OUTPUT=$($BITCOIN_TOOL \
+	--log-level none \
+	--input-type private-key \
+	--input-format hex \
+	--output-type address \
+	--output-format base58check \
+	--public-key-compression compressed \
+	--network bitcoin \
+	--input 00g0 2>&1 >/dev/null)
+check "${TEST}" "${OUTPUT}" "${EXPECTED}" || exit 1
+# -----------------------------------------------------------------------------
+SHARD_INPUT="${TMPDIR:-/tmp}/bitcoin-tool-test-$$.keys"
+SHARD_OUTPUT="${TMPDIR:-/tmp}/bitcoin-tool-test-$$.out"
+for I in 1 2 3 4 5 6 7 8 9 a b; do
+	printf '%064s\n' "${I}" | tr ' ' 0
+done > "${SHARD_INPUT}"
+SHARD_OPTIONS="--batch
+	--input-type private-key
+	--input-format hex
+	--output-type address
+	--output-format base58check
+	--public-key-compression compressed
+	--network bitcoin
+	--input-file ${SHARD_INPUT}"
+EXPECTED=$($BITCOIN_TOOL ${SHARD_OPTIONS})
+# -----------------------------------------------------------------------------
+TEST="shard1 - --threads writes output in input order"
+OUTPUT=$($BITCOIN_TOOL ${SHARD_OPTIONS} --threads 4)
+check "${TEST}" "${OUTPUT}" "${EXPECTED}" || exit 1
+# -----------------------------------------------------------------------------
+TEST="shard3 - --threads splits input with NULs in lines the same as one thread"
+NUL_INPUT="${TMPDIR:-/tmp}/bitcoin-tool-test-$$.nul"
+for I in 1 2 3 4 5 6 7 8 9 a b c d e f; do
+	printf '%064s\n' "${I}" | tr ' ' 0
+	printf '%064s\0zzzzzzzzzzzzzzzzzzzz\n' "${I}" | tr ' ' 0
+done > "${NUL_INPUT}"
+EXPECTED_NUL=$($BITCOIN_TOOL ${SHARD_OPTIONS} --input-file "${NUL_INPUT}" 2>/dev/null)
+OUTPUT=$(
+	for THREADS in 2 3 4 8; do
+		$BITCOIN_TOOL ${SHARD_OPTIONS} --input-file "${NUL_INPUT}" \
+			--threads ${THREADS} 2>/dev/null
+	done
+)
+rm -f "${NUL_INPUT}"
+EXPECTED_ALL=$(for I in 1 2 3 4; do echo "${EXPECTED_NUL}"; done)
+check "${TEST}" "${OUTPUT}" "${EXPECTED_ALL}" || exit 1
+# -----------------------------------------------------------------------------
+TEST="io1 - every --io-engine reads and writes the same"
+OUTPUT=$(
+	for ENGINE in stdio thread uring; do
+		$BITCOIN_TOOL ${SHARD_OPTIONS} --io-engine ${ENGINE}
+		cat "${SHARD_INPUT}" | $BITCOIN_TOOL ${SHARD_OPTIONS} --input-file - \
+			--io-engine ${ENGINE}
+	done
+)
+EXPECTED_ALL=$(for I in 1 2 3 4 5 6; do echo "${EXPECTED}"; done)
+check "${TEST}" "${OUTPUT}" "${EXPECTED_ALL}" || exit 1
+# -----------------------------------------------------------------------------
+TEST="compress1 - compressed output reads back as compressed input"
+for FORMAT in gzip zstd; do
+	# only the formats this build has
+	$BITCOIN_TOOL ${SHARD_OPTIONS} --output-compression ${FORMAT} \
+		> /dev/null 2>&1 || continue
+	OUTPUT=$(
+		$BITCOIN_TOOL ${SHARD_OPTIONS} --output-type private-key \
+			--output-format hex --output-compression ${FORMAT} \
+		| $BITCOIN_TOOL ${SHARD_OPTIONS} --input-file -
+	)
+	check "${TEST} (${FORMAT})" "${OUTPUT}" "${EXPECTED}" || exit 1
+done
+# -----------------------------------------------------------------------------
+TEST="compress2 - auto is only for --input-compression"
+OUTPUT=$($BITCOIN_TOOL ${SHARD_OPTIONS} --output-compression auto 2>&1)
+OUTPUT="${OUTPUT} $?"
+check "${TEST}" "${OUTPUT}" \
+	"value for --output-compression should be one of: none, gzip, zstd 1" || exit 1
+# -----------------------------------------------------------------------------
+TEST="cache1 - --cache-size gives the same output for repeated keys"
+# more keys than a batch, since repeats within a batch all miss
+for I in $(seq 1 300) $(seq 1 300); do
+	printf '%064x\n' "${I}"
+done > "${SHARD_OUTPUT}"
+EXPECTED_ALL=$($BITCOIN_TOOL ${SHARD_OPTIONS} --input-file "${SHARD_OUTPUT}"
+	echo "  cache hits 300, misses 300, evictions 0")
+OUTPUT=$(
+	$BITCOIN_TOOL ${SHARD_OPTIONS} --input-file "${SHARD_OUTPUT}" \
+		--cache-size 100
+	$BITCOIN_TOOL ${SHARD_OPTIONS} --input-file "${SHARD_OUTPUT}" \
+		--cache-size 400 --stats 2>&1 >/dev/null \
+		| grep "cache hits" | cut -d, -f1-3
+)
+rm -f "${SHARD_OUTPUT}"
+check "${TEST}" "${OUTPUT}" "${EXPECTED_ALL}" || exit 1
+# -----------------------------------------------------------------------------
+TEST="index1 - --match-index outputs the addresses in a --build-index index"
+EXPECTED_ALL=$(echo "${EXPECTED}" | awk 'NR % 3 == 1')
+printf '%s\n' "${EXPECTED_ALL}" "${EXPECTED_ALL}" \
+| $BITCOIN_TOOL --build-index "${SHARD_OUTPUT}" --input-file - \
+	--log-level warning
+OUTPUT=$($BITCOIN_TOOL ${SHARD_OPTIONS} --match-index "${SHARD_OUTPUT}")
+rm -f "${SHARD_OUTPUT}" "${SHARD_OUTPUT}.lock"
+check "${TEST}" "${OUTPUT}" "${EXPECTED_ALL}" || exit 1
+# -----------------------------------------------------------------------------
+TEST="index2 - --update-index deltas are matched, before and after compaction"
+# addresses of keys 1 to 300, of which the test keys are the first 11
+ADDRESSES=$(for I in $(seq 1 300); do printf '%064x\n' "${I}"; done \
+	| $BITCOIN_TOOL ${SHARD_OPTIONS} --input-file -)
+EXPECTED_ALL=$(echo "${EXPECTED}" | awk 'NR == 4 || NR == 6 || NR >= 7 && NR != 8')
+echo "${ADDRESSES}" | awk 'NR >= 7' \
+| $BITCOIN_TOOL --build-index "${SHARD_OUTPUT}" --input-file - \
+	--log-level warning
+echo "${ADDRESSES}" | awk 'NR >= 4 && NR <= 6 { print "+" $0 }' \
+| $BITCOIN_TOOL --update-index "${SHARD_OUTPUT}" --input-file - \
+	--log-level warning
+echo "${ADDRESSES}" | awk 'NR == 5 || NR == 8 { print "-" $0 }' \
+| $BITCOIN_TOOL --update-index "${SHARD_OUTPUT}" --input-file - \
+	--log-level warning
+OUTPUT=$(
+	ls "${SHARD_OUTPUT}".delta.* | wc -l
+	$BITCOIN_TOOL ${SHARD_OPTIONS} --match-index "${SHARD_OUTPUT}"
+	$BITCOIN_TOOL --compact-index "${SHARD_OUTPUT}" --log-level warning
+	ls "${SHARD_OUTPUT}".delta.* 2>/dev/null | wc -l
+	$BITCOIN_TOOL ${SHARD_OPTIONS} --match-index "${SHARD_OUTPUT}"
+)
+rm -f "${SHARD_OUTPUT}" "${SHARD_OUTPUT}".*
+check "${TEST}" "$(echo ${OUTPUT})" "$(echo 2 ${EXPECTED_ALL} 0 ${EXPECTED_ALL})" || exit 1
+# -----------------------------------------------------------------------------
+TEST="index3 - a large --update-index compacts in the background"
+echo "${ADDRESSES}" | awk 'NR >= 100' \
+| $BITCOIN_TOOL --build-index "${SHARD_OUTPUT}" --input-file - \
+	--log-level warning
+OUTPUT=$(
+	echo "${ADDRESSES}" | awk 'NR < 100' \
+	| $BITCOIN_TOOL --update-index "${SHARD_OUTPUT}" --input-file - 2>&1 \
+	| grep -c "in the background"
+	# waits for the background compaction, then has nothing to do
+	$BITCOIN_TOOL --compact-index "${SHARD_OUTPUT}" --log-level warning
+	ls "${SHARD_OUTPUT}".delta.* 2>/dev/null | wc -l
+	$BITCOIN_TOOL ${SHARD_OPTIONS} --match-index "${SHARD_OUTPUT}"
+)
+rm -f "${SHARD_OUTPUT}" "${SHARD_OUTPUT}".*
+check "${TEST}" "$(echo ${OUTPUT})" "$(echo 1 0 ${EXPECTED})" || exit 1
+# -----------------------------------------------------------------------------
+TEST="set1 - --match-set outputs the addresses in a list, gzipped or not"
+EXPECTED_ALL=$(echo "${EXPECTED}" | awk 'NR % 3 == 1')
+printf '%s\n' "${EXPECTED_ALL}" "${EXPECTED_ALL}" > "${SHARD_OUTPUT}"
+OUTPUT=$(
+	$BITCOIN_TOOL ${SHARD_OPTIONS} --match-set "${SHARD_OUTPUT}"
+	gzip "${SHARD_OUTPUT}"
+	$BITCOIN_TOOL ${SHARD_OPTIONS} --threads 2 --match-set "${SHARD_OUTPUT}.gz"
+)
+rm -f "${SHARD_OUTPUT}.gz"
+check "${TEST}" "${OUTPUT}" "$(printf '%s\n' "${EXPECTED_ALL}" "${EXPECTED_ALL}")" || exit 1
+# -----------------------------------------------------------------------------
+TEST="huge1 - every --huge-pages mode gives the same output"
+EXPECTED_ALL=$(echo "${EXPECTED}" | awk 'NR % 2 == 1')
+echo "${EXPECTED_ALL}" > "${SHARD_OUTPUT}"
+OUTPUT=$(
+	for MODE in off transparent explicit; do
+		$BITCOIN_TOOL ${SHARD_OPTIONS} --huge-pages "${MODE}" \
+			--match-set "${SHARD_OUTPUT}"
+	done
+)
+rm -f "${SHARD_OUTPUT}"
+check "${TEST}" "${OUTPUT}" "$(printf '%s\n' "${EXPECTED_ALL}" "${EXPECTED_ALL}" "${EXPECTED_ALL}")" || exit 1
+# -----------------------------------------------------------------------------
+TEST="numa1 - every --numa mode gives the same output"
+EXPECTED_ALL=$(echo "${EXPECTED}" | awk 'NR % 2 == 0')
+echo "${EXPECTED_ALL}" > "${SHARD_OUTPUT}"
+OUTPUT=$(
+	for MODE in off pin replicate; do
+		$BITCOIN_TOOL ${SHARD_OPTIONS} --threads 2 --numa "${MODE}" \
+			--match-set "${SHARD_OUTPUT}"
+	done
+)
+rm -f "${SHARD_OUTPUT}"
+check "${TEST}" "${OUTPUT}" "$(printf '%s\n' "${EXPECTED_ALL}" "${EXPECTED_ALL}" "${EXPECTED_ALL}")" || exit 1
+# -----------------------------------------------------------------------------
+TEST="shard2 - --shard-output writes one file per thread"
+$BITCOIN_TOOL ${SHARD_OPTIONS} --threads 3 --shard-output "${SHARD_OUTPUT}"
+OUTPUT=$(cat "${SHARD_OUTPUT}.0" "${SHARD_OUTPUT}.1" "${SHARD_OUTPUT}.2")
+rm -f "${SHARD_INPUT}" "${SHARD_OUTPUT}".*
+check "${TEST}" "${OUTPUT}" "${EXPECTED}" || exit 1
+# -----------------------------------------------------------------------------
+TEST="cpu1 - fallback kernels when CPU features are disabled"
+EXPECTED="sha256: openssl hex: scalar base58: generic secp256k1: generic 1BgGZ9tcN4rm9KBzDn7KprQz87SZ26SAMH"
+OUTPUT=$(
+	export BITCOIN_TOOL_DISABLE_CPU_FEATURES=all
+	$BITCOIN_TOOL --cpu-features | grep -v "^features\|^disabled"
+	$BITCOIN_TOOL \
+		--input-type private-key-wif \
+		--input-format base58check \
+		--output-type address \
+		--output-format base58check \
+		--input KwDiBf89QgGbjEhKnhXJuH7LrciVrZi3qYjgd9M7rFU73sVHnoWn
+)
+OUTPUT=$(echo ${OUTPUT})
+check "${TEST}" "${OUTPUT}" "${EXPECTED}" || exit 1
+# -----------------------------------------------------------------------------
+TEST="secp1 - each secp256k1 kernel derives the same public keys as OpenSSL"
+EXPECTED="207 keys, 0 mismatches 207 keys, 0 mismatches 207 keys, 0 mismatches"
+OUTPUT=$(
+	for DISABLED in "" avx512ifma all;do
+		BITCOIN_TOOL_DISABLE_CPU_FEATURES="${DISABLED}" \
+			$BITCOIN_TOOL_BENCH --verify 200 | sed 's/^.*: //'
+	done
+)
+OUTPUT=$(echo ${OUTPUT})
+check "${TEST}" "${OUTPUT}" "${EXPECTED}" || exit 1
+# -----------------------------------------------------------------------------
+TEST="lib1 - batch API of the static library"
+EXPECTED="decode-address 0: success
+decode-address 1: checksum failure
+decode-address 2: invalid format
+decode-address 3: output buffer too small
+decode-address 4: checksum failure
+decode-address valid: 1
+decode-address-any 0: success
+decode-address-any 1: checksum failure
+decode-address-any 2: success
+decode-address-any 3: output buffer too small
+decode-address-any 4: checksum failure
+decode-address-any valid: 2
+encode-address 0: success 1BgGZ9tcN4rm9KBzDn7KprQz87SZ26SAMH
+encode-address 1: success mrCDrCybB6J1vRfbwM5hemdJz73FwDBC8r
+encode-address valid: 2
+encode-address-short 0: output buffer too small
+encode-address-short valid: 0
+decode-wif 0: success
+decode-wif 1: success
+decode-wif 2: success
+decode-wif 3: checksum failure
+decode-wif 4: invalid private key format
+decode-wif 5: output buffer too small
+decode-wif valid: 3
+decode-wif 0: bitcoin compressed
+decode-wif 1: bitcoin uncompressed
+decode-wif 2: bitcoin-testnet compressed
+encode-wif 0: success KwdMAjGmerYanjeui5SHS7JkmpZvVipYvB2LJGU1ZxJwYvP98617
+encode-wif 1: success 5HueCGU8rMjxEXxiPuD5BDku4MkFqeZyd4dZ1jvhTVqvbTLvyTJ
+encode-wif 2: success cMzLdeGd5vEqxB8B6VFQoRopQ3sLAAvEzDAoQgvX54xwofSWj1fx
+encode-wif 3: invalid private key format
+encode-wif valid: 3"
+OUTPUT=$($BATCHTEST)
+check "${TEST}" "${OUTPUT}" "${EXPECTED}" || exit 1
+# -----------------------------------------------------------------------------
+TEST="serve1 - --serve answers pipelined line requests in order"
+EXPECTED="1BgGZ9tcN4rm9KBzDn7KprQz87SZ26SAMH error: invalid format 1cMh228HTCiwS8ZsaakH8A8wze1JR5ZsP"
+SOCKET="${TMPDIR:-/tmp}/bitcoin-tool-test-$$.sock"
+$BITCOIN_TOOL \
+	--serve "${SOCKET}" \
+	--serve-threads 2 \
+	--log-level none \
+	--input-type private-key \
+	--input-format hex \
+	--output-type address \
+	--output-format base58check \
+	--public-key-compression compressed \
+	--network bitcoin &
+SERVER=$!
+for I in 1 2 3 4 5 6 7 8 9 10;do [ -S "${SOCKET}" ] && break; sleep 0.2; done
+OUTPUT=$(printf '%s\n' \
+	0000000000000000000000000000000000000000000000000000000000000001 \
+	not-hex \
+	0000000000000000000000000000000000000000000000000000000000000002 \
+	| $BITCOIN_TOOL_CLIENT --socket "${SOCKET}")
+OUTPUT=$(echo ${OUTPUT})
+kill ${SERVER}; wait ${SERVER}
+check "${TEST}" "${OUTPUT}" "${EXPECTED}" || exit 1
+# -----------------------------------------------------------------------------
+TEST="serve2 - --serve-protocol binary"
+EXPECTED="751e76e8199196d454941c45d1b3a323f1433bd6 error: invalid format"
+$BITCOIN_TOOL \
+	--serve "${SOCKET}" \
+	--serve-protocol binary \
+	--log-level none \
+	--input-type address \
+	--input-format base58check \
+	--output-type public-key-rmd \
+	--output-format hex &
+SERVER=$!
+for I in 1 2 3 4 5 6 7 8 9 10;do [ -S "${SOCKET}" ] && break; sleep 0.2; done
+OUTPUT=$(printf '%s\n' \
+	1BgGZ9tcN4rm9KBzDn7KprQz87SZ26SAMH \
+	1BgGZ9tcN4rm9KBzDn7KprQz87SZ26SAMx \
+	| $BITCOIN_TOOL_CLIENT --protocol binary --socket "${SOCKET}")
+OUTPUT=$(echo ${OUTPUT})
+kill ${SERVER}; wait ${SERVER}
+check "${TEST}" "${OUTPUT}" "${EXPECTED}" || exit 1
+# -----------------------------------------------------------------------------
+TEST="serve3 - a second server refuses a socket which is being served"
+EXPECTED="1 751e76e8199196d454941c45d1b3a323f1433bd6"
+$BITCOIN_TOOL \
+	--serve "${SOCKET}" \
+	--log-level none \
+	--input-type address \
+	--input-format base58check \
+	--output-type public-key-rmd \
+	--output-format hex &
+SERVER=$!
+for I in 1 2 3 4 5 6 7 8 9 10;do [ -S "${SOCKET}" ] && break; sleep 0.2; done
+$BITCOIN_TOOL \
+	--serve "${SOCKET}" \
+	--log-level none \
+	--input-type address \
+	--input-format base58check \
+	--output-type public-key-rmd \
+	--output-format hex
+OUTPUT="$? $(echo 1BgGZ9tcN4rm9KBzDn7KprQz87SZ26SAMH \
+	| $BITCOIN_TOOL_CLIENT --socket "${SOCKET}")"
+kill ${SERVER}; wait ${SERVER}
+check "${TEST}" "${OUTPUT}" "${EXPECTED}" || exit 1
+# -----------------------------------------------------------------------------
+
 
 
 
@@ -0,0 +1,2808 @@
+#define _POSIX_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <assert.h>
+
+#include "hash.h"
+#include "keys.h"
+#include "utility.h"
+#include "base58.h"
+#include "applog.h"
+#include "result.h"
+#include "prefix.h"
+#include "stats.h"
+#include "context.h"
+#include "records.h"
+#include "secp256k1.h"
+#include "cpu.h"
+#include "tool.h"
+
+static void BitcoinTool_ListInputTypes(FILE *output)
+{
+	static const char indent[] = "      ";
+	fprintf(output, "%smini-private-key : 30 character Casascius mini private key\n", indent);
+	fprintf(output, "%sprivate-key      : 32 byte ECDSA private key\n", indent);
+	fprintf(output, "%sprivate-key-wif  : 33/34 byte ECDSA WIF private key\n", indent);
+	fprintf(output, "%spublic-key       : 33/65 byte ECDSA public key\n", indent);
+	fprintf(output, "%spublic-key-sha   : 32 byte SHA256(public key) hash\n", indent);
+	fprintf(output, "%spublic-key-rmd   : 20 byte RIPEMD160(SHA256(public key)) hash\n", indent);
+	fprintf(output, "%saddress          : 21 byte Bitcoin address (prefix + hash)\n", indent);
+}
+
+static void BitcoinTool_ListOutputTypes(FILE *output)
+{
+	static const char indent[] = "      ";
+	fprintf(output, "%sall              : All output types, as type:value pairs, most of which\n", indent);
+	fprintf(output, "%s                   are never commonly used, probably for good reason.\n", indent);
+	BitcoinTool_ListInputTypes(output);
+}
+
+static void BitcoinTool_ListInputFormats(FILE *output)
+{
+	static const char indent[] = "      ";
+	fprintf(output, "%sraw         : Raw binary\n", indent);
+	fprintf(output, "%shex         : Hexadecimal encoded\n", indent);
+	fprintf(output, "%sbase58      : Base58 encoded\n", indent);
+	fprintf(output, "%sbase58check : Base58Check encoded (most common)\n", indent);
+}
+
+static void BitcoinTool_ListOutputFormats(FILE *output)
+{
+	BitcoinTool_ListInputFormats(output);
+}
+
+static void BitcoinTool_help(BitcoinTool *self)
+{
+	FILE *file = stderr;
+	fprintf(file,
+		"Usage: bitcoin-tool [option]...\n"
+		"Convert Bitcoin keys and addresses.\n"
+		"\n"
+	);
+	fprintf(file,
+		"  --input-type : Input data type, must be one of :\n"
+	);
+	BitcoinTool_ListInputTypes(file);
+
+	fprintf(file,
+		"  --input-format : Input data format, must be one of :\n"
+	);
+	BitcoinTool_ListInputFormats(file);
+
+	fprintf(file,
+		"  --output-type  : Output data type, must be one of :\n"
+	);
+	BitcoinTool_ListOutputTypes(file);
+
+	fprintf(file,
+		"  --output-format : Output data format, must be one of :\n"
+	);
+	BitcoinTool_ListOutputFormats(file);
+
+	fprintf(file,
+		"  --input               : Specify input data on command line\n"
+		"  --input-file          : Specify file name to read for input ('-' for stdin)\n"
+		"  --batch               : Read multiple lines of input from --input-file\n"
+		"  --ignore-input-errors : Continue processing batch input if errors are found.\n"
+		"  --stats               : Report the conversion pipeline selected, time spent\n"
+		"                          in each stage, record counts and records/second\n"
+		"                          to stderr when finished.\n"
+		"  --stats-interval <seconds> : Also report stats periodically.\n"
+		"  --threads <n>         : In batch mode, split --input-file into n parts at\n"
+		"                          line boundaries and convert them in parallel.\n"
+		"                          Output is in input order (default: 1).\n"
+		"  --shard-output <prefix> : In batch mode, write the output of each part to\n"
+		"                          <prefix>.0, <prefix>.1, ... instead.\n"
+		"  --io-engine <engine>  : How batch mode reads and writes, one of:\n"
+		"                          auto (default: uring if available, else thread),\n"
+		"                          uring (io_uring, reading ahead in large blocks),\n"
+		"                          thread (a reader and a writer thread), stdio\n"
+		"  --input-compression <format> : Compression of batch input, one of:\n"
+		"                          auto (default: detect gzip and zstd), none,\n"
+		"                          gzip, zstd\n"
+		"  --output-compression <format> : Compress batch output, one of: none\n"
+		"                          (default), gzip, zstd\n"
+		"  --compression-level <n> : Level for --output-compression (default: the\n"
+		"                          format's default, 6 for gzip, 3 for zstd).\n"
+		"  --cache-size <n>      : Keep the public keys, hashes and addresses derived\n"
+		"                          from the last n distinct keys (per thread), so\n"
+		"                          repeated inputs are not derived again (default\n"
+		"                          0, no cache).\n"
+		"  --build-index <file>  : Instead of converting, write an index of the hashes\n"
+		"                          of the addresses listed in --input-file, one per\n"
+		"                          line, with --threads threads (default: one per\n"
+		"                          CPU).\n"
+		"  --update-index <file> : Instead of converting, add the addresses listed in\n"
+		"                          --input-file to an index, or remove those on\n"
+		"                          lines starting with '-', as a delta file which\n"
+		"                          is merged into the index later, in the\n"
+		"                          background once the deltas hold an eighth as\n"
+		"                          many hashes as the index.\n"
+		"  --compact-index <file> : Instead of converting, merge the deltas of an\n"
+		"                          index into it.\n"
+	);
+	fprintf(file,
+		"  --index-memory <MiB>  : Memory for sorting --build-index and\n"
+		"                          --update-index hashes before spilling them to\n"
+		"                          temporary files (default %u).\n",
+		BITCOINTOOL_OPTION_DEFAULT_INDEX_MEMORY
+	);
+	fprintf(file,
+		"  --match-index <file>  : In batch mode, only output the records whose\n"
+		"                          address is in an index from --build-index.\n"
+		"  --match-set <file>    : In batch mode, only output the records whose\n"
+		"                          address is listed in a file, one per line, which\n"
+		"                          is loaded into memory.\n"
+		"  --huge-pages <mode>   : Back the secp256k1 tables, --match-set sets and\n"
+		"                          --match-index indexes with 2 MiB pages, one of:\n"
+		"                          transparent (default), explicit (from the\n"
+		"                          vm.nr_hugepages pool, falling back to\n"
+		"                          transparent), off\n"
+		"  --numa <mode>         : Place --threads and --serve-threads workers on\n"
+		"                          NUMA nodes, one of: off (default), pin (pin each\n"
+		"                          to a CPU, with its working memory on that CPU's\n"
+		"                          node), replicate (pin, and copy the secp256k1\n"
+		"                          tables and --match-set sets to each node)\n"
+		"  --log-level <level>   : Only output messages of this level or higher, one of:\n"
+		"                          debug, info, notice (default), warning, error,\n"
+		"                          fatal, none\n"
+		"  --log-repeat-limit <n> : Output each message at most n times (default\n"
+		"                          100, 0 for no limit) and report how many repeats\n"
+		"                          were suppressed when finished.\n"
+		"  --log-timestamps      : Prefix messages with the time and function name.\n"
+		"  --cpu-features        : Show the CPU features found and the hashing, hex,\n"
+		"                          Base58 and secp256k1 kernels selected for them,\n"
+		"                          then exit.\n"
+		"                          Set BITCOIN_TOOL_DISABLE_CPU_FEATURES to a list of\n"
+		"                          features (or \"all\") to stop kernels using them.\n"
+		"  --serve <socket>      : Listen on a Unix socket and convert each request\n"
+		"                          received, until interrupted.\n"
+		"  --serve-threads <n>   : Number of worker threads (default: one per CPU).\n"
+		"  --serve-protocol <protocol> : Can be one of :\n"
+		"      line   : each request is a line of input, each reply is a line of\n"
+		"               output, or \"error: <reason>\" (default)\n"
+		"      binary : each request is a 2 byte big-endian length then the input,\n"
+		"               each reply is a status byte (0 for success), a 2 byte\n"
+		"               big-endian length then the output or error reason\n"
+	);
+	fprintf(file,
+		"  --public-key-compression : Can be one of :\n"
+		"      auto         : determine compression from base58 private key (default)\n"
+		"      compressed   : force compressed public key\n"
+		"      uncompressed : force uncompressed public key\n"
+		"    (must be specified for raw/hex keys, should be auto for base58)\n"
+	);
+	fprintf(file,
+		"  --network        : Network type of keys, one of :\n"
+	);
+	Bitcoin_ListNetworks(file);
+
+	fprintf(file,
+		"  --fix-base58check : Attempt to fix a Base58Check string by changing\n"
+		"                      characters until the checksum matches.\n"
+	);
+	fprintf(file,
+		"  --fix-base58check-change-chars : Maximum number of characters to change\n"
+		"                                   (default=%u)\n",
+		BITCOINTOOL_OPTION_DEFAULT_BASE58CHECK_CHANGE_CHARS
+	);
+	fprintf(file,
+		"\n"
+	);
+	fprintf(file,
+		"Examples:\n"
+	);
+	fprintf(file,
+		"  Show address for specified WIF private key\n"
+		"    --input-type private-key-wif \\\n"
+		"    --input-format base58check \\\n"
+		"    --input 5J2YUwNA5hmZFW33nbUCp5TmvszYXxVYthqDv7axSisBjFJMqaT \\\n"
+		"    --output-type address \\\n"
+		"    --output-format base58check \n"
+		"\n"
+	);
+	fprintf(file,
+		"  Show everything that a raw private key can be converted to\n"
+		"    --input-type private-key \\\n"
+		"    --input-format raw \\\n"
+		"    --input-file <(openssl rand 32) \\\n"
+		"    --output-type all \\\n"
+		"    --public-key-compression compressed \\\n"
+		"    --network bitcoin\n"
+		"\n"
+	);
+}
+
+static int BitcoinTool_parseOptions(BitcoinTool *self
+	,int argc
+	,char *argv[]
+)
+{
+	unsigned i = 0;
+	int errors = 0;
+	BitcoinToolOptions *o = &self->options;
+
+	/* detect key compression where possible */
+	o->public_key_compression = PUBLIC_KEY_COMPRESSION_AUTO;
+
+	/* fail-safe network type - don't assume Bitcoin for raw keys */
+	o->network_type = NULL;
+
+	o->huge_pages = BITCOIN_HUGE_PAGES_TRANSPARENT;
+	o->numa = BITCOIN_NUMA_OFF;
+
+	for (i=1; i<argc; i++) {
+		const char *a = argv[i];
+		const char *v = NULL;
+
+		if (!strcmp(a, "--input-type")) {
+			if (++i >= argc) {
+				applog(APPLOG_ERROR, __func__, "Missing value for %s, must be one of:", a);
+				BitcoinTool_ListInputTypes(stderr);
+				errors++;
+				break;
+			}
+			v = argv[i];
+			if (!strcmp(v, "address")) {
+				o->input_type = INPUT_TYPE_ADDRESS;
+			} else if (!strcmp(v, "public-key-rmd")) {
+				o->input_type = INPUT_TYPE_PUBLIC_KEY_RIPEMD160;
+			} else if (!strcmp(v, "public-key-sha")) {
+				o->input_type = INPUT_TYPE_PUBLIC_KEY_SHA256;
+			} else if (!strcmp(v, "public-key")) {
+				o->input_type = INPUT_TYPE_PUBLIC_KEY;
+			} else if (!strcmp(v, "private-key-wif")) {
+				o->input_type = INPUT_TYPE_PRIVATE_KEY_WIF;
+			} else if (!strcmp(v, "private-key")) {
+				o->input_type = INPUT_TYPE_PRIVATE_KEY;
+			} else if (!strcmp(v, "mini-private-key")) {
+				o->input_type = INPUT_TYPE_MINI_PRIVATE_KEY;
+			} else {
+				applog(APPLOG_ERROR, __func__,
+					"Unknown value \"%s\" for --input-type, must be one of:", v
+				);
+				BitcoinTool_ListInputTypes(stderr);
+				errors++;
+				break;
+			}
+		} else if (!strcmp(a, "--output-type")) {
+			if (++i >= argc) {
+				applog(APPLOG_ERROR, __func__, "Missing value for %s, must be one of:", a);
+				BitcoinTool_ListOutputTypes(stderr);
+				errors++;
+				break;
+			}
+			v = argv[i];
+			if (!strcmp(v, "address")) {
+				o->output_type = OUTPUT_TYPE_ADDRESS;
+			} else if (!strcmp(v, "public-key-rmd")) {
+				o->output_type = OUTPUT_TYPE_PUBLIC_KEY_RIPEMD160;
+			} else if (!strcmp(v, "public-key-sha")) {
+				o->output_type = OUTPUT_TYPE_PUBLIC_KEY_SHA256;
+			} else if (!strcmp(v, "public-key")) {
+				o->output_type = OUTPUT_TYPE_PUBLIC_KEY;
+			} else if (!strcmp(v, "private-key-wif")) {
+				o->output_type = OUTPUT_TYPE_PRIVATE_KEY_WIF;
+			} else if (!strcmp(v, "private-key")) {
+				o->output_type = OUTPUT_TYPE_PRIVATE_KEY;
+			} else if (!strcmp(v, "all")) {
+				o->output_type = OUTPUT_TYPE_ALL;
+			} else {
+				applog(APPLOG_ERROR, __func__,
+					"Unknown value \"%s\" for --output-type", v
+				);
+				BitcoinTool_ListOutputTypes(stderr);
+				errors++;
+				break;
+			}
+		} else if (!strcmp(a, "--input-format")) {
+			if (++i >= argc) {
+				applog(APPLOG_ERROR, __func__, "Missing value for %s, must be one of:", a);
+				BitcoinTool_ListInputFormats(stderr);
+				errors++;
+				break;
+			}
+			v = argv[i];
+			if (!strcmp(v, "raw")) {
+				o->input_format = INPUT_FORMAT_RAW;
+			} else if (!strcmp(v, "hex")) {
+				o->input_format = INPUT_FORMAT_HEX;
+			} else if (!strcmp(v, "base58")) {
+				o->input_format = INPUT_FORMAT_BASE58;
+			} else if (!strcmp(v, "base58check")) {
+				o->input_format = INPUT_FORMAT_BASE58CHECK;
+			} else {
+				applog(APPLOG_ERROR, __func__,
+					"Unknown value \"%s\" for --input-format, must be one of:", v
+				);
+				BitcoinTool_ListInputFormats(stderr);
+				errors++;
+				break;
+			}
+		} else if (!strcmp(a, "--output-format")) {
+			if (++i >= argc) {
+				applog(APPLOG_ERROR, __func__, "Missing value for %s, must be one of:", a);
+				BitcoinTool_ListOutputFormats(stderr);
+				errors++;
+				break;
+			}
+			v = argv[i];
+			if (!strcmp(v, "raw")) {
+				o->output_format = OUTPUT_FORMAT_RAW;
+			} else if (!strcmp(v, "hex")) {
+				o->output_format = OUTPUT_FORMAT_HEX;
+			} else if (!strcmp(v, "base58")) {
+				o->output_format = OUTPUT_FORMAT_BASE58;
+			} else if (!strcmp(v, "base58check")) {
+				o->output_format = OUTPUT_FORMAT_BASE58CHECK;
+			} else {
+				applog(APPLOG_ERROR, __func__,
+					"Unknown value \"%s\" for --output-format, must be one of:", v
+				);
+				BitcoinTool_ListOutputFormats(stderr);
+				errors++;
+				break;
+			}
+		} else if (!strcmp(a, "--public-key-compression")) {
+			if (++i >= argc) {
+				applog(APPLOG_ERROR, __func__, "Missing value for %s.", a);
+				return 0;
+			}
+			v = argv[i];
+			if (!strcmp(v, "auto")) {
+				o->public_key_compression = PUBLIC_KEY_COMPRESSION_AUTO;
+			} else if (!strcmp(v, "compressed")) {
+				o->public_key_compression = PUBLIC_KEY_COMPRESSION_COMPRESSED;
+			} else if (!strcmp(v, "uncompressed")) {
+				o->public_key_compression = PUBLIC_KEY_COMPRESSION_UNCOMPRESSED;
+			} else {
+				applog(APPLOG_ERROR, __func__,
+					"unknown value \"%s\" for --public-key-compression", v
+				);
+				return 0;
+			}
+		} else if (!strcmp(a, "--input-file")) {
+			if (++i >= argc) {
+				applog(APPLOG_ERROR, __func__, "Missing value for %s", a);
+				return 0;
+			}
+			o->input_file = argv[i];
+		} else if (!strcmp(a, "--input")) {
+			if (++i >= argc) {
+				applog(APPLOG_ERROR, __func__, "Missing value for %s", a);
+				return 0;
+			}
+			o->input = argv[i];
+		} else if (
+			!strcmp(a, "--network")
+			|| !strcmp(a, "--private-key-prefix") /* deprecated */
+			|| !strcmp(a, "--public-key-prefix") /* deprecated */
+		) {
+			if (++i >= argc) {
+				applog(APPLOG_ERROR, __func__,
+					"Missing value for %s, must be one of:", a
+				);
+				Bitcoin_ListNetworks(stderr);
+				return 0;
+			}
+			if (o->network_type) {
+				applog(APPLOG_ERROR, __func__,
+					"--network specified multiple times, please use only once"
+				);
+				return 0;
+			}
+			v = argv[i];
+			o->network_type = Bitcoin_GetNetworkTypeByName(v);
+			if (o->network_type == NULL) {
+				applog(APPLOG_ERROR, __func__,
+					"Unknown network type \"%s\", must be one of:", v
+				);
+				Bitcoin_ListNetworks(stderr);
+				return 0;
+			}
+		} else if (!strcmp(a, "--fix-base58check")) {
+			o->fix_base58 = 1;
+			o->fix_base58_change_chars = BITCOINTOOL_OPTION_DEFAULT_BASE58CHECK_CHANGE_CHARS;
+			o->fix_base58_insert_chars = BITCOINTOOL_OPTION_DEFAULT_BASE58CHECK_INSERT_CHARS;
+			o->fix_base58_remove_chars = BITCOINTOOL_OPTION_DEFAULT_BASE58CHECK_REMOVE_CHARS;
+		} else if (!strcmp(a, "--fix-base58check-change-chars")) {
+			unsigned parsed_value = 0;
+			if (++i >= argc) {
+				applog(APPLOG_ERROR, __func__, "missing value for %s", a);
+				return 0;
+			}
+			v = argv[i];
+			if (sscanf(v, "%u", &parsed_value)) {
+				o->fix_base58_change_chars = parsed_value;
+			} else {
+				applog(APPLOG_ERROR, __func__,
+					"value for %s should be an unsigned integer", a
+				);
+				return 0;
+			}
+		} else if (!strcmp(a, "--batch")) {
+			o->batch = 1;
+		} else if (!strcmp(a, "--ignore-input-errors")) {
+			o->ignore_input_errors = 1;
+		} else if (!strcmp(a, "--stats")) {
+			o->stats = 1;
+		} else if (!strcmp(a, "--stats-interval")) {
+			unsigned parsed_value = 0;
+			if (++i >= argc) {
+				applog(APPLOG_ERROR, __func__, "missing value for %s", a);
+				return 0;
+			}
+			v = argv[i];
+			if (sscanf(v, "%u", &parsed_value) == 1) {
+				o->stats = 1;
+				o->stats_interval = parsed_value;
+			} else {
+				applog(APPLOG_ERROR, __func__,
+					"value for %s should be an unsigned integer", a
+				);
+				return 0;
+			}
+		} else if (!strcmp(a, "--threads")) {
+			unsigned parsed_value = 0;
+			if (++i >= argc) {
+				applog(APPLOG_ERROR, __func__, "missing value for %s", a);
+				return 0;
+			}
+			v = argv[i];
+			if (sscanf(v, "%u", &parsed_value) == 1 && parsed_value > 0) {
+				o->threads = parsed_value;
+			} else {
+				applog(APPLOG_ERROR, __func__,
+					"value for %s should be a positive integer", a
+				);
+				return 0;
+			}
+		} else if (!strcmp(a, "--shard-output")) {
+			if (++i >= argc) {
+				applog(APPLOG_ERROR, __func__, "missing value for %s", a);
+				return 0;
+			}
+			o->shard_output = argv[i];
+		} else if (!strcmp(a, "--io-engine")) {
+			if (++i >= argc) {
+				applog(APPLOG_ERROR, __func__, "missing value for %s", a);
+				return 0;
+			}
+			v = argv[i];
+			if (!BitcoinIO_ParseEngine(v, &o->io_engine)) {
+				applog(APPLOG_ERROR, __func__,
+					"value for %s should be one of: auto, uring, thread, stdio", a
+				);
+				return 0;
+			}
+		} else if (!strcmp(a, "--input-compression")
+			|| !strcmp(a, "--output-compression")
+		) {
+			const int input = !strcmp(a, "--input-compression");
+			enum BitcoinCompression compression;
+			if (++i >= argc) {
+				applog(APPLOG_ERROR, __func__, "missing value for %s", a);
+				return 0;
+			}
+			v = argv[i];
+			/* output has nothing to detect a format from */
+			if (!BitcoinCompress_Parse(v, &compression)
+				|| (!input && compression == BITCOIN_COMPRESSION_AUTO)
+			) {
+				applog(APPLOG_ERROR, __func__,
+					"value for %s should be one of: %snone, gzip, zstd", a,
+					input ? "auto, " : ""
+				);
+				return 0;
+			}
+			if (!BitcoinCompress_IsAvailable(compression)) {
+				applog(APPLOG_ERROR, __func__,
+					"%s compression is not available in this build.", v
+				);
+				return 0;
+			}
+			if (input) {
+				o->input_compression = compression;
+			} else {
+				o->output_compression = compression;
+			}
+		} else if (!strcmp(a, "--compression-level")) {
+			int parsed_value = 0;
+			if (++i >= argc) {
+				applog(APPLOG_ERROR, __func__, "missing value for %s", a);
+				return 0;
+			}
+			v = argv[i];
+			if (sscanf(v, "%d", &parsed_value) == 1) {
+				o->compression_level = parsed_value;
+			} else {
+				applog(APPLOG_ERROR, __func__,
+					"value for %s should be an integer", a
+				);
+				return 0;
+			}
+		} else if (!strcmp(a, "--log-level")) {
+			enum ApplogLevel level;
+			if (++i >= argc) {
+				applog(APPLOG_ERROR, __func__, "missing value for %s", a);
+				return 0;
+			}
+			v = argv[i];
+			if (!applog_parse_level(v, &level)) {
+				applog(APPLOG_ERROR, __func__,
+					"Unknown log level \"%s\", must be one of: debug, info,"
+					" notice, warning, error, fatal, none", v
+				);
+				return 0;
+			}
+			applog_set_level(level);
+		} else if (!strcmp(a, "--log-repeat-limit")) {
+			unsigned parsed_value = 0;
+			if (++i >= argc) {
+				applog(APPLOG_ERROR, __func__, "missing value for %s", a);
+				return 0;
+			}
+			v = argv[i];
+			if (sscanf(v, "%u", &parsed_value) == 1) {
+				applog_set_repeat_limit(parsed_value);
+			} else {
+				applog(APPLOG_ERROR, __func__,
+					"value for %s should be an unsigned integer", a
+				);
+				return 0;
+			}
+		} else if (!strcmp(a, "--log-timestamps")) {
+			applog_set_timestamps(1);
+		} else if (!strcmp(a, "--serve")) {
+			if (++i >= argc) {
+				applog(APPLOG_ERROR, __func__, "missing value for %s", a);
+				return 0;
+			}
+			o->serve_socket = argv[i];
+		} else if (!strcmp(a, "--cache-size")) {
+			unsigned parsed_value = 0;
+			if (++i >= argc) {
+				applog(APPLOG_ERROR, __func__, "missing value for %s", a);
+				return 0;
+			}
+			v = argv[i];
+			if (sscanf(v, "%u", &parsed_value) == 1
+				&& parsed_value <= BITCOIN_CACHE_MAX_ENTRIES
+			) {
+				o->cache_size = parsed_value;
+			} else {
+				applog(APPLOG_ERROR, __func__,
+					"value for %s should be an integer from 0 to %u", a,
+					(unsigned)BITCOIN_CACHE_MAX_ENTRIES
+				);
+				return 0;
+			}
+		} else if (!strcmp(a, "--build-index")) {
+			if (++i >= argc) {
+				applog(APPLOG_ERROR, __func__, "missing value for %s", a);
+				return 0;
+			}
+			o->build_index = argv[i];
+		} else if (!strcmp(a, "--update-index")) {
+			if (++i >= argc) {
+				applog(APPLOG_ERROR, __func__, "missing value for %s", a);
+				return 0;
+			}
+			o->update_index = argv[i];
+		} else if (!strcmp(a, "--compact-index")) {
+			if (++i >= argc) {
+				applog(APPLOG_ERROR, __func__, "missing value for %s", a);
+				return 0;
+			}
+			o->compact_index = argv[i];
+		} else if (!strcmp(a, "--index-memory")) {
+			unsigned parsed_value = 0;
+			if (++i >= argc) {
+				applog(APPLOG_ERROR, __func__, "missing value for %s", a);
+				return 0;
+			}
+			v = argv[i];
+			if (sscanf(v, "%u", &parsed_value) == 1 && parsed_value > 0) {
+				o->index_memory = parsed_value;
+			} else {
+				applog(APPLOG_ERROR, __func__,
+					"value for %s should be a positive integer", a
+				);
+				return 0;
+			}
+		} else if (!strcmp(a, "--match-index")) {
+			if (++i >= argc) {
+				applog(APPLOG_ERROR, __func__, "missing value for %s", a);
+				return 0;
+			}
+			o->match_index = argv[i];
+		} else if (!strcmp(a, "--match-set")) {
+			if (++i >= argc) {
+				applog(APPLOG_ERROR, __func__, "missing value for %s", a);
+				return 0;
+			}
+			o->match_set = argv[i];
+		} else if (!strcmp(a, "--huge-pages")) {
+			if (++i >= argc) {
+				applog(APPLOG_ERROR, __func__, "missing value for %s", a);
+				return 0;
+			}
+			v = argv[i];
+			if (!BitcoinHugePage_ParseMode(v, &o->huge_pages)) {
+				applog(APPLOG_ERROR, __func__,
+					"value for %s should be one of: off, transparent, explicit", a
+				);
+				return 0;
+			}
+		} else if (!strcmp(a, "--numa")) {
+			if (++i >= argc) {
+				applog(APPLOG_ERROR, __func__, "missing value for %s", a);
+				return 0;
+			}
+			v = argv[i];
+			if (!BitcoinNUMA_ParseMode(v, &o->numa)) {
+				applog(APPLOG_ERROR, __func__,
+					"value for %s should be one of: off, pin, replicate", a
+				);
+				return 0;
+			}
+		} else if (!strcmp(a, "--serve-threads")) {
+			unsigned parsed_value = 0;
+			if (++i >= argc) {
+				applog(APPLOG_ERROR, __func__, "missing value for %s", a);
+				return 0;
+			}
+			v = argv[i];
+			if (sscanf(v, "%u", &parsed_value) == 1 && parsed_value > 0) {
+				o->serve_threads = parsed_value;
+			} else {
+				applog(APPLOG_ERROR, __func__,
+					"value for %s should be a positive integer", a
+				);
+				return 0;
+			}
+		} else if (!strcmp(a, "--serve-protocol")) {
+			if (++i >= argc) {
+				applog(APPLOG_ERROR, __func__, "missing value for %s", a);
+				return 0;
+			}
+			v = argv[i];
+			if (!strcmp(v, "line")) {
+				o->serve_protocol = SERVE_PROTOCOL_LINE;
+			} else if (!strcmp(v, "binary")) {
+				o->serve_protocol = SERVE_PROTOCOL_BINARY;
+			} else {
+				applog(APPLOG_ERROR, __func__,
+					"Unknown serve protocol \"%s\", must be one of: line, binary", v
+				);
+				return 0;
+			}
+		} else if (!strcmp(a, "--cpu-features")) {
+			o->cpu_features = 1;
+		} else if (!strcmp(a, "--help")) {
+			BitcoinTool_help(self);
+			return 0;
+		} else {
+			applog(APPLOG_ERROR, __func__, "unknown option \"%s\"", a);
+			return 0;
+		}
+	}
+
+	/* nothing is converted, so no other options are needed */
+	if (o->cpu_features) {
+		return 1;
+	}
+
+	/* only addresses are read, and only an index is written */
+	if ((o->build_index != NULL) + (o->update_index != NULL)
+		+ (o->compact_index != NULL) > 1
+	) {
+		applog(APPLOG_ERROR, __func__,
+			"Only one of --build-index, --update-index and --compact-index can"
+			" be specified."
+		);
+		applog(APPLOG_ERROR, __func__, "Use --help for more information.");
+		return 0;
+	}
+	if (o->build_index || o->update_index) {
+		if (!o->input_file || o->input) {
+			applog(APPLOG_ERROR, __func__,
+				"%s reads addresses from --input-file (or '-' for stdin), and"
+				" not from --input.",
+				o->build_index ? "--build-index" : "--update-index"
+			);
+			applog(APPLOG_ERROR, __func__, "Use --help for more information.");
+			return 0;
+		}
+		return 1;
+	}
+	if (o->compact_index) {
+		return 1;
+	}
+
+	if (o->match_index || o->match_set) {
+		const char *option = o->match_index ? "--match-index" : "--match-set";
+
+		if (o->match_index && o->match_set) {
+			applog(APPLOG_ERROR, __func__,
+				"Only one of --match-index and --match-set can be specified."
+			);
+			errors++;
+		}
+		if (!o->batch || o->serve_socket) {
+			applog(APPLOG_ERROR, __func__,
+				"%s filters the output of --batch mode, please also specify"
+				" --batch.", option
+			);
+			errors++;
+		}
+		switch (o->output_type) {
+			case OUTPUT_TYPE_ALL :
+			case OUTPUT_TYPE_ADDRESS :
+			case OUTPUT_TYPE_PUBLIC_KEY_RIPEMD160 :
+				break;
+			default :
+				applog(APPLOG_ERROR, __func__,
+					"%s matches addresses, please use --output-type address,"
+					" public-key-rmd or all.", option
+				);
+				errors++;
+				break;
+		}
+	}
+
+	if (o->serve_socket) {
+		if (o->batch || o->input || o->input_file) {
+			applog(APPLOG_ERROR, __func__,
+				"--serve reads input from its socket, --batch, --input and"
+				" --input-file should not be specified."
+			);
+			errors++;
+		}
+		if (o->output_type == OUTPUT_TYPE_ALL) {
+			applog(APPLOG_ERROR, __func__,
+				"--output-type all is not supported with --serve, since each"
+				" request must have exactly one reply."
+			);
+			errors++;
+		}
+		if (o->serve_protocol == SERVE_PROTOCOL_LINE
+			&& o->output_format == OUTPUT_FORMAT_RAW
+		) {
+			applog(APPLOG_ERROR, __func__,
+				"--output-format raw needs --serve-protocol binary, since raw"
+				" output can contain newlines."
+			);
+			errors++;
+		}
+	} else if (o->batch) {
+		if (o->input) {
+			applog(APPLOG_ERROR, __func__,
+				"--batch and --input should not be specified at the same time."
+				" In batch mode, use --input-file to specify the name of the"
+				" file (or '-' or stdin) to read lines of input from."
+			);
+			errors++;
+		}
+		if (!o->input_file) {
+			applog(APPLOG_ERROR, __func__,
+				"If --batch is specified then --input-file must be used to"
+				" specify the name of the file (or '-' or stdin) to read lines"
+				" of input from."
+			);
+			errors++;
+		}
+	} else {
+		if (o->threads > 1 || o->shard_output) {
+			applog(APPLOG_ERROR, __func__,
+				"--threads and --shard-output split the input of --batch mode,"
+				" please also specify --batch."
+			);
+			errors++;
+		}
+		if (o->output_compression == BITCOIN_COMPRESSION_GZIP
+			|| o->output_compression == BITCOIN_COMPRESSION_ZSTD
+		) {
+			applog(APPLOG_ERROR, __func__,
+				"--output-compression compresses the output of --batch mode,"
+				" please also specify --batch."
+			);
+			errors++;
+		}
+		if (!o->input && !o->input_file) {
+			applog(APPLOG_ERROR, __func__,
+				"Either --input <text> or --input-file <filename>"
+				" must be specified.");
+			errors++;
+		}
+	}
+
+	if (!o->input_type) {
+		applog(APPLOG_ERROR, __func__, "--input-type must be specified.");
+		errors++;
+	}
+
+	if (!o->input_format) {
+		applog(APPLOG_ERROR, __func__, "--input-format must be specified.");
+		errors++;
+	}
+
+	if (!o->output_type) {
+		applog(APPLOG_ERROR, __func__, "--output-type must be specified.");
+		errors++;
+	}
+
+	if (
+		INPUT_FORMAT_BASE58CHECK == o->input_format
+		&& (
+			PUBLIC_KEY_COMPRESSION_COMPRESSED == o->public_key_compression
+			|| PUBLIC_KEY_COMPRESSION_UNCOMPRESSED == o->public_key_compression
+		)
+	) {
+		applog(APPLOG_WARNING, __func__,
+			"using --input-format base58check with --public-key-compression"
+			" other than auto to override the WIF compression type is very"
+			" unusual, please be sure what you are doing!");
+	}
+
+	if (errors) {
+		applog(APPLOG_ERROR, __func__, "Use --help for more information.");
+		return 0;
+	}
+
+	return argc > 1;
+}
+
+static __inline__ __attribute__((always_inline)) BitcoinResult BitcoinTool_convertRecord(
+	BitcoinTool *self, size_t i,
+	enum InputType input_type, enum OutputType output_type
+)
+{
+	/* Convert from the input type to the output type.
+	   Depending on the options selected, this may need multiple conversions
+	   for example :
+
+	    private key -> public key -> sha256 -> ripemd160 -> address -> base58
+
+	   The conversion may be impossible, for example asking to output the
+	   private key, using the public key as input.  We can detect this and
+	   return an error.
+	*/
+	struct BitcoinRecords *records = &self->records;
+	BitcoinResult result;
+
+	switch (input_type) {
+		case INPUT_TYPE_MINI_PRIVATE_KEY :
+			switch (output_type) {
+				case OUTPUT_TYPE_ALL :
+				case OUTPUT_TYPE_ADDRESS :
+				case OUTPUT_TYPE_PUBLIC_KEY_RIPEMD160 :
+				case OUTPUT_TYPE_PUBLIC_KEY_SHA256 :
+				case OUTPUT_TYPE_PUBLIC_KEY :
+				case OUTPUT_TYPE_PRIVATE_KEY_WIF :
+					records->flags[i] |= BITCOIN_RECORD_MINI_PRIVATE_KEY;
+					break;
+				default :
+					break;
+			}
+		case INPUT_TYPE_PRIVATE_KEY :
+			switch (output_type) {
+				case OUTPUT_TYPE_ALL :
+				case OUTPUT_TYPE_ADDRESS :
+				case OUTPUT_TYPE_PUBLIC_KEY_RIPEMD160 :
+				case OUTPUT_TYPE_PUBLIC_KEY_SHA256 :
+				case OUTPUT_TYPE_PUBLIC_KEY :
+				case OUTPUT_TYPE_PRIVATE_KEY_WIF :
+					records->flags[i] |= BITCOIN_RECORD_PRIVATE_KEY_WIF;
+					break;
+				case OUTPUT_TYPE_PRIVATE_KEY :
+					return BITCOIN_SUCCESS;
+					break;
+				default :
+					break;
+			}
+		case INPUT_TYPE_PRIVATE_KEY_WIF :
+			switch (output_type) {
+				case OUTPUT_TYPE_ALL :
+				case OUTPUT_TYPE_ADDRESS :
+				case OUTPUT_TYPE_PUBLIC_KEY_RIPEMD160 :
+				case OUTPUT_TYPE_PUBLIC_KEY_SHA256 :
+				case OUTPUT_TYPE_PUBLIC_KEY :
+				case OUTPUT_TYPE_PRIVATE_KEY :
+					records->flags[i] |= BITCOIN_RECORD_PRIVATE_KEY;
+					break;
+				case OUTPUT_TYPE_PRIVATE_KEY_WIF :
+					return BITCOIN_SUCCESS;
+					break;
+				default :
+					break;
+			}
+			switch (output_type) {
+				case OUTPUT_TYPE_ALL :
+				case OUTPUT_TYPE_ADDRESS :
+				case OUTPUT_TYPE_PUBLIC_KEY_RIPEMD160 :
+				case OUTPUT_TYPE_PUBLIC_KEY_SHA256 :
+				case OUTPUT_TYPE_PUBLIC_KEY : {
+					/* usually already derived for the whole batch, by
+					   BitcoinTool_makePublicKeys() */
+					if (records->flags[i] & BITCOIN_RECORD_PUBLIC_KEY) {
+						break;
+					}
+
+					if (records->private_keys[i].network_type == NULL) {
+						applog(APPLOG_ERROR, __func__,
+							"Network type is not specified, please set using"
+							" --network option"
+						);
+						return BITCOIN_ERROR_PRIVATE_KEY_INVALID_FORMAT;
+					}
+
+					result = BitcoinContext_MakePublicKey(self->context,
+						&records->public_keys[i], &records->private_keys[i]
+					);
+					if (result != BITCOIN_SUCCESS) {
+						return result;
+					}
+					records->flags[i] |= BITCOIN_RECORD_PUBLIC_KEY;
+					break;
+				}
+				case OUTPUT_TYPE_PRIVATE_KEY_WIF :
+				case OUTPUT_TYPE_PRIVATE_KEY :
+					return BITCOIN_SUCCESS;
+					break;
+				default :
+					break;
+			}
+		case INPUT_TYPE_PUBLIC_KEY :
+			switch (output_type) {
+				case OUTPUT_TYPE_ALL :
+				case OUTPUT_TYPE_ADDRESS :
+				case OUTPUT_TYPE_PUBLIC_KEY_RIPEMD160 :
+				case OUTPUT_TYPE_PUBLIC_KEY_SHA256 :
+					/* unless it came from the cache */
+					if (records->flags[i] & BITCOIN_RECORD_PUBLIC_KEY_SHA256) {
+						break;
+					}
+					Bitcoin_MakeSHA256FromPublicKey(&records->public_key_sha256[i], &records->public_keys[i]);
+					records->flags[i] |= BITCOIN_RECORD_PUBLIC_KEY_SHA256;
+					break;
+				case OUTPUT_TYPE_PUBLIC_KEY :
+					return BITCOIN_SUCCESS;
+					break;
+				case OUTPUT_TYPE_PRIVATE_KEY_WIF :
+				case OUTPUT_TYPE_PRIVATE_KEY :
+					applog(APPLOG_ERROR, __func__, "impossible conversion");
+					return BITCOIN_ERROR_IMPOSSIBLE_CONVERSION;
+					break;
+				default :
+					break;
+			}
+		case INPUT_TYPE_PUBLIC_KEY_SHA256 :
+			switch (output_type) {
+				case OUTPUT_TYPE_ALL :
+				case OUTPUT_TYPE_ADDRESS :
+				case OUTPUT_TYPE_PUBLIC_KEY_RIPEMD160 :
+					if (records->flags[i] & BITCOIN_RECORD_PUBLIC_KEY_RIPEMD160) {
+						break;
+					}
+					Bitcoin_MakeRIPEMD160FromSHA256(&records->public_key_ripemd160[i], &records->public_key_sha256[i]);
+					records->flags[i] |= BITCOIN_RECORD_PUBLIC_KEY_RIPEMD160;
+					break;
+				case OUTPUT_TYPE_PUBLIC_KEY_SHA256 :
+					return BITCOIN_SUCCESS;
+					break;
+				case OUTPUT_TYPE_PUBLIC_KEY :
+				case OUTPUT_TYPE_PRIVATE_KEY_WIF :
+				case OUTPUT_TYPE_PRIVATE_KEY :
+					applog(APPLOG_ERROR, __func__, "impossible conversion");
+					return BITCOIN_ERROR_IMPOSSIBLE_CONVERSION;
+					break;
+				default :
+					break;
+			}
+		case INPUT_TYPE_PUBLIC_KEY_RIPEMD160 :
+			switch (output_type) {
+				case OUTPUT_TYPE_ALL :
+				case OUTPUT_TYPE_ADDRESS : {
+					/* check if user has asked to override public key prefix */
+					if (self->options.network_type) {
+						records->public_keys[i].network_type = self->options.network_type;
+					}
+
+					/* refuse to generate an address with no prefix set */
+					if (!records->public_keys[i].network_type) {
+						applog(APPLOG_ERROR, __func__,
+							"Raw public key has no network prefix and it is unsafe"
+							" to assume one.  Please explicitally specify prefix using"
+							" --network option."
+						);
+						return BITCOIN_ERROR_IMPOSSIBLE_CONVERSION;
+					}
+
+					if (records->flags[i] & BITCOIN_RECORD_ADDRESS) {
+						break;
+					}
+
+					Bitcoin_MakeAddressFromRIPEMD160(&records->addresses[i],
+						&records->public_key_ripemd160[i],
+						records->public_keys[i].network_type
+					);
+
+					records->flags[i] |= BITCOIN_RECORD_ADDRESS;
+					break;
+				}
+				case OUTPUT_TYPE_PUBLIC_KEY_RIPEMD160 :
+					return BITCOIN_SUCCESS;
+					break;
+				case OUTPUT_TYPE_PUBLIC_KEY_SHA256 :
+				case OUTPUT_TYPE_PUBLIC_KEY :
+				case OUTPUT_TYPE_PRIVATE_KEY_WIF :
+				case OUTPUT_TYPE_PRIVATE_KEY :
+					applog(APPLOG_ERROR, __func__, "impossible conversion");
+					return BITCOIN_ERROR_IMPOSSIBLE_CONVERSION;
+					break;
+				default :
+					break;
+			}
+		case INPUT_TYPE_ADDRESS :
+			switch (output_type) {
+				case OUTPUT_TYPE_ALL :
+				case OUTPUT_TYPE_ADDRESS :
+					return BITCOIN_SUCCESS;
+					break;
+				case OUTPUT_TYPE_PUBLIC_KEY_RIPEMD160 :
+					Bitcoin_MakeRIPEMD160FromAddress(&records->public_key_ripemd160[i], &records->addresses[i]);
+					records->flags[i] |= BITCOIN_RECORD_PUBLIC_KEY_RIPEMD160;
+					return BITCOIN_SUCCESS;
+					break;
+				case OUTPUT_TYPE_PUBLIC_KEY_SHA256 :
+				case OUTPUT_TYPE_PUBLIC_KEY :
+				case OUTPUT_TYPE_PRIVATE_KEY_WIF :
+				case OUTPUT_TYPE_PRIVATE_KEY :
+					applog(APPLOG_ERROR, __func__, "impossible conversion");
+					return BITCOIN_ERROR_IMPOSSIBLE_CONVERSION;
+					break;
+				default :
+					break;
+			}
+		default :
+			break;
+	}
+
+	return BITCOIN_SUCCESS;
+}
+
+BitcoinResult Bitcoin_ConvertInputToOutput(struct BitcoinTool *self, size_t i)
+{
+	return BitcoinTool_convertRecord(self, i,
+		self->options.input_type, self->options.output_type
+	);
+}
+
+/* The public key compression of private keys read from input, before any
+   WIF compression flag is read */
+static enum BitcoinPublicKeyCompression BitcoinTool_defaultCompression(
+	const BitcoinTool *self
+)
+{
+	/* has user asked to override public key compression? */
+	switch (self->options.public_key_compression) {
+		/* user wants compressed public key */
+		case PUBLIC_KEY_COMPRESSION_COMPRESSED :
+			return BITCOIN_PUBLIC_KEY_COMPRESSED;
+		/* user wants uncompressed public key */
+		case PUBLIC_KEY_COMPRESSION_UNCOMPRESSED :
+			return BITCOIN_PUBLIC_KEY_UNCOMPRESSED;
+		/* use the compression specified in the private key */
+		case PUBLIC_KEY_COMPRESSION_AUTO :
+		default :
+			return BITCOIN_PUBLIC_KEY_EMPTY;
+	}
+}
+
+/* The number of bytes fgets() read into a line buffer of size chars, which
+   was filled with '\n' first.  That is up to the last NUL, rather than the
+   first which strlen() finds, since a line may hold NULs of its own. */
+static size_t Bitcoin_lineBytesRead(const char *line, size_t size)
+{
+	while (size > 0 && line[size - 1] != '\0') {
+		size--;
+	}
+	return size > 0 ? size - 1 : 0;
+}
+
+/* Read the next batch of input into a new batch of records: the next lines
+   of a file in batch mode, or one record from the command line or a file */
+static BitcoinResult Bitcoin_ReadInput(struct BitcoinTool *self)
+{
+	struct BitcoinRecords *records = &self->records;
+	size_t i = 0;
+
+	if (self->options.batch) {
+		/* in batch mode we open the file only once and read as much as
+		   we can out of it, splitting it into line-delimited text
+		   (for variable-sized input), or fixed sized fields, when we know
+		   the field size. */
+
+		if (!self->input_file_handle) {
+			self->input_file_handle = BitcoinIO_OpenInput(
+				self->options.input_file, 0, self->io_engine,
+				self->options.input_compression
+			);
+		}
+
+		if (!self->input_file_handle) {
+			applog(APPLOG_ERROR, __func__, "Failed to open file [%s] (%s)",
+				self->options.input_file,
+				strerror(errno)
+			);
+			return BITCOIN_ERROR_FILE;
+		}
+
+		if (feof(self->input_file_handle)) {
+			return BITCOIN_ERROR_END_OF_FILE;
+		}
+
+		BitcoinRecords_Reset(records, records->capacity,
+			BitcoinTool_defaultCompression(self)
+		);
+
+		for (i = 0; i < records->capacity; i++) {
+			if (self->input_ranged) {
+				if (self->input_offset >= self->input_end) {
+					break;
+				}
+				/* so that the bytes read can be told from the rest of the
+				   buffer, see Bitcoin_lineBytesRead() */
+				memset(records->input[i], '\n', sizeof(records->input[i]));
+			}
+			if (!fgets(records->input[i], sizeof(records->input[i]) - 1,
+				self->input_file_handle)
+			) {
+				if (feof(self->input_file_handle)) {
+					break;
+				}
+				applog(APPLOG_ERROR, __func__, "Failed to read file [%s] (%s)",
+					self->options.input_file,
+					strerror(errno)
+				);
+				return BITCOIN_ERROR_FILE;
+			}
+
+			records->input_size[i] = strlen(records->input[i]);
+			if (self->input_ranged) {
+				self->input_offset += Bitcoin_lineBytesRead(records->input[i],
+					sizeof(records->input[i]) - 1
+				);
+			}
+			if (records->input_size[i] > 0) {
+				/* remove newline character */
+				if (records->input[i][records->input_size[i] - 1] == '\n') {
+					records->input[i][records->input_size[i] - 1] = '\0';
+					records->input_size[i]--;
+				}
+			}
+		}
+
+		/* the records after the end of the file stay empty */
+		records->count = records->limit = i;
+		if (i == 0) {
+			return BITCOIN_ERROR_END_OF_FILE;
+		}
+
+	} else {
+		BitcoinRecords_Reset(records, 1, BitcoinTool_defaultCompression(self));
+
+		/* get input data _once_ from file or from command line option */
+		if (self->options.input_file) {
+			FILE *file = NULL;
+			int bytes_read = 0;
+
+			if (strcmp(self->options.input_file, "-") == 0) {
+				file = stdin;
+			} else {
+				file = fopen(self->options.input_file, "rb");
+				if (!file) {
+					applog(APPLOG_ERROR, __func__, "Failed to open file [%s] (%s)",
+						self->options.input_file,
+						strerror(errno)
+					);
+					return BITCOIN_ERROR_FILE;
+				}
+			}
+
+			/* allow space for NUL char, so we can use it as a string later */
+			bytes_read = fread(records->input[i], 1, sizeof(records->input[i]) - 1, file);
+			if (bytes_read <= 0) {
+				applog(APPLOG_ERROR, __func__, "Failed to read file [%s] (%s)",
+					self->options.input_file,
+					strerror(errno)
+				);
+				fclose(file);
+				return BITCOIN_ERROR_FILE;
+			}
+
+			fclose(file);
+
+			records->input_size[i] = bytes_read;
+		} else if (self->options.input) {
+			records->input_size[i] = strlen(self->options.input);
+			if (records->input_size[i] >= sizeof(records->input[i])) {
+				applog(APPLOG_ERROR, __func__,
+					"--input value too large for internal buffer or any expected type"
+				);
+				return BITCOIN_ERROR;
+			}
+			strncpy(records->input[i], self->options.input, records->input_size[i]);
+		}
+	}
+
+	return BITCOIN_SUCCESS;
+}
+
+static __inline__ __attribute__((always_inline)) BitcoinResult BitcoinTool_decodeRecord(
+	BitcoinTool *self, size_t i, enum InputFormat input_format
+)
+{
+	struct BitcoinRecords *records = &self->records;
+
+	records->output_text_size[i] = sizeof(records->output_text[i]);
+
+	/* check if we have any input we can work with */
+	if (records->input_size[i] == 0) {
+		applog(APPLOG_ERROR, __func__,
+			"No input data specified, use --input or --input-file to specify"
+			" input data."
+		);
+		return BITCOIN_ERROR;
+	}
+
+	/* convert input format to raw data */
+	switch (input_format) {
+		case INPUT_FORMAT_RAW : {
+			/* no translation required, just copy */
+			memcpy(records->input_raw[i], records->input[i], records->input_size[i]);
+			records->input_raw_size[i] = records->input_size[i];
+			break;
+		}
+		case INPUT_FORMAT_HEX : {
+			BitcoinResult result = Bitcoin_DecodeHex(
+				records->input_raw[i], sizeof(records->input_raw[i]), &records->input_raw_size[i],
+				records->input[i], records->input_size[i]
+			);
+			if (result != BITCOIN_SUCCESS) {
+				applog(APPLOG_ERROR, __func__,
+					"Failed to decode hex input (%s).",
+					Bitcoin_ResultString(result)
+				);
+				return BITCOIN_ERROR_INVALID_FORMAT;
+			}
+			break;
+		}
+		case INPUT_FORMAT_BASE58 : {
+			BitcoinResult result = Bitcoin_DecodeBase58(
+				records->input_raw[i], sizeof(records->input_raw[i]), &records->input_raw_size[i],
+				records->input[i], records->input_size[i]
+			);
+			if (result != BITCOIN_SUCCESS) {
+				applog(APPLOG_ERROR, __func__,
+					"Failed to decode Base58 input (%s).",
+					Bitcoin_ResultString(result)
+				);
+				return BITCOIN_ERROR_INVALID_FORMAT;
+			}
+			break;
+		}
+		case INPUT_FORMAT_BASE58CHECK : {
+			BitcoinResult result = Bitcoin_DecodeBase58Check(
+				records->input_raw[i], sizeof(records->input_raw[i]), &records->input_raw_size[i],
+				records->input[i], records->input_size[i]
+			);
+			if (result != BITCOIN_SUCCESS) {
+				applog(APPLOG_ERROR, __func__,
+					"Failed to decode Base58Check input (%s).",
+					Bitcoin_ResultString(result)
+				);
+
+				if (self->options.fix_base58) {
+					size_t output_base58_buffer_size = records->input_size[i] + 1;
+					char *output_base58 = calloc(1, output_base58_buffer_size);
+					size_t output_base58_size = 0;
+					int result;
+
+					result = Bitcoin_FixBase58Check(
+						output_base58, output_base58_buffer_size, &output_base58_size,
+						records->input_raw[i], sizeof(records->input_raw[i]), &records->input_raw_size[i],
+						records->input[i], records->input_size[i],
+						self->options.fix_base58_change_chars,
+						self->options.fix_base58_insert_chars,
+						self->options.fix_base58_remove_chars
+					);
+
+					free(output_base58);
+
+					return result;
+				} else {
+					applog(APPLOG_ERROR, __func__,
+						"You can use the --fix-base58check option to change"
+						" the input string until the checksum is valid, but"
+						" this may return a false positive match."
+					);
+				}
+
+				return BITCOIN_ERROR_INVALID_FORMAT;
+			}
+			break;
+		}
+		default :
+			applog(APPLOG_ERROR, __func__, "unspecified input type");
+			return BITCOIN_ERROR_INVALID_FORMAT;
+			break;
+	}
+
+	return BITCOIN_SUCCESS;
+}
+
+BitcoinResult Bitcoin_DecodeInput(struct BitcoinTool *self, size_t i)
+{
+	return BitcoinTool_decodeRecord(self, i, self->options.input_format);
+}
+
+static __inline__ __attribute__((always_inline)) BitcoinResult BitcoinTool_checkRecord(
+	BitcoinTool *self, size_t i, enum InputType input_type
+)
+{
+	/* convenience pointers with less verbose names */
+	struct BitcoinRecords *records = &self->records;
+	const size_t input_raw_size = records->input_raw_size[i];
+	const uint8_t *input_raw = records->input_raw[i];
+
+	/* check the size of the input matches what we expect for its type */
+	switch (input_type) {
+		case INPUT_TYPE_MINI_PRIVATE_KEY : {
+			size_t expected_size = BITCOIN_MINI_PRIVATE_KEY_SIZE;
+			char test_buffer[BITCOIN_MINI_PRIVATE_KEY_SIZE + 1];
+			struct BitcoinSHA256 hash;
+
+			if (input_raw_size != expected_size) {
+				const char *extra_message = "";
+				applog(APPLOG_ERROR, __func__,
+					"Invalid size input for mini private key:"
+					" expected %u bytes but got %u bytes instead.",
+					(unsigned)expected_size,
+					(unsigned)input_raw_size,
+					extra_message
+				);
+				return BITCOIN_ERROR_PRIVATE_KEY_INVALID_FORMAT;
+			}
+
+			/* prepare a test buffer, to check that the key is valid */
+			memcpy(test_buffer, input_raw, input_raw_size);
+			test_buffer[input_raw_size] = '?';
+			Bitcoin_SHA256(&hash, test_buffer, BITCOIN_MINI_PRIVATE_KEY_SIZE + 1);
+			if (hash.data[0] != 0) {
+				applog(APPLOG_ERROR, __func__,
+					"Mini private key invalid: SHA256(key + '?')[0] results in"
+					" 0x%02x when the expected value is 0x00.  Check the key"
+					" for typing errors and try again.",
+					(unsigned)hash.data[0]
+				);
+				return BITCOIN_ERROR_PRIVATE_KEY_INVALID_FORMAT;
+			}
+
+			/* 1/256 chance the key is valid, hash the string into the real
+			   private key. */
+			Bitcoin_SHA256(&hash, input_raw, BITCOIN_MINI_PRIVATE_KEY_SIZE);
+			memcpy(records->private_keys[i].data, hash.data, BITCOIN_SHA256_SIZE);
+
+			/* since the compression type is always uncompressed, we can set
+			   that too, and we can produce a valid WIF key */
+			records->private_keys[i].public_key_compression = BITCOIN_PUBLIC_KEY_UNCOMPRESSED;
+
+			if (!self->options.network_type) {
+				/* This is normal : mini keys don't store a prefix, so Bitcoin
+				   is implied */
+				records->private_keys[i].network_type = Bitcoin_GetNetworkTypeByName("bitcoin");
+			} else {
+				/* user is asking to override the implicit Bitcoin prefix -
+				   this is very unusual so warn about it. */
+				records->private_keys[i].network_type = self->options.network_type;
+				applog(APPLOG_WARNING, __func__,
+					"Overriding mini private key prefix is unusual, since"
+					" only Bitcoin is implied in the mini key format."
+					" Please check your inputs."
+				);
+			}
+
+			/* we have a valid private key */
+			records->flags[i] |= BITCOIN_RECORD_PRIVATE_KEY;
+
+			/* we have a valid WIF private key */
+			records->flags[i] |= BITCOIN_RECORD_PRIVATE_KEY_WIF;
+
+			break;
+		}
+		case INPUT_TYPE_PRIVATE_KEY : {
+			size_t expected_size = BITCOIN_PRIVATE_KEY_SIZE;
+			if (input_raw_size != expected_size) {
+				const char *extra_message = "";
+				if (
+					(input_raw_size == BITCOIN_PRIVATE_KEY_WIF_UNCOMPRESSED_SIZE) ||
+					(input_raw_size == BITCOIN_PRIVATE_KEY_WIF_COMPRESSED_SIZE)
+				) {
+					extra_message = " (did you mean \"--input-type private-key-wif\"?)";
+				}
+				applog(APPLOG_ERROR, __func__,
+					"Invalid size input for private key:"
+					" expected %u bytes but got %u bytes%s.",
+					(unsigned)expected_size,
+					(unsigned)input_raw_size,
+					extra_message
+				);
+				return BITCOIN_ERROR_PRIVATE_KEY_INVALID_FORMAT;
+			}
+			assert(sizeof(records->private_keys[i].data) >= input_raw_size);
+			memcpy(records->private_keys[i].data, input_raw, input_raw_size);
+
+			if (!self->options.network_type) {
+				applog(APPLOG_ERROR, __func__,
+					"Raw private key has no network prefix and it is unsafe"
+					" to assume one.  Please explicitally specify prefix using"
+					" --network option."
+				);
+				return BITCOIN_ERROR_PRIVATE_KEY_INVALID_FORMAT;
+			}
+			records->private_keys[i].network_type = self->options.network_type;
+			records->flags[i] |= BITCOIN_RECORD_PRIVATE_KEY;
+			break;
+		}
+		case INPUT_TYPE_PRIVATE_KEY_WIF : {
+			if (input_raw_size != BITCOIN_PRIVATE_KEY_WIF_UNCOMPRESSED_SIZE &&
+				input_raw_size != BITCOIN_PRIVATE_KEY_WIF_COMPRESSED_SIZE
+			) {
+				applog(APPLOG_ERROR, __func__,
+					"Invalid size input for WIF private key:"
+					" expected %u (uncompressed) or"
+					" %u (compressed) bytes but got %u bytes instead.",
+					(unsigned)BITCOIN_PRIVATE_KEY_WIF_UNCOMPRESSED_SIZE,
+					(unsigned)BITCOIN_PRIVATE_KEY_WIF_COMPRESSED_SIZE,
+					(unsigned)input_raw_size
+				);
+				return BITCOIN_ERROR_PRIVATE_KEY_INVALID_FORMAT;
+			}
+			switch (input_raw_size) {
+				case BITCOIN_PRIVATE_KEY_WIF_UNCOMPRESSED_SIZE :
+					records->private_keys[i].public_key_compression = BITCOIN_PUBLIC_KEY_UNCOMPRESSED;
+					break;
+				case BITCOIN_PRIVATE_KEY_WIF_COMPRESSED_SIZE :
+					records->private_keys[i].public_key_compression = BITCOIN_PUBLIC_KEY_COMPRESSED;
+					break;
+			}
+			assert(sizeof(records->private_keys[i].data) == BITCOIN_PRIVATE_KEY_SIZE);
+			memcpy(records->private_keys[i].data,
+				input_raw+BITCOIN_PRIVATE_KEY_WIF_VERSION_SIZE,
+				BITCOIN_PRIVATE_KEY_SIZE
+			);
+			records->private_keys[i].network_type =
+				Bitcoin_GetNetworkTypeByPrivateKeyPrefix(input_raw[0]);
+			if (records->private_keys[i].network_type == NULL) {
+				applog(APPLOG_ERROR, __func__,
+					"Unknown prefix byte in WIF private key [%u]",
+					(unsigned)input_raw[0]
+				);
+				return BITCOIN_ERROR_PRIVATE_KEY_INVALID_FORMAT;
+			}
+			records->flags[i] |= BITCOIN_RECORD_PRIVATE_KEY_WIF;
+			break;
+		}
+		case INPUT_TYPE_PUBLIC_KEY : {
+			if (input_raw_size != BITCOIN_PUBLIC_KEY_UNCOMPRESSED_SIZE &&
+				input_raw_size != BITCOIN_PUBLIC_KEY_COMPRESSED_SIZE
+			) {
+				applog(APPLOG_ERROR, __func__,
+					"Invalid size input for public key:"
+					" expected %u (uncompressed) or"
+					" %u (compressed) bytes but got %u bytes instead.",
+					(unsigned)BITCOIN_PUBLIC_KEY_UNCOMPRESSED_SIZE,
+					(unsigned)BITCOIN_PUBLIC_KEY_COMPRESSED_SIZE,
+					(unsigned)input_raw_size
+				);
+				return BITCOIN_ERROR_PUBLIC_KEY_INVALID_FORMAT;
+			}
+			switch (input_raw_size) {
+				case BITCOIN_PUBLIC_KEY_UNCOMPRESSED_SIZE :
+					records->public_keys[i].compression = BITCOIN_PUBLIC_KEY_UNCOMPRESSED;
+					break;
+				case BITCOIN_PUBLIC_KEY_COMPRESSED_SIZE :
+					records->public_keys[i].compression = BITCOIN_PUBLIC_KEY_COMPRESSED;
+					break;
+			}
+			assert(sizeof(records->public_keys[i].data) >= input_raw_size);
+			memcpy(records->public_keys[i].data, input_raw, input_raw_size);
+			records->flags[i] |= BITCOIN_RECORD_PUBLIC_KEY;
+			break;
+		}
+		case INPUT_TYPE_PUBLIC_KEY_SHA256 : {
+			size_t expected_size = BITCOIN_SHA256_SIZE;
+			if (input_raw_size != expected_size) {
+				applog(APPLOG_ERROR, __func__,
+					"Invalid size input for SHA256(public_key):"
+					" expected %u bytes but got %u bytes instead.",
+					(unsigned)expected_size,
+					(unsigned)input_raw_size
+				);
+				return BITCOIN_ERROR_INVALID_FORMAT;
+			}
+                        assert(sizeof(records->public_key_sha256[i].data) >= BITCOIN_SHA256_SIZE);
+                        assert(input_raw_size >= BITCOIN_SHA256_SIZE);
+                        memcpy(records->public_key_sha256[i].data, input_raw, BITCOIN_SHA256_SIZE);
+			records->flags[i] |= BITCOIN_RECORD_PUBLIC_KEY_SHA256;
+			break;
+		}
+		case INPUT_TYPE_PUBLIC_KEY_RIPEMD160 : {
+			size_t expected_size = BITCOIN_RIPEMD160_SIZE;
+			if (input_raw_size != expected_size) {
+				applog(APPLOG_ERROR, __func__,
+					"Invalid size input for RIPEMD160(SHA256(public_key)):"
+					" expected %u bytes but got %u bytes instead.",
+					(unsigned)expected_size,
+					(unsigned)input_raw_size
+				);
+				return BITCOIN_ERROR_INVALID_FORMAT;
+			}
+			assert(sizeof(records->public_key_ripemd160[i].data) >= BITCOIN_RIPEMD160_SIZE);
+			assert(input_raw_size >= BITCOIN_RIPEMD160_SIZE);
+			memcpy(records->public_key_ripemd160[i].data, input_raw, BITCOIN_RIPEMD160_SIZE);
+			records->flags[i] |= BITCOIN_RECORD_PUBLIC_KEY_RIPEMD160;
+			break;
+		}
+		case INPUT_TYPE_ADDRESS : {
+			size_t expected_size = BITCOIN_ADDRESS_SIZE;
+			if (input_raw_size != expected_size) {
+				applog(APPLOG_ERROR, __func__,
+					"Invalid size input for address:"
+					" expected %u bytes but got %u bytes instead.",
+					(unsigned)expected_size,
+					(unsigned)input_raw_size
+				);
+				return BITCOIN_ERROR_INVALID_FORMAT;
+			}
+			memcpy(records->addresses[i].data, input_raw, BITCOIN_ADDRESS_SIZE);
+			records->flags[i] |= BITCOIN_RECORD_ADDRESS;
+			break;
+		}
+		default :
+			applog(APPLOG_ERROR, __func__, "Unknown input.");
+			return BITCOIN_ERROR_INVALID_FORMAT;
+			break;
+	}
+
+	return BITCOIN_SUCCESS;
+}
+
+BitcoinResult Bitcoin_CheckInputSize(struct BitcoinTool *self, size_t i)
+{
+	return BitcoinTool_checkRecord(self, i, self->options.input_type);
+}
+
+static BitcoinResult BitcoinTool_writeText(BitcoinTool *self, size_t i,
+	enum OutputType output_type, enum OutputFormat output_format
+);
+
+BitcoinResult Bitcoin_WriteAllOutput(struct BitcoinTool *self, size_t i)
+{
+	struct BitcoinRecords *records = &self->records;
+	FILE *file = self->output_file_handle;
+
+	struct OutputFormatString {
+		enum OutputFormat output_format;
+		char *name;
+	} output_formats[] = {
+		{ OUTPUT_FORMAT_HEX,         "hex" },
+		{ OUTPUT_FORMAT_BASE58,      "base58" },
+		{ OUTPUT_FORMAT_BASE58CHECK, "base58check" }
+	}, *output_format = NULL;
+
+	struct OutputTypeString {
+		enum OutputType output_type;
+		char *name;
+		int is_set;
+	} output_types[] = {
+		{ OUTPUT_TYPE_ADDRESS,              "address" },
+		{ OUTPUT_TYPE_PUBLIC_KEY_RIPEMD160, "public-key-ripemd160" },
+		{ OUTPUT_TYPE_PUBLIC_KEY_SHA256,    "public-key-sha256" },
+		{ OUTPUT_TYPE_PUBLIC_KEY,           "public-key" },
+		{ OUTPUT_TYPE_PRIVATE_KEY_WIF,      "private-key-wif" },
+		{ OUTPUT_TYPE_PRIVATE_KEY,          "private-key" }
+	}, *output_type = NULL;
+
+	for (output_type = output_types;
+		output_type != output_types +
+		(sizeof(output_types) / sizeof(output_types[0]));
+		output_type++
+	) {
+		for (output_format = output_formats;
+			output_format != output_formats +
+			(sizeof(output_formats) / sizeof(output_formats[0]));
+			output_format++
+		) {
+			if (
+				(output_type->output_type == OUTPUT_TYPE_ADDRESS && (records->flags[i] & BITCOIN_RECORD_ADDRESS)) ||
+				(output_type->output_type == OUTPUT_TYPE_PUBLIC_KEY_RIPEMD160 && (records->flags[i] & BITCOIN_RECORD_PUBLIC_KEY_RIPEMD160)) ||
+				(output_type->output_type == OUTPUT_TYPE_PUBLIC_KEY_SHA256 && (records->flags[i] & BITCOIN_RECORD_PUBLIC_KEY_SHA256)) ||
+				(output_type->output_type == OUTPUT_TYPE_PUBLIC_KEY && (records->flags[i] & BITCOIN_RECORD_PUBLIC_KEY)) ||
+				(output_type->output_type == OUTPUT_TYPE_PRIVATE_KEY_WIF && (records->flags[i] & BITCOIN_RECORD_PRIVATE_KEY_WIF)) ||
+				(output_type->output_type == OUTPUT_TYPE_PRIVATE_KEY && (records->flags[i] & BITCOIN_RECORD_PRIVATE_KEY))
+			) {
+				fprintf(file, "%s.%s:",
+					output_type->name, output_format->name
+				);
+				BitcoinTool_writeText(self, i,
+					output_type->output_type, output_format->output_format
+				);
+			}
+		}
+	}
+
+	return BITCOIN_SUCCESS;
+}
+
+static __inline__ __attribute__((always_inline)) BitcoinResult BitcoinTool_formatRecord(
+	BitcoinTool *self, size_t i,
+	enum OutputType output_type, enum OutputFormat output_format
+)
+{
+	struct BitcoinRecords *records = &self->records;
+	BitcoinResult result = BITCOIN_SUCCESS;
+
+	/* the raw output is encoded straight from the record's arrays, only
+	   a WIF key needs assembling first */
+	uint8_t wif[BITCOIN_PRIVATE_KEY_WIF_COMPRESSED_SIZE];
+	const uint8_t *output_raw = NULL;
+	size_t output_raw_size = 0;
+
+	switch (output_type) {
+		case OUTPUT_TYPE_ADDRESS :
+			output_raw = records->addresses[i].data;
+			output_raw_size = BITCOIN_ADDRESS_SIZE;
+			break;
+		case OUTPUT_TYPE_PUBLIC_KEY_RIPEMD160 :
+			output_raw = records->public_key_ripemd160[i].data;
+			output_raw_size = BITCOIN_RIPEMD160_SIZE;
+			break;
+		case OUTPUT_TYPE_PUBLIC_KEY_SHA256 :
+			output_raw = records->public_key_sha256[i].data;
+			output_raw_size = BITCOIN_SHA256_SIZE;
+			break;
+		case OUTPUT_TYPE_PUBLIC_KEY :
+			output_raw = records->public_keys[i].data;
+			output_raw_size = BitcoinPublicKey_GetSize(&records->public_keys[i]);
+			break;
+		case OUTPUT_TYPE_PRIVATE_KEY_WIF :
+			wif[0] = BitcoinNetworkType_GetPrivateKeyPrefix(records->private_keys[i].network_type);
+			memcpy(wif + BITCOIN_PRIVATE_KEY_WIF_VERSION_SIZE,
+				records->private_keys[i].data, BITCOIN_PRIVATE_KEY_SIZE
+			);
+			switch (records->private_keys[i].public_key_compression) {
+				case BITCOIN_PUBLIC_KEY_COMPRESSED :
+					/* set compression flag */
+					wif[
+						BITCOIN_PRIVATE_KEY_WIF_VERSION_SIZE +
+						BITCOIN_PRIVATE_KEY_SIZE
+					] = BITCOIN_PRIVATE_KEY_WIF_COMPRESSION_FLAG_COMPRESSED;
+					output_raw_size = BITCOIN_PRIVATE_KEY_WIF_VERSION_SIZE +
+						BITCOIN_PRIVATE_KEY_SIZE +
+						BITCOIN_PRIVATE_KEY_WIF_COMPRESSION_FLAG_SIZE;
+					break;
+				case BITCOIN_PUBLIC_KEY_UNCOMPRESSED :
+					/* no compression flag to set, size determines that the
+					corresponding public key should be uncompressed. */
+					output_raw_size = BITCOIN_PRIVATE_KEY_WIF_VERSION_SIZE +
+						BITCOIN_PRIVATE_KEY_SIZE;
+					break;
+				default :
+					memset(wif, 0, sizeof(wif));
+					applog(APPLOG_ERROR, __func__,
+						"Public key compression flag must be set using"
+						" --public-key-compression (compressed | uncompressed)"
+						" when importing raw private keys."
+					);
+					return BITCOIN_ERROR_INVALID_FORMAT;
+					break;
+			}
+			assert(sizeof(wif) >= output_raw_size);
+			output_raw = wif;
+			break;
+		case OUTPUT_TYPE_PRIVATE_KEY :
+			output_raw = records->private_keys[i].data;
+			output_raw_size = BitcoinPrivateKey_GetSize(&records->private_keys[i]);
+			break;
+		default :
+			applog(APPLOG_ERROR, __func__, "Unknown output type.");
+			return BITCOIN_ERROR_INVALID_FORMAT;
+			break;
+	}
+
+	switch (output_format) {
+		case OUTPUT_FORMAT_RAW : {
+			if (output_raw_size > sizeof(records->output_text[i])) {
+				applog(APPLOG_BUG, __func__,
+					"output_raw buffer (%u) larger than output_text buffer (%u),"
+					"unable to write output",
+					(unsigned)output_raw_size,
+					(unsigned)sizeof(records->output_text[i])
+				);
+				result = BITCOIN_ERROR_INVALID_FORMAT;
+				break;
+			}
+			memcpy(records->output_text[i], output_raw, output_raw_size);
+			records->output_text_size[i] = output_raw_size;
+			break;
+		}
+		case OUTPUT_FORMAT_HEX : {
+			int lower_case = 1;
+			result = Bitcoin_EncodeHex(
+				records->output_text[i], sizeof(records->output_text[i]),
+				&records->output_text_size[i],
+				output_raw, output_raw_size,
+				lower_case
+			);
+			break;
+		}
+		case OUTPUT_FORMAT_BASE58 : {
+			result = Bitcoin_EncodeBase58(
+				records->output_text[i], sizeof(records->output_text[i]),
+				&records->output_text_size[i],
+				output_raw, output_raw_size
+			);
+			break;
+		}
+		case OUTPUT_FORMAT_BASE58CHECK : {
+			result = Bitcoin_EncodeBase58Check(
+				records->output_text[i], sizeof(records->output_text[i]),
+				&records->output_text_size[i],
+				output_raw, output_raw_size
+			);
+			break;
+		}
+		default:
+			applog(APPLOG_ERROR, __func__,
+				"Unspecified output format."
+				" Please use --output-format with one of:"
+			);
+			BitcoinTool_ListOutputFormats(stderr);
+			memset(wif, 0, sizeof(wif));
+			return BITCOIN_ERROR_INVALID_FORMAT;
+			break;
+	}
+
+	memset(wif, 0, sizeof(wif));
+
+	if (result != BITCOIN_SUCCESS) {
+		applog(APPLOG_ERROR, __func__,
+			"Failed to encode raw output data (%s)",
+			Bitcoin_ResultString(result)
+		);
+		return result;
+	}
+
+	if (records->output_text_size[i] == 0) {
+		applog(APPLOG_BUG, __func__,
+			"No text to output - something went wrong"
+		);
+		return BITCOIN_ERROR_INVALID_FORMAT;
+	}
+
+	return BITCOIN_SUCCESS;
+}
+
+BitcoinResult Bitcoin_FormatOutput(struct BitcoinTool *self, size_t i)
+{
+	return BitcoinTool_formatRecord(self, i,
+		self->options.output_type, self->options.output_format
+	);
+}
+
+/* Format one output type of record i, and write it */
+static __inline__ __attribute__((always_inline)) BitcoinResult
+BitcoinTool_writeTextRecord(BitcoinTool *self, size_t i,
+	enum OutputType output_type, enum OutputFormat output_format
+)
+{
+	struct BitcoinRecords *records = &self->records;
+	FILE *file = self->output_file_handle;
+	BitcoinResult result;
+	int bytes_wrote = 0;
+
+	result = BitcoinTool_formatRecord(self, i, output_type, output_format);
+	if (result != BITCOIN_SUCCESS) {
+		return result;
+	}
+
+	bytes_wrote = fwrite(records->output_text[i], 1, records->output_text_size[i], file);
+	if (bytes_wrote < 0) {
+		applog(APPLOG_ERROR, __func__, "Error writing output (%s)", strerror(errno));
+	} else if (bytes_wrote < records->output_text_size[i]) {
+		applog(APPLOG_ERROR, __func__, "Error writing output, short write");
+	}
+
+	/* output a newline for clarity if we're on a TTY */
+	if (self->output_newline) {
+		fputc('\n', file);
+	}
+
+	return BITCOIN_SUCCESS;
+}
+
+static BitcoinResult BitcoinTool_writeText(BitcoinTool *self, size_t i,
+	enum OutputType output_type, enum OutputFormat output_format
+)
+{
+	return BitcoinTool_writeTextRecord(self, i, output_type, output_format);
+}
+
+static __inline__ __attribute__((always_inline)) BitcoinResult
+BitcoinTool_writeRecord(BitcoinTool *self, size_t i,
+	enum OutputType output_type, enum OutputFormat output_format
+)
+{
+	if (output_type == OUTPUT_TYPE_ALL) {
+		return Bitcoin_WriteAllOutput(self, i);
+	}
+	return BitcoinTool_writeTextRecord(self, i, output_type, output_format);
+}
+
+BitcoinResult Bitcoin_WriteOutput(struct BitcoinTool *self, size_t i)
+{
+	return BitcoinTool_writeRecord(self, i,
+		self->options.output_type, self->options.output_format
+	);
+}
+
+static int Bitcoin_HasMoreInput(BitcoinTool *self)
+{
+	return self->options.batch;
+}
+
+/* Define a stage function, which calls 'call' (an expression of self and i)
+   for each record of the batch, timing the whole batch if --stats is
+   enabled.  A record which fails is skipped by the later stages if
+   ignore_errors is set, otherwise the batch stops there.  The function
+   returns the first error which stopped the batch, or BITCOIN_SUCCESS. */
+#define BITCOIN_TOOL_STAGE(name, stats_stage, call) \
+static BitcoinResult name(BitcoinTool *self, int ignore_errors) \
+{ \
+	struct BitcoinRecords *records = &self->records; \
+	BitcoinResult result = BITCOIN_SUCCESS; \
+	uint64_t start = 0; \
+	size_t i, calls = 0, errors = 0; \
+\
+	if (self->options.stats) { \
+		start = BitcoinStats_Ticks(); \
+	} \
+\
+	for (i = 0; i < records->limit; i++) { \
+		BitcoinResult record_result; \
+\
+		if (records->flags[i] & BITCOIN_RECORD_SKIPPED) { \
+			continue; \
+		} \
+\
+		calls++; \
+		record_result = (call); \
+		if (record_result == BITCOIN_SUCCESS) { \
+			continue; \
+		} \
+\
+		errors++; \
+		if (ignore_errors) { \
+			records->flags[i] |= BITCOIN_RECORD_SKIPPED; \
+		} else { \
+			records->limit = i; \
+			result = record_result; \
+		} \
+	} \
+\
+	if (self->options.stats) { \
+		BitcoinStats_AddStageRecords(&self->stats, (stats_stage), \
+			BitcoinStats_Ticks() - start, calls, errors \
+		); \
+	} \
+\
+	return result; \
+}
+
+/* The options never change during a run, so each stage is also generated
+   for every value of the options it depends on, with the value as a
+   constant: the switches on the options in the record functions then
+   disappear from the loops.  The lists below are the values, and the valid
+   conversions, each with its option name. */
+
+/* X(type, type name, format, name), for input and output formats, the
+   type being whatever the caller needs */
+#define BITCOIN_TOOL_FORMATS(X, type, type_name) \
+	X(type, type_name, RAW, "raw") \
+	X(type, type_name, HEX, "hex") \
+	X(type, type_name, BASE58, "base58") \
+	X(type, type_name, BASE58CHECK, "base58check")
+
+/* X(type, name), for the types which are both input and output types */
+#define BITCOIN_TOOL_TYPES(X) \
+	X(ADDRESS, "address") \
+	X(PUBLIC_KEY_RIPEMD160, "public-key-rmd") \
+	X(PUBLIC_KEY_SHA256, "public-key-sha") \
+	X(PUBLIC_KEY, "public-key") \
+	X(PRIVATE_KEY_WIF, "private-key-wif") \
+	X(PRIVATE_KEY, "private-key")
+
+/* X(input type, output type), for the conversions which are possible */
+#define BITCOIN_TOOL_PRIVATE_KEY_CONVERSIONS(X, input) \
+	X(input, ALL) \
+	X(input, ADDRESS) \
+	X(input, PUBLIC_KEY_RIPEMD160) \
+	X(input, PUBLIC_KEY_SHA256) \
+	X(input, PUBLIC_KEY) \
+	X(input, PRIVATE_KEY_WIF) \
+	X(input, PRIVATE_KEY)
+#define BITCOIN_TOOL_CONVERSIONS(X) \
+	BITCOIN_TOOL_PRIVATE_KEY_CONVERSIONS(X, MINI_PRIVATE_KEY) \
+	BITCOIN_TOOL_PRIVATE_KEY_CONVERSIONS(X, PRIVATE_KEY) \
+	BITCOIN_TOOL_PRIVATE_KEY_CONVERSIONS(X, PRIVATE_KEY_WIF) \
+	X(PUBLIC_KEY, ALL) \
+	X(PUBLIC_KEY, ADDRESS) \
+	X(PUBLIC_KEY, PUBLIC_KEY_RIPEMD160) \
+	X(PUBLIC_KEY, PUBLIC_KEY_SHA256) \
+	X(PUBLIC_KEY, PUBLIC_KEY) \
+	X(PUBLIC_KEY_SHA256, ALL) \
+	X(PUBLIC_KEY_SHA256, ADDRESS) \
+	X(PUBLIC_KEY_SHA256, PUBLIC_KEY_RIPEMD160) \
+	X(PUBLIC_KEY_SHA256, PUBLIC_KEY_SHA256) \
+	X(PUBLIC_KEY_RIPEMD160, ALL) \
+	X(PUBLIC_KEY_RIPEMD160, ADDRESS) \
+	X(PUBLIC_KEY_RIPEMD160, PUBLIC_KEY_RIPEMD160) \
+	X(ADDRESS, ALL) \
+	X(ADDRESS, ADDRESS) \
+	X(ADDRESS, PUBLIC_KEY_RIPEMD160)
+
+/* the generic stages, which read the options for each record */
+BITCOIN_TOOL_STAGE(BitcoinTool_decodeGeneric, BITCOIN_STATS_STAGE_PARSE_INPUT,
+	Bitcoin_DecodeInput(self, i))
+BITCOIN_TOOL_STAGE(BitcoinTool_checkGeneric, BITCOIN_STATS_STAGE_CHECK_INPUT_SIZE,
+	Bitcoin_CheckInputSize(self, i))
+BITCOIN_TOOL_STAGE(BitcoinTool_convertGeneric, BITCOIN_STATS_STAGE_CONVERT,
+	Bitcoin_ConvertInputToOutput(self, i))
+BITCOIN_TOOL_STAGE(BitcoinTool_formatGeneric, BITCOIN_STATS_STAGE_WRITE_OUTPUT,
+	Bitcoin_FormatOutput(self, i))
+BITCOIN_TOOL_STAGE(BitcoinTool_writeGeneric, BITCOIN_STATS_STAGE_WRITE_OUTPUT,
+	Bitcoin_WriteOutput(self, i))
+
+/* the specialized stages */
+#define BITCOIN_TOOL_DECODE_STAGE(type, type_name, format, name) \
+	BITCOIN_TOOL_STAGE(BitcoinTool_decode_##format, \
+		BITCOIN_STATS_STAGE_PARSE_INPUT, \
+		BitcoinTool_decodeRecord(self, i, INPUT_FORMAT_##format))
+#define BITCOIN_TOOL_CHECK_STAGE(type, name) \
+	BITCOIN_TOOL_STAGE(BitcoinTool_check_##type, \
+		BITCOIN_STATS_STAGE_CHECK_INPUT_SIZE, \
+		BitcoinTool_checkRecord(self, i, INPUT_TYPE_##type))
+#define BITCOIN_TOOL_CONVERT_STAGE(input, output) \
+	BITCOIN_TOOL_STAGE(BitcoinTool_convert_##input##_##output, \
+		BITCOIN_STATS_STAGE_CONVERT, \
+		BitcoinTool_convertRecord(self, i, \
+			INPUT_TYPE_##input, OUTPUT_TYPE_##output))
+#define BITCOIN_TOOL_WRITE_STAGE(type, type_name, format, name) \
+	BITCOIN_TOOL_STAGE(BitcoinTool_write_##type##_##format, \
+		BITCOIN_STATS_STAGE_WRITE_OUTPUT, \
+		BitcoinTool_writeTextRecord(self, i, \
+			OUTPUT_TYPE_##type, OUTPUT_FORMAT_##format))
+#define BITCOIN_TOOL_WRITE_STAGES(type, name) \
+	BITCOIN_TOOL_FORMATS(BITCOIN_TOOL_WRITE_STAGE, type, name)
+
+BITCOIN_TOOL_FORMATS(BITCOIN_TOOL_DECODE_STAGE, INPUT, "input")
+BITCOIN_TOOL_TYPES(BITCOIN_TOOL_CHECK_STAGE)
+BITCOIN_TOOL_CHECK_STAGE(MINI_PRIVATE_KEY, "mini-private-key")
+BITCOIN_TOOL_CONVERSIONS(BITCOIN_TOOL_CONVERT_STAGE)
+BITCOIN_TOOL_TYPES(BITCOIN_TOOL_WRITE_STAGES)
+BITCOIN_TOOL_STAGE(BitcoinTool_write_ALL, BITCOIN_STATS_STAGE_WRITE_OUTPUT,
+	Bitcoin_WriteAllOutput(self, i))
+
+/* Tables of the specialized stages, by the option values they are for */
+struct BitcoinToolStageEntry {
+	int first, second;
+	const char *name;
+	BitcoinToolStage stage;
+};
+
+#define BITCOIN_TOOL_DECODE_ENTRY(type, type_name, format, name) \
+	{ INPUT_FORMAT_##format, 0, name, BitcoinTool_decode_##format },
+#define BITCOIN_TOOL_CHECK_ENTRY(type, name) \
+	{ INPUT_TYPE_##type, 0, name, BitcoinTool_check_##type },
+#define BITCOIN_TOOL_CONVERT_ENTRY(input, output) \
+	{ INPUT_TYPE_##input, OUTPUT_TYPE_##output, NULL, \
+		BitcoinTool_convert_##input##_##output },
+#define BITCOIN_TOOL_WRITE_ENTRY(type, type_name, format, name) \
+	{ OUTPUT_TYPE_##type, OUTPUT_FORMAT_##format, type_name "." name, \
+		BitcoinTool_write_##type##_##format },
+#define BITCOIN_TOOL_WRITE_ENTRIES(type, name) \
+	BITCOIN_TOOL_FORMATS(BITCOIN_TOOL_WRITE_ENTRY, type, name)
+
+static const struct BitcoinToolStageEntry decode_stages[] = {
+	BITCOIN_TOOL_FORMATS(BITCOIN_TOOL_DECODE_ENTRY, INPUT, "input")
+	{ 0, 0, NULL, NULL }
+};
+
+static const struct BitcoinToolStageEntry check_stages[] = {
+	BITCOIN_TOOL_TYPES(BITCOIN_TOOL_CHECK_ENTRY)
+	BITCOIN_TOOL_CHECK_ENTRY(MINI_PRIVATE_KEY, "mini-private-key")
+	{ 0, 0, NULL, NULL }
+};
+
+static const struct BitcoinToolStageEntry convert_stages[] = {
+	BITCOIN_TOOL_CONVERSIONS(BITCOIN_TOOL_CONVERT_ENTRY)
+	{ 0, 0, NULL, NULL }
+};
+
+static const struct BitcoinToolStageEntry write_stages[] = {
+	BITCOIN_TOOL_TYPES(BITCOIN_TOOL_WRITE_ENTRIES)
+	{ 0, 0, NULL, NULL }
+};
+
+static const struct BitcoinToolStageEntry *BitcoinTool_findStage(
+	const struct BitcoinToolStageEntry *entries, int first, int second
+)
+{
+	for (; entries->stage; entries++) {
+		if (entries->first == first && entries->second == second) {
+			return entries;
+		}
+	}
+	return NULL;
+}
+
+/* Does converting the input type to the output type derive a public key
+   from a private key? */
+static int BitcoinTool_derivesPublicKey(const BitcoinTool *self)
+{
+	switch (self->options.input_type) {
+		case INPUT_TYPE_MINI_PRIVATE_KEY :
+		case INPUT_TYPE_PRIVATE_KEY :
+		case INPUT_TYPE_PRIVATE_KEY_WIF :
+			break;
+		default :
+			return 0;
+	}
+
+	switch (self->options.output_type) {
+		case OUTPUT_TYPE_ALL :
+		case OUTPUT_TYPE_ADDRESS :
+		case OUTPUT_TYPE_PUBLIC_KEY_RIPEMD160 :
+		case OUTPUT_TYPE_PUBLIC_KEY_SHA256 :
+		case OUTPUT_TYPE_PUBLIC_KEY :
+			return 1;
+		default :
+			return 0;
+	}
+}
+
+/* Can record i's public key be derived with the rest of the batch? */
+static int BitcoinTool_canDerivePublicKey(const struct BitcoinRecords *records,
+	size_t i
+)
+{
+	const struct BitcoinPrivateKey *private_key = &records->private_keys[i];
+
+	return !(records->flags[i] & BITCOIN_RECORD_SKIPPED)
+		&& private_key->network_type != NULL
+		&& (
+			private_key->public_key_compression == BITCOIN_PUBLIC_KEY_COMPRESSED
+			|| private_key->public_key_compression == BITCOIN_PUBLIC_KEY_UNCOMPRESSED
+		);
+}
+
+/* Does record i still need its public key derived with the rest of the
+   batch, not having it from the cache? */
+static int BitcoinTool_needsPublicKey(const struct BitcoinRecords *records,
+	size_t i
+)
+{
+	return !(records->flags[i] & BITCOIN_RECORD_PUBLIC_KEY)
+		&& BitcoinTool_canDerivePublicKey(records, i);
+}
+
+/* Derive the public keys of the whole batch at once, in place in the
+   records, so the secp256k1 kernel can work on several keys at a time.
+   Records it can't handle (no network, or no compression set) are left to
+   Bitcoin_ConvertInputToOutput(), which reports the problem. */
+static BitcoinResult BitcoinTool_makePublicKeys(BitcoinTool *self)
+{
+	struct BitcoinRecords *records = &self->records;
+	BitcoinResult results[BITCOIN_RECORDS_BATCH_SIZE];
+	uint64_t start = 0;
+	size_t i, run_end, errors = 0;
+
+	if (!self->pipeline.make_public_keys) {
+		return BITCOIN_SUCCESS;
+	}
+
+	if (self->options.stats) {
+		start = BitcoinStats_Ticks();
+	}
+
+	assert(records->limit <= sizeof(results) / sizeof(results[0]));
+	for (i = 0; i < records->limit; i = run_end) {
+		/* find the next run of records to derive */
+		while (i < records->limit && !BitcoinTool_needsPublicKey(records, i)) {
+			i++;
+		}
+		run_end = i;
+		while (run_end < records->limit
+			&& BitcoinTool_needsPublicKey(records, run_end)
+		) {
+			run_end++;
+		}
+		if (run_end == i) {
+			break;
+		}
+
+		BitcoinSecp256k1_MakePublicKeysOnNode(
+			BitcoinContext_GetNode(self->context), &records->public_keys[i],
+			&records->private_keys[i], run_end - i, &results[i]
+		);
+		for (; i < run_end; i++) {
+			if (results[i] == BITCOIN_SUCCESS) {
+				records->flags[i] |= BITCOIN_RECORD_PUBLIC_KEY;
+			} else if (!errors++) {
+				/* an invalid key stops the batch, like any conversion
+				   error */
+				records->limit = i;
+			}
+		}
+	}
+
+	if (self->options.stats) {
+		BitcoinStats_AddStageRecords(&self->stats, BITCOIN_STATS_STAGE_CONVERT,
+			BitcoinStats_Ticks() - start, 0, errors
+		);
+	}
+
+	return errors ? BITCOIN_ERROR_PRIVATE_KEY_INVALID_FORMAT : BITCOIN_SUCCESS;
+}
+
+/* Does the conversion derive anything worth caching: a public key from a
+   private key, or hashes of a public key? */
+static int BitcoinTool_cachesRecords(const BitcoinTool *self)
+{
+	if (BitcoinTool_derivesPublicKey(self)) {
+		return 1;
+	}
+	if (self->options.input_type != INPUT_TYPE_PUBLIC_KEY) {
+		return 0;
+	}
+
+	switch (self->options.output_type) {
+		case OUTPUT_TYPE_ALL :
+		case OUTPUT_TYPE_ADDRESS :
+		case OUTPUT_TYPE_PUBLIC_KEY_RIPEMD160 :
+		case OUTPUT_TYPE_PUBLIC_KEY_SHA256 :
+			return 1;
+		default :
+			return 0;
+	}
+}
+
+/* Write the cache key of record i: its public key, or its private key
+   tagged with the public key compression, since each private key has two
+   public keys.  Returns the size of the key, or 0 if the record isn't
+   cached. */
+static size_t BitcoinTool_cacheKey(const BitcoinTool *self, size_t i,
+	unsigned char key[BITCOIN_CACHE_KEY_MAX_SIZE]
+)
+{
+	const struct BitcoinRecords *records = &self->records;
+	size_t size;
+
+	if (records->flags[i] & BITCOIN_RECORD_SKIPPED) {
+		return 0;
+	}
+
+	if (self->options.input_type == INPUT_TYPE_PUBLIC_KEY) {
+		size = BitcoinPublicKey_GetSize(&records->public_keys[i]);
+		assert(size < BITCOIN_CACHE_KEY_MAX_SIZE);
+		key[0] = 0;
+		memcpy(key + 1, records->public_keys[i].data, size);
+		return 1 + size;
+	}
+
+	if (!BitcoinTool_canDerivePublicKey(records, i)) {
+		return 0;
+	}
+	key[0] = (unsigned char)records->private_keys[i].public_key_compression;
+	memcpy(key + 1, records->private_keys[i].data, BITCOIN_PRIVATE_KEY_SIZE);
+	return 1 + BITCOIN_PRIVATE_KEY_SIZE;
+}
+
+/* Fill in what the cache has for the checked records, before the public
+   keys are derived.  The convert stage skips whatever is flagged as done,
+   and the address is only used if it is for the network the record's
+   address would be made for. */
+static void BitcoinTool_lookupCache(BitcoinTool *self)
+{
+	struct BitcoinRecords *records = &self->records;
+	unsigned char key[BITCOIN_CACHE_KEY_MAX_SIZE];
+	uint64_t start = 0;
+	size_t i, key_size;
+
+	if (!self->cache) {
+		return;
+	}
+
+	if (self->options.stats) {
+		start = BitcoinStats_Ticks();
+	}
+
+	for (i = 0; i < records->limit; i++) {
+		const struct BitcoinCacheValue *value;
+		const struct BitcoinNetworkType *network_type;
+
+		key_size = BitcoinTool_cacheKey(self, i, key);
+		if (!key_size) {
+			continue;
+		}
+		value = BitcoinCache_Get(self->cache, key, key_size);
+		if (!value) {
+			self->stats.cache_misses++;
+			continue;
+		}
+		self->stats.cache_hits++;
+
+		if (!(records->flags[i] & BITCOIN_RECORD_PUBLIC_KEY)) {
+			records->public_keys[i] = value->public_key;
+			records->public_keys[i].network_type =
+				records->private_keys[i].network_type;
+		}
+		records->public_key_sha256[i] = value->public_key_sha256;
+		records->public_key_ripemd160[i] = value->public_key_ripemd160;
+		records->flags[i] |= BITCOIN_RECORD_CACHED | (value->flags & (
+			BITCOIN_RECORD_PUBLIC_KEY
+			| BITCOIN_RECORD_PUBLIC_KEY_SHA256
+			| BITCOIN_RECORD_PUBLIC_KEY_RIPEMD160
+		));
+
+		network_type = self->options.network_type ? self->options.network_type
+			: records->public_keys[i].network_type;
+		if ((value->flags & BITCOIN_RECORD_ADDRESS) && network_type
+			&& network_type == value->address_network_type
+		) {
+			records->addresses[i] = value->address;
+			records->flags[i] |= BITCOIN_RECORD_ADDRESS;
+		}
+	}
+	memset(key, 0, sizeof(key));
+
+	if (self->options.stats) {
+		BitcoinStats_AddStageRecords(&self->stats, BITCOIN_STATS_STAGE_CONVERT,
+			BitcoinStats_Ticks() - start, 0, 0
+		);
+	}
+}
+
+/* Keep what was derived for the converted records which weren't found in
+   the cache */
+static void BitcoinTool_storeCache(BitcoinTool *self)
+{
+	struct BitcoinRecords *records = &self->records;
+	unsigned char key[BITCOIN_CACHE_KEY_MAX_SIZE];
+	struct BitcoinCacheValue value;
+	uint64_t start = 0;
+	size_t i, key_size;
+
+	if (!self->cache) {
+		return;
+	}
+
+	if (self->options.stats) {
+		start = BitcoinStats_Ticks();
+	}
+
+	for (i = 0; i < records->limit; i++) {
+		if ((records->flags[i] & BITCOIN_RECORD_CACHED)
+			|| !(records->flags[i] & BITCOIN_RECORD_PUBLIC_KEY)
+		) {
+			continue;
+		}
+		key_size = BitcoinTool_cacheKey(self, i, key);
+		if (!key_size) {
+			continue;
+		}
+
+		value.flags = records->flags[i] & (
+			BITCOIN_RECORD_PUBLIC_KEY
+			| BITCOIN_RECORD_PUBLIC_KEY_SHA256
+			| BITCOIN_RECORD_PUBLIC_KEY_RIPEMD160
+			| BITCOIN_RECORD_ADDRESS
+		);
+		value.public_key = records->public_keys[i];
+		value.public_key_sha256 = records->public_key_sha256[i];
+		value.public_key_ripemd160 = records->public_key_ripemd160[i];
+		value.address = records->addresses[i];
+		/* the network the address was made for, after any --network */
+		value.address_network_type = records->public_keys[i].network_type;
+
+		self->stats.cache_evictions += BitcoinCache_Put(self->cache,
+			key, key_size, &value
+		);
+	}
+	memset(key, 0, sizeof(key));
+	memset(&value, 0, sizeof(value));
+
+	if (self->options.stats) {
+		BitcoinStats_AddStageRecords(&self->stats, BITCOIN_STATS_STAGE_CONVERT,
+			BitcoinStats_Ticks() - start, 0, 0
+		);
+	}
+}
+
+/* Skip the converted records whose hash isn't in options.match_index (or
+   options.match_set), so they aren't written */
+static void BitcoinTool_matchIndex(BitcoinTool *self)
+{
+	struct BitcoinRecords *records = &self->records;
+	struct BitcoinRIPEMD160 hashes[BITCOIN_INDEX_BATCH_SIZE];
+	size_t positions[BITCOIN_INDEX_BATCH_SIZE];
+	unsigned char found[BITCOIN_INDEX_BATCH_SIZE];
+	uint64_t start = 0;
+	size_t i, j, count;
+
+	if (!self->match_index && !self->match_set) {
+		return;
+	}
+
+	if (self->options.stats) {
+		start = BitcoinStats_Ticks();
+	}
+
+	/* gathered into batches, for the index to look them up together */
+	for (i = 0; i < records->limit;) {
+		for (count = 0; i < records->limit && count < BITCOIN_INDEX_BATCH_SIZE; i++) {
+			if (records->flags[i] & BITCOIN_RECORD_SKIPPED) {
+				continue;
+			}
+			/* an address which was input, rather than made from the hash */
+			if (records->flags[i] & BITCOIN_RECORD_PUBLIC_KEY_RIPEMD160) {
+				hashes[count] = records->public_key_ripemd160[i];
+			} else {
+				Bitcoin_MakeRIPEMD160FromAddress(&hashes[count],
+					&records->addresses[i]
+				);
+			}
+			positions[count++] = i;
+		}
+
+		if (self->match_set) {
+			BitcoinHashSet_ContainsBatch(self->match_set, hashes, count, found);
+		} else {
+			BitcoinIndex_ContainsBatch(self->match_index, hashes, count, found);
+		}
+		for (j = 0; j < count; j++) {
+			if (!found[j]) {
+				records->flags[positions[j]] |= BITCOIN_RECORD_SKIPPED;
+			}
+		}
+	}
+
+	if (self->options.stats) {
+		BitcoinStats_AddStageRecords(&self->stats, BITCOIN_STATS_STAGE_CONVERT,
+			BitcoinStats_Ticks() - start, 0, 0
+		);
+	}
+}
+
+void BitcoinTool_resetInput(BitcoinTool *self)
+{
+	BitcoinRecords_Reset(&self->records, 1, BitcoinTool_defaultCompression(self));
+}
+
+/* Select the stages for the options, once the options are set: the
+   specialized ones if the combination has them, otherwise the generic ones,
+   which also report impossible conversions */
+static void BitcoinTool_selectPipeline(BitcoinTool *self)
+{
+	struct BitcoinToolPipeline *pipeline = &self->pipeline;
+	const struct BitcoinToolStageEntry *decode, *check, *convert, *write;
+
+	pipeline->make_public_keys = BitcoinTool_derivesPublicKey(self);
+
+	decode = BitcoinTool_findStage(decode_stages, self->options.input_format, 0);
+	check = BitcoinTool_findStage(check_stages, self->options.input_type, 0);
+	convert = BitcoinTool_findStage(convert_stages,
+		self->options.input_type, self->options.output_type
+	);
+	write = BitcoinTool_findStage(write_stages,
+		self->options.output_type, self->options.output_format
+	);
+
+	if (!decode || !check || !convert
+		|| (!write && self->options.output_type != OUTPUT_TYPE_ALL)
+	) {
+		pipeline->decode = BitcoinTool_decodeGeneric;
+		pipeline->check = BitcoinTool_checkGeneric;
+		pipeline->convert = BitcoinTool_convertGeneric;
+		pipeline->write = BitcoinTool_writeGeneric;
+		strcpy(pipeline->name, "generic");
+		return;
+	}
+
+	pipeline->decode = decode->stage;
+	pipeline->check = check->stage;
+	pipeline->convert = convert->stage;
+	pipeline->write = write ? write->stage : BitcoinTool_write_ALL;
+	assert(strlen(check->name) + strlen(decode->name)
+		+ (write ? strlen(write->name) : 3) + 3 <= sizeof(pipeline->name));
+	sprintf(pipeline->name, "%s.%s>%s",
+		check->name, decode->name, write ? write->name : "all"
+	);
+}
+
+BitcoinResult BitcoinTool_convertInput(BitcoinTool *self)
+{
+	BitcoinResult result;
+
+	result = self->pipeline.decode(self, 0);
+	if (result == BITCOIN_SUCCESS) {
+		result = self->pipeline.check(self, 0);
+	}
+	if (result == BITCOIN_SUCCESS) {
+		BitcoinTool_lookupCache(self);
+		result = self->pipeline.convert(self, 0);
+	}
+	if (result == BITCOIN_SUCCESS) {
+		BitcoinTool_storeCache(self);
+		result = BitcoinTool_formatGeneric(self, 0);
+	}
+	if (result == BITCOIN_SUCCESS) {
+		self->stats.records++;
+	}
+
+	return result;
+}
+
+static void BitcoinTool_periodicStats(BitcoinTool *self)
+{
+	double now;
+
+	if (!self->options.stats_interval) {
+		return;
+	}
+
+	now = BitcoinStats_Now();
+	if (now - self->stats.report_ns >= self->options.stats_interval * 1e9) {
+		BitcoinStats_Report(&self->stats, stderr, "progress");
+		self->stats.report_ns = now;
+	}
+}
+
+/* Convert the input a batch at a time: each stage runs over the whole batch
+   before the next one starts.  The records before a failed record are still
+   written, in order, before giving up. */
+int BitcoinTool_convertAll(BitcoinTool *self)
+{
+	struct BitcoinRecords *records = &self->records;
+
+	do {
+		uint64_t start = 0;
+		size_t i, written = 0;
+		BitcoinResult result;
+
+		if (self->options.stats) {
+			start = BitcoinStats_Ticks();
+		}
+		result = Bitcoin_ReadInput(self);
+		if (self->options.stats && result != BITCOIN_ERROR_END_OF_FILE) {
+			BitcoinStats_AddStageRecords(&self->stats,
+				BITCOIN_STATS_STAGE_PARSE_INPUT, BitcoinStats_Ticks() - start,
+				0, result != BITCOIN_SUCCESS
+			);
+		}
+		if (result == BITCOIN_ERROR_END_OF_FILE) {
+			break;
+		} else if (result != BITCOIN_SUCCESS) {
+			return 0;
+		}
+
+		self->pipeline.decode(self, self->options.ignore_input_errors);
+		self->pipeline.check(self, 0);
+		BitcoinTool_lookupCache(self);
+		BitcoinTool_makePublicKeys(self);
+		self->pipeline.convert(self, 0);
+		BitcoinTool_storeCache(self);
+		BitcoinTool_matchIndex(self);
+		self->pipeline.write(self, 0);
+
+		for (i = 0; i < records->limit; i++) {
+			if (!(records->flags[i] & BITCOIN_RECORD_SKIPPED)) {
+				written++;
+			}
+		}
+		self->stats.records += written;
+
+		if (records->limit < records->count) {
+			return 0;
+		}
+
+		BitcoinTool_periodicStats(self);
+	} while (Bitcoin_HasMoreInput(self));
+
+	return 1;
+}
+
+void BitcoinTool_placeWorker(BitcoinTool *self, unsigned worker)
+{
+	unsigned node;
+	int cpu;
+
+	if (self->options.numa == BITCOIN_NUMA_OFF) {
+		return;
+	}
+
+	cpu = BitcoinNUMA_PinThread(worker, &node);
+	BitcoinContext_SetNode(self->context, node);
+	if (self->match_sets[node]) {
+		self->match_set = self->match_sets[node];
+	}
+	applog(APPLOG_DEBUG, __func__, "Worker %u on CPU %d, node %u", worker, cpu,
+		node
+	);
+}
+
+/* Log the NUMA topology and, with --numa replicate, copy the secp256k1
+   tables to each node, before any workers are started */
+static void BitcoinTool_placeTables(BitcoinTool *self)
+{
+	unsigned replicas = 0;
+
+	if (self->options.numa == BITCOIN_NUMA_OFF) {
+		return;
+	}
+	if (self->options.numa == BITCOIN_NUMA_REPLICATE) {
+		replicas = BitcoinSecp256k1_ReplicateTables();
+	}
+	applog(APPLOG_INFO, __func__,
+		"NUMA: %u nodes, %u CPUs, secp256k1 tables on %u nodes",
+		BitcoinNUMA_GetNodeCount(), BitcoinNUMA_GetCPUCount(),
+		replicas ? replicas : 1
+	);
+}
+
+static void BitcoinTool_destroyMatchSets(BitcoinTool *self)
+{
+	unsigned node;
+
+	for (node = 0; node < BITCOIN_NUMA_MAX_NODES; node++) {
+		BitcoinHashSet_destroy(self->match_sets[node]);
+		self->match_sets[node] = NULL;
+	}
+	BitcoinHashSet_destroy(self->match_set);
+	self->match_set = NULL;
+}
+
+/* With --numa replicate, copy the match set to each node.  Returns 1 if
+   success, 0 if failure. */
+static int BitcoinTool_replicateMatchSet(BitcoinTool *self)
+{
+	const unsigned nodes = BitcoinNUMA_GetNodeCount();
+	unsigned node;
+
+	if (self->options.numa != BITCOIN_NUMA_REPLICATE || nodes < 2) {
+		return 1;
+	}
+	for (node = 0; node < nodes; node++) {
+		self->match_sets[node] = BitcoinHashSet_clone(self->match_set, node);
+		if (!self->match_sets[node]) {
+			return 0;
+		}
+	}
+	applog(APPLOG_INFO, __func__, "Copied the match set to %u nodes", nodes);
+	return 1;
+}
+
+static int BitcoinTool_run(BitcoinTool *self)
+{
+	enum BitcoinHugePageBacking backing;
+	uint64_t huge_bytes = 0;
+	int success;
+
+	BitcoinHugePage_SetMode(self->options.huge_pages);
+
+	if (self->options.cpu_features) {
+		BitcoinCPU_Report(stdout);
+		return 1;
+	}
+
+	if (self->options.build_index) {
+		return BitcoinTool_buildIndex(self);
+	}
+	if (self->options.update_index) {
+		return BitcoinTool_updateIndex(self);
+	}
+	if (self->options.compact_index) {
+		return BitcoinTool_compactIndex(self);
+	}
+
+	BitcoinTool_selectPipeline(self);
+	self->output_newline = self->options.batch || isatty(fileno(stdin));
+
+	BitcoinStats_Start(&self->stats);
+	self->stats.pipeline = self->pipeline.name;
+
+	/* before any serve or shard threads derive keys with them */
+	backing = BitcoinSecp256k1_PlaceTables(&huge_bytes);
+	applog(APPLOG_INFO, __func__,
+		"secp256k1 tables in huge pages: %s (%llu KiB)",
+		BitcoinHugePage_GetBackingName(backing),
+		(unsigned long long)(huge_bytes >> 10)
+	);
+	BitcoinTool_placeTables(self);
+
+	if (self->options.cache_size && BitcoinTool_cachesRecords(self)) {
+		self->cache = BitcoinCache_create(self->options.cache_size);
+		if (!self->cache) {
+			return 0;
+		}
+	}
+
+	if (self->options.serve_socket) {
+		return BitcoinTool_serve(self);
+	}
+
+	if (self->options.match_index) {
+		self->match_index = BitcoinIndex_open(self->options.match_index);
+		if (!self->match_index) {
+			return 0;
+		}
+		applog(APPLOG_INFO, __func__,
+			"Opened [%s], %llu hashes and %lu deltas, huge pages: %s",
+			self->options.match_index,
+			(unsigned long long)BitcoinIndex_GetCount(self->match_index),
+			(unsigned long)BitcoinIndex_GetDeltaCount(self->match_index),
+			BitcoinHugePage_GetBackingName(
+				BitcoinIndex_GetBacking(self->match_index, NULL)
+			)
+		);
+	}
+	if (self->options.match_set) {
+		self->match_set = BitcoinTool_loadMatchSet(self);
+		if (!self->match_set || !BitcoinTool_replicateMatchSet(self)) {
+			BitcoinTool_destroyMatchSets(self);
+			return 0;
+		}
+	}
+
+	if (self->options.batch) {
+		self->io_engine = BitcoinIO_SelectEngine(self->options.io_engine);
+		self->stats.io_engine = BitcoinIO_GetEngineName(self->io_engine);
+		/* with --shard-output, each shard file is compressed instead */
+		self->output_file_handle = BitcoinIO_OpenOutput(stdout, self->io_engine,
+			self->options.shard_output ? BITCOIN_COMPRESSION_NONE
+				: self->options.output_compression,
+			self->options.compression_level
+		);
+		if (!self->output_file_handle) {
+			applog(APPLOG_ERROR, __func__, "Failed to open output (%s)",
+				strerror(errno)
+			);
+			self->output_file_handle = stdout;
+			return 0;
+		}
+	}
+
+	if (self->options.threads > 1 || self->options.shard_output) {
+		success = BitcoinTool_convertShards(self);
+	} else {
+		success = BitcoinTool_convertAll(self);
+	}
+
+	/* wait for the output to be written */
+	if (self->output_file_handle != stdout) {
+		if (fclose(self->output_file_handle)) {
+			applog(APPLOG_ERROR, __func__, "Error writing output (%s)",
+				strerror(errno)
+			);
+			success = 0;
+		}
+		self->output_file_handle = stdout;
+	}
+
+	/* the clones sharing it are gone by now */
+	BitcoinIndex_close(self->match_index);
+	self->match_index = NULL;
+	BitcoinTool_destroyMatchSets(self);
+
+	if (self->options.stats) {
+		fflush(self->output_file_handle);
+		BitcoinStats_Report(&self->stats, stderr, "final");
+	}
+
+	return success;
+}
+
+static void BitcoinTool_destroy(BitcoinTool *self)
+{
+	BitcoinCache_destroy(self->cache);
+	BitcoinContext_destroy(self->context);
+	free(self);
+}
+
+BitcoinTool *BitcoinTool_create(void)
+{
+	BitcoinTool *self = (BitcoinTool *)calloc(1, sizeof(*self));
+
+	if (!self) {
+		return NULL;
+	}
+
+	/* before any serve threads are started */
+	BitcoinCPU_SelectKernels();
+
+	self->context = BitcoinContext_create();
+	if (!self->context) {
+		free(self);
+		return NULL;
+	}
+
+	/* the records live in the context's arena, and are wiped with it */
+	if (!BitcoinRecords_Init(&self->records,
+		BitcoinContext_GetArena(self->context), BITCOIN_RECORDS_BATCH_SIZE)
+	) {
+		BitcoinContext_destroy(self->context);
+		free(self);
+		return NULL;
+	}
+
+	self->help = BitcoinTool_help;
+	self->parseOptions = BitcoinTool_parseOptions;
+	self->run = BitcoinTool_run;
+	self->destroy = BitcoinTool_destroy;
+
+	self->output_file_handle = stdout;
+
+	self->pipeline.decode = BitcoinTool_decodeGeneric;
+	self->pipeline.check = BitcoinTool_checkGeneric;
+	self->pipeline.convert = BitcoinTool_convertGeneric;
+	self->pipeline.write = BitcoinTool_writeGeneric;
+	strcpy(self->pipeline.name, "generic");
+
+	return self;
+}
+
+BitcoinTool *BitcoinTool_clone(const BitcoinTool *other)
+{
+	BitcoinTool *self = BitcoinTool_create();
+
+	if (!self) {
+		return NULL;
+	}
+
+	self->options = other->options;
+	self->pipeline = other->pipeline;
+	self->output_newline = other->output_newline;
+	self->io_engine = other->io_engine;
+	self->match_index = other->match_index;
+	self->match_set = other->match_set;
+	memcpy(self->match_sets, other->match_sets, sizeof(self->match_sets));
+	BitcoinStats_Start(&self->stats);
+
+	/* each thread has a cache of its own, so lookups don't lock */
+	if (other->cache) {
+		self->cache = BitcoinCache_create(self->options.cache_size);
+		if (!self->cache) {
+			BitcoinTool_destroy(self);
+			return NULL;
+		}
+	}
+
+	return self;
+}
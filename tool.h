@@ -0,0 +1,316 @@
+#ifndef BITCOIN_INCLUDE_TOOL_H
+#define BITCOIN_INCLUDE_TOOL_H
+
+/** @file tool.h
+ *  @brief The bitcoin-tool command: options, conversion state and the
+ *         stages each input goes through.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "hash.h"
+#include "keys.h"
+#include "result.h"
+#include "stats.h"
+#include "context.h"
+#include "records.h"
+#include "ioengine.h"
+#include "cache.h"
+#include "index.h"
+#include "hashset.h"
+#include "hugepage.h"
+#include "numa.h"
+
+#define BITCOINTOOL_OPTION_DEFAULT_BASE58CHECK_CHANGE_CHARS 3
+#define BITCOINTOOL_OPTION_DEFAULT_BASE58CHECK_INSERT_CHARS 3
+#define BITCOINTOOL_OPTION_DEFAULT_BASE58CHECK_REMOVE_CHARS 3
+#define BITCOINTOOL_OPTION_DEFAULT_INDEX_MEMORY 1024
+
+typedef struct BitcoinTool BitcoinTool;
+typedef struct BitcoinToolOptions BitcoinToolOptions;
+
+struct BitcoinToolOptions {
+	const char *input;
+	const char *input_file;
+
+	enum InputType {
+		INPUT_TYPE_NONE,
+		INPUT_TYPE_ADDRESS,
+		INPUT_TYPE_PUBLIC_KEY_RIPEMD160,
+		INPUT_TYPE_PUBLIC_KEY_SHA256,
+		INPUT_TYPE_PUBLIC_KEY,
+		INPUT_TYPE_PRIVATE_KEY_WIF,
+		INPUT_TYPE_PRIVATE_KEY,
+		INPUT_TYPE_MINI_PRIVATE_KEY
+	} input_type;
+
+	enum InputFormat {
+		INPUT_FORMAT_NONE,
+		INPUT_FORMAT_RAW,
+		INPUT_FORMAT_HEX,
+		INPUT_FORMAT_BASE58,
+		INPUT_FORMAT_BASE58CHECK
+	} input_format;
+
+	enum OutputType {
+		OUTPUT_TYPE_NONE,
+		OUTPUT_TYPE_ALL,
+		OUTPUT_TYPE_ADDRESS,
+		OUTPUT_TYPE_PUBLIC_KEY_RIPEMD160,
+		OUTPUT_TYPE_PUBLIC_KEY_SHA256,
+		OUTPUT_TYPE_PUBLIC_KEY,
+		OUTPUT_TYPE_PRIVATE_KEY_WIF,
+		OUTPUT_TYPE_PRIVATE_KEY
+	} output_type;
+
+	enum OutputFormat {
+		OUTPUT_FORMAT_NONE,
+		OUTPUT_FORMAT_RAW,
+		OUTPUT_FORMAT_HEX,
+		OUTPUT_FORMAT_BASE58,
+		OUTPUT_FORMAT_BASE58CHECK
+	} output_format;
+
+	enum PublicKeyCompression {
+		PUBLIC_KEY_COMPRESSION_AUTO,
+		PUBLIC_KEY_COMPRESSION_COMPRESSED,
+		PUBLIC_KEY_COMPRESSION_UNCOMPRESSED
+	} public_key_compression;
+
+	/* attempt to fix invalid base58check encoded inputs? */
+	unsigned fix_base58;
+
+	/* maximum number of characters to change */
+	unsigned fix_base58_change_chars;
+
+	/* maximum number of characters to insert */
+	unsigned fix_base58_insert_chars;
+
+	/* maximum number of characters to remove */
+	unsigned fix_base58_remove_chars;
+
+	/* set the network type prefix of addresses, public keys and private keys */
+	const struct BitcoinNetworkType *network_type;
+
+	/* in batch mode we read input from each line of --input-file */
+	int batch;
+
+	/* in batch mode we can set a flag to ignore invalid inputs and continue
+	   with the next line */
+	int ignore_input_errors;
+
+	/* report per-stage timing and counters to stderr at the end of the run,
+	   and every stats_interval seconds if non-zero */
+	int stats;
+	unsigned stats_interval;
+
+	/* in batch mode, split the input file into this many byte ranges at
+	   line boundaries, converted by one thread each, and write the output
+	   of each to <shard_output>.<n> if set, rather than in order */
+	unsigned threads;
+	const char *shard_output;
+
+	/* in batch mode, how the input is read ahead and the output written
+	   behind the conversion */
+	enum BitcoinIOEngine io_engine;
+
+	/* in batch mode, the input's compression (detected by default), and
+	   the compression and level (0 for default) of the output */
+	enum BitcoinCompression input_compression, output_compression;
+	int compression_level;
+
+	/* keep what was derived from the last cache_size distinct keys of
+	   each thread, so repeated inputs skip deriving it again (0 for no
+	   cache) */
+	unsigned cache_size;
+
+	/* instead of converting, write the index of the addresses listed in
+	   input_file to build_index, sorting index_memory MiB (0 for the
+	   default) of hashes at a time */
+	const char *build_index;
+	unsigned index_memory;
+
+	/* instead of converting, add the addresses listed in input_file to
+	   update_index, or remove those listed with '-', as a delta; or merge
+	   the deltas of compact_index into it */
+	const char *update_index;
+	const char *compact_index;
+
+	/* in batch mode, only output records whose hash is in this index, or
+	   in this list of addresses, loaded into memory */
+	const char *match_index;
+	const char *match_set;
+
+	/* how the secp256k1 tables, match sets and indexes use huge pages */
+	enum BitcoinHugePageMode huge_pages;
+
+	/* how threads and their memory are placed on NUMA nodes */
+	enum BitcoinNUMAMode numa;
+
+	/* print the CPU features and selected kernels instead of converting */
+	int cpu_features;
+
+	/* in serve mode we listen on a Unix socket and convert each request
+	   received, using serve_threads worker threads */
+	const char *serve_socket;
+	unsigned serve_threads;
+	enum ServeProtocol {
+		SERVE_PROTOCOL_LINE,
+		SERVE_PROTOCOL_BINARY
+	} serve_protocol;
+};
+
+/* One stage of the conversion, run over every record of the batch: see
+   BitcoinTool_selectPipeline() */
+typedef BitcoinResult (*BitcoinToolStage)(struct BitcoinTool *self,
+	int ignore_errors
+);
+
+/* The stages for the options of a run, selected once they are set */
+struct BitcoinToolPipeline {
+	/* eg: "private-key.hex>address.base58check", or "generic" */
+	char name[64];
+
+	BitcoinToolStage decode, check, convert, write;
+
+	/* derive the batch's public keys before the convert stage */
+	int make_public_keys;
+};
+
+struct BitcoinTool {
+	struct BitcoinToolOptions options;
+
+	/* the batch being converted, one record unless in batch mode */
+	struct BitcoinRecords records;
+
+	struct BitcoinToolPipeline pipeline;
+
+	FILE *input_file_handle;
+	FILE *output_file_handle;
+
+	/* the engine options.io_engine selected, for opening batch input */
+	enum BitcoinIOEngine io_engine;
+
+	/* when converting one shard of the input file, stop reading at
+	   input_end, input_offset being the offset of the next line */
+	int input_ranged;
+	uint64_t input_offset, input_end;
+
+	/* write a newline after each output, in batch mode or on a TTY */
+	int output_newline;
+
+	/* curve and scratch space for deriving public keys */
+	struct BitcoinContext *context;
+
+	/* what was derived from recent keys, if options.cache_size is set and
+	   the conversion derives anything */
+	struct BitcoinCache *cache;
+
+	/* options.match_index or options.match_set, opened or loaded by run()
+	   and shared with clones */
+	struct BitcoinIndex *match_index;
+	struct BitcoinHashSet *match_set;
+
+	/* with --numa replicate, a copy of match_set on each node, if there
+	   is more than one, for placed workers to use instead */
+	struct BitcoinHashSet *match_sets[BITCOIN_NUMA_MAX_NODES];
+
+	struct BitcoinStats stats;
+
+	int (*parseOptions)(struct BitcoinTool *self, int argc, char *argv[]);
+	void (*help)(struct BitcoinTool *self);
+	int (*run)(struct BitcoinTool *self);
+	void (*destroy)(struct BitcoinTool *self);
+};
+
+/** @brief Allocate a tool with default options and a new context.
+ *
+ *  @return Pointer to tool, or NULL if failure.
+ */
+BitcoinTool *BitcoinTool_create(void);
+
+/** @brief Allocate a tool with the same options as another, but its own
+ *         context, conversion state and stats, for use by another thread.
+ *
+ *  @return Pointer to tool, or NULL if failure.
+ */
+BitcoinTool *BitcoinTool_clone(const BitcoinTool *other);
+
+/** @brief Place a clone's thread as options.numa says: pin it to a CPU for
+ *         the worker'th worker, and use memory and tables on that CPU's
+ *         node.  Called by each worker thread before it converts anything.
+ */
+void BitcoinTool_placeWorker(BitcoinTool *self, unsigned worker);
+
+/** @brief Start a batch of one record, for the caller to fill in
+ *         records.input[0] and records.input_size[0].
+ */
+void BitcoinTool_resetInput(BitcoinTool *self);
+
+/** @brief Convert the text in records.input[0] (records.input_size[0]
+ *         chars) to the output type and format, leaving the result in
+ *         records.output_text[0].  Each stage is timed if --stats is
+ *         enabled.  Output type "all" is not supported, since it produces
+ *         several outputs.
+ */
+BitcoinResult BitcoinTool_convertInput(BitcoinTool *self);
+
+/* conversion stages, of record i of the batch */
+BitcoinResult Bitcoin_DecodeInput(struct BitcoinTool *self, size_t i);
+BitcoinResult Bitcoin_CheckInputSize(struct BitcoinTool *self, size_t i);
+BitcoinResult Bitcoin_ConvertInputToOutput(struct BitcoinTool *self, size_t i);
+BitcoinResult Bitcoin_FormatOutput(struct BitcoinTool *self, size_t i);
+BitcoinResult Bitcoin_WriteOutput(struct BitcoinTool *self, size_t i);
+
+/** @brief Convert every input, in batches, writing the output of each
+ *         record in order.
+ *
+ *  @return 1 if success, 0 if an input could not be converted.
+ */
+int BitcoinTool_convertAll(BitcoinTool *self);
+
+/** @brief Convert options.input_file in options.threads shards, in
+ *         parallel, each with a clone of the tool.  Implemented in
+ *         shard.c.
+ *
+ *  @return 1 if success, 0 if failure.
+ */
+int BitcoinTool_convertShards(BitcoinTool *self);
+
+/** @brief Write the index of the addresses in options.input_file to
+ *         options.build_index.  Implemented in buildindex.c.
+ *
+ *  @return 1 if success, 0 if failure.
+ */
+int BitcoinTool_buildIndex(BitcoinTool *self);
+
+/** @brief Add the addresses in options.input_file to, or remove them from,
+ *         options.update_index.  Implemented in buildindex.c.
+ *
+ *  @return 1 if success, 0 if failure.
+ */
+int BitcoinTool_updateIndex(BitcoinTool *self);
+
+/** @brief Merge the deltas of options.compact_index into it.  Implemented
+ *         in buildindex.c.
+ *
+ *  @return 1 if success, 0 if failure.
+ */
+int BitcoinTool_compactIndex(BitcoinTool *self);
+
+/** @brief Load the addresses listed in options.match_set into a hash set.
+ *         Implemented in buildindex.c.
+ *
+ *  @return Pointer to set, or NULL if failure.
+ */
+struct BitcoinHashSet *BitcoinTool_loadMatchSet(BitcoinTool *self);
+
+/** @brief Listen on options.serve_socket and convert requests until
+ *         interrupted.  Implemented in serve.c.
+ *
+ *  @return 1 if success, 0 if failure.
+ */
+int BitcoinTool_serve(BitcoinTool *self);
+
+#endif
@@ -1,10 +1,303 @@
 #include "utility.h"
 #include "applog.h"
+#include "cpu.h"
 
 #include <stdio.h>
 #include <unistd.h>
 #include <stdint.h>
 
+#ifdef BITCOIN_HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+static const char hex_chars_lower[] = "0123456789abcdef";
+static const char hex_chars_upper[] = "0123456789ABCDEF";
+
+/* Hex kernels convert as much of their input as they can in large blocks and
+return the number of input bytes (or characters) consumed.  The callers deal
+with the remaining tail, and with locating the exact offset of any invalid
+character, using the scalar code.  Decoding kernels stop at the first block
+containing an invalid character so that error reporting is unchanged. */
+typedef size_t (*BitcoinHexDecodeKernel)(uint8_t *output,
+	const char *source, size_t source_size
+);
+typedef size_t (*BitcoinHexEncodeKernel)(char *output,
+	const uint8_t *source, size_t source_size, int lower_case
+);
+
+/* hex digit values for every byte value, 0xff if not a hex digit */
+static uint8_t hex_values[256];
+
+/* the two hex chars of every byte value, upper case then lower case */
+static char hex_pairs[2][256][2];
+
+static void Bitcoin_InitHexValues(void)
+{
+	unsigned c;
+	for (c = 0; c < sizeof(hex_values); c++) {
+		uint_fast8_t value;
+		hex_values[c] = Bitcoin_DecodeHexChar(&value, (char)c) ? value : 0xff;
+	}
+	for (c = 0; c < 256; c++) {
+		hex_pairs[0][c][0] = hex_chars_upper[c >> 4];
+		hex_pairs[0][c][1] = hex_chars_upper[c & 0xf];
+		hex_pairs[1][c][0] = hex_chars_lower[c >> 4];
+		hex_pairs[1][c][1] = hex_chars_lower[c & 0xf];
+	}
+}
+
+static size_t Bitcoin_DecodeHexKernelScalar(uint8_t *output,
+	const char *source, size_t source_size
+)
+{
+	const unsigned char *s = (const unsigned char *)source;
+	size_t offset = 0;
+
+	while (source_size - offset >= 2) {
+		uint8_t high = hex_values[s[offset]];
+		uint8_t low = hex_values[s[offset + 1]];
+		/* an invalid char has the top bits set, so one test covers both */
+		if ((high | low) & 0xf0) {
+			break;
+		}
+		output[offset / 2] = (high << 4) | low;
+		offset += 2;
+	}
+
+	return offset;
+}
+
+static size_t Bitcoin_EncodeHexKernelScalar(char *output,
+	const uint8_t *source, size_t source_size, int lower_case
+)
+{
+	const char (*pairs)[2] = hex_pairs[lower_case != 0];
+	size_t offset;
+
+	for (offset = 0; offset < source_size; offset++) {
+		output[offset * 2] = pairs[source[offset]][0];
+		output[offset * 2 + 1] = pairs[source[offset]][1];
+	}
+
+	return offset;
+}
+
+#ifdef BITCOIN_HAVE_X86_SIMD
+
+/* Decode 16 hex chars to 8 bytes.  Returns the validity mask (one bit per
+char, 0xffff if all valid) and the decoded values as 16-bit words of
+(high << 4 | low) in *words. */
+__attribute__((target("ssse3")))
+static int Bitcoin_DecodeHex16SSSE3(__m128i *words, __m128i chars)
+{
+	const __m128i digit_offset = _mm_set1_epi8('0');
+	const __m128i alpha_offset = _mm_set1_epi8('a');
+	const __m128i lower_bit = _mm_set1_epi8(0x20);
+	const __m128i nine = _mm_set1_epi8(9);
+	const __m128i five = _mm_set1_epi8(5);
+	const __m128i ten = _mm_set1_epi8(10);
+	/* multiply high nibble by 16 and low nibble by 1, then add the pair */
+	const __m128i nibble_weights = _mm_set1_epi16(0x0110);
+
+	/* unsigned (x <= n) is (min(x, n) == x) */
+	__m128i digit = _mm_sub_epi8(chars, digit_offset);
+	__m128i alpha = _mm_sub_epi8(_mm_or_si128(chars, lower_bit), alpha_offset);
+	__m128i is_digit = _mm_cmpeq_epi8(_mm_min_epu8(digit, nine), digit);
+	__m128i is_alpha = _mm_cmpeq_epi8(_mm_min_epu8(alpha, five), alpha);
+	__m128i values = _mm_or_si128(
+		_mm_and_si128(is_digit, digit),
+		_mm_and_si128(is_alpha, _mm_add_epi8(alpha, ten))
+	);
+
+	*words = _mm_maddubs_epi16(values, nibble_weights);
+	return _mm_movemask_epi8(_mm_or_si128(is_digit, is_alpha));
+}
+
+__attribute__((target("ssse3")))
+static size_t Bitcoin_DecodeHexKernelSSSE3(uint8_t *output,
+	const char *source, size_t source_size
+)
+{
+	size_t offset = 0;
+
+	while (source_size - offset >= 32) {
+		__m128i low, high;
+		int valid_low = Bitcoin_DecodeHex16SSSE3(&low,
+			_mm_loadu_si128((const __m128i *)(source + offset))
+		);
+		int valid_high = Bitcoin_DecodeHex16SSSE3(&high,
+			_mm_loadu_si128((const __m128i *)(source + offset + 16))
+		);
+		if ((valid_low & valid_high) != 0xffff) {
+			break;
+		}
+		_mm_storeu_si128((__m128i *)(output + offset / 2),
+			_mm_packus_epi16(low, high)
+		);
+		offset += 32;
+	}
+
+	return offset;
+}
+
+__attribute__((target("ssse3")))
+static size_t Bitcoin_EncodeHexKernelSSSE3(char *output,
+	const uint8_t *source, size_t source_size, int lower_case
+)
+{
+	const __m128i table = _mm_loadu_si128((const __m128i *)(
+		lower_case ? hex_chars_lower : hex_chars_upper
+	));
+	const __m128i nibble_mask = _mm_set1_epi8(0x0f);
+	size_t offset = 0;
+
+	while (source_size - offset >= 16) {
+		__m128i bytes = _mm_loadu_si128((const __m128i *)(source + offset));
+		__m128i high = _mm_and_si128(_mm_srli_epi16(bytes, 4), nibble_mask);
+		__m128i low = _mm_and_si128(bytes, nibble_mask);
+		high = _mm_shuffle_epi8(table, high);
+		low = _mm_shuffle_epi8(table, low);
+		_mm_storeu_si128((__m128i *)(output + offset * 2),
+			_mm_unpacklo_epi8(high, low)
+		);
+		_mm_storeu_si128((__m128i *)(output + offset * 2 + 16),
+			_mm_unpackhi_epi8(high, low)
+		);
+		offset += 16;
+	}
+
+	return offset;
+}
+
+__attribute__((target("avx2")))
+static size_t Bitcoin_DecodeHexKernelAVX2(uint8_t *output,
+	const char *source, size_t source_size
+)
+{
+	const __m256i digit_offset = _mm256_set1_epi8('0');
+	const __m256i alpha_offset = _mm256_set1_epi8('a');
+	const __m256i lower_bit = _mm256_set1_epi8(0x20);
+	const __m256i nine = _mm256_set1_epi8(9);
+	const __m256i five = _mm256_set1_epi8(5);
+	const __m256i ten = _mm256_set1_epi8(10);
+	const __m256i nibble_weights = _mm256_set1_epi16(0x0110);
+	size_t offset = 0;
+
+	while (source_size - offset >= 64) {
+		__m256i words[2];
+		int i;
+		unsigned valid = 0xffffffff;
+
+		for (i = 0; i < 2; i++) {
+			__m256i chars = _mm256_loadu_si256(
+				(const __m256i *)(source + offset + i * 32)
+			);
+			__m256i digit = _mm256_sub_epi8(chars, digit_offset);
+			__m256i alpha = _mm256_sub_epi8(
+				_mm256_or_si256(chars, lower_bit), alpha_offset
+			);
+			__m256i is_digit = _mm256_cmpeq_epi8(
+				_mm256_min_epu8(digit, nine), digit
+			);
+			__m256i is_alpha = _mm256_cmpeq_epi8(
+				_mm256_min_epu8(alpha, five), alpha
+			);
+			__m256i values = _mm256_or_si256(
+				_mm256_and_si256(is_digit, digit),
+				_mm256_and_si256(is_alpha, _mm256_add_epi8(alpha, ten))
+			);
+			valid &= (unsigned)_mm256_movemask_epi8(
+				_mm256_or_si256(is_digit, is_alpha)
+			);
+			words[i] = _mm256_maddubs_epi16(values, nibble_weights);
+		}
+		if (valid != 0xffffffff) {
+			break;
+		}
+		/* packus works within 128-bit lanes, so restore the qword order */
+		_mm256_storeu_si256((__m256i *)(output + offset / 2),
+			_mm256_permute4x64_epi64(
+				_mm256_packus_epi16(words[0], words[1]), 0xd8
+			)
+		);
+		offset += 64;
+	}
+
+	return offset + Bitcoin_DecodeHexKernelSSSE3(output + offset / 2,
+		source + offset, source_size - offset
+	);
+}
+
+__attribute__((target("avx2")))
+static size_t Bitcoin_EncodeHexKernelAVX2(char *output,
+	const uint8_t *source, size_t source_size, int lower_case
+)
+{
+	const __m256i table = _mm256_broadcastsi128_si256(
+		_mm_loadu_si128((const __m128i *)(
+			lower_case ? hex_chars_lower : hex_chars_upper
+		))
+	);
+	const __m256i nibble_mask = _mm256_set1_epi16(0x0f);
+	size_t offset = 0;
+
+	while (source_size - offset >= 16) {
+		/* widen each byte to a 16-bit word, then place the high nibble in
+		   the first byte and the low nibble in the second byte of the word,
+		   which is exactly the output order. */
+		__m256i words = _mm256_cvtepu8_epi16(
+			_mm_loadu_si128((const __m128i *)(source + offset))
+		);
+		__m256i nibbles = _mm256_or_si256(
+			_mm256_srli_epi16(words, 4),
+			_mm256_slli_epi16(_mm256_and_si256(words, nibble_mask), 8)
+		);
+		_mm256_storeu_si256((__m256i *)(output + offset * 2),
+			_mm256_shuffle_epi8(table, nibbles)
+		);
+		offset += 16;
+	}
+
+	return offset;
+}
+
+#endif /* BITCOIN_HAVE_X86_SIMD */
+
+static BitcoinHexDecodeKernel hex_decode_kernel = NULL;
+static BitcoinHexEncodeKernel hex_encode_kernel = NULL;
+static const char *hex_kernel_name = NULL;
+
+/* Called once, through BitcoinCPU_SelectKernels().  Each pointer is
+stored once, with its final value. */
+void Bitcoin_SelectHexKernels(void)
+{
+	BitcoinHexDecodeKernel decode = Bitcoin_DecodeHexKernelScalar;
+	BitcoinHexEncodeKernel encode = Bitcoin_EncodeHexKernelScalar;
+	const char *name = "scalar";
+
+	Bitcoin_InitHexValues();
+#ifdef BITCOIN_HAVE_X86_SIMD
+	if (BitcoinCPU_Has(BITCOIN_CPU_AVX2)) {
+		name = "avx2";
+		decode = Bitcoin_DecodeHexKernelAVX2;
+		encode = Bitcoin_EncodeHexKernelAVX2;
+	} else if (BitcoinCPU_Has(BITCOIN_CPU_SSSE3)) {
+		name = "ssse3";
+		decode = Bitcoin_DecodeHexKernelSSSE3;
+		encode = Bitcoin_EncodeHexKernelSSSE3;
+	}
+#endif
+	hex_kernel_name = name;
+	hex_encode_kernel = encode;
+	hex_decode_kernel = decode;
+}
+
+const char *Bitcoin_GetHexKernelName(void)
+{
+	BitcoinCPU_SelectKernels();
+	return hex_kernel_name;
+}
+
 int Bitcoin_DecodeHexChar(uint_fast8_t *output, char c)
 {
 	/* convert hex char 0-9,a-f,A-F to 0-15 decimal value and return 1,
@@ -22,45 +315,110 @@ int Bitcoin_DecodeHexChar(uint_fast8_t *output, char c)
 	return 0;
 }
 
-BitcoinResult Bitcoin_DecodeHex(void *output, size_t output_size,
-	size_t *decoded_output_size,
+/* Decode source_size hex chars without logging.  Returns the offset of the
+first invalid character, or source_size if all were valid.  An odd trailing
+character is reported as invalid at offset source_size. */
+static size_t Bitcoin_DecodeHexRecord(uint8_t *output,
 	const char *source, size_t source_size
 )
 {
-	unsigned char *output_bytes = (unsigned char *)output;
-	const char *source_copy = source;
+	size_t offset;
 
-	*decoded_output_size = 0;
+	if (!hex_decode_kernel) {
+		BitcoinCPU_SelectKernels();
+	}
 
-	while (source_size) {
+	offset = hex_decode_kernel(output, source, source_size & ~(size_t)1);
+	offset += Bitcoin_DecodeHexKernelScalar(output + offset / 2,
+		source + offset, (source_size & ~(size_t)1) - offset
+	);
+
+	while (offset < source_size) {
 		uint_fast8_t high, low;
 
-		if (!Bitcoin_DecodeHexChar(&high, *source)) {
-			applog(APPLOG_ERROR, __func__,
-				"Invalid character (ASCII=%u) at offset %u",
-				(unsigned)*source, source - source_copy
-			);
-			return BITCOIN_ERROR_INVALID_FORMAT;
+		if (!Bitcoin_DecodeHexChar(&high, source[offset])) {
+			return offset;
 		}
-		source++;
-
-		if (!Bitcoin_DecodeHexChar(&low, *source)) {
-			applog(APPLOG_ERROR, __func__,
-				"Invalid character (ASCII=%u) at offset %u",
-				(unsigned)*source, source - source_copy
-			);
-			return BITCOIN_ERROR_INVALID_FORMAT;
+		if (offset + 1 >= source_size) {
+			return source_size;
+		}
+		if (!Bitcoin_DecodeHexChar(&low, source[offset + 1])) {
+			return offset + 1;
 		}
-		source++;
+		output[offset / 2] = (high << 4) | low;
+		offset += 2;
+	}
+
+	return source_size;
+}
+
+BitcoinResult Bitcoin_DecodeHex(void *output, size_t output_size,
+	size_t *decoded_output_size,
+	const char *source, size_t source_size
+)
+{
+	size_t invalid_offset;
+
+	*decoded_output_size = 0;
 
-		*output_bytes++ = (high << 4) | low;
-		source_size -= 2;
-		(*decoded_output_size)++;
+	if (source_size / 2 > output_size) {
+		applog(APPLOG_ERROR, __func__,
+			"Hex input too large (%u chars) for output buffer (%u bytes)",
+			(unsigned)source_size, (unsigned)output_size
+		);
+		return BITCOIN_ERROR_OUTPUT_BUFFER_TOO_SMALL;
 	}
 
+	invalid_offset = Bitcoin_DecodeHexRecord((uint8_t *)output,
+		source, source_size
+	);
+	if (invalid_offset != source_size || (source_size & 1)) {
+		/* an odd length input is missing the low nibble of the last byte,
+		   which we report as an invalid NUL char just past the end */
+		unsigned c = invalid_offset < source_size ?
+			(unsigned)source[invalid_offset] : 0;
+		applog(APPLOG_ERROR, __func__,
+			"Invalid character (ASCII=%u) at offset %u",
+			c, (unsigned)invalid_offset
+		);
+		*decoded_output_size = invalid_offset / 2;
+		return BITCOIN_ERROR_INVALID_FORMAT;
+	}
+
+	*decoded_output_size = source_size / 2;
+
 	return BITCOIN_SUCCESS;
 }
 
+size_t Bitcoin_DecodeHexRecords(
+	void *output, size_t record_size,
+	const char *source, size_t source_stride,
+	size_t record_count,
+	BitcoinResult *results
+)
+{
+	uint8_t *output_bytes = (uint8_t *)output;
+	size_t valid_count = 0;
+	size_t i;
+
+	for (i = 0; i < record_count; i++) {
+		size_t invalid_offset = Bitcoin_DecodeHexRecord(output_bytes,
+			source, record_size * 2
+		);
+		if (invalid_offset == record_size * 2) {
+			valid_count++;
+		}
+		if (results) {
+			results[i] = invalid_offset == record_size * 2 ?
+				BITCOIN_SUCCESS : BITCOIN_ERROR_INVALID_FORMAT;
+		}
+		output_bytes += record_size;
+		source += source_stride;
+	}
+
+	return valid_count;
+}
+
 BitcoinResult Bitcoin_EncodeHex(
 	char *output, size_t output_size,
 	size_t *encoded_output_size,
@@ -68,14 +426,31 @@ BitcoinResult Bitcoin_EncodeHex(
 	int lower_case
 )
 {
-	static const char hex_chars_lower[] = "0123456789abcdef";
-	static const char hex_chars_upper[] = "0123456789ABCDEF";
-
 	const uint8_t *source_bytes = (const uint8_t *)source;
 	const char *hex_chars = lower_case ? hex_chars_lower : hex_chars_upper;
 	size_t output_bytes_left = output_size;
+	size_t encoded;
+
+	if (!hex_encode_kernel) {
+		BitcoinCPU_SelectKernels();
+	}
+
+	/* the kernel never writes more than the output buffer allows */
+	if (source_size > output_size / 2) {
+		encoded = hex_encode_kernel(output, source_bytes, output_size / 2,
+			lower_case
+		);
+	} else {
+		encoded = hex_encode_kernel(output, source_bytes, source_size,
+			lower_case
+		);
+	}
 
-	*encoded_output_size = 0;
+	source_bytes += encoded;
+	source_size -= encoded;
+	output += encoded * 2;
+	output_bytes_left -= encoded * 2;
+	*encoded_output_size = encoded * 2;
 
 	while (source_size-- && output_bytes_left >= 2) {
 		output[0] = hex_chars[(*source_bytes >> 4) & 0xf];
@@ -89,11 +464,41 @@ BitcoinResult Bitcoin_EncodeHex(
 	return BITCOIN_SUCCESS;
 }
 
+void Bitcoin_EncodeHexRecords(
+	char *output, size_t output_stride,
+	const void *source, size_t record_size,
+	size_t record_count,
+	int lower_case
+)
+{
+	const uint8_t *source_bytes = (const uint8_t *)source;
+	size_t encoded_size;
+	size_t i;
+
+	for (i = 0; i < record_count; i++) {
+		Bitcoin_EncodeHex(output, record_size * 2, &encoded_size,
+			source_bytes, record_size, lower_case
+		);
+		output += output_stride;
+		source_bytes += record_size;
+	}
+}
+
 void Bitcoin_OutputHex(const void *source, size_t source_size)
 {
 	const uint8_t *source_bytes = (const uint8_t *)source;
-	while (source_size--) {
-		printf("%02x", *source_bytes++);
+	char buffer[512];
+
+	while (source_size) {
+		size_t chunk = source_size < sizeof(buffer) / 2 ?
+			source_size : sizeof(buffer) / 2;
+		size_t encoded_size = 0;
+		Bitcoin_EncodeHex(buffer, sizeof(buffer), &encoded_size,
+			source_bytes, chunk, 1
+		);
+		fwrite(buffer, 1, encoded_size, stdout);
+		source_bytes += chunk;
+		source_size -= chunk;
 	}
 }
 
@@ -113,4 +518,3 @@ void Bitcoin_ReverseBytes(void *buffer, size_t size)
 		last--;
 	}
 }
-
@@ -28,7 +28,9 @@ int Bitcoin_DecodeHexChar(uint_fast8_t *output, char c);
  *  @param[in] source Pointer to multiple of two hex digits.
  *  @param[in] source_size Count of multiple of two hex digits.
 
- *  @return BITCOIN_SUCCESS if chars were valid.
+ *  @return BITCOIN_SUCCESS if chars were valid,
+ *          BITCOIN_ERROR_INVALID_FORMAT if an invalid char was found (its
+ *          offset is logged), or BITCOIN_ERROR_OUTPUT_BUFFER_TOO_SMALL.
  */
 BitcoinResult Bitcoin_DecodeHex(
 	void *output, size_t output_size,
@@ -36,6 +38,33 @@ BitcoinResult Bitcoin_DecodeHex(
 	const char *source, size_t source_size
 );
 
+/** @brief Convert many fixed-size records of hex digits to byte values.
+ *         This is the batch form of Bitcoin_DecodeHex, for converting many
+ *         records of the same length (eg: 64 char private keys) in one call.
+ *         Nothing is logged for invalid records.
+ *
+ *  @param[out] output Buffer of record_count * record_size bytes to write
+ *                     decoded records to.
+ *  @param[in] record_size Number of bytes in each decoded record.  Each
+ *                         source record has twice this many hex digits.
+ *  @param[in] source Pointer to the first source record.
+ *  @param[in] source_stride Distance in chars between the start of each
+ *                           source record (eg: record_size * 2 + 1 for
+ *                           newline separated records).
+ *  @param[in] record_count Number of records to convert.
+ *  @param[out] results Optional array of record_count results, set to
+ *                      BITCOIN_SUCCESS or BITCOIN_ERROR_INVALID_FORMAT for
+ *                      each record.  May be NULL.
+ *
+ *  @return Number of records which were valid.
+ */
+size_t Bitcoin_DecodeHexRecords(
+	void *output, size_t record_size,
+	const char *source, size_t source_stride,
+	size_t record_count,
+	BitcoinResult *results
+);
+
 /** @brief Convert multiple bytes of data to ASCII hex digits.
  *
  *  @param[out] output Buffer to write encoded values to.
@@ -59,6 +88,34 @@ BitcoinResult Bitcoin_EncodeHex(
 	int lower_case
 );
 
+/** @brief Convert many fixed-size records of bytes to ASCII hex digits.
+ *         This is the batch form of Bitcoin_EncodeHex.
+ *
+ *  @param[out] output Buffer to write encoded records to.  Each record is
+ *                     written as record_size * 2 chars, with no terminator.
+ *  @param[in] output_stride Distance in chars between the start of each
+ *                           output record.
+ *  @param[in] source Pointer to record_count * record_size bytes.
+ *  @param[in] record_size Number of bytes in each source record.
+ *  @param[in] record_count Number of records to convert.
+ *  @param[in] lower_case Non-zero if output is to be lower-case, otherwise
+                          output will be upper-case.
+ */
+void Bitcoin_EncodeHexRecords(
+	char *output, size_t output_stride,
+	const void *source, size_t record_size,
+	size_t record_count,
+	int lower_case
+);
+
+/** @brief Select the hex kernels for this CPU.  Only to be called by
+ *         BitcoinCPU_SelectKernels(), which does it once.
+ */
+void Bitcoin_SelectHexKernels(void);
+
+/** @brief Get the name of the hex kernels selected for this CPU. */
+const char *Bitcoin_GetHexKernelName(void);
+
 /** @brief Output the hex representation of a pointer to byte values,
  *         to standard output.
  *